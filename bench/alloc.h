@@ -0,0 +1,126 @@
+#ifndef LU_BENCH_ALLOC_H
+#define LU_BENCH_ALLOC_H
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// counts every global heap allocation of the benchmark executable.
+// replaces the global operator new/delete, every form but the aligned ones, so include it once per executable
+// (bench.h does).
+
+namespace lu
+{
+namespace bench
+{
+
+struct alloc_stats
+{
+    size_t allocs;
+    size_t bytes;
+};
+
+namespace internal
+{
+    std::atomic<size_t> nallocs(0);
+    std::atomic<size_t> nbytes(0);
+
+    // null if out of memory
+    void* counted_alloc_nothrow(size_t size) noexcept
+    {
+        nallocs.fetch_add(1, std::memory_order_relaxed);
+        nbytes.fetch_add(size, std::memory_order_relaxed);
+        return std::malloc(size > 0 ? size : 1);
+    }
+
+    void* counted_alloc(size_t size)
+    {
+        void* p = counted_alloc_nothrow(size);
+        if (p == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+}
+
+inline alloc_stats allocations()
+{
+    alloc_stats stats;
+    stats.allocs = internal::nallocs.load(std::memory_order_relaxed);
+    stats.bytes = internal::nbytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// allocations made since construction
+struct alloc_scope
+{
+    alloc_scope() : start(allocations()) {}
+
+    alloc_stats delta() const
+    {
+        alloc_stats now = allocations();
+        alloc_stats d;
+        d.allocs = now.allocs - start.allocs;
+        d.bytes = now.bytes - start.bytes;
+        return d;
+    }
+
+    alloc_stats start;
+};
+
+}
+}
+
+void* operator new(size_t size)
+{
+    return lu::bench::internal::counted_alloc(size);
+}
+
+void* operator new[](size_t size)
+{
+    return lu::bench::internal::counted_alloc(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return lu::bench::internal::counted_alloc_nothrow(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return lu::bench::internal::counted_alloc_nothrow(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+// sized, what C++14 calls when the size is known
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+#endif // LU_BENCH_ALLOC_H
@@ -0,0 +1,378 @@
+#include "bench.h"
+#include "codegen.h"
+#include "compiler.h"
+#include "optimize.h"
+#include "layout.h"
+#include "fuse.h"
+#include "lower.h"
+#include "timer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <sstream>
+
+// ahead of time backend benchmark: the jit corpus as written (every intrinsic, aggregates the C backend does not
+// support, straight line arithmetic) and the hand built programs with loops, calls and tail calls through the -O2
+// passes, built into an executable with the system C compiler. the executable's output must match the
+// interpreter's, then the run times are reported, process start included for the executable.
+
+namespace
+{
+
+struct corpus_script
+{
+    const char* name;
+    const char* header;
+    const char* body; // repeated
+};
+
+const corpus_script CORPUS[] =
+{
+    {
+        // every intrinsic, with register and immediate operands
+        "intrinsics",
+        "a: int32 = 7; b: int32 = 3\nc: int64 = 9000000000; d: int64 = 2\ne: uint32 = 4000000000; f: uint32 = 1\n"
+        "g: uint64 = 18000000000000000000; h: uint64 = 5\np: bool = true; q: bool = false\nnl: ascii = \"\\n\"\n",
+        "$i32add(a, b); $i32add(a, 1); $i32print(a); $i32print(12); $asciiprint(nl)\n"
+        "$i64add(c, d); $i64add(c, 10); $i64add(c, 9000000000); $i64print(c); $i64print(34); $asciiprint(nl)\n"
+        "$u32add(e, f); $u32add(e, 300000000); $u32print(e); $u32print(56); $asciiprint(nl)\n"
+        "$u64add(g, h); $u64add(g, 7); $u64print(g); $u64print(78); $asciiprint(nl)\n"
+        "$lneg(p); $bprint(p); $lor(p, q); $bprint(p); $lor(q, true); $bprint(q); $land(p, q); $bprint(p); $land(q, false); $bprint(q); $asciiprint(nl)\n",
+    },
+    {
+        // tuples are aggregates, left to the interpreter
+        "mixed",
+        "eol: ascii = \"\\n\"\nc: int64 = 4\nd: int64 = 96\nb: bool = false\nt = (c, d)\nu = t\n",
+        "{\n    a: int32 = 3\n    $i32print(a), 123.99, \"abc\"\n}\nt = (c, d); u = t\n$i64add(c, d); $i64print(c); $lneg(b); $bprint(b); $asciiprint(eol)\n",
+    },
+    {
+        "arith",
+        "a: int64 = 1\nb: int64 = 2\nc: int64 = 0\nf: bool = false\n",
+        "a = 1; b = 2\n$i64add(a, b); $i64add(b, a); $i64add(a, b)\nc = a; $lneg(f)\n",
+    },
+};
+
+lu::string make_script(const corpus_script& cs, size_t nrepeat)
+{
+    lu::string s(cs.header);
+    for (size_t i = 0; i < nrepeat; ++i)
+    {
+        s.append(cs.body);
+    }
+    return s;
+}
+
+const char* SYMBOLS_SCRIPT = "n: int64 = 0\na: int64 = 0\nstep: int64 = 0\nf: bool = false\nr: int64 = 0\nm: int64 = 0\nx: int64 = 0\ny: int64 = 0\n";
+
+lu::symbol_id find(lu::intermediate_program& ip, lu::string_view name)
+{
+    lu::symbol_table& syms = ip.context().symbols();
+    return syms.find_local(syms.top(), name);
+}
+
+lu::intermediate load(const lu::intermediate_program& ip, lu::symbol_id sid, lu::intermediate_register reg)
+{
+    return lu::intermediate::emplace_load_symbol(sid, ip.context().symbols()[sid].tid, lu::intermediate_slot::SCALAR, reg);
+}
+
+lu::intermediate store(lu::symbol_id sid, lu::intermediate_register reg, lu::intermediate&& eval)
+{
+    return lu::intermediate::emplace_store_symbol(sid, lu::intermediate_slot::SCALAR, reg, lu::make_unique(new lu::intermediate(lu::move(eval))));
+}
+
+lu::intermediate constant(lu::intermediate_program& ip, lu::symbol_id sid, int64_t k)
+{
+    lu::intermediate_value val(ip.context().symbols()[sid].tid);
+    lu::scalar_value sv;
+    sv.i64 = k;
+    lu::set_scalar(&val.bin, sv);
+    return ip.make_load_constant(lu::move(val));
+}
+
+lu::intermediate branch(lu::intermediate_addr from, lu::intermediate_addr to, lu::unique<lu::intermediate>&& cond)
+{
+    return lu::intermediate::emplace_branch(from, lu::move(cond), to >= from
+        ? lu::intermediate_branch::branch_offset(lu::intermediate_branch::branch_offset::POSITIVE, to - from)
+        : lu::intermediate_branch::branch_offset(lu::intermediate_branch::branch_offset::NEGATIVE, from - to));
+}
+
+lu::intermediate ret(lu::intermediate&& eval)
+{
+    return lu::intermediate::emplace_return(lu::make_unique(new lu::intermediate(lu::move(eval))));
+}
+
+lu::intermediate intrinsic(lu::intermediate_program& ip, lu::intrinsic_code icode, const char* name, lu::symbol_id dest, lu::symbol_id op, lu::intermediate_register dest_reg, lu::intermediate_register op_reg)
+{
+    return lu::intermediate::emplace_intrinsic(icode, ip.context().symbols().find_intrinsic_id(name), dest, op, dest_reg, op_reg);
+}
+
+lu::intermediate add_imm(lu::intermediate_program& ip, lu::symbol_id sid, lu::intermediate_register reg, int64_t k)
+{
+    lu::scalar_value imm;
+    imm.i64 = k;
+    return lu::intermediate::emplace_intrinsic(lu::I64ADD, ip.context().symbols().find_intrinsic_id("i64add"), sid, reg, imm);
+}
+
+// n = 1000000; a = 0; step = 3; f = false
+// while n: a += step; lneg f; n += -1
+// print a; print f
+void make_loop(const lu::source* p_src, lu::intermediate_program* p_ip)
+{
+    lu::intermediate_program& ip = *p_ip;
+    lu::bench::compile(p_src, &ip);
+    lu::symbol_id sn = find(ip, "n");
+    lu::symbol_id sa = find(ip, "a");
+    lu::symbol_id sstep = find(ip, "step");
+    lu::symbol_id sf = find(ip, "f");
+
+    // n s0, a s1, step s2, f s3
+    lu::vector<lu::intermediate> code;
+    code.push_back(store(sn, 0, constant(ip, sn, 1000000)));
+    code.push_back(store(sa, 1, constant(ip, sa, 0)));
+    code.push_back(store(sstep, 2, constant(ip, sstep, 3)));
+    code.push_back(store(sf, 3, constant(ip, sf, 0)));
+    code.push_back(branch(4, 6, lu::make_unique(new lu::intermediate(load(ip, sn, 0)))));
+    code.push_back(branch(5, 10, nullptr));
+    code.push_back(intrinsic(ip, lu::I64ADD, "i64add", sa, sstep, 1, 2));
+    code.push_back(intrinsic(ip, lu::LNEG, "lneg", sf, lu::symbol::INVALID_ID, 3, 0));
+    code.push_back(add_imm(ip, sn, 0, -1));
+    code.push_back(branch(9, 4, nullptr));
+    code.push_back(intrinsic(ip, lu::I64PRINT, "i64print", lu::symbol::INVALID_ID, sa, 0, 1));
+    code.push_back(intrinsic(ip, lu::BPRINT, "bprint", lu::symbol::INVALID_ID, sf, 0, 3));
+    code.push_back(lu::intermediate::create_halt());
+
+    ip.rewrite(lu::move(code));
+    ip.frame(lu::intermediate_frame::TOP) = lu::intermediate_frame(0, 4, 0);
+}
+
+// fib(n) = n == 0 ? 0 : n - 1 == 0 ? 1 : fib(n - 1) + fib(n - 2), r = fib(20)
+void make_fib(const lu::source* p_src, lu::intermediate_program* p_ip)
+{
+    lu::intermediate_program& ip = *p_ip;
+    lu::bench::compile(p_src, &ip);
+    lu::symbol_id sn = find(ip, "n");
+    lu::symbol_id sr = find(ip, "r");
+    lu::symbol_id sm = find(ip, "m");
+    lu::symbol_id sx = find(ip, "x");
+    lu::symbol_id sy = find(ip, "y");
+
+    lu::intermediate_frame_id fib = 1;
+    auto call = [&](lu::symbol_id arg, lu::intermediate_register arg_reg, lu::symbol_id result, lu::intermediate_register result_reg)
+    {
+        lu::array<lu::intermediate> args(1);
+        args[0] = store(sn, 0, load(ip, arg, arg_reg));
+        return lu::intermediate::emplace_call(fib, lu::move(args), result, lu::intermediate_slot::SCALAR, result_reg);
+    };
+
+    lu::vector<lu::intermediate> code;
+    // top frame: n s0, r s1
+    code.push_back(store(sn, 0, constant(ip, sn, 20)));
+    code.push_back(call(sn, 0, sr, 1));
+    code.push_back(intrinsic(ip, lu::I64PRINT, "i64print", lu::symbol::INVALID_ID, sr, 0, 1));
+    code.push_back(lu::intermediate::create_halt());
+    // fib frame: n s0, m s1, x s2, y s3
+    lu::intermediate_addr entry = code.size();
+    code.push_back(branch(entry, entry + 2, lu::make_unique(new lu::intermediate(load(ip, sn, 0)))));
+    code.push_back(ret(constant(ip, sn, 0)));
+    code.push_back(store(sm, 1, load(ip, sn, 0)));
+    code.push_back(add_imm(ip, sm, 1, -1));
+    code.push_back(branch(entry + 4, entry + 6, lu::make_unique(new lu::intermediate(load(ip, sm, 1)))));
+    code.push_back(ret(constant(ip, sn, 1)));
+    code.push_back(call(sm, 1, sx, 2));
+    code.push_back(add_imm(ip, sm, 1, -1));
+    code.push_back(call(sm, 1, sy, 3));
+    code.push_back(intrinsic(ip, lu::I64ADD, "i64add", sx, sy, 2, 3));
+    code.push_back(ret(load(ip, sx, 2)));
+
+    ip.rewrite(lu::move(code));
+    ip.frame(lu::intermediate_frame::TOP) = lu::intermediate_frame(0, 2, 0);
+    ip.push_frame(lu::intermediate_frame(entry, 4, 0));
+}
+
+// count(n, a) = n == 0 ? a : count(n - 1, a + 1), r = count(100000, 0), tail calls once lowered
+void make_count(const lu::source* p_src, lu::intermediate_program* p_ip)
+{
+    lu::intermediate_program& ip = *p_ip;
+    lu::bench::compile(p_src, &ip);
+    lu::symbol_id sn = find(ip, "n");
+    lu::symbol_id sa = find(ip, "a");
+    lu::symbol_id sr = find(ip, "r");
+    lu::symbol_id sx = find(ip, "x");
+
+    lu::intermediate_frame_id count = 1;
+    auto call = [&](lu::symbol_id result, lu::intermediate_register result_reg)
+    {
+        lu::array<lu::intermediate> args(2);
+        args[0] = store(sn, 0, load(ip, sn, 0));
+        args[1] = store(sa, 1, load(ip, sa, 1));
+        return lu::intermediate::emplace_call(count, lu::move(args), result, lu::intermediate_slot::SCALAR, result_reg);
+    };
+
+    lu::vector<lu::intermediate> code;
+    // top frame: n s0, a s1, r s2
+    code.push_back(store(sn, 0, constant(ip, sn, 100000)));
+    code.push_back(store(sa, 1, constant(ip, sa, 0)));
+    code.push_back(call(sr, 2));
+    code.push_back(intrinsic(ip, lu::I64PRINT, "i64print", lu::symbol::INVALID_ID, sr, 0, 2));
+    code.push_back(lu::intermediate::create_halt());
+    // count frame: n s0, a s1, x s2
+    lu::intermediate_addr entry = code.size();
+    code.push_back(branch(entry, entry + 2, lu::make_unique(new lu::intermediate(load(ip, sn, 0)))));
+    code.push_back(ret(load(ip, sa, 1)));
+    code.push_back(add_imm(ip, sn, 0, -1));
+    code.push_back(add_imm(ip, sa, 1, 1));
+    code.push_back(call(sx, 2));
+    code.push_back(ret(load(ip, sx, 2)));
+
+    ip.rewrite(lu::move(code));
+    ip.frame(lu::intermediate_frame::TOP) = lu::intermediate_frame(0, 3, 0);
+    ip.push_frame(lu::intermediate_frame(entry, 3, 0));
+    lu::lower_tail_calls(&ip);
+}
+
+const char* EXE_PATH = "/tmp/lu_bench_aot";
+
+// output of the last of nrun runs
+struct run_capture
+{
+    std::string out;
+    double seconds; // per run
+};
+
+run_capture interpret(const lu::intermediate_program& ip, size_t nrun)
+{
+    std::ostringstream out;
+    std::streambuf* p_cout = std::cout.rdbuf(out.rdbuf());
+    run_capture rc;
+    lu::stopwatch sw;
+    sw.start();
+    for (size_t k = 0; k < nrun; ++k)
+    {
+        out.str("");
+        lu::bench::run(&ip);
+    }
+    rc.seconds = sw.lap().count() / static_cast<double>(nrun);
+    std::cout.rdbuf(p_cout);
+    rc.out = out.str();
+    return rc;
+}
+
+run_capture execute(const char* path, size_t nrun)
+{
+    run_capture rc;
+    lu::stopwatch sw;
+    sw.start();
+    for (size_t k = 0; k < nrun; ++k)
+    {
+        rc.out.clear();
+        FILE* p = popen(path, "r");
+        if (!p)
+        {
+            std::cerr << "bench: cannot run " << path << "\n";
+            std::exit(1);
+        }
+        char buf[4096];
+        size_t nread;
+        while ((nread = std::fread(buf, 1, sizeof(buf), p)) != 0)
+        {
+            rc.out.append(buf, nread);
+        }
+        if (pclose(p) != 0)
+        {
+            std::cerr << "bench: " << path << " failed\n";
+            std::exit(1);
+        }
+    }
+    rc.seconds = sw.lap().count() / static_cast<double>(nrun);
+    return rc;
+}
+
+// builds the program into an executable, then runs both. false if the output differs, or the program was
+// expected to build and did not (or the other way around)
+bool compare(lu::string_view name, std::function<void(lu::intermediate_program*)> build, bool o2, bool supported, size_t nrun)
+{
+    lu::intermediate_program ip;
+    build(&ip);
+    if (o2)
+    {
+        lu::optimize_settings settings(lu::optimize_level::O2);
+        lu::optimize(&ip, settings);
+        lu::layout_blocks(&ip);
+    }
+    lu::fuse(&ip);
+    lu::lower_intrinsics(&ip);
+
+    // only flushed on failure, the unsupported script logs by design
+    lu::diag_logger log(lu::diag::ERROR_LEVEL);
+    lu::codegen_stats stats;
+    lu::string c;
+    bool generated = ok(lu::codegen_c(&ip, &c, &log, &stats));
+    if (generated != supported)
+    {
+        log.flush();
+        std::cerr << "bench: " << name << (supported ? " has no C\n" : " should have no C\n");
+        return false;
+    }
+    if (!supported)
+    {
+        std::cout << name << ": no C, as expected\n";
+        return true;
+    }
+
+    lu::compiler_settings cs;
+    cs.keep_c = false;
+    lu::stopwatch sw;
+    sw.start();
+    if (!ok(lu::compile_native(&ip, EXE_PATH, &log, cs)))
+    {
+        log.flush();
+        std::cerr << "bench: " << name << " did not build\n";
+        return false;
+    }
+    double build_seconds = sw.lap().count();
+
+    run_capture expected = interpret(ip, nrun);
+    run_capture actual = execute(EXE_PATH, nrun);
+    std::remove(EXE_PATH);
+    if (actual.out != expected.out)
+    {
+        std::cerr << "bench: " << name << " executable output differs:\n" << actual.out << "\ninterpreter:\n" << expected.out << "\n";
+        return false;
+    }
+    std::cout << name << ": interpreter " << expected.seconds * 1000 << " ms/run, executable " << actual.seconds * 1000
+        << " ms/run (" << to_string(stats) << ", built in " << build_seconds * 1000 << " ms)\n";
+    return true;
+}
+
+}
+
+int main(int, char**)
+{
+    lu::compiler_settings settings;
+    if (std::system(lu::string::join(settings.cc, " --version > /dev/null 2>&1").buffer()) != 0)
+    {
+        std::cout << "no C compiler, skipped\n";
+        return 0;
+    }
+
+    for (const corpus_script& cs : CORPUS)
+    {
+        lu::source src = lu::source::from_string(lu::string::join(cs.name, ".lu"), make_script(cs, 200));
+        // as written, -O2 would remove the tuples of mixed
+        bool supported = lu::string_view(cs.name) != "mixed";
+        if (!compare(cs.name, [&](lu::intermediate_program* p_ip) { lu::bench::compile(&src, p_ip); }, false, supported, 5))
+        {
+            return 1;
+        }
+    }
+
+    lu::source src = lu::source::from_string("aot.lu", SYMBOLS_SCRIPT);
+    if (!compare("loop", [&](lu::intermediate_program* p_ip) { make_loop(&src, p_ip); }, true, true, 5)
+        || !compare("fib", [&](lu::intermediate_program* p_ip) { make_fib(&src, p_ip); }, true, true, 5)
+        || !compare("tail calls", [&](lu::intermediate_program* p_ip) { make_count(&src, p_ip); }, true, true, 5))
+    {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,237 @@
+#include "bench.h"
+#include "timer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// batch benchmark: a directory of small scripts is run by one main -O2 --batch, and one main -O2 file per script.
+// the batch output of every script must match the driver's, then scripts per second of both and the batch summary
+// (with the arena's allocation stats) are reported. a manifest must run the same scripts, a broken script must fail
+// the batch with its diagnostics kept apart. main is expected next to this bench (make all bench)
+
+namespace
+{
+
+const char* const TEMPLATES[] =
+{
+    "a: int64 = 1\nb: int64 = %d\nnl: ascii = \"\\n\"\n$i64add(a, b); $i64print(a); $asciiprint(nl)\n",
+    "p: bool = true; q: bool = false\n$lor(q, p); $bprint(q); $lneg(p); $bprint(p)\nt = (1, %d)\nu = t\n",
+    "e: uint32 = 4000000000; f: uint32 = %d\n{\n    $u32add(e, f)\n    $u32print(e)\n}\n$u32print(56)\n",
+};
+const size_t NTEMPLATES = sizeof(TEMPLATES) / sizeof(TEMPLATES[0]);
+const size_t NSCRIPTS = 300;
+const size_t NPROCESSES = 60; // of the scripts, run one process each
+const char* DIR = "/tmp/lu_bench_batch";
+const char* OUT_DIR = "/tmp/lu_bench_batch_out";
+
+lu::string script_name(size_t k)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "s%04zu.lu", k);
+    return name;
+}
+
+lu::string script_path(size_t k)
+{
+    return lu::string::join(DIR, "/", script_name(k));
+}
+
+std::string read_file(const lu::string& path)
+{
+    std::ifstream file(path.buffer(), std::ios::binary);
+    std::ostringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+// exit code, or -1 if it did not exit. output and diagnostics are dropped
+int spawn(const char* const* argv)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, 1);
+        dup2(null, 2);
+        execv(argv[0], const_cast<char* const*>(argv));
+        _exit(127);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+    {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+// what the shell command prints, and its exit code
+int capture(const lu::string& command, std::string* p_out)
+{
+    FILE* p_pipe = popen(command.buffer(), "r");
+    if (!p_pipe)
+    {
+        return -1;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), p_pipe)) > 0)
+    {
+        p_out->append(buf, n);
+    }
+    int status = pclose(p_pipe);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// the driver's output around the program's is dropped
+std::string driver_output(const lu::string& main_path, const lu::string& path)
+{
+    std::string out;
+    capture(lu::string::join(main_path, " -O2 ", path, " 2>/dev/null"), &out);
+    const std::string begin = ">>\n";
+    const std::string end = "END\n";
+    if (out.compare(0, begin.size(), begin) == 0 && out.size() >= begin.size() + end.size())
+    {
+        out = out.substr(begin.size(), out.size() - begin.size() - end.size());
+    }
+    return out;
+}
+
+size_t count(const std::string& s, const std::string& what)
+{
+    size_t n = 0;
+    for (size_t i = s.find(what); i != std::string::npos; i = s.find(what, i + what.size()))
+    {
+        ++n;
+    }
+    return n;
+}
+
+bool check_manifest(const lu::string& main_path)
+{
+    lu::string manifest = lu::string::join(DIR, "/manifest");
+    {
+        std::ofstream file(manifest.buffer());
+        file << "# every script\n";
+        for (size_t k = 0; k < NSCRIPTS; ++k)
+        {
+            file << script_name(k) << "\n";
+        }
+    }
+    std::string out;
+    int code = capture(lu::string::join(main_path, " -O2 --batch ", manifest, " 2>/dev/null"), &out);
+    if (code != 0 || count(out, "== ") != NSCRIPTS)
+    {
+        std::cerr << "bench: the manifest ran " << count(out, "== ") << " scripts, exited " << code << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool check_failure(const lu::string& main_path)
+{
+    {
+        std::ofstream file(lu::string::join(DIR, "/broken.lu").buffer());
+        file << "a: int64 = \n(";
+    }
+    const char* argv[] = { main_path.buffer(), "-O2", "--batch", DIR, "--batch-out", OUT_DIR, nullptr };
+    int code = spawn(argv);
+    std::string diags = read_file(lu::string::join(OUT_DIR, "/broken.lu.err"));
+    std::string others = read_file(lu::string::join(OUT_DIR, "/", script_name(0), ".err"));
+    if (code != 9 || diags.empty() || !others.empty())
+    {
+        std::cerr << "bench: a broken script exited " << code << " with diagnostics \"" << diags << "\", the others \"" << others << "\"\n";
+        return false;
+    }
+    return true;
+}
+
+bool run(const lu::string& main_path)
+{
+    for (size_t k = 0; k < NSCRIPTS; ++k)
+    {
+        char text[256];
+        std::snprintf(text, sizeof(text), TEMPLATES[k % NTEMPLATES], static_cast<int>(k));
+        std::ofstream file(script_path(k).buffer(), std::ios::binary);
+        file << text;
+    }
+
+    lu::stopwatch sw;
+    sw.start();
+    for (size_t k = 0; k < NPROCESSES; ++k)
+    {
+        lu::string path = script_path(k);
+        const char* argv[] = { main_path.buffer(), "-O2", path.buffer(), nullptr };
+        if (spawn(argv) != 0)
+        {
+            std::cerr << "bench: " << path << " failed\n";
+            return false;
+        }
+    }
+    double process_rate = static_cast<double>(NPROCESSES) / sw.lap().count();
+
+    std::string summary;
+    sw.start();
+    int code = capture(lu::string::join(main_path, " -O2 --batch ", DIR, " --batch-out ", OUT_DIR, " 2>&1 >/dev/null"), &summary);
+    double batch_rate = static_cast<double>(NSCRIPTS) / sw.lap().count();
+    if (code != 0)
+    {
+        std::cerr << "bench: the batch exited " << code << "\n" << summary;
+        return false;
+    }
+
+    for (size_t k = 0; k < NTEMPLATES * 2; ++k)
+    {
+        std::string expected = driver_output(main_path, script_path(k));
+        std::string actual = read_file(lu::string::join(OUT_DIR, "/", script_name(k), ".out"));
+        if (actual != expected)
+        {
+            std::cerr << "bench: " << script_name(k) << " output differs from the driver:\n" << actual << "\ndriver:\n" << expected << "\n";
+            return false;
+        }
+    }
+    if (!check_manifest(main_path) || !check_failure(main_path))
+    {
+        return false;
+    }
+
+    std::cout << "process per script: " << process_rate << " scripts/s, batch: " << batch_rate << " scripts/s ("
+        << batch_rate / process_rate << "x)\n" << summary;
+    return true;
+}
+
+}
+
+int main(int, char** argv)
+{
+    lu::string_view self(argv[0]);
+    size_t slash = self.size();
+    while (slash > 0 && self[slash - 1] != '/')
+    {
+        --slash;
+    }
+    lu::string dir = slash == 0 ? lu::string(".") : lu::string(self.subview(0, slash - 1));
+    lu::string main_path = lu::string::join(dir, "/main");
+    if (access(main_path.buffer(), X_OK) != 0)
+    {
+        std::cerr << "bench: needs " << main_path << ", make all first\n";
+        return 1;
+    }
+
+    lu::string clear = lu::string::join("rm -rf ", DIR, " ", OUT_DIR);
+    if (std::system(clear.buffer()) != 0 || std::system(lu::string::join("mkdir -p ", DIR, " ", OUT_DIR).buffer()) != 0)
+    {
+        std::cerr << "bench: cannot make " << DIR << "\n";
+        return 1;
+    }
+    bool passed = run(main_path);
+    if (std::system(clear.buffer()) != 0)
+    {
+        std::cerr << "bench: cannot remove " << DIR << "\n";
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+#ifndef LU_BENCH_H
+#define LU_BENCH_H
+
+#include "source.h"
+#include "parse.h"
+#include "analyze.h"
+#include "intermediate.h"
+#include "interpreter.h"
+#include "diag.h"
+#include "profile.h"
+#include "string.h"
+#include "alloc.h"
+
+#include <iostream>
+#include <cstdlib>
+
+namespace lu
+{
+namespace bench
+{
+
+// front end only, diagnostics below error are dropped so they do not count towards the timings.
+// the source must outlive the program
+inline void compile(const source* p_src, intermediate_program* p_ip)
+{
+    diag_logger log(diag::ERROR_LEVEL);
+    parse_expr_tree pet;
+    analyze_expr_tree aet;
+    if (!ok(parse(p_src, &pet, &log)) || !ok(analyze(&pet, &aet, &log)) || !ok(intermediate_transform(&aet, p_ip, &log)))
+    {
+        log.flush();
+        std::cerr << "bench: failed to compile " << p_src->name() << "\n";
+        std::exit(1);
+    }
+}
+
+// the state is kept after the run, so registers can be inspected
+inline void run(const intermediate_program* p_ip, intermediate_interpreter_state* p_iis, const interpret_settings& settings = interpret_settings())
+{
+    diag_logger log(diag::ERROR_LEVEL);
+    if (!ok(interpret(p_ip, p_iis, 0, &log, settings)))
+    {
+        log.flush();
+        std::cerr << "bench: failed to run\n";
+        std::exit(1);
+    }
+}
+
+inline void run(const intermediate_program* p_ip, const interpret_settings& settings = interpret_settings())
+{
+    diag_logger log(diag::ERROR_LEVEL);
+    intermediate_interpreter_state iis;
+    if (!ok(interpret(p_ip, &iis, 0, &log, settings)))
+    {
+        log.flush();
+        std::cerr << "bench: failed to run\n";
+        std::exit(1);
+    }
+}
+
+}
+}
+
+#endif // LU_BENCH_H
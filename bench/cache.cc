@@ -0,0 +1,264 @@
+#include "bench.h"
+#include "cache.h"
+#include "optimize.h"
+#include "inline.h"
+#include "layout.h"
+#include "fuse.h"
+#include "lower.h"
+#include "timer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+// compile cache benchmark: large scripts are started cold (a miss, compiled through the -O2 passes like the driver
+// does, then stored) and warm (a hit, loaded from the cache), the output must match and the startup times are
+// reported. then keys must change with the source and options, damaged entries must be dropped, and a cache over
+// its size must evict the least recently used entry.
+
+namespace
+{
+
+struct corpus_script
+{
+    const char* name;
+    const char* header;
+    const char* body; // repeated
+};
+
+const corpus_script CORPUS[] =
+{
+    {
+        "intrinsics",
+        "a: int32 = 7; b: int32 = 3\nc: int64 = 9000000000; d: int64 = 2\ne: uint32 = 4000000000; f: uint32 = 1\n"
+        "g: uint64 = 18000000000000000000; h: uint64 = 5\np: bool = true; q: bool = false\nnl: ascii = \"\\n\"\n",
+        "$i32add(a, b); $i32add(a, 1); $i32print(a); $i32print(12); $asciiprint(nl)\n"
+        "$i64add(c, d); $i64add(c, 10); $i64add(c, 9000000000); $i64print(c); $i64print(34); $asciiprint(nl)\n"
+        "$u32add(e, f); $u32add(e, 300000000); $u32print(e); $u32print(56); $asciiprint(nl)\n"
+        "$u64add(g, h); $u64add(g, 7); $u64print(g); $u64print(78); $asciiprint(nl)\n"
+        "$lneg(p); $bprint(p); $lor(p, q); $bprint(p); $lor(q, true); $bprint(q); $land(p, q); $bprint(p); $land(q, false); $bprint(q); $asciiprint(nl)\n",
+    },
+    {
+        "mixed",
+        "eol: ascii = \"\\n\"\nc: int64 = 4\nd: int64 = 96\nb: bool = false\nt = (c, d)\nu = t\n",
+        "{\n    a: int32 = 3\n    $i32print(a), 123.99, \"abc\"\n}\nt = (c, d); u = t\n$i64add(c, d); $i64print(c); $lneg(b); $bprint(b); $asciiprint(eol)\n",
+    },
+    {
+        "arith",
+        "a: int64 = 1\nb: int64 = 2\nc: int64 = 0\nf: bool = false\nnl: ascii = \"\\n\"\n",
+        "a = 1; b = 2\n$i64add(a, b); $i64add(b, a); $i64add(a, b)\nc = a; $lneg(f)\n$i64print(c); $bprint(f); $asciiprint(nl)\n",
+    },
+};
+
+const size_t NREPEAT = 1000;
+const size_t NRUN = 3;
+const char* CACHE_DIR = "/tmp/lu_bench_cache";
+const char* OPTIONS = "-O2";
+
+lu::string make_script(const corpus_script& cs, size_t nrepeat)
+{
+    lu::string s(cs.header);
+    for (size_t i = 0; i < nrepeat; ++i)
+    {
+        s.append(cs.body);
+    }
+    return s;
+}
+
+void compile_o2(const lu::source* p_src, lu::intermediate_program* p_ip)
+{
+    lu::bench::compile(p_src, p_ip);
+    lu::optimize_settings settings(lu::optimize_level::O2);
+    lu::inline_calls(p_ip);
+    lu::optimize(p_ip, settings);
+    lu::layout_blocks(p_ip);
+    lu::fuse(p_ip);
+    lu::lower_intrinsics(p_ip);
+}
+
+std::string output(const lu::intermediate_program& ip)
+{
+    std::ostringstream out;
+    std::streambuf* p_cout = std::cout.rdbuf(out.rdbuf());
+    lu::bench::run(&ip);
+    std::cout.rdbuf(p_cout);
+    return out.str();
+}
+
+// the driver's startup with the cache: a hit, or a compile and store. the source must outlive the program
+void start(lu::compile_cache* p_cache, const lu::source* p_src, lu::intermediate_program* p_ip)
+{
+    lu::diag_logger log(lu::diag::ERROR_LEVEL);
+    uint64_t key = lu::cache_key(p_src->read(0), OPTIONS);
+    if (!p_cache->lookup(key, p_ip, &log))
+    {
+        compile_o2(p_src, p_ip);
+        if (!p_cache->store(key, p_ip, &log))
+        {
+            log.flush();
+            std::cerr << "bench: could not store " << p_src->name() << "\n";
+            std::exit(1);
+        }
+    }
+}
+
+void clear_cache()
+{
+    if (std::system(lu::string::join("rm -rf ", CACHE_DIR).buffer()) != 0)
+    {
+        std::cerr << "bench: cannot clear " << CACHE_DIR << "\n";
+        std::exit(1);
+    }
+}
+
+bool exists(const lu::string& path)
+{
+    return std::ifstream(path.buffer()).good();
+}
+
+bool compare(lu::compile_cache* p_cache, const corpus_script& cs)
+{
+    lu::source src = lu::source::from_string(lu::string::join(cs.name, ".lu"), make_script(cs, NREPEAT));
+    size_t hits = p_cache->stats().hits;
+    size_t misses = p_cache->stats().misses;
+
+    lu::intermediate_program cold;
+    lu::stopwatch sw;
+    sw.start();
+    start(p_cache, &src, &cold);
+    double cold_seconds = sw.lap().count();
+
+    lu::intermediate_program warm;
+    sw.start();
+    for (size_t k = 0; k < NRUN; ++k)
+    {
+        warm = lu::intermediate_program();
+        start(p_cache, &src, &warm);
+    }
+    double warm_seconds = sw.lap().count() / static_cast<double>(NRUN);
+
+    if (p_cache->stats().misses != misses + 1 || p_cache->stats().hits != hits + NRUN)
+    {
+        std::cerr << "bench: " << cs.name << " expected 1 miss and " << NRUN << " hits, " << to_string(p_cache->stats()) << "\n";
+        return false;
+    }
+    std::string expected = output(cold);
+    std::string actual = output(warm);
+    if (actual != expected)
+    {
+        std::cerr << "bench: " << cs.name << " output differs from the cache:\n" << actual << "\ncompiled:\n" << expected << "\n";
+        return false;
+    }
+    std::cout << cs.name << ": cold " << cold_seconds * 1000 << " ms, warm " << warm_seconds * 1000 << " ms ("
+        << cold_seconds / warm_seconds << "x)\n";
+    return true;
+}
+
+bool check_keys()
+{
+    uint64_t key = lu::cache_key("a: int64 = 1\n", "-O2");
+    if (key != lu::cache_key("a: int64 = 1\n", "-O2") || key == lu::cache_key("a: int64 = 2\n", "-O2")
+        || key == lu::cache_key("a: int64 = 1\n", "-O0") || lu::cache_key("ab", "c") == lu::cache_key("a", "bc"))
+    {
+        std::cerr << "bench: cache keys do not follow the source and options\n";
+        return false;
+    }
+    return true;
+}
+
+bool check_damaged()
+{
+    lu::compile_cache cache;
+    lu::intermediate_program ip;
+    lu::source src = lu::source::from_string("damaged.lu", "a: int64 = 1\n$i64print(a)\n");
+    start(&cache, &src, &ip);
+    lu::string path = cache.path(lu::cache_key(src.read(0), OPTIONS));
+    {
+        std::ofstream file(path.buffer(), std::ios::binary | std::ios::trunc);
+        file << "not a program";
+    }
+    lu::diag_logger log(lu::diag::MAX_LEVEL);
+    if (cache.lookup(lu::cache_key(src.read(0), OPTIONS), &ip, &log) || exists(path))
+    {
+        std::cerr << "bench: a damaged entry was loaded or kept\n";
+        return false;
+    }
+    return true;
+}
+
+// three entries in a cache with room for two: the one not used since the first two were stored goes
+bool check_eviction()
+{
+    clear_cache();
+    lu::source srcs[] =
+    {
+        lu::source::from_string("a.lu", "a: int64 = 1\n$i64print(a)\n"),
+        lu::source::from_string("b.lu", "b: int64 = 2\n$i64print(b)\n"),
+        lu::source::from_string("c.lu", "c: int64 = 3\n$i64print(c)\n"),
+    };
+    lu::string paths[3];
+    lu::compile_cache sizing;
+    for (size_t k = 0; k < 3; ++k)
+    {
+        paths[k] = sizing.path(lu::cache_key(srcs[k].read(0), OPTIONS));
+    }
+    lu::intermediate_program ip;
+    start(&sizing, &srcs[0], &ip);
+    size_t entry_size = sizing.stats().size;
+    clear_cache();
+
+    lu::cache_settings settings;
+    settings.max_bytes = entry_size * 2 + entry_size / 2;
+    lu::compile_cache cache(settings);
+    // modification times may only move on every few milliseconds
+    auto step = []() { std::this_thread::sleep_for(std::chrono::milliseconds(20)); };
+    lu::intermediate_program a;
+    lu::intermediate_program b;
+    lu::intermediate_program c;
+    start(&cache, &srcs[0], &a);
+    step();
+    start(&cache, &srcs[1], &b);
+    step();
+    a = lu::intermediate_program();
+    start(&cache, &srcs[0], &a);
+    step();
+    start(&cache, &srcs[2], &c);
+
+    if (!exists(paths[0]) || exists(paths[1]) || !exists(paths[2]) || cache.stats().evictions != 1)
+    {
+        std::cerr << "bench: expected the second entry evicted, " << to_string(cache.stats()) << "\n";
+        return false;
+    }
+    std::cout << "eviction: " << to_string(cache.stats()) << "\n";
+    return true;
+}
+
+}
+
+int main(int, char**)
+{
+    // the default directory is the user's, the bench uses its own
+    if (setenv("LU_CACHE_DIR", CACHE_DIR, 1) != 0)
+    {
+        std::cerr << "bench: cannot set LU_CACHE_DIR\n";
+        return 1;
+    }
+    clear_cache();
+
+    lu::compile_cache cache;
+    for (const corpus_script& cs : CORPUS)
+    {
+        if (!compare(&cache, cs))
+        {
+            return 1;
+        }
+    }
+    std::cout << to_string(cache.stats()) << "\n";
+
+    bool checked = check_keys() && check_damaged() && check_eviction();
+    clear_cache();
+    return checked ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+#include "bench.h"
+#include "lower.h"
+#include "timer.h"
+
+// call benchmark: recursive fib built directly as intermediates (the front end does not lower functions yet).
+// checks the result and that the number of allocations does not depend on the number of calls once the frame pool
+// is warm, then reports calls per second.
+// then a million iteration tail recursive loop, as normal calls and as tail calls: checks the result and that
+// tail calls run in constant stack depth, and compares the two.
+
+namespace
+{
+
+struct call_program
+{
+    lu::intermediate_program ip;
+    lu::intermediate_register result_reg;
+};
+
+const char* SYMBOLS_SCRIPT = "n: int64 = 0\nr: int64 = 0\nm: int64 = 0\nx: int64 = 0\ny: int64 = 0\na: int64 = 0\n";
+
+lu::intermediate load(const lu::intermediate_program& ip, lu::symbol_id sid, lu::intermediate_register reg)
+{
+    return lu::intermediate::emplace_load_symbol(sid, ip.context().symbols()[sid].tid, lu::intermediate_slot::SCALAR, reg);
+}
+
+lu::intermediate store(lu::symbol_id sid, lu::intermediate_register reg, lu::intermediate&& eval)
+{
+    return lu::intermediate::emplace_store_symbol(sid, lu::intermediate_slot::SCALAR, reg, lu::make_unique(new lu::intermediate(lu::move(eval))));
+}
+
+lu::intermediate constant(lu::intermediate_program& ip, int64_t k)
+{
+    lu::intermediate_value val(ip.context().types().find_builtin_type_id(lu::builtin_type::INT64));
+    val.bin.i64 = k;
+    return ip.make_load_constant(lu::move(val));
+}
+
+lu::intermediate branch_if(lu::intermediate_addr base, size_t offset, lu::intermediate&& cond)
+{
+    return lu::intermediate::emplace_branch(base, lu::make_unique(new lu::intermediate(lu::move(cond))), lu::intermediate_branch::branch_offset(lu::intermediate_branch::branch_offset::POSITIVE, offset));
+}
+
+lu::intermediate ret(lu::intermediate&& eval)
+{
+    return lu::intermediate::emplace_return(lu::make_unique(new lu::intermediate(lu::move(eval))));
+}
+
+lu::symbol_id find(lu::intermediate_program& ip, lu::string_view name)
+{
+    lu::symbol_table& syms = ip.context().symbols();
+    return syms.find_local(syms.top(), name);
+}
+
+lu::intermediate add_imm(lu::intermediate_program& ip, lu::symbol_id sid, lu::intermediate_register reg, int64_t k)
+{
+    lu::scalar_value imm;
+    imm.i64 = k;
+    return lu::intermediate::create_typed_intrinsic(lu::intermediate_intrinsic(lu::I64ADD, ip.context().symbols().find_intrinsic_id("i64add"), sid, reg, imm));
+}
+
+// fib(n) = n == 0 ? 0 : n - 1 == 0 ? 1 : fib(n - 1) + fib(n - 2)
+void make_fib(const lu::source* p_src, int64_t n, call_program* p_fib)
+{
+    // only for the symbols and intrinsics
+    lu::intermediate_program& ip = p_fib->ip;
+    lu::bench::compile(p_src, &ip);
+    lu::symbol_id sn = find(ip, "n");
+    lu::symbol_id sr = find(ip, "r");
+    lu::symbol_id sm = find(ip, "m");
+    lu::symbol_id sx = find(ip, "x");
+    lu::symbol_id sy = find(ip, "y");
+    lu::intrinsic_id add = ip.context().symbols().find_intrinsic_id("i64add");
+
+    lu::intermediate_frame_id fib = 1;
+    lu::vector<lu::intermediate> code;
+    auto call = [&](lu::symbol_id arg, lu::intermediate_register arg_reg, lu::symbol_id result, lu::intermediate_register result_reg)
+    {
+        lu::array<lu::intermediate> args(1);
+        args[0] = store(sn, 0, load(ip, arg, arg_reg));
+        return lu::intermediate::emplace_call(fib, lu::move(args), result, lu::intermediate_slot::SCALAR, result_reg);
+    };
+
+    // top frame: n s0, r s1
+    code.push_back(store(sn, 0, constant(ip, n)));
+    code.push_back(call(sn, 0, sr, 1));
+    code.push_back(lu::intermediate::create_halt());
+    // fib frame: n s0, m s1, x s2, y s3
+    lu::intermediate_addr entry = code.size();
+    code.push_back(branch_if(entry, 2, load(ip, sn, 0)));
+    code.push_back(ret(constant(ip, 0)));
+    code.push_back(store(sm, 1, load(ip, sn, 0)));
+    code.push_back(add_imm(ip, sm, 1, -1));
+    code.push_back(branch_if(entry + 4, 2, load(ip, sm, 1)));
+    code.push_back(ret(constant(ip, 1)));
+    code.push_back(call(sm, 1, sx, 2));
+    code.push_back(add_imm(ip, sm, 1, -1));
+    code.push_back(call(sm, 1, sy, 3));
+    code.push_back(lu::intermediate::create_typed_intrinsic(lu::intermediate_intrinsic(lu::I64ADD, add, sx, sy, 2, 3)));
+    code.push_back(ret(load(ip, sx, 2)));
+
+    ip.rewrite(lu::move(code));
+    ip.frame(lu::intermediate_frame::TOP) = lu::intermediate_frame(0, 2, 0);
+    ip.push_frame(lu::intermediate_frame(entry, 4, 0));
+    p_fib->result_reg = 1;
+}
+
+// count(n, a) = n == 0 ? a : count(n - 1, a + 1), with the recursive call in tail position
+void make_count(const lu::source* p_src, int64_t n, bool tail, call_program* p_count)
+{
+    lu::intermediate_program& ip = p_count->ip;
+    lu::bench::compile(p_src, &ip);
+    lu::symbol_id sn = find(ip, "n");
+    lu::symbol_id sa = find(ip, "a");
+    lu::symbol_id sr = find(ip, "r");
+    lu::symbol_id sx = find(ip, "x");
+
+    lu::intermediate_frame_id count = 1;
+    auto call = [&](lu::symbol_id result, lu::intermediate_register result_reg)
+    {
+        lu::array<lu::intermediate> args(2);
+        args[0] = store(sn, 0, load(ip, sn, 0));
+        args[1] = store(sa, 1, load(ip, sa, 1));
+        return lu::intermediate::emplace_call(count, lu::move(args), result, lu::intermediate_slot::SCALAR, result_reg);
+    };
+
+    lu::vector<lu::intermediate> code;
+    // top frame: n s0, a s1, r s2
+    code.push_back(store(sn, 0, constant(ip, n)));
+    code.push_back(store(sa, 1, constant(ip, 0)));
+    code.push_back(call(sr, 2));
+    code.push_back(lu::intermediate::create_halt());
+    // count frame: n s0, a s1, x s2
+    lu::intermediate_addr entry = code.size();
+    code.push_back(branch_if(entry, 2, load(ip, sn, 0)));
+    code.push_back(ret(load(ip, sa, 1)));
+    code.push_back(add_imm(ip, sn, 0, -1));
+    code.push_back(add_imm(ip, sa, 1, 1));
+    code.push_back(call(sx, 2));
+    code.push_back(ret(load(ip, sx, 2)));
+
+    ip.rewrite(lu::move(code));
+    ip.frame(lu::intermediate_frame::TOP) = lu::intermediate_frame(0, 3, 0);
+    ip.push_frame(lu::intermediate_frame(entry, 3, 0));
+    if (tail)
+    {
+        lu::lower_tail_calls(&ip);
+    }
+    p_count->result_reg = 2;
+}
+
+int64_t fib(int64_t n)
+{
+    return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+// calls made by evaluating fib(n), including the first one
+uint64_t fib_calls(int64_t n)
+{
+    return n < 2 ? 1 : 1 + fib_calls(n - 1) + fib_calls(n - 2);
+}
+
+struct call_run
+{
+    int64_t result;
+    size_t allocs;
+    double seconds;
+    size_t max_depth;
+};
+
+// the first run grows the frame pool to the deepest call, the second one is measured on the same state
+call_run run(const call_program& prog)
+{
+    lu::intermediate_interpreter_state iis;
+    lu::bench::run(&prog.ip, &iis);
+
+    call_run fr;
+    lu::bench::alloc_scope scope;
+    lu::stopwatch sw;
+    sw.start();
+    lu::bench::run(&prog.ip, &iis);
+    fr.seconds = sw.lap().count();
+    fr.allocs = scope.delta().allocs;
+    fr.result = iis.scalar(prog.result_reg).i64;
+    fr.max_depth = iis.max_depth();
+    return fr;
+}
+
+}
+
+int main(int, char**)
+{
+    lu::source src = lu::source::from_string("calls.lu", SYMBOLS_SCRIPT);
+    const int64_t ns[] = { 15, 20, 25 };
+    size_t first_allocs = 0;
+    for (int64_t n : ns)
+    {
+        call_program prog;
+        make_fib(&src, n, &prog);
+        call_run fr = run(prog);
+        if (fr.result != fib(n))
+        {
+            std::cerr << "bench: fib(" << n << ") = " << fr.result << ", expected " << fib(n) << "\n";
+            return 1;
+        }
+        if (n == ns[0])
+        {
+            first_allocs = fr.allocs;
+        }
+        else if (fr.allocs != first_allocs)
+        {
+            std::cerr << "bench: calls allocate, " << fr.allocs << " allocations for fib(" << n << ") vs " << first_allocs << "\n";
+            return 1;
+        }
+        uint64_t ncalls = fib_calls(n);
+        std::cout << "fib(" << n << ") = " << fr.result << ": " << ncalls << " calls, " << fr.allocs << " allocations, "
+            << static_cast<uint64_t>(static_cast<double>(ncalls) / fr.seconds) << " calls/sec\n";
+    }
+
+    const int64_t niter = 1000000;
+    for (bool tail : { false, true })
+    {
+        call_program prog;
+        make_count(&src, niter, tail, &prog);
+        call_run cr = run(prog);
+        if (cr.result != niter)
+        {
+            std::cerr << "bench: count(" << niter << ") = " << cr.result << "\n";
+            return 1;
+        }
+        if (tail && cr.max_depth != 2)
+        {
+            std::cerr << "bench: tail calls grew the stack to depth " << cr.max_depth << "\n";
+            return 1;
+        }
+        std::cout << (tail ? "tail" : "normal") << " calls: count(" << niter << ") = " << cr.result << ", max depth " << cr.max_depth << ", "
+            << cr.seconds * 1000 << " ms, " << static_cast<uint64_t>(static_cast<double>(niter) / cr.seconds) << " calls/sec\n";
+    }
+    return 0;
+}
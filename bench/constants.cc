@@ -0,0 +1,98 @@
+#include "bench.h"
+#include "fuse.h"
+#include "lower.h"
+
+// constant pool benchmark: a literal heavy script (numbers, immediates, constant tuples). reports the number of
+// constant load sites against the number of pooled constants, and the bytes the constant values take when every
+// load embeds its own copy (as before the pool) against the pooled values, then times the script.
+
+namespace
+{
+
+lu::string make_script(size_t nrepeat)
+{
+    lu::string s("a: int64 = 0\nb: int64 = 0\nc: int32 = 0\nf: bool = false\np = (0, 0)\nq = (0, false)\n");
+    for (size_t i = 0; i < nrepeat; ++i)
+    {
+        s.append("a = 1; b = 2; c = 1; f = true\np = (1, 2); q = (7, true); p = (a, 2)\n$i64add(a, 1); $i64add(b, 1000000); $i32add(c, 1); $lor(f, false)\n");
+    }
+    return s;
+}
+
+// bytes of a value, including what it owns on the heap
+size_t value_bytes(const lu::intermediate_value& val)
+{
+    size_t n = sizeof(lu::intermediate_value);
+    if (val.tid().is(lu::LITERAL))
+    {
+        n += val.lit.text.size();
+    }
+    else if (val.tid().is(lu::TUPLE))
+    {
+        for (size_t i = 0; i < val.tup.vals.size(); ++i)
+        {
+            n += value_bytes(val.tup.vals[i]);
+        }
+    }
+    return n;
+}
+
+struct constant_stats
+{
+    size_t nloads = 0;
+    size_t embedded_bytes = 0; // if each load held its own value
+};
+
+void count_loads(const lu::intermediate_program& ip, const lu::intermediate& i, constant_stats* p_stats)
+{
+    switch (i.op())
+    {
+    case lu::intermediate::LOAD_CONSTANT:
+        ++p_stats->nloads;
+        p_stats->embedded_bytes += value_bytes(ip.constants()[i.imm.idx]);
+        break;
+    case lu::intermediate::STORE_SYMBOL:
+    case lu::intermediate::STORE_CONSTANT:
+    case lu::intermediate::STORE_COPY:
+        count_loads(ip, *i.store.eval, p_stats);
+        break;
+    case lu::intermediate::TUPLE:
+        for (size_t k = 0; k < i.tup.subs.size(); ++k)
+        {
+            count_loads(ip, i.tup.subs[k], p_stats);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+}
+
+int main(int, char**)
+{
+    lu::source src = lu::source::from_string("constants.lu", make_script(1000));
+    lu::intermediate_program ip;
+    lu::bench::compile(&src, &ip);
+    lu::fuse(&ip);
+    lu::lower_intrinsics(&ip);
+
+    constant_stats stats;
+    for (lu::intermediate_addr iaddr = 0; iaddr < ip.size(); ++iaddr)
+    {
+        count_loads(ip, ip[iaddr], &stats);
+    }
+    size_t pooled_bytes = stats.nloads * sizeof(lu::intermediate_constant);
+    for (size_t i = 0; i < ip.constants().size(); ++i)
+    {
+        pooled_bytes += value_bytes(ip.constants()[static_cast<lu::intermediate_constant>(i)]);
+    }
+    std::cout << ip.size() << " instructions, " << stats.nloads << " constant loads, " << ip.constants().size() << " pooled constants\n";
+    std::cout << "constant bytes: " << stats.embedded_bytes << " embedded per load -> " << pooled_bytes << " pooled\n";
+
+    lu::profile::time_settings ts;
+    ts.sizes = { 10, 100, 1000 };
+    ts.name = "constants";
+    lu::profile::time([&]() { lu::bench::run(&ip); }, ts, std::cout);
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include "bench.h"
+
+// dispatch micro benchmark: instruction heavy straight line scripts, no printing,
+// run with switch and with direct threaded dispatch.
+
+namespace
+{
+
+lu::string make_script(size_t nrepeat)
+{
+    lu::string s("a: int64 = 1\nb: int64 = 2\nc: int64 = 0\nf: bool = false\n");
+    for (size_t i = 0; i < nrepeat; ++i)
+    {
+        s.append("a = 1; b = 2\n$i64add(a, b); $i64add(b, a); $i64add(a, b)\nc = a; $lneg(f)\n");
+    }
+    return s;
+}
+
+void time_dispatch(const lu::intermediate_program& ip, lu::string_view name, lu::interpret_dispatch dispatch)
+{
+    lu::interpret_settings settings;
+    settings.dispatch = dispatch;
+
+    lu::profile::time_settings ts;
+    ts.sizes = { 10, 100, 1000 };
+    ts.name = name;
+    lu::profile::time([&]() { lu::bench::run(&ip, settings); }, ts, std::cout);
+}
+
+}
+
+int main(int, char**)
+{
+    if (!lu::has_threaded_dispatch())
+    {
+        std::cout << "threaded dispatch not supported by this compiler, both runs use switch\n";
+    }
+
+    const size_t repeats[] = { 100, 1000 };
+    for (size_t nrepeat : repeats)
+    {
+        lu::source src = lu::source::from_string(lu::string::join("dispatch", lu::to_string(nrepeat), ".lu"), make_script(nrepeat));
+        lu::intermediate_program ip;
+        lu::bench::compile(&src, &ip);
+
+        std::cout << ip.size() << " instructions\n";
+        time_dispatch(ip, lu::string::join("switch (", lu::to_string(nrepeat), " repeats)"), lu::interpret_dispatch::SWITCH);
+        time_dispatch(ip, lu::string::join("threaded (", lu::to_string(nrepeat), " repeats)"), lu::interpret_dispatch::THREADED);
+    }
+    return 0;
+}
@@ -0,0 +1,339 @@
+#include "format.h"
+#include "string.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <cmath>
+
+#if __cplusplus >= 201703L
+#   include <charconv>
+#endif // __cplusplus >= 201703L
+
+// number formatting benchmark: integers must read as snprintf prints them, at the edges and for random values. doubles
+// and floats from random bits and from short decimals must read back (strtod, strtof) as the same value, and are
+// counted where a shorter %.*g would also have read back (Grisu2 is not always the shortest). then the formatters are
+// timed against snprintf, and std::to_chars when built as C++17
+
+namespace
+{
+
+const size_t NCHECK = 200000;
+const size_t NTIME = 1000000;
+
+// <cstring> would find src/string.h
+template <typename To, typename From>
+To bit_cast(const From& from)
+{
+    static_assert(sizeof(To) == sizeof(From), "bit_cast of different sizes");
+    To to;
+    std::copy_n(reinterpret_cast<const char*>(&from), sizeof(To), reinterpret_cast<char*>(&to));
+    return to;
+}
+
+uint64_t next(uint64_t* p_state)
+{
+    // xorshift64*
+    uint64_t x = *p_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *p_state = x;
+    return x * 0x2545f4914f6cdd1dull;
+}
+
+bool check_int(int64_t v)
+{
+    char buf[lu::FORMAT_INT_SIZE];
+    char expected[32];
+    size_t n = lu::format_int(v, buf);
+    int m = snprintf(expected, sizeof(expected), "%lld", static_cast<long long>(v));
+    if (lu::string_view(buf, n) != lu::string_view(expected, static_cast<size_t>(m)))
+    {
+        std::cerr << "bench: " << expected << " formats as " << lu::string(buf, n) << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool check_uint(uint64_t v)
+{
+    char buf[lu::FORMAT_INT_SIZE];
+    char expected[32];
+    size_t n = lu::format_uint(v, buf);
+    int m = snprintf(expected, sizeof(expected), "%llu", static_cast<unsigned long long>(v));
+    if (lu::string_view(buf, n) != lu::string_view(expected, static_cast<size_t>(m)))
+    {
+        std::cerr << "bench: " << expected << " formats as " << lu::string(buf, n) << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool check_ints()
+{
+    const int64_t edges[] =
+    {
+        0, 1, -1, 9, 10, 99, 100, 999, 1000, -1000, 4294967295ll, 4294967296ll,
+        std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min(),
+        std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::min(),
+    };
+    for (int64_t v : edges)
+    {
+        if (!check_int(v) || !check_uint(static_cast<uint64_t>(v)))
+        {
+            return false;
+        }
+    }
+    uint64_t p = 1;
+    for (int i = 0; i < 20; ++i, p *= 10)
+    {
+        if (!check_uint(p - 1) || !check_uint(p) || !check_int(static_cast<int64_t>(p)) || !check_int(-static_cast<int64_t>(p - 1)))
+        {
+            return false;
+        }
+    }
+    uint64_t state = 88172645463325252ull;
+    for (size_t i = 0; i < NCHECK; ++i)
+    {
+        uint64_t v = next(&state) >> (i % 64); // every length
+        if (!check_uint(v) || !check_int(static_cast<int64_t>(v)) || !check_int(-static_cast<int64_t>(v >> 1)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the fewest %.*g digits that read back
+template <typename T>
+size_t shortest_g(T v, T (*read)(const char*, char**))
+{
+    char buf[64];
+    for (int precision = 1; precision < 17; ++precision)
+    {
+        snprintf(buf, sizeof(buf), "%.*g", precision, static_cast<double>(v));
+        if (read(buf, nullptr) == v)
+        {
+            return static_cast<size_t>(precision);
+        }
+    }
+    return 17;
+}
+
+// significant digits of formatted text
+size_t count_digits(lu::string_view s)
+{
+    size_t n = 0;
+    bool leading = true;
+    size_t trailing = 0;
+    for (size_t i = 0; i < s.size() && s[i] != 'e'; ++i)
+    {
+        char c = s[i];
+        if (c < '0' || c > '9')
+        {
+            continue;
+        }
+        if (leading && c == '0')
+        {
+            continue;
+        }
+        leading = false;
+        ++n;
+        trailing = c == '0' ? trailing + 1 : 0;
+    }
+    return n > trailing ? n - trailing : 1;
+}
+
+double read_double(const char* p, char** pp_end) { return std::strtod(p, pp_end); }
+float read_float(const char* p, char** pp_end) { return std::strtof(p, pp_end); }
+
+template <typename T> struct bits_of;
+template <> struct bits_of<double> { typedef uint64_t type; };
+template <> struct bits_of<float> { typedef uint32_t type; };
+
+template <typename T>
+bool check_round_trip(T v, size_t (*format)(T, char*), T (*read)(const char*, char**), size_t* p_longer)
+{
+    char buf[lu::FORMAT_FLOAT_SIZE + 1];
+    size_t n = format(v, buf);
+    buf[n] = '\0';
+    T back = read(buf, nullptr);
+    if (bit_cast<typename bits_of<T>::type>(back) != bit_cast<typename bits_of<T>::type>(v))
+    {
+        std::cerr << "bench: " << buf << " does not read back as " << static_cast<double>(v) << "\n";
+        return false;
+    }
+    if (count_digits(lu::string_view(buf, n)) > shortest_g(v, read))
+    {
+        ++*p_longer;
+    }
+    return true;
+}
+
+bool check_floats()
+{
+    const double edges[] =
+    {
+        0.0, -0.0, 1.0, -1.0, 0.1, 0.3, 1.5, 100.0, 1e21, 1e-6, 1e-7, 123456789012345680000.0, 5e-324, 2.2250738585072014e-308,
+        std::numeric_limits<double>::max(), std::numeric_limits<double>::min(), std::numeric_limits<double>::lowest(),
+    };
+    size_t longer = 0;
+    for (double v : edges)
+    {
+        if (!check_round_trip(v, lu::format_double, read_double, &longer)
+            || !check_round_trip(static_cast<float>(v), lu::format_float, read_float, &longer))
+        {
+            return false;
+        }
+    }
+    // text, then the value. decimal notation stops at 1e21 going up and below 1e-6 going down, the exponent has its
+    // sign and no padding
+    const char* expected[][2] =
+    {
+        { "0.0", "0" }, { "-0.0", "-0" }, { "3.0", "3" }, { "0.001", "0.001" }, { "0.1", "0.1" }, { "123.456", "123.456" },
+        { "999999999999999900000.0", "999999999999999900000" }, { "1e+21", "1e21" }, { "1.5e+21", "1.5e21" },
+        { "-1e+21", "-1e21" }, { "1e+100", "1e100" }, { "1.5e+300", "1.5e300" },
+        { "0.000001", "1e-6" }, { "0.0000015", "1.5e-6" }, { "9.99e-7", "9.99e-7" }, { "1e-7", "1e-7" },
+        { "-1e-7", "-1e-7" }, { "1.23e-10", "1.23e-10" }, { "1e-300", "1e-300" }, { "5e-324", "5e-324" },
+        { "inf", "inf" }, { "-inf", "-inf" }, { "nan", "nan" },
+    };
+    const char* expected_float[][2] =
+    {
+        { "3.0", "3" }, { "0.1", "0.1" }, { "1e+21", "1e21" }, { "1.5e+21", "1.5e21" }, { "1e+38", "1e38" },
+        { "0.000001", "1e-6" }, { "9.99e-7", "9.99e-7" }, { "1e-7", "1e-7" }, { "1e-45", "1e-45" },
+    };
+    for (const auto& e : expected)
+    {
+        char buf[lu::FORMAT_FLOAT_SIZE];
+        lu::string_view text(e[0]);
+        size_t n = lu::format_double(std::strtod(e[1], nullptr), buf);
+        if (lu::string_view(buf, n) != text)
+        {
+            std::cerr << "bench: " << e[1] << " formats as " << lu::string(buf, n) << ", expected " << e[0] << "\n";
+            return false;
+        }
+    }
+    for (const auto& e : expected_float)
+    {
+        char buf[lu::FORMAT_FLOAT_SIZE];
+        lu::string_view text(e[0]);
+        size_t n = lu::format_float(std::strtof(e[1], nullptr), buf);
+        if (lu::string_view(buf, n) != text)
+        {
+            std::cerr << "bench: float " << e[1] << " formats as " << lu::string(buf, n) << ", expected " << e[0] << "\n";
+            return false;
+        }
+    }
+
+    uint64_t state = 1181783497276652981ull;
+    size_t ndouble = 0;
+    size_t nfloat = 0;
+    for (size_t i = 0; i < NCHECK; ++i)
+    {
+        uint64_t bits = next(&state);
+        double d = bit_cast<double>(bits);
+        float f = bit_cast<float>(static_cast<uint32_t>(bits >> 32));
+        // and short decimals, the most common in scripts
+        double decimal = static_cast<double>(bits % 1000000) / 1000.0;
+        if (std::isfinite(d))
+        {
+            ++ndouble;
+            if (!check_round_trip(d, lu::format_double, read_double, &longer))
+            {
+                return false;
+            }
+        }
+        if (std::isfinite(f))
+        {
+            ++nfloat;
+            if (!check_round_trip(f, lu::format_float, read_float, &longer))
+            {
+                return false;
+            }
+        }
+        if (!check_round_trip(decimal, lu::format_double, read_double, &longer)
+            || !check_round_trip(static_cast<float>(decimal), lu::format_float, read_float, &longer))
+        {
+            return false;
+        }
+    }
+    std::cout << ndouble << " doubles, " << nfloat << " floats and " << NCHECK * 2 << " decimals read back, "
+        << longer << " longer than the shortest\n";
+    return true;
+}
+
+// sums the lengths, so the formatting is not optimized out
+template <typename F>
+double time_format(const char* name, F format, double base_seconds)
+{
+    uint64_t state = 2463534242ull;
+    size_t total = 0;
+    lu::stopwatch sw;
+    sw.start();
+    for (size_t i = 0; i < NTIME; ++i)
+    {
+        total += format(next(&state));
+    }
+    double seconds = sw.lap().count();
+    std::cout << "  " << name << " " << seconds * 1e9 / NTIME << " ns a value (" << total << " chars)";
+    if (base_seconds > 0)
+    {
+        std::cout << ", " << base_seconds / seconds << "x snprintf";
+    }
+    std::cout << "\n";
+    return seconds;
+}
+
+double to_double(uint64_t bits)
+{
+    // finite, spread over every exponent
+    return bit_cast<double>(bits & ~(1ull << 62));
+}
+
+void time_all()
+{
+    char buf[64];
+    std::cout << NTIME << " integers\n";
+    double base = time_format("snprintf", [&](uint64_t v)
+    {
+        return static_cast<size_t>(snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(v)));
+    }, 0);
+    time_format("format_int", [&](uint64_t v) { return lu::format_int(static_cast<int64_t>(v), buf); }, base);
+    time_format("lu::to_string", [&](uint64_t v) { return lu::to_string(static_cast<long long>(v)).size(); }, base);
+#if __cplusplus >= 201703L
+    time_format("std::to_chars", [&](uint64_t v)
+    {
+        return static_cast<size_t>(std::to_chars(buf, buf + sizeof(buf), static_cast<long long>(v)).ptr - buf);
+    }, base);
+#endif // __cplusplus >= 201703L
+
+    std::cout << NTIME << " doubles\n";
+    base = time_format("snprintf %.17g", [&](uint64_t v)
+    {
+        return static_cast<size_t>(snprintf(buf, sizeof(buf), "%.17g", to_double(v)));
+    }, 0);
+    time_format("format_double", [&](uint64_t v) { return lu::format_double(to_double(v), buf); }, base);
+    time_format("lu::to_string", [&](uint64_t v) { return lu::to_string(to_double(v)).size(); }, base);
+#if __cplusplus >= 201703L && defined(__cpp_lib_to_chars)
+    time_format("std::to_chars", [&](uint64_t v)
+    {
+        return static_cast<size_t>(std::to_chars(buf, buf + sizeof(buf), to_double(v)).ptr - buf);
+    }, base);
+#endif // __cplusplus >= 201703L && defined(__cpp_lib_to_chars)
+}
+
+}
+
+int main()
+{
+    if (!check_ints() || !check_floats())
+    {
+        return 1;
+    }
+    time_all();
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include "bench.h"
+#include "fuse.h"
+
+// superinstruction fusion benchmark: profiles opcode pairs over a small corpus of straight line scripts,
+// then compares dispatch counts and run time of each script before and after fusion.
+
+namespace
+{
+
+struct corpus_script
+{
+    const char* name;
+    const char* header;
+    const char* body; // repeated
+};
+
+const corpus_script CORPUS[] =
+{
+    {
+        "arith",
+        "a: int64 = 1\nb: int64 = 2\nc: int64 = 0\nf: bool = false\n",
+        "a = 1; b = 2\n$i64add(a, b); $i64add(b, a); $i64add(a, b)\nc = a; $lneg(f)\n",
+    },
+    {
+        "counters",
+        "i: int32 = 0\nj: int32 = 0\none: int32 = 1\nn: int64 = 0\nstep: int64 = 3\n",
+        "$i32add(i, one); $i32add(j, i); $i64add(n, step)\ni = j\n",
+    },
+    {
+        "logic",
+        "p: bool = true\nq: bool = false\nr: bool = false\n",
+        "r = p; $lneg(r); $lneg(q)\np = q; q = true\n",
+    },
+};
+
+lu::string make_script(const corpus_script& cs, size_t nrepeat)
+{
+    lu::string s(cs.header);
+    for (size_t i = 0; i < nrepeat; ++i)
+    {
+        s.append(cs.body);
+    }
+    return s;
+}
+
+size_t count_dispatches(const lu::intermediate_program& ip, lu::opcode_pair_profile* p_profile)
+{
+    lu::interpret_settings settings;
+    settings.p_profile = p_profile;
+    size_t before = p_profile->dispatches();
+    lu::bench::run(&ip, settings);
+    return p_profile->dispatches() - before;
+}
+
+void time_run(const lu::intermediate_program& ip, lu::string_view name)
+{
+    lu::profile::time_settings ts;
+    ts.sizes = { 10, 100, 1000 };
+    ts.name = name;
+    lu::profile::time([&]() { lu::bench::run(&ip); }, ts, std::cout);
+}
+
+}
+
+int main(int, char**)
+{
+    const size_t nrepeat = 1000;
+
+    lu::opcode_pair_profile corpus_profile;
+    lu::opcode_pair_profile fused_profile;
+    for (const corpus_script& cs : CORPUS)
+    {
+        lu::source src = lu::source::from_string(lu::string::join(cs.name, ".lu"), make_script(cs, nrepeat));
+        lu::intermediate_program ip;
+        lu::bench::compile(&src, &ip);
+        lu::intermediate_program fused;
+        lu::bench::compile(&src, &fused);
+        if (!ok(lu::fuse(&fused)))
+        {
+            std::cerr << "bench: fusion skipped " << cs.name << "\n";
+            return 1;
+        }
+
+        std::cout << cs.name << ": " << ip.size() << " -> " << fused.size() << " instructions, "
+            << count_dispatches(ip, &corpus_profile) << " -> " << count_dispatches(fused, &fused_profile) << " dispatches\n";
+        time_run(ip, lu::string::join(cs.name, " unfused"));
+        time_run(fused, lu::string::join(cs.name, " fused"));
+    }
+
+    std::cout << "corpus opcode pairs before fusion: " << lu::to_string(corpus_profile);
+    std::cout << "corpus opcode pairs after fusion: " << lu::to_string(fused_profile);
+    return 0;
+}
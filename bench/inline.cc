@@ -0,0 +1,265 @@
+#include "bench.h"
+#include "inline.h"
+#include "optimize.h"
+#include "layout.h"
+#include "fuse.h"
+#include "lower.h"
+#include "timer.h"
+
+#include <sstream>
+
+// inliner benchmark: a loop calling small helpers, built directly as intermediates (the front end does not lower
+// functions yet), run without inlining, with inlining by size, with inlining guided by a call profile and through
+// the -O2 passes. checks that the output does not change and that fewer calls run, then reports the run times.
+
+namespace
+{
+
+const char* SYMBOLS_SCRIPT = "n: int64 = 0\na: int64 = 0\nb: int64 = 0\nf: int64 = 0\nc: int64 = 0\nx: int64 = 0\ny: int64 = 0\n";
+
+lu::symbol_id find(lu::intermediate_program& ip, lu::string_view name)
+{
+    lu::symbol_table& syms = ip.context().symbols();
+    return syms.find_local(syms.top(), name);
+}
+
+lu::intermediate load(const lu::intermediate_program& ip, lu::symbol_id sid, lu::intermediate_register reg)
+{
+    return lu::intermediate::emplace_load_symbol(sid, ip.context().symbols()[sid].tid, lu::intermediate_slot::SCALAR, reg);
+}
+
+lu::intermediate store(lu::symbol_id sid, lu::intermediate_register reg, lu::intermediate&& eval)
+{
+    return lu::intermediate::emplace_store_symbol(sid, lu::intermediate_slot::SCALAR, reg, lu::make_unique(new lu::intermediate(lu::move(eval))));
+}
+
+lu::intermediate constant(lu::intermediate_program& ip, int64_t k)
+{
+    lu::intermediate_value val(ip.context().types().find_builtin_type_id(lu::builtin_type::INT64));
+    val.bin.i64 = k;
+    return ip.make_load_constant(lu::move(val));
+}
+
+lu::intermediate branch(lu::intermediate_addr from, lu::intermediate_addr to, lu::unique<lu::intermediate>&& cond)
+{
+    return lu::intermediate::emplace_branch(from, lu::move(cond), to >= from
+        ? lu::intermediate_branch::branch_offset(lu::intermediate_branch::branch_offset::POSITIVE, to - from)
+        : lu::intermediate_branch::branch_offset(lu::intermediate_branch::branch_offset::NEGATIVE, from - to));
+}
+
+lu::intermediate ret(lu::intermediate&& eval)
+{
+    return lu::intermediate::emplace_return(lu::make_unique(new lu::intermediate(lu::move(eval))));
+}
+
+lu::intermediate add_imm(lu::intermediate_program& ip, lu::symbol_id sid, lu::intermediate_register reg, int64_t k)
+{
+    lu::scalar_value imm;
+    imm.i64 = k;
+    return lu::intermediate::create_typed_intrinsic(lu::intermediate_intrinsic(lu::I64ADD, ip.context().symbols().find_intrinsic_id("i64add"), sid, reg, imm));
+}
+
+lu::intermediate print(lu::intermediate_program& ip, lu::symbol_id sid, lu::intermediate_register reg)
+{
+    return lu::intermediate::emplace_intrinsic(lu::I64PRINT, ip.context().symbols().find_intrinsic_id("i64print"), lu::symbol_id(lu::symbol::INVALID_ID), sid, 0, reg);
+}
+
+// frames
+const lu::intermediate_frame_id INC = 1;
+const lu::intermediate_frame_id ADD = 2;
+const lu::intermediate_frame_id STEP = 3;
+const lu::intermediate_frame_id INC2 = 4;
+const lu::intermediate_frame_id BIG = 5;
+
+// inc(x) = x + 1
+// add(x, y) = x + y
+// step(x, f) = f ? x + 1 : x      (two returns)
+// inc2(x) = inc(inc(x))          (inlined in the second round)
+// big(x) = x + 8, one add at a time  (only inlined when the profile finds it hot)
+//
+// n = 100000; a = 0; b = 0; f = 1; c = 0
+// while n: a = inc(a); b = add(a, b); c = step(c, f); c = inc2(c); a = big(a); n += -1
+// print a; print b; print c
+void make_helpers(const lu::source* p_src, int64_t n, lu::intermediate_program* p_ip)
+{
+    lu::intermediate_program& ip = *p_ip;
+    lu::bench::compile(p_src, &ip);
+    lu::symbol_id sn = find(ip, "n");
+    lu::symbol_id sa = find(ip, "a");
+    lu::symbol_id sb = find(ip, "b");
+    lu::symbol_id sf = find(ip, "f");
+    lu::symbol_id sc = find(ip, "c");
+    lu::symbol_id sx = find(ip, "x");
+    lu::symbol_id sy = find(ip, "y");
+
+    // calls fid with args from the caller registers, into params x s0 and y s1 if there is a second one
+    auto call = [&](lu::intermediate_frame_id fid, lu::symbol_id result, lu::intermediate_register result_reg,
+        lu::symbol_id x, lu::intermediate_register x_reg, lu::symbol_id y, lu::intermediate_register y_reg)
+    {
+        lu::array<lu::intermediate> args(y != lu::symbol::INVALID_ID ? 2 : 1);
+        args[0] = store(sx, 0, load(ip, x, x_reg));
+        if (y != lu::symbol::INVALID_ID)
+        {
+            args[1] = store(sy, 1, load(ip, y, y_reg));
+        }
+        return lu::intermediate::emplace_call(fid, lu::move(args), result, lu::intermediate_slot::SCALAR, result_reg);
+    };
+    const lu::symbol_id none = lu::symbol::INVALID_ID;
+
+    lu::vector<lu::intermediate> code;
+    // top frame: n s0, a s1, b s2, f s3, c s4
+    code.push_back(store(sn, 0, constant(ip, n)));
+    code.push_back(store(sa, 1, constant(ip, 0)));
+    code.push_back(store(sb, 2, constant(ip, 0)));
+    code.push_back(store(sf, 3, constant(ip, 1)));
+    code.push_back(store(sc, 4, constant(ip, 0)));
+    code.push_back(branch(5, 7, lu::make_unique(new lu::intermediate(load(ip, sn, 0)))));
+    code.push_back(branch(6, 14, nullptr));
+    code.push_back(call(INC, sa, 1, sa, 1, none, 0));
+    code.push_back(call(ADD, sb, 2, sa, 1, sb, 2));
+    code.push_back(call(STEP, sc, 4, sc, 4, sf, 3));
+    code.push_back(call(INC2, sc, 4, sc, 4, none, 0));
+    code.push_back(call(BIG, sa, 1, sa, 1, none, 0));
+    code.push_back(add_imm(ip, sn, 0, -1));
+    code.push_back(branch(13, 5, nullptr));
+    code.push_back(print(ip, sa, 1));
+    code.push_back(print(ip, sb, 2));
+    code.push_back(print(ip, sc, 4));
+    code.push_back(lu::intermediate::create_halt());
+    // inc: x s0
+    lu::intermediate_addr inc = code.size();
+    code.push_back(add_imm(ip, sx, 0, 1));
+    code.push_back(ret(load(ip, sx, 0)));
+    // add: x s0, y s1
+    lu::intermediate_addr add = code.size();
+    code.push_back(lu::intermediate::create_typed_intrinsic(lu::intermediate_intrinsic(lu::I64ADD, ip.context().symbols().find_intrinsic_id("i64add"), sx, sy, 0, 1)));
+    code.push_back(ret(load(ip, sx, 0)));
+    // step: x s0, f s1
+    lu::intermediate_addr step = code.size();
+    code.push_back(branch(step, step + 2, lu::make_unique(new lu::intermediate(load(ip, sy, 1)))));
+    code.push_back(ret(load(ip, sx, 0)));
+    code.push_back(add_imm(ip, sx, 0, 1));
+    code.push_back(ret(load(ip, sx, 0)));
+    // inc2: x s0
+    lu::intermediate_addr inc2 = code.size();
+    code.push_back(call(INC, sx, 0, sx, 0, none, 0));
+    code.push_back(call(INC, sx, 0, sx, 0, none, 0));
+    code.push_back(ret(load(ip, sx, 0)));
+    // big: x s0
+    lu::intermediate_addr big = code.size();
+    for (int k = 0; k < 8; ++k)
+    {
+        code.push_back(add_imm(ip, sx, 0, 1));
+    }
+    code.push_back(ret(load(ip, sx, 0)));
+
+    ip.rewrite(lu::move(code));
+    ip.frame(lu::intermediate_frame::TOP) = lu::intermediate_frame(0, 5, 0);
+    ip.push_frame(lu::intermediate_frame(inc, 1, 0));
+    ip.push_frame(lu::intermediate_frame(add, 2, 0));
+    ip.push_frame(lu::intermediate_frame(step, 2, 0));
+    ip.push_frame(lu::intermediate_frame(inc2, 1, 0));
+    ip.push_frame(lu::intermediate_frame(big, 1, 0));
+}
+
+// runs the program nrun times, returns the output of the last run
+std::string run(const lu::intermediate_program& ip, size_t nrun, double* p_seconds)
+{
+    std::ostringstream out;
+    std::streambuf* p_cout = std::cout.rdbuf(out.rdbuf());
+    lu::stopwatch sw;
+    sw.start();
+    for (size_t k = 0; k < nrun; ++k)
+    {
+        out.str("");
+        lu::bench::run(&ip);
+    }
+    *p_seconds = sw.lap().count() / static_cast<double>(nrun);
+    std::cout.rdbuf(p_cout);
+    return out.str();
+}
+
+// one profiled run, output dropped. returns the number of calls made
+uint64_t profile(const lu::intermediate_program& ip, lu::edge_profile* p_edges)
+{
+    std::ostringstream out;
+    std::streambuf* p_cout = std::cout.rdbuf(out.rdbuf());
+    lu::interpret_settings settings;
+    settings.p_edges = p_edges;
+    lu::bench::run(&ip, settings);
+    std::cout.rdbuf(p_cout);
+
+    uint64_t ncalls = 0;
+    for (lu::intermediate_addr iaddr = 0; iaddr < ip.size(); ++iaddr)
+    {
+        if (ip[iaddr].op() == lu::intermediate::CALL || ip[iaddr].op() == lu::intermediate::TAIL_CALL)
+        {
+            ncalls += p_edges->executed(iaddr);
+        }
+    }
+    return ncalls;
+}
+
+}
+
+int main(int, char**)
+{
+    const int64_t n = 100000;
+    lu::source src = lu::source::from_string("inline.lu", SYMBOLS_SCRIPT);
+    lu::edge_profile edges;
+    {
+        lu::intermediate_program ip;
+        make_helpers(&src, n, &ip);
+        profile(ip, &edges);
+    }
+
+    enum { OFF, SIZE, PROFILED, O2 };
+    const char* names[] = { "off", "by size", "profiled", "by size, -O2" };
+    std::string expected;
+    uint64_t ncalls_off = 0;
+    for (int kind : { OFF, SIZE, PROFILED, O2 })
+    {
+        lu::intermediate_program ip;
+        make_helpers(&src, n, &ip);
+        lu::inline_stats stats;
+        if (kind != OFF && !ok(lu::inline_calls(&ip, lu::inline_settings(), kind == PROFILED ? &edges : nullptr, &stats)))
+        {
+            std::cerr << "bench: inlining skipped\n";
+            return 1;
+        }
+        if (kind == O2)
+        {
+            lu::optimize(&ip, lu::optimize_settings(lu::optimize_level::O2));
+            lu::layout_blocks(&ip);
+        }
+
+        lu::edge_profile after;
+        uint64_t ncalls = profile(ip, &after);
+        lu::fuse(&ip);
+        lu::lower_intrinsics(&ip);
+        double seconds = 0;
+        std::string output = run(ip, 10, &seconds);
+        if (kind == OFF)
+        {
+            expected = output;
+            ncalls_off = ncalls;
+        }
+        else if (output != expected)
+        {
+            std::cerr << "bench: inlining " << names[kind] << " output differs\n";
+            return 1;
+        }
+        else if (ncalls >= ncalls_off)
+        {
+            std::cerr << "bench: inlining " << names[kind] << " makes no fewer calls\n";
+            return 1;
+        }
+        std::cout << names[kind] << ": " << ncalls << " calls, " << seconds * 1000 << " ms/run";
+        if (kind != OFF)
+        {
+            std::cout << " (" << to_string(stats) << ")";
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "bench.h"
+#include "fuse.h"
+#include "lower.h"
+#include "internal/value_printer.h"
+
+// typed intrinsic benchmark: checks that lowered typed intrinsics (register and immediate operands) behave
+// exactly like the generic INTRINSIC (same output and registers), then times generic, lowered, and fused + lowered.
+
+namespace
+{
+
+// every intrinsic, with register and immediate operands
+const char* VERIFY_SCRIPT =
+    "a: int32 = 7; b: int32 = 3\n"
+    "c: int64 = 9000000000; d: int64 = 2\n"
+    "e: uint32 = 4000000000; f: uint32 = 1\n"
+    "g: uint64 = 18000000000000000000; h: uint64 = 5\n"
+    "p: bool = true; q: bool = false\n"
+    "ch: ascii = \"x\"; nl: ascii = \"\\n\"\n"
+    "$i32add(a, b); $i32add(a, 1); $i32print(a); $i32print(12); $asciiprint(nl)\n"
+    "$i64add(c, d); $i64add(c, 10); $i64print(c); $i64print(34); $asciiprint(nl)\n"
+    "$u32add(e, f); $u32add(e, 300000000); $u32print(e); $u32print(56); $asciiprint(nl)\n"
+    "$u64add(g, h); $u64add(g, 7); $u64print(g); $u64print(78); $asciiprint(nl)\n"
+    "$lneg(p); $bprint(p); $lor(p, q); $bprint(p); $lor(q, true); $bprint(q); $land(p, q); $bprint(p); $land(q, false); $bprint(q); $bprint(true); $asciiprint(nl)\n"
+    "$asciiprint(ch); $asciiprint(\"y\"); $asciiprint(nl)\n";
+
+lu::string make_timing_script(size_t nrepeat)
+{
+    lu::string s("a: int64 = 0\nb: int64 = 3\ni: int32 = 0\nf: bool = false\nt: bool = true\n");
+    for (size_t k = 0; k < nrepeat; ++k)
+    {
+        s.append("$i64add(a, 1); $i64add(a, b); $i32add(i, 1)\n$lneg(f); $lor(f, t); $land(f, false)\n");
+    }
+    return s;
+}
+
+struct run_capture
+{
+    lu::string out;
+    lu::vector<lu::string> regs;
+};
+
+run_capture capture(const lu::intermediate_program& ip)
+{
+    lu::memory_sink out;
+    lu::intermediate_interpreter_state iis;
+    iis.set_out(&out);
+    lu::bench::run(&ip, &iis);
+
+    run_capture rc;
+    rc.out = out.str();
+    const lu::intermediate_frame& top = ip.frame(lu::intermediate_frame::TOP);
+    for (lu::intermediate_register r = 0; r < top.nscalars; ++r)
+    {
+        rc.regs.push_back(lu::to_string(iis.scalar(r).bits));
+    }
+    for (lu::intermediate_register r = 0; r < top.naggregates; ++r)
+    {
+        rc.regs.push_back(lu::internal::intermediate_value_printer().print(ip.context().symbols(), ip.context().types(), iis.aggregate(r).to_intermediate()));
+    }
+    return rc;
+}
+
+bool same(const run_capture& lhs, const run_capture& rhs)
+{
+    if (lu::string_view(lhs.out) != lu::string_view(rhs.out) || lhs.regs.size() != rhs.regs.size())
+    {
+        return false;
+    }
+    for (size_t r = 0; r < lhs.regs.size(); ++r)
+    {
+        if (lu::string_view(lhs.regs[r]) != lu::string_view(rhs.regs[r]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void time_run(const lu::intermediate_program& ip, lu::string_view name)
+{
+    lu::profile::time_settings ts;
+    ts.sizes = { 10, 100, 1000 };
+    ts.name = name;
+    lu::profile::time([&]() { lu::bench::run(&ip); }, ts, std::cout);
+}
+
+}
+
+int main(int, char**)
+{
+    {
+        lu::source src = lu::source::from_string("verify.lu", VERIFY_SCRIPT);
+        lu::intermediate_program generic;
+        lu::bench::compile(&src, &generic);
+        lu::intermediate_program lowered;
+        lu::bench::compile(&src, &lowered);
+        size_t nlowered = lu::lower_intrinsics(&lowered);
+
+        run_capture expected = capture(generic);
+        run_capture actual = capture(lowered);
+        std::cout << "verify: " << nlowered << " intrinsics lowered, output:\n" << lu::string_view(expected.out);
+        if (!same(expected, actual))
+        {
+            std::cerr << "bench: typed intrinsics differ from generic intrinsics, lowered output:\n" << lu::string_view(actual.out);
+            return 1;
+        }
+    }
+
+    lu::source src = lu::source::from_string("intrinsic.lu", make_timing_script(1000));
+    lu::intermediate_program generic;
+    lu::bench::compile(&src, &generic);
+    lu::intermediate_program lowered;
+    lu::bench::compile(&src, &lowered);
+    lu::lower_intrinsics(&lowered);
+    lu::intermediate_program fused;
+    lu::bench::compile(&src, &fused);
+    lu::fuse(&fused);
+    lu::lower_intrinsics(&fused);
+
+    std::cout << generic.size() << " instructions, " << fused.size() << " fused\n";
+    time_run(generic, "generic intrinsics");
+    time_run(lowered, "typed intrinsics");
+    time_run(fused, "fused then typed intrinsics");
+    return 0;
+}
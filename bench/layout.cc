@@ -0,0 +1,192 @@
+#include "bench.h"
+#include "layout.h"
+#include "cfg.h"
+#include "fuse.h"
+#include "lower.h"
+#include "timer.h"
+
+#include <sstream>
+
+// block layout benchmark: a hand built loop (the front end has no control flow yet) with an error path inside
+// the loop and a rarely run block, laid out as written, with static prediction and with an edge profile.
+// checks that the output does not change and reports the taken branches and run time of each layout.
+
+namespace
+{
+
+const char* SYMBOLS_SCRIPT = "n: int64 = 0\na: int64 = 0\nstep: int64 = 0\nok: bool = false\nfast: bool = false\nc: int64 = 0\n";
+
+lu::symbol_id find(lu::intermediate_program& ip, lu::string_view name)
+{
+    lu::symbol_table& syms = ip.context().symbols();
+    return syms.find_local(syms.top(), name);
+}
+
+lu::intermediate load(const lu::intermediate_program& ip, lu::symbol_id sid, lu::intermediate_register reg)
+{
+    return lu::intermediate::emplace_load_symbol(sid, ip.context().symbols()[sid].tid, lu::intermediate_slot::SCALAR, reg);
+}
+
+lu::intermediate store_constant(lu::intermediate_program& ip, lu::symbol_id sid, lu::intermediate_register reg, uint64_t bits)
+{
+    lu::intermediate_value val(ip.context().symbols()[sid].tid);
+    lu::scalar_value sv;
+    sv.bits = bits;
+    lu::set_scalar(&val.bin, sv);
+    return lu::intermediate::emplace_store_symbol(sid, lu::intermediate_slot::SCALAR, reg, lu::make_unique(new lu::intermediate(ip.make_load_constant(lu::move(val)))));
+}
+
+lu::intermediate branch(lu::intermediate_addr from, lu::intermediate_addr to, lu::unique<lu::intermediate>&& cond)
+{
+    return lu::intermediate::emplace_branch(from, lu::move(cond), to >= from
+        ? lu::intermediate_branch::branch_offset(lu::intermediate_branch::branch_offset::POSITIVE, to - from)
+        : lu::intermediate_branch::branch_offset(lu::intermediate_branch::branch_offset::NEGATIVE, from - to));
+}
+
+lu::intermediate intrinsic(lu::intermediate_program& ip, lu::intrinsic_code icode, const char* name, lu::symbol_id dest, lu::symbol_id op, lu::intermediate_register dest_reg, lu::intermediate_register op_reg)
+{
+    return lu::intermediate::emplace_intrinsic(icode, ip.context().symbols().find_intrinsic_id(name), dest, op, dest_reg, op_reg);
+}
+
+// n = 200000; a = 0; step = 1; ok = true; fast = true
+// while n:
+//     if !ok: print n; trap      (error path, never runs)
+//     if !fast: a += step        (never runs, only a profile knows)
+//     a += step; n += -1
+// c = a; print c
+void make_loop(const lu::source* p_src, lu::intermediate_program* p_ip)
+{
+    lu::intermediate_program& ip = *p_ip;
+    lu::bench::compile(p_src, &ip);
+    lu::symbol_id sn = find(ip, "n");
+    lu::symbol_id sa = find(ip, "a");
+    lu::symbol_id sstep = find(ip, "step");
+    lu::symbol_id sok = find(ip, "ok");
+    lu::symbol_id sfast = find(ip, "fast");
+    lu::symbol_id sc = find(ip, "c");
+    lu::scalar_value minus_one;
+    minus_one.i64 = -1;
+
+    // n s0, a s1, step s2, ok s3, fast s4, c s5
+    lu::vector<lu::intermediate> code;
+    code.push_back(store_constant(ip, sn, 0, 200000));
+    code.push_back(store_constant(ip, sa, 1, 0));
+    code.push_back(store_constant(ip, sstep, 2, 1));
+    code.push_back(store_constant(ip, sok, 3, 1));
+    code.push_back(store_constant(ip, sfast, 4, 1));
+    // loop header
+    code.push_back(branch(5, 7, lu::make_unique(new lu::intermediate(load(ip, sn, 0)))));
+    code.push_back(branch(6, 15, nullptr));
+    code.push_back(branch(7, 10, lu::make_unique(new lu::intermediate(load(ip, sok, 3)))));
+    code.push_back(intrinsic(ip, lu::I64PRINT, "i64print", lu::symbol::INVALID_ID, sn, 0, 0));
+    code.push_back(lu::intermediate()); // ILLEGAL
+    code.push_back(branch(10, 12, lu::make_unique(new lu::intermediate(load(ip, sfast, 4)))));
+    code.push_back(intrinsic(ip, lu::I64ADD, "i64add", sa, sstep, 1, 2));
+    code.push_back(intrinsic(ip, lu::I64ADD, "i64add", sa, sstep, 1, 2));
+    code.push_back(lu::intermediate::emplace_intrinsic(lu::I64ADD, ip.context().symbols().find_intrinsic_id("i64add"), sn, 0, minus_one));
+    code.push_back(branch(14, 5, nullptr));
+    code.push_back(lu::intermediate::emplace_store_symbol(sc, lu::intermediate_slot::SCALAR, 5, lu::make_unique(new lu::intermediate(load(ip, sa, 1)))));
+    code.push_back(intrinsic(ip, lu::I64PRINT, "i64print", lu::symbol::INVALID_ID, sc, 0, 5));
+    code.push_back(lu::intermediate::create_halt());
+
+    ip.rewrite(lu::move(code));
+    ip.frame(lu::intermediate_frame::TOP) = lu::intermediate_frame(0, 6, 0);
+}
+
+// runs the program nrun times, returns the output of the last run
+std::string run(const lu::intermediate_program& ip, size_t nrun, double* p_seconds)
+{
+    std::ostringstream out;
+    std::streambuf* p_cout = std::cout.rdbuf(out.rdbuf());
+    lu::stopwatch sw;
+    sw.start();
+    for (size_t k = 0; k < nrun; ++k)
+    {
+        out.str("");
+        lu::bench::run(&ip);
+    }
+    *p_seconds = sw.lap().count() / static_cast<double>(nrun);
+    std::cout.rdbuf(p_cout);
+    return out.str();
+}
+
+// one profiled run, output dropped
+void profile(const lu::intermediate_program& ip, lu::edge_profile* p_edges)
+{
+    std::ostringstream out;
+    std::streambuf* p_cout = std::cout.rdbuf(out.rdbuf());
+    lu::interpret_settings settings;
+    settings.p_edges = p_edges;
+    lu::bench::run(&ip, settings);
+    std::cout.rdbuf(p_cout);
+}
+
+}
+
+int main(int, char**)
+{
+    lu::source src = lu::source::from_string("layout.lu", SYMBOLS_SCRIPT);
+    lu::intermediate_program ip;
+    make_loop(&src, &ip);
+
+    lu::control_flow_graph cfg(ip);
+    size_t nlooped = 0;
+    for (lu::cfg_block_id id = 0; id < cfg.size(); ++id)
+    {
+        nlooped += cfg.loop_depth(id) != 0 ? 1 : 0;
+    }
+    std::cout << "cfg: " << cfg.size() << " blocks, " << cfg.loop_count() << " loops, " << nlooped << " blocks in loops\n";
+    if (cfg.loop_count() != 1)
+    {
+        std::cerr << "bench: expected one loop\n";
+        return 1;
+    }
+
+    lu::edge_profile edges;
+    profile(ip, &edges);
+
+    enum { WRITTEN, STATIC, PROFILED };
+    const char* names[] = { "as written", "static", "profiled" };
+    std::string expected;
+    uint64_t ntaken_written = 0;
+    for (int kind : { WRITTEN, STATIC, PROFILED })
+    {
+        lu::intermediate_program laid_out;
+        make_loop(&src, &laid_out);
+        lu::layout_stats stats;
+        if (kind != WRITTEN && !ok(lu::layout_blocks(&laid_out, kind == PROFILED ? &edges : nullptr, &stats)))
+        {
+            std::cerr << "bench: layout skipped\n";
+            return 1;
+        }
+
+        lu::edge_profile after;
+        profile(laid_out, &after);
+        lu::fuse(&laid_out);
+        lu::lower_intrinsics(&laid_out);
+        double seconds = 0;
+        std::string output = run(laid_out, 20, &seconds);
+        if (kind == WRITTEN)
+        {
+            expected = output;
+            ntaken_written = after.taken_total();
+        }
+        else if (output != expected)
+        {
+            std::cerr << "bench: " << names[kind] << " layout output differs\n";
+            return 1;
+        }
+        else if (after.taken_total() >= ntaken_written)
+        {
+            std::cerr << "bench: " << names[kind] << " layout takes no fewer branches\n";
+            return 1;
+        }
+        std::cout << names[kind] << ": " << after.taken_total() << " taken branches, " << seconds * 1000 << " ms/run";
+        if (kind != WRITTEN)
+        {
+            std::cout << " (" << to_string(stats) << ")";
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
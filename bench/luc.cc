@@ -0,0 +1,223 @@
+#include "bench.h"
+#include "bytecode.h"
+#include "optimize.h"
+#include "inline.h"
+#include "layout.h"
+#include "fuse.h"
+#include "lower.h"
+#include "timer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+// .luc startup benchmark: large scripts (every intrinsic, aggregates and fused arithmetic) are started from source,
+// read and compiled through the -O2 passes like the driver does, and from their .luc file, mapped and loaded. the
+// loaded program must write the same .luc again and print the same output, then both startup times are reported.
+// damaged files must be rejected.
+
+namespace
+{
+
+struct corpus_script
+{
+    const char* name;
+    const char* header;
+    const char* body; // repeated
+};
+
+const corpus_script CORPUS[] =
+{
+    {
+        "intrinsics",
+        "a: int32 = 7; b: int32 = 3\nc: int64 = 9000000000; d: int64 = 2\ne: uint32 = 4000000000; f: uint32 = 1\n"
+        "g: uint64 = 18000000000000000000; h: uint64 = 5\np: bool = true; q: bool = false\nnl: ascii = \"\\n\"\n",
+        "$i32add(a, b); $i32add(a, 1); $i32print(a); $i32print(12); $asciiprint(nl)\n"
+        "$i64add(c, d); $i64add(c, 10); $i64add(c, 9000000000); $i64print(c); $i64print(34); $asciiprint(nl)\n"
+        "$u32add(e, f); $u32add(e, 300000000); $u32print(e); $u32print(56); $asciiprint(nl)\n"
+        "$u64add(g, h); $u64add(g, 7); $u64print(g); $u64print(78); $asciiprint(nl)\n"
+        "$lneg(p); $bprint(p); $lor(p, q); $bprint(p); $lor(q, true); $bprint(q); $land(p, q); $bprint(p); $land(q, false); $bprint(q); $asciiprint(nl)\n",
+    },
+    {
+        // tuples are aggregates and pooled constants
+        "mixed",
+        "eol: ascii = \"\\n\"\nc: int64 = 4\nd: int64 = 96\nb: bool = false\nt = (c, d)\nu = t\n",
+        "{\n    a: int32 = 3\n    $i32print(a), 123.99, \"abc\"\n}\nt = (c, d); u = t\n$i64add(c, d); $i64print(c); $lneg(b); $bprint(b); $asciiprint(eol)\n",
+    },
+    {
+        "arith",
+        "a: int64 = 1\nb: int64 = 2\nc: int64 = 0\nf: bool = false\nnl: ascii = \"\\n\"\n",
+        "a = 1; b = 2\n$i64add(a, b); $i64add(b, a); $i64add(a, b)\nc = a; $lneg(f)\n$i64print(c); $bprint(f); $asciiprint(nl)\n",
+    },
+};
+
+const size_t NREPEAT = 1000;
+const size_t NRUN = 3;
+const char* LU_PATH = "/tmp/lu_bench_luc.lu";
+const char* LUC_PATH = "/tmp/lu_bench_luc.luc";
+
+lu::string make_script(const corpus_script& cs, size_t nrepeat)
+{
+    lu::string s(cs.header);
+    for (size_t i = 0; i < nrepeat; ++i)
+    {
+        s.append(cs.body);
+    }
+    return s;
+}
+
+size_t count_lines(lu::string_view s)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        n += s[i] == '\n';
+    }
+    return n;
+}
+
+// what the driver does for a file at -O2. the source must outlive the program
+void compile_o2(const lu::source* p_src, lu::intermediate_program* p_ip)
+{
+    lu::bench::compile(p_src, p_ip);
+    lu::optimize_settings settings(lu::optimize_level::O2);
+    lu::inline_calls(p_ip);
+    lu::optimize(p_ip, settings);
+    lu::layout_blocks(p_ip);
+    lu::fuse(p_ip);
+    lu::lower_intrinsics(p_ip);
+}
+
+std::string output(const lu::intermediate_program& ip)
+{
+    std::ostringstream out;
+    std::streambuf* p_cout = std::cout.rdbuf(out.rdbuf());
+    lu::bench::run(&ip);
+    std::cout.rdbuf(p_cout);
+    return out.str();
+}
+
+bool load(lu::string_view path, lu::intermediate_program* p_ip, lu::bytecode_stats* p_stats = nullptr)
+{
+    lu::diag_logger log(lu::diag::ERROR_LEVEL);
+    lu::bytecode_image image;
+    if (!ok(lu::bytecode_map(path, &image, &log)) || !ok(lu::bytecode_load(image, p_ip, &log, p_stats)))
+    {
+        log.flush();
+        return false;
+    }
+    return true;
+}
+
+bool compare(const corpus_script& cs)
+{
+    lu::string script = make_script(cs, NREPEAT);
+    {
+        std::ofstream file(LU_PATH, std::ios::binary);
+        file.write(script.buffer(), static_cast<std::streamsize>(script.size()));
+    }
+
+    // both keep the program of their last run
+    lu::intermediate_program compiled;
+    lu::stopwatch sw;
+    sw.start();
+    for (size_t k = 0; k < NRUN; ++k)
+    {
+        std::ifstream file(LU_PATH);
+        lu::source src = lu::source::from_stream(LU_PATH, file);
+        compiled = lu::intermediate_program();
+        compile_o2(&src, &compiled);
+    }
+    double source_seconds = sw.lap().count() / static_cast<double>(NRUN);
+
+    lu::diag_logger log(lu::diag::ERROR_LEVEL);
+    if (!ok(lu::bytecode_save(&compiled, LUC_PATH, &log)))
+    {
+        log.flush();
+        std::cerr << "bench: " << cs.name << " has no .luc\n";
+        return false;
+    }
+
+    lu::intermediate_program loaded;
+    lu::bytecode_stats stats;
+    sw.start();
+    for (size_t k = 0; k < NRUN; ++k)
+    {
+        if (!load(LUC_PATH, &loaded, &stats))
+        {
+            std::cerr << "bench: " << cs.name << " .luc did not load\n";
+            return false;
+        }
+    }
+    double luc_seconds = sw.lap().count() / static_cast<double>(NRUN);
+
+    lu::vector<uint8_t> written;
+    lu::vector<uint8_t> rewritten;
+    if (!ok(lu::bytecode_write(&compiled, &written, &log)) || !ok(lu::bytecode_write(&loaded, &rewritten, &log)) || written != rewritten)
+    {
+        log.flush();
+        std::cerr << "bench: " << cs.name << " .luc differs once loaded\n";
+        return false;
+    }
+    std::string expected = output(compiled);
+    std::string actual = output(loaded);
+    if (actual != expected)
+    {
+        std::cerr << "bench: " << cs.name << " output differs once loaded:\n" << actual << "\nfrom source:\n" << expected << "\n";
+        return false;
+    }
+
+    std::cout << cs.name << ": " << count_lines(script) << " lines, source " << source_seconds * 1000 << " ms, .luc "
+        << luc_seconds * 1000 << " ms (" << source_seconds / luc_seconds << "x, " << to_string(stats) << ")\n";
+    return true;
+}
+
+// the .luc at LUC_PATH, damaged by f, must not load
+template <typename FunctionT>
+bool rejects(const char* what, FunctionT f)
+{
+    std::ifstream in(LUC_PATH, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    f(&bytes);
+    const char* path = "/tmp/lu_bench_luc_damaged.luc";
+    {
+        std::ofstream out(path, std::ios::binary);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+
+    lu::intermediate_program ip;
+    lu::diag_logger log(lu::diag::MAX_LEVEL);
+    lu::bytecode_image image;
+    bool loaded = ok(lu::bytecode_map(path, &image, &log)) && ok(lu::bytecode_load(image, &ip, &log));
+    std::remove(path);
+    if (loaded)
+    {
+        std::cerr << "bench: loaded a .luc with " << what << "\n";
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main(int, char**)
+{
+    for (const corpus_script& cs : CORPUS)
+    {
+        if (!compare(cs))
+        {
+            return 1;
+        }
+    }
+
+    // the header is magic, version, byte order, then the size. it is 184 bytes, the first intermediate follows
+    bool rejected = rejects("no magic", [](std::string* p) { (*p)[0] = 'x'; })
+        && rejects("another version", [](std::string* p) { (*p)[4] = static_cast<char>((*p)[4] + 1); })
+        && rejects("another byte order", [](std::string* p) { std::swap((*p)[8], (*p)[11]); })
+        && rejects("a short read", [](std::string* p) { p->resize(p->size() / 2); })
+        && rejects("a bad op", [](std::string* p) { (*p)[184] = static_cast<char>(0x7f); });
+    std::remove(LU_PATH);
+    std::remove(LUC_PATH);
+    return rejected ? 0 : 1;
+}
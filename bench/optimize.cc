@@ -0,0 +1,192 @@
+#include "bench.h"
+#include "optimize.h"
+#include "fuse.h"
+#include "lower.h"
+#include "timer.h"
+
+#include <functional>
+#include <sstream>
+
+// optimizer benchmark: compiles straight line scripts and a hand built loop (the front end has no control flow yet)
+// at each optimization level, checks that the printed output matches the unoptimized program and reports the
+// intermediate count and run time per level.
+
+namespace
+{
+
+struct corpus_script
+{
+    const char* name;
+    const char* header;
+    const char* body; // repeated
+};
+
+const corpus_script CORPUS[] =
+{
+    {
+        // stores constants, then overwrites them
+        "overwrite",
+        "a: int64 = 0\nb: int64 = 0\nf: bool = false\neol: ascii = \"\\n\"\n",
+        "a = 1; b = 2; a = 3; f = true\n$i64add(a, b); $lneg(f)\n$i64print(a); $bprint(f); $asciiprint(eol)\n",
+    },
+    {
+        // copies of registers that change afterwards
+        "copies",
+        "i: int64 = 0\nj: int64 = 0\nk: int64 = 0\nstep: int64 = 3\n",
+        "$i64add(i, step); j = i; k = j; $i64add(i, step)\n$i64print(k); $i64print(i)\n",
+    },
+};
+
+lu::string make_script(const corpus_script& cs, size_t nrepeat)
+{
+    lu::string s(cs.header);
+    for (size_t i = 0; i < nrepeat; ++i)
+    {
+        s.append(cs.body);
+    }
+    return s;
+}
+
+const char* LOOP_SYMBOLS_SCRIPT = "n: int64 = 0\na: int64 = 0\nstep: int64 = 0\nf: bool = false\nc: int64 = 0\n";
+
+lu::symbol_id find(lu::intermediate_program& ip, lu::string_view name)
+{
+    lu::symbol_table& syms = ip.context().symbols();
+    return syms.find_local(syms.top(), name);
+}
+
+lu::intermediate load(const lu::intermediate_program& ip, lu::symbol_id sid, lu::intermediate_register reg)
+{
+    return lu::intermediate::emplace_load_symbol(sid, ip.context().symbols()[sid].tid, lu::intermediate_slot::SCALAR, reg);
+}
+
+lu::intermediate store_constant(lu::intermediate_program& ip, lu::symbol_id sid, lu::intermediate_register reg, uint64_t bits)
+{
+    lu::intermediate_value val(ip.context().symbols()[sid].tid);
+    lu::scalar_value sv;
+    sv.bits = bits;
+    lu::set_scalar(&val.bin, sv);
+    return lu::intermediate::emplace_store_symbol(sid, lu::intermediate_slot::SCALAR, reg, lu::make_unique(new lu::intermediate(ip.make_load_constant(lu::move(val)))));
+}
+
+lu::intermediate branch(lu::intermediate_addr from, lu::intermediate_addr to, lu::unique<lu::intermediate>&& cond)
+{
+    return lu::intermediate::emplace_branch(from, lu::move(cond), to >= from
+        ? lu::intermediate_branch::branch_offset(lu::intermediate_branch::branch_offset::POSITIVE, to - from)
+        : lu::intermediate_branch::branch_offset(lu::intermediate_branch::branch_offset::NEGATIVE, from - to));
+}
+
+lu::intermediate intrinsic(lu::intermediate_program& ip, lu::intrinsic_code icode, const char* name, lu::symbol_id dest, lu::symbol_id op, lu::intermediate_register dest_reg, lu::intermediate_register op_reg)
+{
+    return lu::intermediate::emplace_intrinsic(icode, ip.context().symbols().find_intrinsic_id(name), dest, op, dest_reg, op_reg);
+}
+
+// n = 100000; a = 0; step = 1; f = false
+// if f: print n                  (never runs)
+// while n: a += step; n += -1
+// c = a; print c
+void make_loop(const lu::source* p_src, lu::intermediate_program* p_ip)
+{
+    lu::intermediate_program& ip = *p_ip;
+    lu::bench::compile(p_src, &ip);
+    lu::symbol_id sn = find(ip, "n");
+    lu::symbol_id sa = find(ip, "a");
+    lu::symbol_id sstep = find(ip, "step");
+    lu::symbol_id sf = find(ip, "f");
+    lu::symbol_id sc = find(ip, "c");
+    lu::scalar_value minus_one;
+    minus_one.i64 = -1;
+
+    // n s0, a s1, step s2, f s3, c s4
+    lu::vector<lu::intermediate> code;
+    code.push_back(store_constant(ip, sn, 0, 100000));
+    code.push_back(store_constant(ip, sa, 1, 0));
+    code.push_back(store_constant(ip, sstep, 2, 1));
+    code.push_back(store_constant(ip, sf, 3, 0));
+    code.push_back(branch(4, 6, lu::make_unique(new lu::intermediate(load(ip, sf, 3)))));
+    code.push_back(branch(5, 7, nullptr));
+    code.push_back(intrinsic(ip, lu::I64PRINT, "i64print", lu::symbol::INVALID_ID, sn, 0, 0));
+    // loop header
+    code.push_back(branch(7, 9, lu::make_unique(new lu::intermediate(load(ip, sn, 0)))));
+    code.push_back(branch(8, 13, nullptr));
+    code.push_back(intrinsic(ip, lu::I64ADD, "i64add", sa, sstep, 1, 2));
+    code.push_back(lu::intermediate::emplace_intrinsic(lu::I64ADD, ip.context().symbols().find_intrinsic_id("i64add"), sn, 0, minus_one));
+    code.push_back(branch(11, 7, nullptr));
+    code.push_back(lu::intermediate::create_halt()); // not reached
+    code.push_back(lu::intermediate::emplace_store_symbol(sc, lu::intermediate_slot::SCALAR, 4, lu::make_unique(new lu::intermediate(load(ip, sa, 1)))));
+    code.push_back(intrinsic(ip, lu::I64PRINT, "i64print", lu::symbol::INVALID_ID, sc, 0, 4));
+    code.push_back(lu::intermediate::create_halt());
+
+    ip.rewrite(lu::move(code));
+    ip.frame(lu::intermediate_frame::TOP) = lu::intermediate_frame(0, 5, 0);
+}
+
+// runs the program nrun times, returns the output of the last run
+std::string run(const lu::intermediate_program& ip, size_t nrun, double* p_seconds)
+{
+    std::ostringstream out;
+    std::streambuf* p_cout = std::cout.rdbuf(out.rdbuf());
+    lu::stopwatch sw;
+    sw.start();
+    for (size_t k = 0; k < nrun; ++k)
+    {
+        out.str("");
+        lu::bench::run(&ip);
+    }
+    *p_seconds = sw.lap().count() / static_cast<double>(nrun);
+    std::cout.rdbuf(p_cout);
+    return out.str();
+}
+
+// false if the output of some level differs from O0
+bool compare_levels(lu::string_view name, std::function<void(lu::intermediate_program*)> build, size_t nrun)
+{
+    const lu::optimize_level levels[] = { lu::optimize_level::O0, lu::optimize_level::O1, lu::optimize_level::O2 };
+    std::string expected;
+    for (lu::optimize_level level : levels)
+    {
+        lu::intermediate_program ip;
+        build(&ip);
+        lu::optimize_stats stats;
+        lu::optimize(&ip, lu::optimize_settings(level), &stats);
+        size_t ninsts = ip.size();
+        lu::fuse(&ip);
+        lu::lower_intrinsics(&ip);
+
+        double seconds = 0;
+        std::string output = run(ip, nrun, &seconds);
+        if (level == lu::optimize_level::O0)
+        {
+            expected = output;
+        }
+        else if (output != expected)
+        {
+            std::cerr << "bench: " << name << " -" << lu::optimize_level_cstr(level) << " output differs from -O0\n";
+            return false;
+        }
+        std::cout << name << " -" << lu::optimize_level_cstr(level) << ": " << ninsts << " intermediates, "
+            << seconds * 1000 << " ms/run (" << to_string(stats) << ")\n";
+    }
+    return true;
+}
+
+}
+
+int main(int, char**)
+{
+    for (const corpus_script& cs : CORPUS)
+    {
+        lu::source src = lu::source::from_string(lu::string::join(cs.name, ".lu"), make_script(cs, 1000));
+        if (!compare_levels(cs.name, [&](lu::intermediate_program* p_ip) { lu::bench::compile(&src, p_ip); }, 100))
+        {
+            return 1;
+        }
+    }
+
+    lu::source src = lu::source::from_string("loop.lu", LOOP_SYMBOLS_SCRIPT);
+    if (!compare_levels("loop", [&](lu::intermediate_program* p_ip) { make_loop(&src, p_ip); }, 10))
+    {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include "bench.h"
+#include "parallel.h"
+#include "optimize.h"
+#include "inline.h"
+#include "layout.h"
+#include "fuse.h"
+#include "lower.h"
+
+#include <sstream>
+#include <thread>
+
+// parallel execution benchmark: one large script is compiled through the -O2 passes once, then many instances of it
+// run on schedulers of 1, 2, 4 .. threads up to the hardware threads (at least 2, so the sharing is checked on one core
+// too). every instance must print what a run on this thread does, then instances per second and the scaling
+// efficiency (speedup over 1 thread, per thread) of each scheduler are reported
+
+namespace
+{
+
+const char* HEADER =
+    "a: int32 = 7; b: int32 = 3\nc: int64 = 9000000000; d: int64 = 2\ne: uint32 = 4000000000; f: uint32 = 1\n"
+    "g: uint64 = 18000000000000000000; h: uint64 = 5\np: bool = true; q: bool = false\nnl: ascii = \"\\n\"\n"
+    "t = (c, d)\nu = t\n";
+const char* BODY =
+    "$i32add(a, b); $i32add(a, 1); $i32print(a); $asciiprint(nl)\n"
+    "$i64add(c, d); $i64add(c, 10); $i64print(c); $asciiprint(nl)\n"
+    "$u32add(e, f); $u32add(e, 300000000); $u32print(e); $asciiprint(nl)\n"
+    "$u64add(g, h); $u64print(g); $asciiprint(nl)\n"
+    "$lneg(p); $bprint(p); $lor(p, q); $land(q, false); $bprint(q); $asciiprint(nl)\nt = (c, d); u = t\n";
+const size_t NREPEAT = 500;
+const size_t NINSTANCES = 256;
+
+// what the driver does for a file at -O2. the source must outlive the program
+void compile_o2(const lu::source* p_src, lu::intermediate_program* p_ip)
+{
+    lu::bench::compile(p_src, p_ip);
+    lu::optimize_settings settings(lu::optimize_level::O2);
+    lu::inline_calls(p_ip);
+    lu::optimize(p_ip, settings);
+    lu::layout_blocks(p_ip);
+    lu::fuse(p_ip);
+    lu::lower_intrinsics(p_ip);
+}
+
+lu::string reference(const lu::intermediate_program& ip)
+{
+    lu::memory_sink out;
+    lu::intermediate_interpreter_state iis;
+    iis.set_out(&out);
+    lu::bench::run(&ip, &iis);
+    return out.str();
+}
+
+bool run_scheduler(const lu::intermediate_program& ip, const lu::string& expected, size_t nthreads, double* p_rate)
+{
+    lu::task_scheduler sched(nthreads);
+    lu::parallel_settings settings;
+    lu::vector<lu::parallel_run> runs;
+    lu::parallel_stats stats;
+    lu::run_parallel(&ip, NINSTANCES, &sched, settings, &runs, &stats);
+    for (size_t i = 0; i < runs.size(); ++i)
+    {
+        if (!ok(runs[i].res) || runs[i].output != expected || !runs[i].diags.empty())
+        {
+            std::cerr << "bench: instance " << i << " of " << nthreads << " threads differs from a run alone, diagnostics:\n"
+                << runs[i].diags << "\n";
+            return false;
+        }
+    }
+    if (runs.size() != NINSTANCES || stats.threads != nthreads || stats.failures != 0)
+    {
+        std::cerr << "bench: " << to_string(stats) << "\n";
+        return false;
+    }
+    *p_rate = static_cast<double>(NINSTANCES) / stats.seconds;
+    return true;
+}
+
+bool run()
+{
+    lu::string script(HEADER);
+    for (size_t i = 0; i < NREPEAT; ++i)
+    {
+        script.append(BODY);
+    }
+    std::istringstream text(std::string(script.buffer(), script.size()));
+    lu::source src = lu::source::from_stream("parallel", text);
+    lu::intermediate_program ip;
+    compile_o2(&src, &ip);
+    lu::string expected = reference(ip);
+
+    size_t hardware = std::thread::hardware_concurrency();
+    size_t most = hardware > 2 ? hardware : 2;
+    std::cout << NINSTANCES << " instances of " << ip.size() << " intermediates, " << hardware << " hardware threads\n";
+    double base = 0;
+    for (size_t nthreads = 1; ; nthreads = nthreads * 2 < most ? nthreads * 2 : most)
+    {
+        double rate;
+        if (!run_scheduler(ip, expected, nthreads, &rate))
+        {
+            return false;
+        }
+        if (nthreads == 1)
+        {
+            base = rate;
+        }
+        double speedup = rate / base;
+        std::cout << nthreads << " threads: " << rate << " instances/s, " << speedup << "x, "
+            << speedup / static_cast<double>(nthreads) * 100 << "% efficiency\n";
+        if (nthreads == most)
+        {
+            break;
+        }
+    }
+    return true;
+}
+
+}
+
+int main()
+{
+    return run() ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+#include "bench.h"
+#include "scheduler.h"
+#include "timer.h"
+
+#include <stdexcept>
+#include <thread>
+
+// task scheduler benchmark: the cost of spawning and waiting on empty tasks, from outside the scheduler (through the
+// injection queue) and from a task (through a worker's deque, when a worker rather than the waiting thread runs it),
+// then fork-join scaling of a compute loop split by parallel_for and of recursive tasks, on 1, 2, 4 .. threads up to
+// the hardware threads (at least 2). results must match a run on this thread. last, independent scripts are lexed,
+// parsed, analyzed, compiled and run as tasks of one scheduler, each printing what it does compiled alone
+
+namespace
+{
+
+const size_t NSPAWN = 1000; // tasks per timed round
+const size_t NWORK = 1 << 16; // indices of the compute loop
+const size_t NSCRIPTS = 64;
+
+size_t most_threads()
+{
+    size_t hardware = std::thread::hardware_concurrency();
+    return hardware > 2 ? hardware : 2;
+}
+
+uint64_t mix(uint64_t x)
+{
+    for (int k = 0; k < 64; ++k)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+    }
+    return x;
+}
+
+uint64_t fib(lu::task_scheduler* p_sched, int n)
+{
+    if (n < 16)
+    {
+        return n < 2 ? static_cast<uint64_t>(n) : fib(p_sched, n - 1) + fib(p_sched, n - 2);
+    }
+    lu::task_future<uint64_t> left = p_sched->submit([=] { return fib(p_sched, n - 1); });
+    uint64_t right = fib(p_sched, n - 2);
+    return left.get() + right;
+}
+
+void time_spawn()
+{
+    lu::task_scheduler sched(most_threads());
+    lu::profile::time_settings ts;
+    ts.sizes = { 10, 100 };
+    ts.name = "spawn and wait 1000 tasks, injected";
+    lu::profile::time([&]()
+    {
+        lu::vector<lu::task_future<void>> futures;
+        futures.reserve(NSPAWN);
+        for (size_t i = 0; i < NSPAWN; ++i)
+        {
+            futures.push_back(sched.submit([] {}));
+        }
+        for (lu::task_future<void>& f : futures)
+        {
+            f.get();
+        }
+    }, ts, std::cout);
+
+    ts.name = "spawn and wait 1000 tasks, from a task";
+    lu::profile::time([&]()
+    {
+        sched.submit([&]
+        {
+            lu::vector<lu::task_future<void>> futures;
+            futures.reserve(NSPAWN);
+            for (size_t i = 0; i < NSPAWN; ++i)
+            {
+                futures.push_back(sched.submit([] {}));
+            }
+            for (lu::task_future<void>& f : futures)
+            {
+                f.get();
+            }
+        }).get();
+    }, ts, std::cout);
+    std::cout << to_string(sched.stats()) << "\n";
+}
+
+bool time_fork_join()
+{
+    lu::vector<uint64_t> expected(NWORK);
+    for (size_t i = 0; i < NWORK; ++i)
+    {
+        expected[i] = mix(i);
+    }
+    size_t most = most_threads();
+    for (size_t nthreads = 1; ; nthreads = nthreads * 2 < most ? nthreads * 2 : most)
+    {
+        lu::task_scheduler sched(nthreads);
+        lu::vector<uint64_t> actual(NWORK);
+        lu::profile::time_settings ts;
+        ts.sizes = { 1, 10 };
+        lu::string name = lu::string::join("parallel_for, ", lu::to_string(nthreads), " threads");
+        ts.name = name;
+        lu::profile::time([&]()
+        {
+            sched.parallel_for(0, NWORK, 256, [&](size_t first, size_t last)
+            {
+                for (size_t i = first; i < last; ++i)
+                {
+                    actual[i] = mix(i);
+                }
+            });
+        }, ts, std::cout);
+        if (actual != expected)
+        {
+            std::cerr << "bench: parallel_for on " << nthreads << " threads differs\n";
+            return false;
+        }
+
+        uint64_t result = 0;
+        name = lu::string::join("recursive fib(27), ", lu::to_string(nthreads), " threads");
+        ts.name = name;
+        lu::profile::time([&]() { result = fib(&sched, 27); }, ts, std::cout);
+        if (result != 196418)
+        {
+            std::cerr << "bench: fib(27) on " << nthreads << " threads is " << result << "\n";
+            return false;
+        }
+        std::cout << to_string(sched.stats()) << "\n";
+        if (nthreads == most)
+        {
+            break;
+        }
+    }
+
+    lu::task_scheduler sched(most);
+    bool caught = false;
+    try
+    {
+        sched.parallel_for(0, 64, 1, [](size_t first, size_t) { if (first == 37) { throw std::runtime_error("37"); } });
+    }
+    catch (const std::runtime_error& e)
+    {
+        caught = lu::string_view(e.what()) == lu::string_view("37");
+    }
+    if (!caught)
+    {
+        std::cerr << "bench: an exception of a task was lost\n";
+        return false;
+    }
+    return true;
+}
+
+lu::string script(size_t k)
+{
+    return lu::string::join(
+        "a: int64 = ", lu::to_string(k), "\nb: int64 = ", lu::to_string(k * 7), "\nnl: ascii = \"\\n\"\n",
+        "$i64add(a, b); $i64print(a); $asciiprint(nl)\nt = (a, b)\nu = t\np: bool = true\n$lneg(p); $bprint(p); $asciiprint(nl)\n");
+}
+
+// every phase of one script, on whatever thread runs it
+lu::string compile_and_run(const lu::analyze_context& builtins, size_t k)
+{
+    lu::source src = lu::source::from_string(lu::string::join("s", lu::to_string(k), ".lu"), script(k));
+    lu::diag_logger log(lu::diag::ERROR_LEVEL);
+    lu::parse_expr_tree pet;
+    lu::analyze_expr_tree aet(builtins);
+    lu::intermediate_program ip;
+    if (!ok(lu::parse(&src, &pet, &log)) || !ok(lu::analyze(&pet, &aet, &log)) || !ok(lu::intermediate_transform(&aet, &ip, &log)))
+    {
+        return "failed to compile";
+    }
+    lu::memory_sink out;
+    lu::intermediate_interpreter_state iis;
+    iis.set_out(&out);
+    if (!ok(lu::interpret(&ip, &iis, 0, &log)))
+    {
+        return "failed to run";
+    }
+    return out.str();
+}
+
+bool check_phases()
+{
+    lu::analyze_context builtins = lu::builtin_context();
+    lu::task_scheduler sched(most_threads());
+    lu::vector<lu::task_future<lu::string>> futures;
+    for (size_t k = 0; k < NSCRIPTS; ++k)
+    {
+        futures.push_back(sched.submit([&builtins, k] { return compile_and_run(builtins, k); }));
+    }
+    for (size_t k = 0; k < NSCRIPTS; ++k)
+    {
+        lu::string expected = compile_and_run(builtins, k);
+        lu::string actual = futures[k].get();
+        if (actual != expected)
+        {
+            std::cerr << "bench: script " << k << " printed\n" << actual << "\nas a task, alone\n" << expected << "\n";
+            return false;
+        }
+    }
+    std::cout << NSCRIPTS << " scripts compiled and run as tasks, " << to_string(sched.stats()) << "\n";
+    return true;
+}
+
+}
+
+int main()
+{
+    time_spawn();
+    return time_fork_join() && check_phases() ? 0 : 1;
+}
@@ -0,0 +1,304 @@
+#include "bench.h"
+#include "server.h"
+#include "timer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// server latency benchmark: tiny scripts are run one process each (main -O2 file, the way they are run without a
+// server), through lu_client against a warm main -O2 --serve, and as requests from this process. the output of every
+// request must match the driver's, then the mean latency of each is reported. failing scripts, unreadable paths and
+// paths outside the server's root (/tmp) must report their exit code, and a client that connects and stalls must not
+// hold up the next past the server's timeout. main and lu_client are expected next to this bench (make all bench)
+
+namespace
+{
+
+const char* const SCRIPTS[] =
+{
+    "a: int64 = 1\nb: int64 = 2\nnl: ascii = \"\\n\"\n$i64add(a, b); $i64print(a); $asciiprint(nl)\n",
+    "p: bool = true; q: bool = false\n$lor(q, p); $bprint(q); $lneg(p); $bprint(p)\nt = (1, 2)\nu = t\n",
+    "e: uint32 = 4000000000; f: uint32 = 1\n{\n    $u32add(e, f)\n    $u32print(e)\n}\n$u32print(56)\n",
+};
+const size_t NSCRIPTS = sizeof(SCRIPTS) / sizeof(SCRIPTS[0]);
+const size_t NREQUESTS = 30; // per way, round robin over the scripts
+const char* SOCKET_PATH = "/tmp/lu_bench_server.sock";
+const char* TIMEOUT_MS = "200";
+
+lu::string script_path(size_t k)
+{
+    return lu::string::join("/tmp/lu_bench_server_", lu::to_string(k), ".lu");
+}
+
+// exit code, or -1 if it did not exit. output and diagnostics are dropped
+int spawn(const char* const* argv)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, 1);
+        dup2(null, 2);
+        execv(argv[0], const_cast<char* const*>(argv));
+        _exit(127);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+    {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+// the driver's output around the program's is dropped
+std::string driver_output(const lu::string& main_path, const lu::string& path)
+{
+    std::string out;
+    FILE* p_pipe = popen(lu::string::join(main_path, " -O2 ", path, " 2>/dev/null").buffer(), "r");
+    if (!p_pipe)
+    {
+        return out;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), p_pipe)) > 0)
+    {
+        out.append(buf, n);
+    }
+    pclose(p_pipe);
+    const std::string begin = ">>\n";
+    const std::string end = "END\n";
+    if (out.compare(0, begin.size(), begin) == 0 && out.size() >= begin.size() + end.size())
+    {
+        out = out.substr(begin.size(), out.size() - begin.size() - end.size());
+    }
+    return out;
+}
+
+int request(lu::server_frame kind, lu::string_view payload, std::string* p_out, std::string* p_err = nullptr)
+{
+    std::ostringstream out;
+    std::ostringstream err;
+    int code = -1;
+    lu::diag_logger log(lu::diag::MAX_LEVEL);
+    if (!ok(lu::server_request(SOCKET_PATH, kind, payload, out, err, &code, &log)))
+    {
+        return -1;
+    }
+    *p_out = out.str();
+    if (p_err)
+    {
+        *p_err = err.str();
+    }
+    return code;
+}
+
+bool wait_for_server()
+{
+    for (size_t k = 0; k < 500; ++k)
+    {
+        std::string out;
+        if (request(lu::server_frame::SOURCE, "", &out) == 0)
+        {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+// connected, with 2 of the 5 bytes of a frame header sent
+int stalled_client()
+{
+    sockaddr_un addr = sockaddr_un();
+    addr.sun_family = AF_UNIX;
+    for (size_t i = 0; SOCKET_PATH[i]; ++i)
+    {
+        addr.sun_path[i] = SOCKET_PATH[i];
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || write(fd, "s\0", 2) != 2)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+bool check_failures(const std::string& expected)
+{
+    std::string out;
+    std::string err;
+    int code = request(lu::server_frame::SOURCE, "a: int64 = \n(", &out, &err);
+    if (code == 0 || code == -1 || err.empty())
+    {
+        std::cerr << "bench: a broken script exited " << code << " with diagnostics \"" << err << "\"\n";
+        return false;
+    }
+    code = request(lu::server_frame::PATH, "lu_bench_server_missing.lu", &out, &err);
+    if (code != 1)
+    {
+        std::cerr << "bench: a missing path exited " << code << "\n";
+        return false;
+    }
+    code = request(lu::server_frame::PATH, "lu_bench_server_0.lu", &out, &err);
+    if (code != 0 || out != expected)
+    {
+        std::cerr << "bench: a path inside the root exited " << code << " with output\n" << out << "\n";
+        return false;
+    }
+    // and through a symbolic link
+    const char* link = "/tmp/lu_bench_server_link.lu";
+    std::remove(link);
+    bool linked = symlink("/etc/passwd", link) == 0;
+    const char* const outside[] = { "../etc/passwd", "/etc/passwd", "./../tmp/../etc/passwd", "lu_bench_server_link.lu" };
+    for (const char* path : outside)
+    {
+        if (!linked && path == outside[3])
+        {
+            continue;
+        }
+        code = request(lu::server_frame::PATH, path, &out, &err);
+        if (code != 1 || !out.empty())
+        {
+            std::cerr << "bench: " << path << ", outside the root, exited " << code << "\n";
+            std::remove(link);
+            return false;
+        }
+    }
+    std::remove(link);
+
+    int stalled = stalled_client();
+    if (stalled < 0)
+    {
+        std::cerr << "bench: cannot connect a stalled client\n";
+        return false;
+    }
+    lu::stopwatch sw;
+    sw.start();
+    code = request(lu::server_frame::SOURCE, SCRIPTS[0], &out);
+    double seconds = sw.lap().count();
+    close(stalled);
+    if (code != 0 || out != expected)
+    {
+        std::cerr << "bench: the request after a stalled client exited " << code << "\n";
+        return false;
+    }
+    std::cout << "request behind a stalled client: " << seconds * 1000 << " ms (timeout " << TIMEOUT_MS << " ms)\n";
+    return true;
+}
+
+}
+
+int main(int, char** argv)
+{
+    lu::string_view self(argv[0]);
+    size_t slash = self.size();
+    while (slash > 0 && self[slash - 1] != '/')
+    {
+        --slash;
+    }
+    lu::string dir = slash == 0 ? lu::string(".") : lu::string(self.subview(0, slash - 1));
+    lu::string main_path = lu::string::join(dir, "/main");
+    lu::string client_path = lu::string::join(dir, "/lu_client");
+    if (access(main_path.buffer(), X_OK) != 0 || access(client_path.buffer(), X_OK) != 0)
+    {
+        std::cerr << "bench: needs " << main_path << " and " << client_path << ", make all first\n";
+        return 1;
+    }
+
+    std::string expected[NSCRIPTS];
+    for (size_t k = 0; k < NSCRIPTS; ++k)
+    {
+        std::ofstream file(script_path(k).buffer(), std::ios::binary);
+        file << SCRIPTS[k];
+        file.close();
+        expected[k] = driver_output(main_path, script_path(k));
+    }
+
+    const char* server_argv[] = { main_path.buffer(), "-O2", "--serve", SOCKET_PATH, "--serve-root", "/tmp", "--serve-timeout", TIMEOUT_MS, nullptr };
+    pid_t server = fork();
+    if (server == 0)
+    {
+        execv(server_argv[0], const_cast<char* const*>(server_argv));
+        _exit(127);
+    }
+    if (server < 0 || !wait_for_server())
+    {
+        std::cerr << "bench: the server did not start\n";
+        return 1;
+    }
+
+    bool passed = true;
+    lu::stopwatch sw;
+    sw.start();
+    for (size_t i = 0; i < NREQUESTS && passed; ++i)
+    {
+        lu::string path = script_path(i % NSCRIPTS);
+        const char* process_argv[] = { main_path.buffer(), "-O2", path.buffer(), nullptr };
+        passed = spawn(process_argv) == 0;
+    }
+    double process_seconds = sw.lap().count() / static_cast<double>(NREQUESTS);
+
+    sw.start();
+    for (size_t i = 0; i < NREQUESTS && passed; ++i)
+    {
+        lu::string path = script_path(i % NSCRIPTS);
+        const char* client_argv[] = { client_path.buffer(), SOCKET_PATH, path.buffer(), nullptr };
+        passed = spawn(client_argv) == 0;
+    }
+    double client_seconds = sw.lap().count() / static_cast<double>(NREQUESTS);
+    if (!passed)
+    {
+        std::cerr << "bench: a script failed\n";
+    }
+
+    sw.start();
+    for (size_t i = 0; i < NREQUESTS && passed; ++i)
+    {
+        std::string out;
+        size_t k = i % NSCRIPTS;
+        if (request(lu::server_frame::SOURCE, SCRIPTS[k], &out) != 0 || out != expected[k])
+        {
+            std::cerr << "bench: script " << k << " output differs from the driver:\n" << out << "\ndriver:\n" << expected[k] << "\n";
+            passed = false;
+        }
+    }
+    double request_seconds = sw.lap().count() / static_cast<double>(NREQUESTS);
+
+    passed = passed && check_failures(expected[0]);
+
+    std::string out;
+    int status = 0;
+    if (request(lu::server_frame::SHUTDOWN, "", &out) != 0 || waitpid(server, &status, 0) != server || !WIFEXITED(status)
+        || WEXITSTATUS(status) != 0)
+    {
+        std::cerr << "bench: the server did not stop\n";
+        passed = false;
+    }
+    for (size_t k = 0; k < NSCRIPTS; ++k)
+    {
+        std::remove(script_path(k).buffer());
+    }
+    if (!passed)
+    {
+        return 1;
+    }
+
+    std::cout << "process per script: " << process_seconds * 1000 << " ms, lu_client: " << client_seconds * 1000
+        << " ms (" << process_seconds / client_seconds << "x), request: " << request_seconds * 1000 << " ms ("
+        << process_seconds / request_seconds << "x)\n";
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include "bench.h"
+#include "sink.h"
+#include "print.h"
+#include "lower.h"
+#include "timer.h"
+
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// output sink benchmark: a print heavy script runs with its output in memory, through a sink of a stream and
+// through a sink of a file descriptor (/dev/null), which must count one write(2) per buffer. the output must be the
+// same every way. then the integers the script prints are formatted like the print intrinsics did before sinks
+// (lu::print of lu::to_string on std::cout) and into a sink, both to /dev/null
+
+namespace
+{
+
+const char* HEADER = "a: int64 = 9000000000000000000\nb: uint64 = 18000000000000000000\nc: int32 = 7\np: bool = true\nnl: ascii = \"\\n\"\n";
+const char* BODY = "$i64add(a, 1234567); $i64print(a); $asciiprint(nl); $u64add(b, 7); $u64print(b); $asciiprint(nl)\n"
+    "$i32add(c, 3); $i32print(c); $bprint(p); $lneg(p); $asciiprint(nl)\n";
+const size_t NREPEAT = 2000;
+const size_t NRUN = 20;
+const size_t NVALUES = 1000000;
+
+// a file descriptor sink that counts its writes
+struct counting_sink : lu::fd_sink
+{
+    explicit counting_sink(int fd) : lu::fd_sink(fd), writes(0) {}
+    ~counting_sink() override { flush(); }
+
+    size_t writes;
+
+protected:
+    void drain(const char* p, size_t n) override
+    {
+        ++writes;
+        lu::fd_sink::drain(p, n);
+    }
+};
+
+double time_runs(const lu::intermediate_program& ip, lu::output_sink* p_sink)
+{
+    lu::stopwatch sw;
+    sw.start();
+    for (size_t k = 0; k < NRUN; ++k)
+    {
+        lu::intermediate_interpreter_state iis;
+        iis.set_out(p_sink);
+        lu::bench::run(&ip, &iis);
+        p_sink->flush();
+    }
+    return sw.lap().count() / static_cast<double>(NRUN);
+}
+
+bool compare(int null_fd)
+{
+    lu::string script(HEADER);
+    for (size_t i = 0; i < NREPEAT; ++i)
+    {
+        script.append(BODY);
+    }
+    lu::source src = lu::source::from_string("sink.lu", lu::move(script));
+    lu::intermediate_program ip;
+    lu::bench::compile(&src, &ip);
+    lu::lower_intrinsics(&ip);
+
+    lu::memory_sink memory;
+    double memory_seconds = time_runs(ip, &memory);
+    std::ostringstream captured;
+    {
+        lu::ostream_sink stream(captured);
+        time_runs(ip, &stream);
+    }
+    std::string text = captured.str();
+    if (lu::string_view(memory.str()) != lu::string_view(text.data(), text.size()))
+    {
+        std::cerr << "bench: the output in memory differs from the output through a stream\n";
+        return false;
+    }
+
+    std::ofstream null_stream("/dev/null");
+    lu::ostream_sink stream(null_stream);
+    double stream_seconds = time_runs(ip, &stream);
+    counting_sink fd(null_fd);
+    double fd_seconds = time_runs(ip, &fd);
+    size_t bytes = memory.str().size() / NRUN;
+    size_t expected_writes = NRUN * ((bytes + lu::output_sink::DEFAULT_CAPACITY - 1) / lu::output_sink::DEFAULT_CAPACITY);
+    if (fd.writes != expected_writes || fd.failed())
+    {
+        std::cerr << "bench: " << fd.writes << " writes of " << bytes << " bytes a run, expected " << expected_writes << "\n";
+        return false;
+    }
+    std::cout << NREPEAT * 7 << " prints (" << bytes << " bytes) a run: memory " << memory_seconds * 1000 << " ms, stream "
+        << stream_seconds * 1000 << " ms, fd " << fd_seconds * 1000 << " ms (" << fd.writes / NRUN << " writes a run)\n";
+    return true;
+}
+
+void time_format(int null_fd)
+{
+    // std::cout to /dev/null, the way the driver's stdout is when redirected
+    std::cout.flush();
+    int saved = dup(1);
+    dup2(null_fd, 1);
+    lu::stopwatch sw;
+    sw.start();
+    for (size_t i = 0; i < NVALUES; ++i)
+    {
+        lu::print(lu::to_string(static_cast<long long>(i * 2654435761u)));
+    }
+    std::cout.flush();
+    double print_seconds = sw.lap().count();
+    dup2(saved, 1);
+    close(saved);
+
+    lu::fd_sink sink(null_fd);
+    sw.start();
+    for (size_t i = 0; i < NVALUES; ++i)
+    {
+        sink.put_int(static_cast<int64_t>(i * 2654435761u));
+    }
+    sink.flush();
+    double sink_seconds = sw.lap().count();
+    std::cout << NVALUES << " integers: lu::print " << print_seconds * 1000 << " ms, sink " << sink_seconds * 1000 << " ms ("
+        << print_seconds / sink_seconds << "x)\n";
+}
+
+}
+
+int main()
+{
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd < 0)
+    {
+        std::cerr << "bench: cannot open /dev/null\n";
+        return 1;
+    }
+    bool passed = compare(null_fd);
+    if (passed)
+    {
+        time_format(null_fd);
+    }
+    close(null_fd);
+    return passed ? 0 : 1;
+}
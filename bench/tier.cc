@@ -0,0 +1,291 @@
+#include "bench.h"
+#include "tier.h"
+#include "lower.h"
+#include "timer.h"
+
+#include <functional>
+#include <sstream>
+
+// tiered execution benchmark: hand built programs with a hot loop (promoted on the stack), hot recursion (promoted
+// on calls while frames of it are running) and tail calls (the front end has no control flow or functions yet),
+// run interpreted, tiered up to optimized code and tiered up to native code. the output must match, then the run
+// times and the tier changes of the last run are reported.
+
+namespace
+{
+
+const char* SYMBOLS_SCRIPT = "n: int64 = 0\na: int64 = 0\nstep: int64 = 0\nf: bool = false\nr: int64 = 0\nm: int64 = 0\nx: int64 = 0\ny: int64 = 0\n";
+
+lu::symbol_id find(lu::intermediate_program& ip, lu::string_view name)
+{
+    lu::symbol_table& syms = ip.context().symbols();
+    return syms.find_local(syms.top(), name);
+}
+
+lu::intermediate load(const lu::intermediate_program& ip, lu::symbol_id sid, lu::intermediate_register reg)
+{
+    return lu::intermediate::emplace_load_symbol(sid, ip.context().symbols()[sid].tid, lu::intermediate_slot::SCALAR, reg);
+}
+
+lu::intermediate store(lu::symbol_id sid, lu::intermediate_register reg, lu::intermediate&& eval)
+{
+    return lu::intermediate::emplace_store_symbol(sid, lu::intermediate_slot::SCALAR, reg, lu::make_unique(new lu::intermediate(lu::move(eval))));
+}
+
+lu::intermediate constant(lu::intermediate_program& ip, lu::symbol_id sid, int64_t k)
+{
+    lu::intermediate_value val(ip.context().symbols()[sid].tid);
+    lu::scalar_value sv;
+    sv.i64 = k;
+    lu::set_scalar(&val.bin, sv);
+    return ip.make_load_constant(lu::move(val));
+}
+
+lu::intermediate branch(lu::intermediate_addr from, lu::intermediate_addr to, lu::unique<lu::intermediate>&& cond)
+{
+    return lu::intermediate::emplace_branch(from, lu::move(cond), to >= from
+        ? lu::intermediate_branch::branch_offset(lu::intermediate_branch::branch_offset::POSITIVE, to - from)
+        : lu::intermediate_branch::branch_offset(lu::intermediate_branch::branch_offset::NEGATIVE, from - to));
+}
+
+lu::intermediate ret(lu::intermediate&& eval)
+{
+    return lu::intermediate::emplace_return(lu::make_unique(new lu::intermediate(lu::move(eval))));
+}
+
+lu::intermediate intrinsic(lu::intermediate_program& ip, lu::intrinsic_code icode, const char* name, lu::symbol_id dest, lu::symbol_id op, lu::intermediate_register dest_reg, lu::intermediate_register op_reg)
+{
+    return lu::intermediate::emplace_intrinsic(icode, ip.context().symbols().find_intrinsic_id(name), dest, op, dest_reg, op_reg);
+}
+
+lu::intermediate add_imm(lu::intermediate_program& ip, lu::symbol_id sid, lu::intermediate_register reg, int64_t k)
+{
+    lu::scalar_value imm;
+    imm.i64 = k;
+    return lu::intermediate::emplace_intrinsic(lu::I64ADD, ip.context().symbols().find_intrinsic_id("i64add"), sid, reg, imm);
+}
+
+// n = 1000000; a = 0; step = 3; f = false
+// while n: a += step; lneg f; n += -1
+// print a; print f
+void make_loop(const lu::source* p_src, lu::intermediate_program* p_ip)
+{
+    lu::intermediate_program& ip = *p_ip;
+    lu::bench::compile(p_src, &ip);
+    lu::symbol_id sn = find(ip, "n");
+    lu::symbol_id sa = find(ip, "a");
+    lu::symbol_id sstep = find(ip, "step");
+    lu::symbol_id sf = find(ip, "f");
+
+    // n s0, a s1, step s2, f s3
+    lu::vector<lu::intermediate> code;
+    code.push_back(store(sn, 0, constant(ip, sn, 1000000)));
+    code.push_back(store(sa, 1, constant(ip, sa, 0)));
+    code.push_back(store(sstep, 2, constant(ip, sstep, 3)));
+    code.push_back(store(sf, 3, constant(ip, sf, 0)));
+    code.push_back(branch(4, 6, lu::make_unique(new lu::intermediate(load(ip, sn, 0)))));
+    code.push_back(branch(5, 10, nullptr));
+    code.push_back(intrinsic(ip, lu::I64ADD, "i64add", sa, sstep, 1, 2));
+    code.push_back(intrinsic(ip, lu::LNEG, "lneg", sf, lu::symbol::INVALID_ID, 3, 0));
+    code.push_back(add_imm(ip, sn, 0, -1));
+    code.push_back(branch(9, 4, nullptr));
+    code.push_back(intrinsic(ip, lu::I64PRINT, "i64print", lu::symbol::INVALID_ID, sa, 0, 1));
+    code.push_back(intrinsic(ip, lu::BPRINT, "bprint", lu::symbol::INVALID_ID, sf, 0, 3));
+    code.push_back(lu::intermediate::create_halt());
+
+    ip.rewrite(lu::move(code));
+    ip.frame(lu::intermediate_frame::TOP) = lu::intermediate_frame(0, 4, 0);
+}
+
+// fib(n) = n == 0 ? 0 : n - 1 == 0 ? 1 : fib(n - 1) + fib(n - 2), r = fib(20)
+void make_fib(const lu::source* p_src, lu::intermediate_program* p_ip)
+{
+    lu::intermediate_program& ip = *p_ip;
+    lu::bench::compile(p_src, &ip);
+    lu::symbol_id sn = find(ip, "n");
+    lu::symbol_id sr = find(ip, "r");
+    lu::symbol_id sm = find(ip, "m");
+    lu::symbol_id sx = find(ip, "x");
+    lu::symbol_id sy = find(ip, "y");
+
+    lu::intermediate_frame_id fib = 1;
+    auto call = [&](lu::symbol_id arg, lu::intermediate_register arg_reg, lu::symbol_id result, lu::intermediate_register result_reg)
+    {
+        lu::array<lu::intermediate> args(1);
+        args[0] = store(sn, 0, load(ip, arg, arg_reg));
+        return lu::intermediate::emplace_call(fib, lu::move(args), result, lu::intermediate_slot::SCALAR, result_reg);
+    };
+
+    lu::vector<lu::intermediate> code;
+    // top frame: n s0, r s1
+    code.push_back(store(sn, 0, constant(ip, sn, 20)));
+    code.push_back(call(sn, 0, sr, 1));
+    code.push_back(intrinsic(ip, lu::I64PRINT, "i64print", lu::symbol::INVALID_ID, sr, 0, 1));
+    code.push_back(lu::intermediate::create_halt());
+    // fib frame: n s0, m s1, x s2, y s3
+    lu::intermediate_addr entry = code.size();
+    code.push_back(branch(entry, entry + 2, lu::make_unique(new lu::intermediate(load(ip, sn, 0)))));
+    code.push_back(ret(constant(ip, sn, 0)));
+    code.push_back(store(sm, 1, load(ip, sn, 0)));
+    code.push_back(add_imm(ip, sm, 1, -1));
+    code.push_back(branch(entry + 4, entry + 6, lu::make_unique(new lu::intermediate(load(ip, sm, 1)))));
+    code.push_back(ret(constant(ip, sn, 1)));
+    code.push_back(call(sm, 1, sx, 2));
+    code.push_back(add_imm(ip, sm, 1, -1));
+    code.push_back(call(sm, 1, sy, 3));
+    code.push_back(intrinsic(ip, lu::I64ADD, "i64add", sx, sy, 2, 3));
+    code.push_back(ret(load(ip, sx, 2)));
+
+    ip.rewrite(lu::move(code));
+    ip.frame(lu::intermediate_frame::TOP) = lu::intermediate_frame(0, 2, 0);
+    ip.push_frame(lu::intermediate_frame(entry, 4, 0));
+}
+
+// count(n, a) = n == 0 ? a : count(n - 1, a + 1), r = count(100000, 0), tail calls once lowered
+void make_count(const lu::source* p_src, lu::intermediate_program* p_ip)
+{
+    lu::intermediate_program& ip = *p_ip;
+    lu::bench::compile(p_src, &ip);
+    lu::symbol_id sn = find(ip, "n");
+    lu::symbol_id sa = find(ip, "a");
+    lu::symbol_id sr = find(ip, "r");
+    lu::symbol_id sx = find(ip, "x");
+
+    lu::intermediate_frame_id count = 1;
+    auto call = [&](lu::symbol_id result, lu::intermediate_register result_reg)
+    {
+        lu::array<lu::intermediate> args(2);
+        args[0] = store(sn, 0, load(ip, sn, 0));
+        args[1] = store(sa, 1, load(ip, sa, 1));
+        return lu::intermediate::emplace_call(count, lu::move(args), result, lu::intermediate_slot::SCALAR, result_reg);
+    };
+
+    lu::vector<lu::intermediate> code;
+    // top frame: n s0, a s1, r s2
+    code.push_back(store(sn, 0, constant(ip, sn, 100000)));
+    code.push_back(store(sa, 1, constant(ip, sa, 0)));
+    code.push_back(call(sr, 2));
+    code.push_back(intrinsic(ip, lu::I64PRINT, "i64print", lu::symbol::INVALID_ID, sr, 0, 2));
+    code.push_back(lu::intermediate::create_halt());
+    // count frame: n s0, a s1, x s2
+    lu::intermediate_addr entry = code.size();
+    code.push_back(branch(entry, entry + 2, lu::make_unique(new lu::intermediate(load(ip, sn, 0)))));
+    code.push_back(ret(load(ip, sa, 1)));
+    code.push_back(add_imm(ip, sn, 0, -1));
+    code.push_back(add_imm(ip, sa, 1, 1));
+    code.push_back(call(sx, 2));
+    code.push_back(ret(load(ip, sx, 2)));
+
+    ip.rewrite(lu::move(code));
+    ip.frame(lu::intermediate_frame::TOP) = lu::intermediate_frame(0, 3, 0);
+    ip.push_frame(lu::intermediate_frame(entry, 3, 0));
+    lu::lower_tail_calls(&ip);
+}
+
+// output of the last of nrun runs, tiered unless p_settings is null
+struct run_capture
+{
+    std::string out;
+    double seconds; // per run
+    lu::tier_stats stats;
+};
+
+run_capture capture(std::function<void(lu::intermediate_program*)> build, const lu::tier_settings* p_settings, size_t nrun)
+{
+    std::ostringstream out;
+    std::streambuf* p_cout = std::cout.rdbuf(out.rdbuf());
+    lu::diag_logger log(lu::diag::ERROR_LEVEL);
+    run_capture rc;
+    rc.seconds = 0;
+    for (size_t k = 0; k < nrun; ++k)
+    {
+        // a fresh program every run, tiers start over
+        lu::intermediate_program ip;
+        build(&ip);
+        out.str("");
+        lu::intermediate_interpreter_state iis;
+        lu::interpret_result res;
+        lu::stopwatch sw;
+        if (p_settings)
+        {
+            lu::tiered_program tp(lu::move(ip), *p_settings);
+            sw.start();
+            res = lu::tiered_run(&tp, &iis, &log, &rc.stats);
+        }
+        else
+        {
+            lu::lower_intrinsics(&ip);
+            sw.start();
+            res = lu::interpret(&ip, &iis, 0, &log);
+        }
+        rc.seconds += sw.lap().count() / static_cast<double>(nrun);
+        if (!ok(res))
+        {
+            std::cout.rdbuf(p_cout);
+            log.flush();
+            std::cerr << "bench: failed to run\n";
+            std::exit(1);
+        }
+    }
+    std::cout.rdbuf(p_cout);
+    rc.out = out.str();
+    return rc;
+}
+
+bool has_event(const lu::tier_stats& stats, lu::intermediate_frame_id fid, bool osr)
+{
+    for (const lu::tier_event& ev : stats.events)
+    {
+        if (ev.fid == fid && ev.osr == osr)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// runs the program interpreted, then tiered with and without native code. false if the output differs, or the
+// frame expected to get hot was not promoted the expected way
+bool compare(lu::string_view name, std::function<void(lu::intermediate_program*)> build, lu::intermediate_frame_id hot, bool osr, size_t nrun)
+{
+    run_capture expected = capture(build, nullptr, nrun);
+    std::cout << name << ": interpreter " << expected.seconds * 1000 << " ms/run\n";
+    for (bool native : { false, true })
+    {
+        lu::tier_settings settings;
+        settings.native = native;
+        run_capture actual = capture(build, &settings, nrun);
+        const char* tiers = native ? "tiered, native" : "tiered, optimized";
+        if (actual.out != expected.out)
+        {
+            std::cerr << "bench: " << name << " " << tiers << " output differs:\n" << actual.out << "\ninterpreter:\n" << expected.out << "\n";
+            return false;
+        }
+        if (!has_event(actual.stats, hot, osr))
+        {
+            std::cerr << "bench: " << name << " " << tiers << " did not promote frame " << hot << (osr ? " on the stack\n" : " on a call\n");
+            return false;
+        }
+        std::cout << name << ": " << tiers << " " << actual.seconds * 1000 << " ms/run\n" << to_string(actual.stats) << "\n";
+    }
+    return true;
+}
+
+}
+
+int main(int, char**)
+{
+    if (!lu::has_jit())
+    {
+        std::cout << "no jit for this host, the top tier is optimized code\n";
+    }
+
+    lu::source src = lu::source::from_string("tier.lu", SYMBOLS_SCRIPT);
+    if (!compare("loop", [&](lu::intermediate_program* p_ip) { make_loop(&src, p_ip); }, lu::intermediate_frame::TOP, true, 5)
+        || !compare("fib", [&](lu::intermediate_program* p_ip) { make_fib(&src, p_ip); }, 1, false, 5)
+        || !compare("tail calls", [&](lu::intermediate_program* p_ip) { make_count(&src, p_ip); }, 1, false, 5))
+    {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "bench.h"
+#include "fuse.h"
+#include "lower.h"
+
+// value passing benchmark: store heavy scripts (builtins and tuples). counts heap allocations per run for
+// two script sizes, the counts must not grow with the number of executed stores (zero allocations in the steady state).
+// also compares the size and copy cost of a register as intermediate_value and as tagged_value.
+
+namespace
+{
+
+lu::string make_script(size_t nrepeat)
+{
+    lu::string s("a = 1\nb = 2\nf = false\np = (a, b)\nq = (b, a)\n");
+    for (size_t i = 0; i < nrepeat; ++i)
+    {
+        s.append("a = b; b = 3; f = true\np = (a, b); q = p; p = (b, 4)\n");
+    }
+    return s;
+}
+
+void compile(const lu::source* p_src, lu::intermediate_program* p_ip)
+{
+    lu::bench::compile(p_src, p_ip);
+    lu::fuse(p_ip);
+    lu::lower_intrinsics(p_ip);
+}
+
+// copies a bank of builtin registers, as a frame's worth of stores would
+template <typename ValueT>
+void time_copies(const ValueT& val, lu::string_view name)
+{
+    const size_t nregs = 256;
+    lu::vector<ValueT> src(nregs, val);
+    lu::vector<ValueT> dst(nregs);
+    lu::profile::time_settings ts;
+    ts.sizes = { 1000, 10000, 100000 };
+    ts.name = name;
+    lu::profile::time([&]()
+    {
+        for (size_t i = 0; i < nregs; ++i)
+        {
+            dst[i] = src[i];
+        }
+    }, ts, std::cout);
+}
+
+size_t count_allocs(const lu::intermediate_program& ip)
+{
+    lu::bench::alloc_scope scope;
+    lu::bench::run(&ip);
+    return scope.delta().allocs;
+}
+
+}
+
+int main(int, char**)
+{
+    const size_t small = 100;
+    const size_t large = 1000;
+
+    lu::source small_src = lu::source::from_string("values_small.lu", make_script(small));
+    lu::source large_src = lu::source::from_string("values_large.lu", make_script(large));
+    lu::intermediate_program small_ip;
+    lu::intermediate_program large_ip;
+    compile(&small_src, &small_ip);
+    compile(&large_src, &large_ip);
+
+    size_t small_allocs = count_allocs(small_ip);
+    size_t large_allocs = count_allocs(large_ip);
+    std::cout << small_ip.size() << " instructions: " << small_allocs << " allocations per run\n";
+    std::cout << large_ip.size() << " instructions: " << large_allocs << " allocations per run\n";
+    if (small_allocs != large_allocs)
+    {
+        std::cerr << "bench: stores allocate in the steady state\n";
+        return 1;
+    }
+
+    lu::profile::time_settings ts;
+    ts.sizes = { 10, 100, 1000 };
+    ts.name = "values";
+    lu::profile::time([&]() { lu::bench::run(&large_ip); }, ts, std::cout);
+
+    std::cout << "register size: intermediate_value " << sizeof(lu::intermediate_value) << " bytes, tagged_value " << sizeof(lu::tagged_value) << " bytes\n";
+    lu::intermediate_value i64(large_ip.context().types().find_builtin_type_id(lu::builtin_type::INT64));
+    i64.bin.i64 = 42;
+    time_copies(i64, "copy 256 intermediate_value int64");
+    time_copies(lu::tagged_value(i64), "copy 256 tagged_value int64");
+    return 0;
+}
@@ -2,6 +2,7 @@
 
 #include "utility.h"
 #include "value.h"
+#include "cast.h"
 #include "enum.h"
 #include "internal/analyze_printer.h"
 
@@ -163,6 +164,9 @@ analyze_expr_tree::analyze_expr_tree()
     //declare_global_builtin_types(_ctxt.types(), _ctxt.symbols());
 }
 
+analyze_expr_tree::analyze_expr_tree(const analyze_context& builtins) : _ctxt(builtins)
+{}
+
 namespace internal
 {
     string_view intr_name(string_view sv)
@@ -178,11 +182,15 @@ namespace internal
         {
             p_scope = symbols().top();
 
-            register_void();
-            register_literal_types();
-            register_builtin_types();
-            declare_intrinsics();
-            declare_global_builtin_types();
+            // a tree started from builtin_context() has them already
+            if (!types().exists(type::create_void_type()))
+            {
+                register_void();
+                register_literal_types();
+                register_builtin_types();
+                declare_intrinsics();
+                declare_global_builtin_types();
+            }
         }
 
         const parse_expr_tree* p_pet;
@@ -366,16 +374,24 @@ namespace internal
             //type_id void_id = types.find_type_id(type::create_void_type()),
             type_id int32_id = types().find_builtin_type_id(builtin_type::INT32);
             type_id int64_id = types().find_builtin_type_id(builtin_type::INT64);
+            type_id uint32_id = types().find_builtin_type_id(builtin_type::UINT32);
+            type_id uint64_id = types().find_builtin_type_id(builtin_type::UINT64);
             type_id bool_id = types().find_builtin_type_id(builtin_type::BOOL);
             type_id ascii_id = types().find_builtin_type_id(builtin_type::ASCII);
 
             symbols().declare_intrinsic(intrinsic("i32add", I32ADD, intrinsic_type::BOTH, int32_id, int32_id)); // TODO using $ in string in fragile in case i change it later
             symbols().declare_intrinsic(intrinsic("i64add", I64ADD, intrinsic_type::BOTH, int64_id, int64_id)); // TODO using $ in string in fragile in case i change it later
             symbols().declare_intrinsic(intrinsic("i32print", I32PRINT, intrinsic_type::OP_ONLY, type_id::UNDEFINED, int32_id));
+            symbols().declare_intrinsic(intrinsic("u32add", U32ADD, intrinsic_type::BOTH, uint32_id, uint32_id));
+            symbols().declare_intrinsic(intrinsic("u64add", U64ADD, intrinsic_type::BOTH, uint64_id, uint64_id));
             symbols().declare_intrinsic(intrinsic("i64print", I64PRINT, intrinsic_type::OP_ONLY, type_id::UNDEFINED, int64_id));
+            symbols().declare_intrinsic(intrinsic("u32print", U32PRINT, intrinsic_type::OP_ONLY, type_id::UNDEFINED, uint32_id));
+            symbols().declare_intrinsic(intrinsic("u64print", U64PRINT, intrinsic_type::OP_ONLY, type_id::UNDEFINED, uint64_id));
             symbols().declare_intrinsic(intrinsic("bprint", BPRINT, intrinsic_type::OP_ONLY, type_id::UNDEFINED, bool_id));
             symbols().declare_intrinsic(intrinsic("asciiprint", ASCIIPRINT, intrinsic_type::OP_ONLY, type_id::UNDEFINED, ascii_id));
             symbols().declare_intrinsic(intrinsic("lneg", LNEG, intrinsic_type::DEST_ONLY, bool_id, type_id::UNDEFINED));
+            symbols().declare_intrinsic(intrinsic("land", LAND, intrinsic_type::BOTH, bool_id, bool_id));
+            symbols().declare_intrinsic(intrinsic("lor", LOR, intrinsic_type::BOTH, bool_id, bool_id));
         }
 
         void declare_global_builtin_types()
@@ -401,6 +417,25 @@ namespace internal
             }
         }
 
+        // exact match, or a literal that is converted to the builtin param and passed as an immediate. only the
+        // conversions literal_to_builtin_cast has, with the value in range of the param
+        bool intrinsic_op_convertible(type_id param, type_id arg, const parse_expr& op)
+        {
+            return param == arg || literal_to_builtin_castable(types(), param, arg, op.text());
+        }
+
+        void set_intrinsic_op_type(const type& callee, analyze_expr& args)
+        {
+            if (callee.intr.config == intrinsic_type::OP_ONLY || callee.intr.config == intrinsic_type::BOTH)
+            {
+                analyze_expr& op = args[args.arity() - 1];
+                if (isliteral(op))
+                {
+                    op.set_eval_type(callee.intr[intrinsic_type::OP_PARAM]);
+                }
+            }
+        }
+
         void check_call(const parse_expr& e, const type& callee, const type& args)
         {
             assert(callee.callable());
@@ -427,7 +462,7 @@ namespace internal
                 }
                 case intrinsic_type::OP_ONLY:
                 {
-                    if (callee.intr[intrinsic_type::OP_PARAM] != args.tup[0].tid)
+                    if (!intrinsic_op_convertible(callee.intr[intrinsic_type::OP_PARAM], args.tup[0].tid, e[1][0]))
                     {
                         throw_diag(make_not_convertible(e, types().find_type(args.tup[0].tid), types().find_type(callee.intr[intrinsic_type::OP_PARAM])));
                     }
@@ -439,7 +474,7 @@ namespace internal
                     {
                         throw_diag(make_not_convertible(e, types().find_type(args.tup[0].tid), types().find_type(callee.intr[intrinsic_type::DEST_PARAM])));
                     }
-                    if (callee.intr[intrinsic_type::OP_PARAM] != args.tup[1].tid)
+                    if (!intrinsic_op_convertible(callee.intr[intrinsic_type::OP_PARAM], args.tup[1].tid, e[1][1]))
                     {
                         throw_diag(make_not_convertible(e, types().find_type(args.tup[1].tid), types().find_type(callee.intr[intrinsic_type::OP_PARAM])));
                     }
@@ -710,6 +745,10 @@ namespace internal
                 type& args_type = types().find_type(args.eval_type());
                 // check arity and type match
                 check_call(pe, callee_type, args_type);
+                if (callee_type.tclass == INTRINSIC)
+                {
+                    set_intrinsic_op_type(callee_type, args);
+                }
                 return analyze_expr::create_vanilla(pe, callee_type.return_type(), { callee, args });
             }
             else if (istuple(pe))
@@ -782,6 +821,15 @@ analyze_result analyze(const parse_expr_tree* p_pet, analyze_expr_tree* p_aet, d
     return res;
 }
 
+analyze_context builtin_context()
+{
+    parse_expr_tree pet;
+    analyze_expr_tree aet;
+    diag_logger log(diag::MAX_LEVEL);
+    internal::analyzer analyzer(&pet, &aet, &log); // registers them
+    return move(aet.context());
+}
+
 
 // string to_string(const analyze_expr& e)
 // {
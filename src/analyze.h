@@ -105,6 +105,7 @@ private:
 struct analyze_expr_tree
 {
     analyze_expr_tree();
+    explicit analyze_expr_tree(const analyze_context& builtins); // starts from a copy of builtin_context()
 
     analyze_expr& operator[](size_t idx) { return _top_exprs[idx]; }
     const analyze_expr& operator[](size_t idx) const { return _top_exprs[idx]; }
@@ -132,6 +133,10 @@ LU_CONSTEXPR bool ok(analyze_result ar)
 
 analyze_result analyze(const parse_expr_tree*, analyze_expr_tree*, diag_logger*);
 
+// only the builtin types and intrinsics every analysis registers first. processes analyzing many sources can make
+// it once and start each tree from a copy (see server.h)
+analyze_context builtin_context();
+
 // string to_string(const analyze_expr& e);
 // string to_string(const analyze_expr_tree& et);
 
@@ -0,0 +1,128 @@
+#include "arena.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace lu
+{
+
+namespace internal
+{
+    size_t align_up(size_t size)
+    {
+        return (size + arena::ALIGN - 1) & ~(arena::ALIGN - 1);
+    }
+}
+
+string to_string(const arena_stats& stats)
+{
+    return string::join(
+        "arena: ", to_string(stats.allocs), " allocs, ",
+        to_string(stats.bytes), " bytes, ",
+        to_string(stats.peak), " peak, ",
+        to_string(stats.blocks), " blocks of ",
+        to_string(stats.capacity), " bytes, ",
+        to_string(stats.resets), " resets");
+}
+
+arena::arena(size_t block_size) : _block_size(block_size), _p_first(nullptr), _p_cur(nullptr), _p_next(nullptr), _p_end(nullptr), _used(0)
+{
+}
+
+arena::~arena()
+{
+    block* p = _p_first;
+    while (p)
+    {
+        block* p_next = p->p_next;
+        std::free(p);
+        p = p_next;
+    }
+}
+
+char* arena::begin(block* p) const
+{
+    return reinterpret_cast<char*>(p) + internal::align_up(sizeof(block));
+}
+
+arena::block* arena::new_block(size_t size)
+{
+    void* p_mem = std::malloc(internal::align_up(sizeof(block)) + size);
+    if (!p_mem)
+    {
+        throw std::bad_alloc();
+    }
+    block* p = static_cast<block*>(p_mem);
+    p->p_next = nullptr;
+    p->size = size;
+    ++_stats.blocks;
+    _stats.capacity += size;
+    return p;
+}
+
+void* arena::allocate(size_t size)
+{
+    size = internal::align_up(size > 0 ? size : 1);
+    if (static_cast<size_t>(_p_end - _p_next) < size)
+    {
+        // the next kept block if it fits, else a new one after the current
+        if (!_p_cur || !_p_cur->p_next || _p_cur->p_next->size < size)
+        {
+            block* p = new_block(size > _block_size ? size : _block_size);
+            if (_p_cur)
+            {
+                p->p_next = _p_cur->p_next;
+                _p_cur->p_next = p;
+            }
+            else
+            {
+                p->p_next = _p_first;
+                _p_first = p;
+            }
+            _p_cur = p;
+        }
+        else
+        {
+            _p_cur = _p_cur->p_next;
+        }
+        _p_next = begin(_p_cur);
+        _p_end = _p_next + _p_cur->size;
+    }
+    void* p = _p_next;
+    _p_next += size;
+    _used += size;
+    ++_stats.allocs;
+    _stats.bytes += size;
+    if (_used > _stats.peak)
+    {
+        _stats.peak = _used;
+    }
+    return p;
+}
+
+void arena::reset()
+{
+#ifndef NDEBUG
+    for (block* p = _p_first; p; p = p->p_next)
+    {
+        std::memset(begin(p), 0xdd, p->size);
+        if (p == _p_cur)
+        {
+            break;
+        }
+    }
+#endif // NDEBUG
+    _p_cur = nullptr;
+    _p_next = nullptr;
+    _p_end = nullptr;
+    if (_p_first)
+    {
+        _p_cur = _p_first;
+        _p_next = begin(_p_first);
+        _p_end = _p_next + _p_first->size;
+    }
+    _used = 0;
+    ++_stats.resets;
+}
+
+}
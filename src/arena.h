@@ -0,0 +1,104 @@
+#ifndef LU_ARENA_H
+#define LU_ARENA_H
+
+#include "string.h"
+
+#include <cstddef>
+#include <new>
+
+namespace lu
+{
+
+struct arena_stats
+{
+    arena_stats() : allocs(0), bytes(0), peak(0), blocks(0), capacity(0), resets(0) {}
+
+    size_t allocs;
+    size_t bytes;
+    size_t peak; // most bytes in use between two resets
+    size_t blocks;
+    size_t capacity; // bytes of all blocks
+    size_t resets;
+};
+
+// one line
+string to_string(const arena_stats&);
+
+// bump allocator over blocks taken from malloc. nothing is freed alone, reset() frees everything at once and keeps
+// the blocks for what comes next. only what is explicitly allocated from it lives there, see arena_allocator
+struct arena
+{
+    static const size_t ALIGN = 16; // of every allocation
+
+    explicit arena(size_t block_size = 1024 * 1024);
+    ~arena();
+
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+
+    void* allocate(size_t size);
+    // everything allocated is gone, in debug builds it is overwritten with 0xdd
+    void reset();
+
+    const arena_stats& stats() const { return _stats; }
+
+private:
+    struct block
+    {
+        block* p_next;
+        size_t size; // bytes after the header
+    };
+
+    char* begin(block* p) const;
+    block* new_block(size_t size);
+
+    size_t _block_size;
+    block* _p_first;
+    block* _p_cur;
+    char* _p_next;
+    char* _p_end;
+    size_t _used; // since the last reset
+    arena_stats _stats;
+};
+
+// for containers whose memory belongs to an arena: deallocate() leaves it for the arena's reset, so a container must
+// be gone (or never touched again) before then. allocators of different arenas do not compare equal
+template <typename T>
+struct arena_allocator
+{
+    typedef T value_type;
+
+    explicit arena_allocator(arena* p_arena) : p_arena(p_arena) {}
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& other) : p_arena(other.p_arena) {}
+
+    T* allocate(size_t n)
+    {
+        static_assert(alignof(T) <= arena::ALIGN, "arena_allocator of an over aligned type");
+        if (n > static_cast<size_t>(-1) / sizeof(T))
+        {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(p_arena->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T*, size_t) {}
+
+    arena* p_arena;
+};
+
+template <typename T, typename U>
+bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b)
+{
+    return a.p_arena == b.p_arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b)
+{
+    return a.p_arena != b.p_arena;
+}
+
+}
+
+#endif // LU_ARENA_H
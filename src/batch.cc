@@ -0,0 +1,227 @@
+#include "batch.h"
+#include "server.h"
+#include "analyze.h"
+#include "source.h"
+#include "print.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// directories are listed with POSIX calls
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(LU_NO_BATCH_DIRS)
+#   define LU_BATCH_DIRS 1
+#   include <dirent.h>
+#   include <sys/stat.h>
+#else
+#   define LU_BATCH_DIRS 0
+#endif // (defined(__unix__) || defined(__APPLE__)) && !defined(LU_NO_BATCH_DIRS)
+
+namespace lu
+{
+
+namespace diags
+{
+    diag BATCH_IO = diag(diag::ERROR_LEVEL, 6500);
+}
+
+namespace internal
+{
+    void batch_io(diag_logger* p_log, string&& msg)
+    {
+        p_log->push(diag_context(diags::BATCH_IO, source_reference(), source_location(), string::join("batch: ", msg)));
+    }
+
+    bool has_lu_suffix(string_view name)
+    {
+        string_view suffix(".lu");
+        return name.size() > suffix.size() && name.subview(name.size() - suffix.size()) == suffix;
+    }
+
+    // up to and with the last /, empty if none
+    string_view dir_of(string_view path)
+    {
+        size_t n = path.size();
+        while (n > 0 && path[n - 1] != '/')
+        {
+            --n;
+        }
+        return path.subview(0, n);
+    }
+
+    batch_result read_manifest(string_view manifest, vector<string>* p_paths, diag_logger* p_log)
+    {
+        std::ifstream file(string(manifest).buffer());
+        if (!file)
+        {
+            batch_io(p_log, string::join("cannot read ", manifest));
+            return batch_result::BATCH_IO;
+        }
+        std::string line;
+        while (std::getline(file, line))
+        {
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t'))
+            {
+                line.pop_back();
+            }
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+            string path(line.data(), line.size());
+            p_paths->push_back(path[0] == '/' ? move(path) : string::join(dir_of(manifest), path));
+        }
+        return batch_result::BATCH_OK;
+    }
+
+    typedef std::vector<char, arena_allocator<char>> arena_chars;
+
+    // what a script prints, kept in the arena until the script's results are copied out
+    struct arena_buf : public std::streambuf
+    {
+        explicit arena_buf(arena* p_arena) : chars(arena_allocator<char>(p_arena)) {}
+
+        int_type overflow(int_type c) override
+        {
+            if (!traits_type::eq_int_type(c, traits_type::eof()))
+            {
+                chars.push_back(traits_type::to_char_type(c));
+            }
+            return traits_type::not_eof(c);
+        }
+
+        std::streamsize xsputn(const char* p, std::streamsize n) override
+        {
+            chars.insert(chars.end(), p, p + n);
+            return n;
+        }
+
+        arena_chars chars;
+    };
+
+    bool read_text(const string& path, arena_chars* p_text)
+    {
+        std::ifstream file(path.buffer(), std::ios::binary);
+        char buf[4096];
+        while (file.read(buf, sizeof(buf)) || file.gcount() > 0)
+        {
+            p_text->insert(p_text->end(), buf, buf + file.gcount());
+        }
+        return file.eof() && !file.bad();
+    }
+}
+
+string to_string(const batch_stats& stats)
+{
+    double rate = stats.seconds > 0 ? static_cast<double>(stats.scripts) / stats.seconds : 0;
+    std::ostringstream line;
+    line << "batch: " << stats.scripts << " scripts, " << stats.failures << " failed, " << stats.seconds * 1000 << " ms, "
+        << rate << " scripts/s";
+    std::string s = line.str();
+    return string::join(string(s.data(), s.size()), ", ", to_string(stats.arena));
+}
+
+batch_result batch_paths(string_view dir_or_manifest, vector<string>* p_paths, diag_logger* p_log)
+{
+#if LU_BATCH_DIRS
+    string path(dir_or_manifest);
+    struct stat st;
+    if (stat(path.buffer(), &st) != 0)
+    {
+        internal::batch_io(p_log, string::join("no file or directory ", path));
+        return batch_result::BATCH_IO;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        return internal::read_manifest(dir_or_manifest, p_paths, p_log);
+    }
+    DIR* p_dir = opendir(path.buffer());
+    if (!p_dir)
+    {
+        internal::batch_io(p_log, string::join("cannot list ", path));
+        return batch_result::BATCH_IO;
+    }
+    vector<std::string> names;
+    while (dirent* p_ent = readdir(p_dir))
+    {
+        if (internal::has_lu_suffix(p_ent->d_name))
+        {
+            names.push_back(p_ent->d_name);
+        }
+    }
+    closedir(p_dir);
+    std::sort(names.begin(), names.end());
+    for (const std::string& name : names)
+    {
+        p_paths->push_back(string::join(path, "/", name.c_str()));
+    }
+    return batch_result::BATCH_OK;
+#else
+    return internal::read_manifest(dir_or_manifest, p_paths, p_log);
+#endif // LU_BATCH_DIRS
+}
+
+void run_batch(const vector<string>& paths, const batch_settings& settings, vector<batch_script>* p_scripts, batch_stats* p_stats)
+{
+    batch_stats stats;
+    analyze_context builtins = builtin_context();
+    arena scratch(settings.arena_block);
+    stopwatch sw;
+    sw.start();
+    for (const string& path : paths)
+    {
+        batch_script script;
+        script.path = path;
+        {
+            internal::arena_buf out(&scratch);
+            internal::arena_buf err(&scratch);
+            {
+                stdio_redirect redirect(&out, &err);
+                try
+                {
+                    internal::arena_chars text{arena_allocator<char>(&scratch)};
+                    if (!internal::read_text(path, &text))
+                    {
+                        std::cerr << "cannot read " << path << "\n";
+                        script.code = 1;
+                    }
+                    else
+                    {
+                        source src = source::from_string(string(path), string(text.data(), text.size()));
+                        // diagnostics point into the source
+                        diag_logger log(diag::WARN_LEVEL, diag::MAX_LEVEL, false);
+                        script.code = run_script(&src, builtins, settings.level, &log);
+                        log.flush();
+                    }
+                }
+                catch (const std::exception& e)
+                {
+                    std::cerr << e.what() << "\n";
+                    script.code = 1;
+                }
+            }
+            // the script's results outlive the reset
+            script.output = string(out.chars.data(), out.chars.size());
+            script.diags = string(err.chars.data(), err.chars.size());
+        }
+        scratch.reset();
+
+        ++stats.scripts;
+        if (script.code != 0)
+        {
+            ++stats.failures;
+        }
+        p_scripts->push_back(move(script));
+    }
+    stats.seconds = sw.lap().count();
+    stats.arena = scratch.stats();
+    if (p_stats)
+    {
+        *p_stats = stats;
+    }
+}
+
+}
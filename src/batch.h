@@ -0,0 +1,74 @@
+#ifndef LU_BATCH_H
+#define LU_BATCH_H
+
+#include "arena.h"
+#include "optimize.h"
+#include "diag.h"
+#include "string.h"
+#include "internal/constexpr.h"
+
+namespace lu
+{
+
+namespace diags
+{
+    extern diag BATCH_IO;
+}
+
+struct batch_settings
+{
+    batch_settings() : level(optimize_level::O2), arena_block(1024 * 1024) {}
+
+    optimize_level level;
+    size_t arena_block; // bytes, see arena
+};
+
+// what one script printed and logged, kept apart from every other script
+struct batch_script
+{
+    batch_script() : code(0) {}
+
+    string path;
+    string output;
+    string diags;
+    int code; // the driver's exit code (see run_script())
+};
+
+struct batch_stats
+{
+    batch_stats() : scripts(0), failures(0), seconds(0) {}
+
+    size_t scripts;
+    size_t failures; // not exiting 0
+    double seconds;
+    arena_stats arena;
+};
+
+// one line, with scripts per second
+string to_string(const batch_stats&);
+
+enum class batch_result
+{
+    BATCH_OK,
+    BATCH_UNSUPPORTED, // directories cannot be listed here, use a manifest
+    BATCH_IO, // logged
+};
+
+LU_CONSTEXPR bool ok(batch_result res)
+{
+    return res == batch_result::BATCH_OK;
+}
+
+// the .lu files of a directory in name order, or the paths of a manifest file, one per line. blank lines and lines
+// starting with # are skipped, relative paths are relative to the manifest
+batch_result batch_paths(string_view dir_or_manifest, vector<string>* p_paths, diag_logger*);
+
+// compiles and runs every script in this process, in order, like run_script() with one copy of builtin_context().
+// the buffers the batch keeps for a script (its text as read, its output and diagnostics while it runs) come from
+// one arena through arena_allocator, reset between scripts instead of freed piece by piece. the front end, passes
+// and interpreter allocate as they always do. output and diagnostics are captured per script in *p_scripts
+void run_batch(const vector<string>& paths, const batch_settings&, vector<batch_script>* p_scripts, batch_stats* = nullptr);
+
+}
+
+#endif // LU_BATCH_H
@@ -0,0 +1,1510 @@
+#include "bytecode.h"
+
+#include "except.h"
+#include "internal/debug.h"
+#include "lower.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+// images are mapped read only where there is mmap, read into memory elsewhere
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(LU_NO_MMAP)
+#   define LU_MMAP 1
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#else
+#   define LU_MMAP 0
+#endif // (defined(__unix__) || defined(__APPLE__)) && !defined(LU_NO_MMAP)
+
+namespace lu
+{
+
+namespace diags
+{
+    diag BYTECODE_UNSUPPORTED = diag(diag::ERROR_LEVEL, 6200);
+    diag BYTECODE_INVALID = diag(diag::ERROR_LEVEL, 6201);
+    diag BYTECODE_IO = diag(diag::ERROR_LEVEL, 6202);
+}
+
+namespace internal
+{
+    LU_CONSTEXPR uint32_t LUC_MAGIC = 0x0a63756c; // "luc\n" in a little endian file
+    LU_CONSTEXPR uint32_t LUC_BYTE_ORDER = 0x01020304; // as the writer stored it
+
+    enum luc_section
+    {
+        LUC_INTERMEDIATES,
+        LUC_CONSTANTS,
+        LUC_TYPES,
+        LUC_MEMBERS, // of types
+        LUC_SYMBOLS,
+        LUC_INTRINSICS,
+        LUC_FRAMES,
+        LUC_LINES,
+        LUC_STRINGS, // bytes
+        _label_LUC_SECTION_COUNT,
+    };
+
+    struct luc_range
+    {
+        uint64_t offset; // bytes from the start of the file
+        uint64_t count; // records
+    };
+
+    struct luc_header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t byte_order;
+        uint32_t reserved;
+        uint64_t size; // of the file
+        uint64_t ninsts; // of the program, the intermediates after are nested ones
+        uint64_t nconstants; // in the pool, the constants after are members
+        luc_range sections[_label_LUC_SECTION_COUNT];
+    };
+
+    struct luc_string
+    {
+        uint64_t offset; // into the strings
+        uint64_t size;
+    };
+
+    // words by op:
+    //   LOAD_CONSTANT: constant, bits
+    //   LOAD_SYMBOL: sid, type class, type idx, slot, reg
+    //   STORE_*: sid, slot, reg, the eval is the one sub
+    //   intrinsics: icode | op_imm << 32, iid, dest, op, dest_reg, op_reg, imm. pairs and triples have them as subs
+    //   TUPLE: type class, type idx
+    //   CALL, TAIL_CALL: fid, result, result_slot, result_reg, the args are the subs
+    //   BRANCH: base, sign, abs_offset, negated, the condition is the sub if any
+    //   RETURN: the eval is the sub if any. BLOCK: its subs
+    struct luc_intermediate
+    {
+        uint32_t op;
+        uint32_t nsubs;
+        uint64_t subs; // index of the first
+        uint64_t words[7];
+    };
+
+    // words by type class: BUILTIN the payload bits (or TYPEID's type class, idx), LITERAL the text's string,
+    // FUNCTION faddr, INTRINSIC iid, UNION the active type class, idx. members of tuples and unions are subs
+    struct luc_value
+    {
+        uint32_t tclass;
+        uint32_t nsubs;
+        uint64_t tidx;
+        uint64_t subs;
+        uint64_t words[2];
+    };
+
+    // kind is the literal or builtin type, or the intrinsic param config. members are the params of intrinsics,
+    // the return type then params of functions, and the members of tuples and unions
+    struct luc_type
+    {
+        uint32_t tclass;
+        uint32_t nmembers;
+        uint64_t idx;
+        uint64_t members;
+        uint64_t kind;
+    };
+
+    struct luc_member
+    {
+        uint64_t tclass;
+        uint64_t tidx;
+        luc_string name;
+    };
+
+    struct luc_symbol
+    {
+        uint64_t tclass;
+        uint64_t tidx;
+        luc_string name;
+        uint64_t flags; // symbol_flag bits
+    };
+
+    struct luc_intrinsic
+    {
+        luc_string name;
+        uint64_t icode;
+        uint64_t config;
+        uint64_t params[4]; // type class, idx of each
+    };
+
+    struct luc_frame
+    {
+        uint64_t entry;
+        uint64_t nscalars;
+        uint64_t naggregates;
+    };
+
+    struct luc_line
+    {
+        uint64_t iaddr;
+        uint64_t pos;
+        uint64_t line;
+        uint64_t col;
+    };
+
+    static_assert(sizeof(luc_header) % 8 == 0 && sizeof(luc_intermediate) == 72 && sizeof(luc_value) == 40 && sizeof(luc_type) == 32
+        && sizeof(luc_member) == 32 && sizeof(luc_symbol) == 40 && sizeof(luc_intrinsic) == 64 && sizeof(luc_frame) == 24 && sizeof(luc_line) == 32,
+        "luc records must have no padding and keep 8 byte alignment");
+
+    LU_CONSTEXPR uint64_t LUC_OP_IMM_SHIFT = 32;
+
+    bytecode_result bytecode_unsupported(diag_logger* p_log, const intermediate& i, string&& msg)
+    {
+        p_log->push(diag_context(diags::BYTECODE_UNSUPPORTED, i.srcref(), i.loc(), move(msg)));
+        return bytecode_result::BYTECODE_UNSUPPORTED;
+    }
+
+    bytecode_result bytecode_invalid(diag_logger* p_log, string&& msg)
+    {
+        p_log->push(diag_context(diags::BYTECODE_INVALID, source_reference(), source_location(), string::join("invalid .luc: ", msg)));
+        return bytecode_result::BYTECODE_INVALID;
+    }
+
+    bytecode_result bytecode_io(diag_logger* p_log, string&& msg)
+    {
+        p_log->push(diag_context(diags::BYTECODE_IO, source_reference(), source_location(), move(msg)));
+        return bytecode_result::BYTECODE_IO;
+    }
+
+    // the header alone, p_data is 8 byte aligned
+    bool check_header(const uint8_t* p_data, size_t size, string* p_err)
+    {
+        if (size < sizeof(luc_header))
+        {
+            *p_err = "shorter than its header";
+            return false;
+        }
+        const luc_header& h = *reinterpret_cast<const luc_header*>(p_data);
+        if (h.magic != LUC_MAGIC)
+        {
+            *p_err = "no magic";
+            return false;
+        }
+        if (h.byte_order != LUC_BYTE_ORDER)
+        {
+            *p_err = "written on a host of another byte order";
+            return false;
+        }
+        if (h.version != BYTECODE_VERSION)
+        {
+            *p_err = string::join("version ", to_string(h.version), ", expected ", to_string(BYTECODE_VERSION));
+            return false;
+        }
+        if (h.size != size)
+        {
+            *p_err = string::join("size ", to_string(size), ", expected ", to_string(h.size));
+            return false;
+        }
+        return true;
+    }
+
+    struct bytecode_writer
+    {
+        bytecode_writer(const intermediate_program* p_ip, diag_logger* p_log) : ip(*p_ip), p_log(p_log), res(bytecode_result::BYTECODE_OK) {}
+
+        const intermediate_program& ip;
+        diag_logger* p_log;
+        bytecode_result res;
+
+        vector<luc_intermediate> insts;
+        vector<luc_value> consts;
+        vector<luc_type> types;
+        vector<luc_member> members;
+        vector<luc_symbol> syms;
+        vector<luc_intrinsic> intrs;
+        vector<luc_frame> frames;
+        vector<luc_line> lines;
+        vector<uint8_t> strings;
+
+        luc_string put_string(string_view s)
+        {
+            luc_string ls;
+            ls.offset = strings.size();
+            ls.size = s.size();
+            strings.insert(strings.end(), s.buffer(), s.buffer() + s.size());
+            return ls;
+        }
+
+        luc_member put_member(type_id tid, string_view name)
+        {
+            luc_member m;
+            m.tclass = tid.tclass;
+            m.tidx = tid.idx;
+            m.name = put_string(name);
+            return m;
+        }
+
+        void encode_intrinsic(const intermediate_intrinsic& intr, luc_intermediate* r)
+        {
+            r->words[0] = static_cast<uint64_t>(intr.icode) | (static_cast<uint64_t>(intr.op_imm) << LUC_OP_IMM_SHIFT);
+            r->words[1] = intr.iid;
+            r->words[2] = intr.dest;
+            r->words[3] = intr.op;
+            r->words[4] = intr.dest_reg;
+            r->words[5] = intr.op_reg;
+            r->words[6] = intr.imm.bits;
+        }
+
+        // nested intermediates are queued in pending at the same index as their record
+        luc_intermediate encode(const intermediate& i, vector<const intermediate*>* p_pending)
+        {
+            luc_intermediate r = luc_intermediate();
+            r.op = static_cast<uint32_t>(i.op());
+            r.subs = insts.size();
+            auto sub = [&](const intermediate& s)
+            {
+                ++r.nsubs;
+                p_pending->push_back(&s);
+                insts.push_back(luc_intermediate());
+            };
+            auto sub_intrinsic = [&](const intermediate_intrinsic& intr)
+            {
+                luc_intermediate s = luc_intermediate();
+                s.op = intermediate::INTRINSIC;
+                encode_intrinsic(intr, &s);
+                ++r.nsubs;
+                p_pending->push_back(nullptr);
+                insts.push_back(s);
+            };
+
+            switch (i.op())
+            {
+            case intermediate::ILLEGAL:
+            case intermediate::HALT:
+                break;
+            case intermediate::LOAD_CONSTANT:
+                r.words[0] = i.imm.idx;
+                r.words[1] = i.imm.bits.bits;
+                break;
+            case intermediate::LOAD_SYMBOL:
+                r.words[0] = i.load.sid;
+                r.words[1] = i.load.tid.tclass;
+                r.words[2] = i.load.tid.idx;
+                r.words[3] = static_cast<uint64_t>(i.load.slot);
+                r.words[4] = i.load.reg;
+                break;
+            case intermediate::STORE_SYMBOL:
+            case intermediate::STORE_CONSTANT:
+            case intermediate::STORE_COPY:
+                r.words[0] = i.store.sid;
+                r.words[1] = static_cast<uint64_t>(i.store.slot);
+                r.words[2] = i.store.reg;
+                sub(*i.store.eval);
+                break;
+            case intermediate::INTRINSIC_PAIR:
+                sub_intrinsic(i.intr2.first);
+                sub_intrinsic(i.intr2.second);
+                break;
+            case intermediate::INTRINSIC_TRIPLE:
+                sub_intrinsic(i.intr3.first);
+                sub_intrinsic(i.intr3.second);
+                sub_intrinsic(i.intr3.third);
+                break;
+            case intermediate::BLOCK:
+                if (i.blk.locals.size() != 0)
+                {
+                    res = bytecode_unsupported(p_log, i, "block with locals");
+                }
+                for (size_t k = 0; k < i.blk.subs.size(); ++k)
+                {
+                    sub(i.blk.subs[k]);
+                }
+                break;
+            case intermediate::TUPLE:
+                r.words[0] = i.tup.tid.tclass;
+                r.words[1] = i.tup.tid.idx;
+                for (size_t k = 0; k < i.tup.subs.size(); ++k)
+                {
+                    sub(i.tup.subs[k]);
+                }
+                break;
+            case intermediate::CALL:
+            case intermediate::TAIL_CALL:
+                r.words[0] = i.call.fid;
+                r.words[1] = i.call.result;
+                r.words[2] = static_cast<uint64_t>(i.call.result_slot);
+                r.words[3] = i.call.result_reg;
+                for (size_t k = 0; k < i.call.args.size(); ++k)
+                {
+                    sub(i.call.args[k]);
+                }
+                break;
+            case intermediate::RETURN:
+                if (i.ret.eval)
+                {
+                    sub(*i.ret.eval);
+                }
+                break;
+            case intermediate::BRANCH:
+                r.words[0] = i.br.base;
+                r.words[1] = i.br.offset.sign;
+                r.words[2] = i.br.offset.abs_offset;
+                r.words[3] = i.br.negated;
+                if (i.br.condition)
+                {
+                    sub(*i.br.condition);
+                }
+                break;
+            default:
+                if (i.op() == intermediate::INTRINSIC || istypedintrinsic(i.op()))
+                {
+                    encode_intrinsic(i.intr, &r);
+                    break;
+                }
+                throw internal_except_unhandled_switch(intermediate_op_cstr(i.op()));
+            }
+            return r;
+        }
+
+        void write_intermediates()
+        {
+            vector<const intermediate*> pending;
+            for (intermediate_addr iaddr = 0; iaddr < ip.size(); ++iaddr)
+            {
+                pending.push_back(&ip[iaddr]);
+                insts.push_back(luc_intermediate());
+            }
+            for (size_t k = 0; k < pending.size(); ++k)
+            {
+                if (pending[k])
+                {
+                    luc_intermediate r = encode(*pending[k], &pending);
+                    insts[k] = r;
+                }
+            }
+        }
+
+        luc_value encode(const intermediate_value& val, vector<const intermediate_value*>* p_pending)
+        {
+            luc_value r = luc_value();
+            r.tclass = static_cast<uint32_t>(val.tid().tclass);
+            r.tidx = val.tid().idx;
+            r.subs = consts.size();
+            auto sub = [&](const intermediate_value& s)
+            {
+                ++r.nsubs;
+                p_pending->push_back(&s);
+                consts.push_back(luc_value());
+            };
+
+            switch (val.tid().tclass)
+            {
+            case type_class::UNDEFINED:
+            case type_class::VOID:
+                break;
+            case type_class::BUILTIN:
+                if (ip.context().types().find_type(val.tid()).bin == builtin_type::TYPEID)
+                {
+                    r.words[0] = val.bin.tid.tclass;
+                    r.words[1] = val.bin.tid.idx;
+                }
+                else
+                {
+                    r.words[0] = to_scalar(val.bin).bits;
+                }
+                break;
+            case type_class::LITERAL:
+            {
+                luc_string text = put_string(val.lit.text);
+                r.words[0] = text.offset;
+                r.words[1] = text.size;
+                break;
+            }
+            case type_class::FUNCTION:
+                r.words[0] = val.func.faddr;
+                break;
+            case type_class::INTRINSIC:
+                r.words[0] = val.intr.iid;
+                break;
+            case type_class::TUPLE:
+                for (size_t k = 0; k < val.tup.vals.size(); ++k)
+                {
+                    sub(val.tup.vals[k]);
+                }
+                break;
+            case type_class::UNION:
+                r.words[0] = val.un.active.tclass;
+                r.words[1] = val.un.active.idx;
+                if (val.un.val)
+                {
+                    sub(*val.un.val);
+                }
+                break;
+            default:
+                p_log->push(diag_context(diags::BYTECODE_UNSUPPORTED, source_reference(), source_location(),
+                    string::join("constant of type ", ip.context().types().name(val.tid()))));
+                res = bytecode_result::BYTECODE_UNSUPPORTED;
+                break;
+            }
+            return r;
+        }
+
+        void write_constants()
+        {
+            vector<const intermediate_value*> pending;
+            for (size_t k = 0; k < ip.constants().size(); ++k)
+            {
+                pending.push_back(&ip.constants()[static_cast<intermediate_constant>(k)]);
+                consts.push_back(luc_value());
+            }
+            for (size_t k = 0; k < pending.size(); ++k)
+            {
+                luc_value r = encode(*pending[k], &pending);
+                consts[k] = r;
+            }
+        }
+
+        void write_types()
+        {
+            const type_registry& reg = ip.context().types();
+            for (uint64_t c = 0; c <= type_class::_label_LAST; ++c)
+            {
+                type_class tclass = static_cast<type_class>(c);
+                for (type_idx idx = 0; idx < reg.count(tclass); ++idx)
+                {
+                    const type& ty = reg.find_type(type_id(tclass, idx));
+                    luc_type r = luc_type();
+                    r.tclass = static_cast<uint32_t>(tclass);
+                    r.idx = idx;
+                    r.members = members.size();
+                    switch (ty.tclass)
+                    {
+                    case type_class::UNDEFINED:
+                    case type_class::VOID:
+                        break;
+                    case type_class::LITERAL:
+                        r.kind = static_cast<uint64_t>(ty.lit);
+                        break;
+                    case type_class::BUILTIN:
+                        r.kind = static_cast<uint64_t>(ty.bin);
+                        break;
+                    case type_class::INTRINSIC:
+                        r.kind = ty.intr.config;
+                        members.push_back(put_member(ty.intr.params[intrinsic_type::DEST_PARAM], ""));
+                        members.push_back(put_member(ty.intr.params[intrinsic_type::OP_PARAM], ""));
+                        break;
+                    case type_class::FUNCTION:
+                        members.push_back(put_member(ty.fun.ret, ""));
+                        for (size_t k = 0; k < ty.fun.param_count(); ++k)
+                        {
+                            members.push_back(put_member(ty.fun[k].tid, ty.fun[k].name));
+                        }
+                        break;
+                    case type_class::TUPLE:
+                        for (size_t k = 0; k < ty.tup.arity(); ++k)
+                        {
+                            members.push_back(put_member(ty.tup[k].tid, ty.tup[k].name));
+                        }
+                        break;
+                    case type_class::UNION:
+                        for (type_id tid : ty.un.types)
+                        {
+                            members.push_back(put_member(tid, ""));
+                        }
+                        break;
+                    default:
+                        p_log->push(diag_context(diags::BYTECODE_UNSUPPORTED, source_reference(), source_location(),
+                            string::join("type ", reg.name(type_id(tclass, idx)))));
+                        res = bytecode_result::BYTECODE_UNSUPPORTED;
+                        break;
+                    }
+                    r.nmembers = static_cast<uint32_t>(members.size() - r.members);
+                    types.push_back(r);
+                }
+            }
+        }
+
+        void write_symbols()
+        {
+            const symbol_table& st = ip.context().symbols();
+            for (symbol_id sid = 0; sid < st.size(); ++sid)
+            {
+                const symbol& sym = st[sid];
+                luc_symbol r;
+                r.tclass = sym.tid.tclass;
+                r.tidx = sym.tid.idx;
+                r.name = put_string(sym.name);
+                r.flags = static_cast<uint64_t>(sym.flags.raw());
+                syms.push_back(r);
+            }
+            for (intrinsic_id iid = 0; iid < st.intrinsic_count(); ++iid)
+            {
+                const intrinsic& intr = st.find_intrinsic(iid);
+                luc_intrinsic r;
+                r.name = put_string(intr.name);
+                r.icode = static_cast<uint64_t>(intr.icode);
+                r.config = intr.itype.config;
+                r.params[0] = intr.itype.params[0].tclass;
+                r.params[1] = intr.itype.params[0].idx;
+                r.params[2] = intr.itype.params[1].tclass;
+                r.params[3] = intr.itype.params[1].idx;
+                intrs.push_back(r);
+            }
+        }
+
+        void write_frames()
+        {
+            for (intermediate_frame_id fid = 0; fid < ip.frame_count(); ++fid)
+            {
+                const intermediate_frame& f = ip.frame(fid);
+                luc_frame r;
+                r.entry = f.entry;
+                r.nscalars = f.nscalars;
+                r.naggregates = f.naggregates;
+                frames.push_back(r);
+            }
+
+            source_location prev;
+            for (intermediate_addr iaddr = 0; iaddr < ip.size(); ++iaddr)
+            {
+                const source_location& loc = ip[iaddr].loc();
+                if (loc.pos != prev.pos || loc.line != prev.line || loc.col != prev.col)
+                {
+                    luc_line r;
+                    r.iaddr = iaddr;
+                    r.pos = loc.pos;
+                    r.line = loc.line;
+                    r.col = loc.col;
+                    lines.push_back(r);
+                    prev = loc;
+                }
+            }
+        }
+
+        template <typename T>
+        static void put_section(const vector<T>& recs, vector<uint8_t>* p_out, luc_range* p_range)
+        {
+            p_out->resize((p_out->size() + 7) / 8 * 8, 0);
+            p_range->offset = p_out->size();
+            p_range->count = recs.size();
+            if (!recs.empty())
+            {
+                size_t at = p_out->size();
+                p_out->resize(at + recs.size() * sizeof(T));
+                std::memcpy(p_out->data() + at, recs.data(), recs.size() * sizeof(T));
+            }
+        }
+
+        void write(vector<uint8_t>* p_out)
+        {
+            write_types();
+            write_symbols();
+            write_constants();
+            write_frames();
+            write_intermediates();
+
+            luc_header h = luc_header();
+            h.magic = LUC_MAGIC;
+            h.version = BYTECODE_VERSION;
+            h.byte_order = LUC_BYTE_ORDER;
+            h.ninsts = ip.size();
+            h.nconstants = ip.constants().size();
+
+            p_out->assign(sizeof(luc_header), 0);
+            put_section(insts, p_out, &h.sections[LUC_INTERMEDIATES]);
+            put_section(consts, p_out, &h.sections[LUC_CONSTANTS]);
+            put_section(types, p_out, &h.sections[LUC_TYPES]);
+            put_section(members, p_out, &h.sections[LUC_MEMBERS]);
+            put_section(syms, p_out, &h.sections[LUC_SYMBOLS]);
+            put_section(intrs, p_out, &h.sections[LUC_INTRINSICS]);
+            put_section(frames, p_out, &h.sections[LUC_FRAMES]);
+            put_section(lines, p_out, &h.sections[LUC_LINES]);
+            put_section(strings, p_out, &h.sections[LUC_STRINGS]);
+            h.size = p_out->size();
+            std::memcpy(p_out->data(), &h, sizeof(h));
+        }
+    };
+
+    // every check fails with a message in err, which is logged once
+    struct bytecode_loader
+    {
+        bytecode_loader(const uint8_t* p_data, size_t size, intermediate_program* p_ip)
+            : p_data(p_data), size(size), ip(*p_ip), h(*reinterpret_cast<const luc_header*>(p_data)), max_reg(1),
+            class_first(type_class::_label_LAST + 1, 0), class_count(type_class::_label_LAST + 1, 0) {}
+
+        const uint8_t* p_data;
+        size_t size;
+        intermediate_program& ip;
+        const luc_header& h;
+        string err;
+        size_t max_reg; // registers of the largest frame, at least 1
+        vector<size_t> class_first; // type record of idx 0 of each class
+        vector<size_t> class_count;
+
+        bool fail(string&& msg)
+        {
+            err = move(msg);
+            return false;
+        }
+
+        template <typename T>
+        const T* section(luc_section s) const
+        {
+            return reinterpret_cast<const T*>(p_data + h.sections[s].offset);
+        }
+
+        size_t count(luc_section s) const
+        {
+            return static_cast<size_t>(h.sections[s].count);
+        }
+
+        template <typename T>
+        bool check_section(luc_section s)
+        {
+            const luc_range& r = h.sections[s];
+            if (r.offset % 8 != 0 || r.offset < sizeof(luc_header) || r.offset > size || r.count > (size - r.offset) / sizeof(T))
+            {
+                return fail(string::join("section ", to_string(static_cast<int>(s)), " out of the file"));
+            }
+            return true;
+        }
+
+        // [first, first + n) in a section of total records
+        static bool in_section(uint64_t first, uint64_t n, size_t total)
+        {
+            return first <= total && n <= total - first;
+        }
+
+        // and after the record at parent
+        static bool in_range(uint64_t first, uint64_t n, size_t total, size_t parent)
+        {
+            return n == 0 || (first > parent && in_section(first, n, total));
+        }
+
+        bool get_string(const luc_string& s, string_view* p_sv)
+        {
+            size_t n = count(LUC_STRINGS);
+            if (s.offset > n || s.size > n - s.offset)
+            {
+                return fail("string out of range");
+            }
+            *p_sv = string_view(reinterpret_cast<const char*>(section<uint8_t>(LUC_STRINGS) + s.offset), static_cast<size_t>(s.size));
+            return true;
+        }
+
+        bool get_type_id(uint64_t tclass, uint64_t tidx, type_id* p_tid)
+        {
+            if (tclass > type_class::_label_LAST)
+            {
+                return fail("type class out of range");
+            }
+            *p_tid = type_id(static_cast<type_class>(tclass), static_cast<type_idx>(tidx));
+            return true;
+        }
+
+        // of a registered type
+        bool get_existing_type_id(uint64_t tclass, uint64_t tidx, type_id* p_tid)
+        {
+            if (!get_type_id(tclass, tidx, p_tid))
+            {
+                return false;
+            }
+            return ip.context().types().exists(*p_tid) || fail(string::join("no type ", to_string(*p_tid)));
+        }
+
+        bool get_member(const luc_member& m, size_t depth, type_id* p_tid, string_view* p_name)
+        {
+            return get_type_id(m.tclass, m.tidx, p_tid) && ensure_type(*p_tid, depth + 1) && get_string(m.name, p_name);
+        }
+
+        bool decode_type(const luc_type& r, size_t depth, type* p_ty)
+        {
+            if (!in_section(r.members, r.nmembers, count(LUC_MEMBERS)))
+            {
+                return fail("type members out of range");
+            }
+            const luc_member* p_mems = section<luc_member>(LUC_MEMBERS) + r.members;
+            type_id tid;
+            string_view name;
+            switch (r.tclass)
+            {
+            case type_class::VOID:
+                *p_ty = type::create_void_type();
+                return true;
+            case type_class::LITERAL:
+                if (r.kind > static_cast<uint64_t>(literal_type::_label_LAST))
+                {
+                    return fail("literal type out of range");
+                }
+                *p_ty = type::create_literal_type(static_cast<literal_type>(r.kind));
+                return true;
+            case type_class::BUILTIN:
+                if (r.kind > static_cast<uint64_t>(builtin_type::_label_LAST))
+                {
+                    return fail("builtin type out of range");
+                }
+                *p_ty = type::create_builtin_type(static_cast<builtin_type>(r.kind));
+                return true;
+            case type_class::INTRINSIC:
+            {
+                if (r.kind > static_cast<uint64_t>(intrinsic_type::BOTH) || r.nmembers != 2)
+                {
+                    return fail("intrinsic type out of range");
+                }
+                intrinsic_type::param_config config = static_cast<intrinsic_type::param_config>(r.kind);
+                type_id params[2];
+                for (size_t k = 0; k < 2; ++k)
+                {
+                    // only the params of the config must be registered
+                    bool used = config == intrinsic_type::BOTH || (k == intrinsic_type::DEST_PARAM ? config == intrinsic_type::DEST_ONLY : config == intrinsic_type::OP_ONLY);
+                    if (!get_type_id(p_mems[k].tclass, p_mems[k].tidx, &params[k]) || (used && !ensure_type(params[k], depth + 1)))
+                    {
+                        return false;
+                    }
+                }
+                *p_ty = type::emplace_intrinsic_type(config, params[0], params[1]);
+                return true;
+            }
+            case type_class::FUNCTION:
+            {
+                if (r.nmembers == 0)
+                {
+                    return fail("function type with no return type");
+                }
+                type_id ret;
+                if (!get_member(p_mems[0], depth, &ret, &name))
+                {
+                    return false;
+                }
+                array<function_type::param> params(r.nmembers - 1);
+                for (size_t k = 0; k < params.size(); ++k)
+                {
+                    if (!get_member(p_mems[k + 1], depth, &tid, &name))
+                    {
+                        return false;
+                    }
+                    params[k] = function_type::param(tid, name);
+                }
+                *p_ty = type::emplace_function_type(ret, move(params));
+                return true;
+            }
+            case type_class::TUPLE:
+            {
+                array<tuple_type::member> mems(r.nmembers);
+                for (size_t k = 0; k < mems.size(); ++k)
+                {
+                    if (!get_member(p_mems[k], depth, &tid, &name))
+                    {
+                        return false;
+                    }
+                    mems[k] = tuple_type::member(tid, name);
+                }
+                *p_ty = type::emplace_tuple_type(move(mems));
+                return true;
+            }
+            case type_class::UNION:
+            {
+                union_type un;
+                for (size_t k = 0; k < r.nmembers; ++k)
+                {
+                    if (!get_member(p_mems[k], depth, &tid, &name))
+                    {
+                        return false;
+                    }
+                    un | tid;
+                }
+                *p_ty = type::create_union_type(move(un));
+                return true;
+            }
+            default:
+                return fail(string::join("type class ", to_string(r.tclass)));
+            }
+        }
+
+        // registers tid's class in index order up to tid, members first. types only refer to types registered before
+        // them, so depth past the number of types is a cycle
+        bool ensure_type(type_id tid, size_t depth)
+        {
+            type_registry& reg = ip.context().types();
+            if (reg.exists(tid))
+            {
+                return true;
+            }
+            if (tid.idx >= class_count[tid.tclass] || depth > count(LUC_TYPES))
+            {
+                return fail(string::join("no type ", to_string(tid)));
+            }
+            while (reg.count(tid.tclass) <= tid.idx)
+            {
+                size_t idx = reg.count(tid.tclass);
+                type ty;
+                if (!decode_type(section<luc_type>(LUC_TYPES)[class_first[tid.tclass] + idx], depth, &ty))
+                {
+                    return false;
+                }
+                // registering a member may have registered this one
+                if (reg.count(tid.tclass) != idx)
+                {
+                    continue;
+                }
+                if (ty.tclass != tid.tclass || reg.exists(ty))
+                {
+                    return fail(string::join("type ", to_string(type_id(tid.tclass, idx)), " is not new"));
+                }
+                reg.register_type(ty);
+            }
+            return true;
+        }
+
+        bool load_types()
+        {
+            const luc_type* p_types = section<luc_type>(LUC_TYPES);
+            for (size_t k = 0; k < count(LUC_TYPES); ++k)
+            {
+                const luc_type& r = p_types[k];
+                if (r.tclass > type_class::_label_LAST || (k > 0 && r.tclass < p_types[k - 1].tclass) || r.idx != class_count[r.tclass])
+                {
+                    return fail("types out of order");
+                }
+                if (class_count[r.tclass] == 0)
+                {
+                    class_first[r.tclass] = k;
+                }
+                ++class_count[r.tclass];
+            }
+            for (size_t k = 0; k < count(LUC_TYPES); ++k)
+            {
+                if (!ensure_type(type_id(static_cast<type_class>(p_types[k].tclass), static_cast<type_idx>(p_types[k].idx)), 0))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool load_symbols()
+        {
+            symbol_table& st = ip.context().symbols();
+            const luc_symbol* p_syms = section<luc_symbol>(LUC_SYMBOLS);
+            for (size_t k = 0; k < count(LUC_SYMBOLS); ++k)
+            {
+                type_id tid;
+                string_view name;
+                if (!get_existing_type_id(p_syms[k].tclass, p_syms[k].tidx, &tid) || !get_string(p_syms[k].name, &name))
+                {
+                    return false;
+                }
+                st.declare_hidden(symbol(tid, name, flags<symbol_flag>(static_cast<symbol_flag>(p_syms[k].flags))));
+            }
+            const luc_intrinsic* p_intrs = section<luc_intrinsic>(LUC_INTRINSICS);
+            for (size_t k = 0; k < count(LUC_INTRINSICS); ++k)
+            {
+                const luc_intrinsic& r = p_intrs[k];
+                type_id tid1;
+                type_id tid2;
+                string_view name;
+                if (r.icode > static_cast<uint64_t>(LOR) || r.config > static_cast<uint64_t>(intrinsic_type::BOTH))
+                {
+                    return fail("intrinsic out of range");
+                }
+                if (!get_type_id(r.params[0], r.params[1], &tid1) || !get_type_id(r.params[2], r.params[3], &tid2) || !get_string(r.name, &name))
+                {
+                    return false;
+                }
+                if (st.find_intrinsic_id(name) != intrinsic::INVALID_ID)
+                {
+                    return fail(string::join("intrinsic ", name, " declared twice"));
+                }
+                st.declare_intrinsic(intrinsic(name, static_cast<intrinsic_code>(r.icode), static_cast<intrinsic_type::param_config>(r.config), tid1, tid2));
+            }
+            return true;
+        }
+
+        bool decode_value(size_t k, intermediate_value* p_val)
+        {
+            const luc_value& r = section<luc_value>(LUC_CONSTANTS)[k];
+            type_id tid;
+            if (!get_existing_type_id(r.tclass, r.tidx, &tid))
+            {
+                return false;
+            }
+            if (!in_range(r.subs, r.nsubs, count(LUC_CONSTANTS), k))
+            {
+                return fail("constant members out of range");
+            }
+
+            switch (tid.tclass)
+            {
+            case type_class::UNDEFINED:
+            case type_class::VOID:
+            case type_class::BUILTIN:
+            case type_class::LITERAL:
+            case type_class::FUNCTION:
+            case type_class::INTRINSIC:
+            case type_class::TUPLE:
+            case type_class::UNION:
+                break;
+            default:
+                return fail(string::join("constant of type class ", to_string(r.tclass)));
+            }
+            intermediate_value val(tid);
+            switch (tid.tclass)
+            {
+            case type_class::BUILTIN:
+                if (ip.context().types().find_type(tid).bin == builtin_type::TYPEID)
+                {
+                    if (!get_existing_type_id(r.words[0], r.words[1], &val.bin.tid))
+                    {
+                        return false;
+                    }
+                }
+                else
+                {
+                    scalar_value sv;
+                    sv.bits = r.words[0];
+                    set_scalar(&val.bin, sv);
+                }
+                break;
+            case type_class::LITERAL:
+            {
+                luc_string text;
+                text.offset = r.words[0];
+                text.size = r.words[1];
+                string_view sv;
+                if (!get_string(text, &sv))
+                {
+                    return false;
+                }
+                val.lit.text = sv;
+                break;
+            }
+            case type_class::FUNCTION:
+                val.func.faddr = static_cast<intermediate_addr>(r.words[0]);
+                break;
+            case type_class::INTRINSIC:
+                if (r.words[0] >= ip.context().symbols().intrinsic_count())
+                {
+                    return fail("intrinsic out of range");
+                }
+                val.intr.iid = static_cast<intrinsic_id>(r.words[0]);
+                break;
+            case type_class::TUPLE:
+                val.tup.vals = array<intermediate_value>(r.nsubs);
+                for (size_t j = 0; j < r.nsubs; ++j)
+                {
+                    if (!decode_value(static_cast<size_t>(r.subs + j), &val.tup.vals[j]))
+                    {
+                        return false;
+                    }
+                }
+                break;
+            case type_class::UNION:
+                if (!get_existing_type_id(r.words[0], r.words[1], &val.un.active) || r.nsubs > 1)
+                {
+                    return r.nsubs > 1 ? fail("union with more than one value") : false;
+                }
+                if (r.nsubs == 1)
+                {
+                    val.un.val = make_unique(new intermediate_value());
+                    if (!decode_value(static_cast<size_t>(r.subs), val.un.val.get()))
+                    {
+                        return false;
+                    }
+                }
+                break;
+            default:
+                break;
+            }
+            *p_val = move(val);
+            return true;
+        }
+
+        bool load_constants()
+        {
+            if (h.nconstants > count(LUC_CONSTANTS))
+            {
+                return fail("constant pool out of range");
+            }
+            for (size_t k = 0; k < h.nconstants; ++k)
+            {
+                intermediate_value val;
+                if (!decode_value(k, &val))
+                {
+                    return false;
+                }
+                // the pool was interned, so no two constants are the same
+                if (ip.constants().intern(move(val)) != k)
+                {
+                    return fail(string::join("constant ", to_string(k), " is not new"));
+                }
+            }
+            return true;
+        }
+
+        bool load_frames()
+        {
+            const luc_frame* p_frames = section<luc_frame>(LUC_FRAMES);
+            for (size_t k = 0; k < count(LUC_FRAMES); ++k)
+            {
+                const luc_frame& r = p_frames[k];
+                if (r.entry > h.ninsts)
+                {
+                    return fail("frame entry out of range");
+                }
+                max_reg = std::max(max_reg, static_cast<size_t>(std::max(r.nscalars, r.naggregates)));
+                ip.push_frame(intermediate_frame(static_cast<intermediate_addr>(r.entry), static_cast<size_t>(r.nscalars), static_cast<size_t>(r.naggregates)));
+            }
+            return count(LUC_FRAMES) != 0 || fail("no top frame");
+        }
+
+        bool check_symbol(uint64_t sid, bool invalid_ok)
+        {
+            return (invalid_ok && sid == static_cast<uint64_t>(symbol::INVALID_ID)) || sid < ip.context().symbols().size() || fail("symbol out of range");
+        }
+
+        bool check_register(uint64_t slot, uint64_t reg)
+        {
+            return (slot <= static_cast<uint64_t>(intermediate_slot::AGGREGATE) && reg < max_reg) || fail("register out of range");
+        }
+
+        bool decode_intrinsic(const luc_intermediate& r, intermediate_intrinsic* p_intr)
+        {
+            uint64_t icode = r.words[0] & ((uint64_t(1) << LUC_OP_IMM_SHIFT) - 1);
+            bool op_imm = (r.words[0] >> LUC_OP_IMM_SHIFT) != 0;
+            if (icode > static_cast<uint64_t>(LOR) || r.words[1] >= ip.context().symbols().intrinsic_count())
+            {
+                return fail("intrinsic out of range");
+            }
+            if (!check_symbol(r.words[2], true) || !check_symbol(r.words[3], true)
+                || !check_register(0, r.words[4]) || !check_register(0, r.words[5]))
+            {
+                return false;
+            }
+            *p_intr = intermediate_intrinsic(static_cast<intrinsic_code>(icode), static_cast<intrinsic_id>(r.words[1]), static_cast<symbol_id>(r.words[2]),
+                static_cast<symbol_id>(r.words[3]), static_cast<intermediate_register>(r.words[4]), static_cast<intermediate_register>(r.words[5]));
+            p_intr->op_imm = op_imm;
+            p_intr->imm.bits = r.words[6];
+            return true;
+        }
+
+        // an INTRINSIC record among the subs
+        bool decode_sub_intrinsic(const luc_intermediate& r, size_t j, intermediate_intrinsic* p_intr)
+        {
+            const luc_intermediate& s = section<luc_intermediate>(LUC_INTERMEDIATES)[r.subs + j];
+            if (s.op != intermediate::INTRINSIC || s.nsubs != 0)
+            {
+                return fail("fused intrinsic is not an intrinsic");
+            }
+            return decode_intrinsic(s, p_intr);
+        }
+
+        bool decode_subs(const luc_intermediate& r, array<intermediate>* p_subs)
+        {
+            *p_subs = array<intermediate>(r.nsubs);
+            for (size_t j = 0; j < r.nsubs; ++j)
+            {
+                if (!decode(static_cast<size_t>(r.subs + j), &(*p_subs)[j]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // the only sub, or null if there is none and that is allowed
+        bool decode_eval(const luc_intermediate& r, bool optional, unique<intermediate>* p_eval)
+        {
+            if (r.nsubs > 1 || (r.nsubs == 0 && !optional))
+            {
+                return fail(string::join(intermediate_op_cstr(static_cast<intermediate::intermediate_op>(r.op)), " with ", to_string(r.nsubs), " evals"));
+            }
+            if (r.nsubs == 0)
+            {
+                *p_eval = nullptr;
+                return true;
+            }
+            *p_eval = make_unique(new intermediate());
+            return decode(static_cast<size_t>(r.subs), p_eval->get());
+        }
+
+        bool decode(size_t k, intermediate* p_i)
+        {
+            const luc_intermediate& r = section<luc_intermediate>(LUC_INTERMEDIATES)[k];
+            if (r.op > intermediate::_label_TYPED_INTRINSIC_LAST)
+            {
+                return fail("op out of range");
+            }
+            if (!in_range(r.subs, r.nsubs, count(LUC_INTERMEDIATES), k))
+            {
+                return fail("nested intermediates out of range");
+            }
+
+            intermediate::intermediate_op op = static_cast<intermediate::intermediate_op>(r.op);
+            unique<intermediate> eval;
+            array<intermediate> subs;
+            intermediate_intrinsic intr[3] =
+            {
+                intermediate_intrinsic(I32PRINT, 0, 0, 0, 0, 0), intermediate_intrinsic(I32PRINT, 0, 0, 0, 0, 0), intermediate_intrinsic(I32PRINT, 0, 0, 0, 0, 0)
+            };
+            switch (op)
+            {
+            case intermediate::ILLEGAL:
+                *p_i = intermediate();
+                return true;
+            case intermediate::HALT:
+                *p_i = intermediate::create_halt();
+                return true;
+            case intermediate::LOAD_CONSTANT:
+            {
+                if (r.words[0] >= ip.constants().size())
+                {
+                    return fail("constant out of range");
+                }
+                scalar_value bits;
+                bits.bits = r.words[1];
+                *p_i = intermediate::emplace_load_constant(static_cast<intermediate_constant>(r.words[0]), bits);
+                return true;
+            }
+            case intermediate::LOAD_SYMBOL:
+            {
+                type_id tid;
+                if (!check_symbol(r.words[0], false) || !get_existing_type_id(r.words[1], r.words[2], &tid) || !check_register(r.words[3], r.words[4]))
+                {
+                    return false;
+                }
+                *p_i = intermediate::emplace_load_symbol(static_cast<symbol_id>(r.words[0]), tid, static_cast<intermediate_slot>(r.words[3]),
+                    static_cast<intermediate_register>(r.words[4]));
+                return true;
+            }
+            case intermediate::STORE_SYMBOL:
+            case intermediate::STORE_CONSTANT:
+            case intermediate::STORE_COPY:
+            {
+                if (!check_symbol(r.words[0], false) || !check_register(r.words[1], r.words[2]) || !decode_eval(r, false, &eval))
+                {
+                    return false;
+                }
+                if ((op == intermediate::STORE_CONSTANT && eval->op() != intermediate::LOAD_CONSTANT) || (op == intermediate::STORE_COPY && eval->op() != intermediate::LOAD_SYMBOL))
+                {
+                    return fail(string::join(intermediate_op_cstr(op), " of ", intermediate_op_cstr(eval->op())));
+                }
+                intermediate_store_symbol store(static_cast<symbol_id>(r.words[0]), static_cast<intermediate_slot>(r.words[1]),
+                    static_cast<intermediate_register>(r.words[2]), move(eval));
+                *p_i = op == intermediate::STORE_CONSTANT ? intermediate::create_store_constant(move(store))
+                    : op == intermediate::STORE_COPY ? intermediate::create_store_copy(move(store))
+                    : intermediate::create_store_symbol(move(store));
+                return true;
+            }
+            case intermediate::INTRINSIC:
+                if (r.nsubs != 0 || !decode_intrinsic(r, &intr[0]))
+                {
+                    return r.nsubs != 0 ? fail("intrinsic with nested intermediates") : false;
+                }
+                *p_i = intermediate::create_intrinsic(intr[0]);
+                return true;
+            case intermediate::INTRINSIC_PAIR:
+            case intermediate::INTRINSIC_TRIPLE:
+            {
+                size_t n = op == intermediate::INTRINSIC_PAIR ? 2 : 3;
+                if (r.nsubs != n)
+                {
+                    return fail(string::join(intermediate_op_cstr(op), " of ", to_string(r.nsubs), " intrinsics"));
+                }
+                for (size_t j = 0; j < n; ++j)
+                {
+                    if (!decode_sub_intrinsic(r, j, &intr[j]))
+                    {
+                        return false;
+                    }
+                }
+                *p_i = n == 2 ? intermediate::create_intrinsic_pair(intermediate_intrinsic_pair(intr[0], intr[1]))
+                    : intermediate::create_intrinsic_triple(intermediate_intrinsic_triple(intr[0], intr[1], intr[2]));
+                return true;
+            }
+            case intermediate::BLOCK:
+                if (!decode_subs(r, &subs))
+                {
+                    return false;
+                }
+                *p_i = intermediate::create_block();
+                p_i->blk.subs = move(subs);
+                return true;
+            case intermediate::TUPLE:
+            {
+                type_id tid;
+                if (!get_existing_type_id(r.words[0], r.words[1], &tid) || !decode_subs(r, &subs))
+                {
+                    return false;
+                }
+                *p_i = intermediate::emplace_tuple(tid, move(subs));
+                return true;
+            }
+            case intermediate::CALL:
+            case intermediate::TAIL_CALL:
+            {
+                if (r.words[0] >= ip.frame_count())
+                {
+                    return fail("frame out of range");
+                }
+                if (!check_symbol(r.words[1], true) || !check_register(r.words[2], r.words[3]) || !decode_subs(r, &subs))
+                {
+                    return false;
+                }
+                intermediate_call call(static_cast<intermediate_frame_id>(r.words[0]), move(subs), static_cast<symbol_id>(r.words[1]),
+                    static_cast<intermediate_slot>(r.words[2]), static_cast<intermediate_register>(r.words[3]));
+                *p_i = op == intermediate::CALL ? intermediate::create_call(move(call)) : intermediate::create_tail_call(move(call));
+                return true;
+            }
+            case intermediate::RETURN:
+                if (!decode_eval(r, true, &eval))
+                {
+                    return false;
+                }
+                *p_i = intermediate::emplace_return(move(eval));
+                return true;
+            case intermediate::BRANCH:
+                if (r.words[1] > 1 || r.words[3] > 1)
+                {
+                    return fail("branch out of range");
+                }
+                if (!decode_eval(r, true, &eval))
+                {
+                    return false;
+                }
+                *p_i = intermediate::emplace_branch(static_cast<intermediate_addr>(r.words[0]), move(eval),
+                    intermediate_branch::branch_offset(r.words[1] != 0, static_cast<size_t>(r.words[2])), r.words[3] != 0);
+                return true;
+            default:
+                // typed intrinsics, the op follows from the icode and whether the op is an immediate
+                if (r.nsubs != 0 || !decode_intrinsic(r, &intr[0]))
+                {
+                    return r.nsubs != 0 ? fail("intrinsic with nested intermediates") : false;
+                }
+                *p_i = intermediate::create_typed_intrinsic(intr[0]);
+                return p_i->op() == op || fail(string::join(intermediate_op_cstr(op), " of ", intrinsic_code_cstr(intr[0].icode)));
+            }
+        }
+
+        bool load_intermediates()
+        {
+            if (h.ninsts > count(LUC_INTERMEDIATES))
+            {
+                return fail("program out of range");
+            }
+            vector<intermediate> code(static_cast<size_t>(h.ninsts));
+            for (size_t k = 0; k < code.size(); ++k)
+            {
+                if (!decode(k, &code[k]))
+                {
+                    return false;
+                }
+            }
+
+            // locations hold until the next line record
+            const luc_line* p_lines = section<luc_line>(LUC_LINES);
+            for (size_t k = 0; k < count(LUC_LINES); ++k)
+            {
+                const luc_line& r = p_lines[k];
+                uint64_t end = k + 1 < count(LUC_LINES) ? p_lines[k + 1].iaddr : h.ninsts;
+                if (r.iaddr >= end || end > h.ninsts)
+                {
+                    return fail("line table out of order");
+                }
+                for (uint64_t iaddr = r.iaddr; iaddr < end; ++iaddr)
+                {
+                    code[static_cast<size_t>(iaddr)].set_loc(source_location(static_cast<size_t>(r.pos), static_cast<size_t>(r.line), static_cast<size_t>(r.col)));
+                }
+            }
+            ip.rewrite(move(code));
+            return true;
+        }
+
+        bool load()
+        {
+            return check_section<luc_intermediate>(LUC_INTERMEDIATES) && check_section<luc_value>(LUC_CONSTANTS)
+                && check_section<luc_type>(LUC_TYPES) && check_section<luc_member>(LUC_MEMBERS)
+                && check_section<luc_symbol>(LUC_SYMBOLS) && check_section<luc_intrinsic>(LUC_INTRINSICS)
+                && check_section<luc_frame>(LUC_FRAMES) && check_section<luc_line>(LUC_LINES) && check_section<uint8_t>(LUC_STRINGS)
+                && load_types() && load_symbols() && load_constants() && load_frames() && load_intermediates();
+        }
+    };
+}
+
+bytecode_image::bytecode_image(bytecode_image&& other) : _p_data(other._p_data), _size(other._size), _mapped(other._mapped), _buf(move(other._buf))
+{
+    other._p_data = nullptr;
+    other._size = 0;
+    other._mapped = false;
+}
+
+bytecode_image::~bytecode_image()
+{
+    release();
+}
+
+bytecode_image& bytecode_image::operator=(bytecode_image&& other)
+{
+    if (this != &other)
+    {
+        release();
+        _p_data = other._p_data;
+        _size = other._size;
+        _mapped = other._mapped;
+        _buf = move(other._buf);
+        other._p_data = nullptr;
+        other._size = 0;
+        other._mapped = false;
+    }
+    return *this;
+}
+
+void bytecode_image::release()
+{
+#if LU_MMAP
+    if (_mapped)
+    {
+        munmap(const_cast<uint8_t*>(_p_data), _size);
+    }
+#endif // LU_MMAP
+    _p_data = nullptr;
+    _size = 0;
+    _mapped = false;
+    _buf.clear();
+}
+
+string to_string(const bytecode_stats& stats)
+{
+    return string::join(
+        to_string(stats.ninsts), " intermediates, ",
+        to_string(stats.nconstants), " constants, ",
+        to_string(stats.ntypes), " types, ",
+        to_string(stats.nsymbols), " symbols, ",
+        to_string(stats.size), " bytes");
+}
+
+bytecode_result bytecode_write(const intermediate_program* ip, vector<uint8_t>* p_out, diag_logger* p_log, bytecode_stats* p_stats)
+{
+    internal::bytecode_writer bw(ip, p_log);
+    bw.write(p_out);
+    if (p_stats)
+    {
+        p_stats->ninsts = bw.insts.size();
+        p_stats->nconstants = bw.consts.size();
+        p_stats->ntypes = bw.types.size();
+        p_stats->nsymbols = bw.syms.size();
+        p_stats->size = p_out->size();
+    }
+    return bw.res;
+}
+
+bytecode_result bytecode_save(const intermediate_program* ip, string_view path, diag_logger* p_log, bytecode_stats* p_stats)
+{
+    vector<uint8_t> bytes;
+    bytecode_result res = bytecode_write(ip, &bytes, p_log, p_stats);
+    if (!ok(res))
+    {
+        return res;
+    }
+    string file_path(path);
+    std::ofstream file(file_path.buffer(), std::ios::binary);
+    file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (!file)
+    {
+        return internal::bytecode_io(p_log, string::join("cannot write ", file_path));
+    }
+    return bytecode_result::BYTECODE_OK;
+}
+
+bytecode_result bytecode_map(string_view path, bytecode_image* p_image, diag_logger* p_log)
+{
+    p_image->release();
+    string file_path(path);
+#if LU_MMAP
+    int fd = open(file_path.buffer(), O_RDONLY);
+    if (fd < 0)
+    {
+        return internal::bytecode_io(p_log, string::join("cannot open ", file_path));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return internal::bytecode_invalid(p_log, string::join(file_path, " is empty"));
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        return internal::bytecode_io(p_log, string::join("cannot map ", file_path));
+    }
+    p_image->_p_data = static_cast<const uint8_t*>(p);
+    p_image->_size = size;
+    p_image->_mapped = true;
+#else
+    std::ifstream file(file_path.buffer(), std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return internal::bytecode_io(p_log, string::join("cannot open ", file_path));
+    }
+    size_t size = static_cast<size_t>(file.tellg());
+    p_image->_buf.resize((size + 7) / 8);
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(p_image->_buf.data()), static_cast<std::streamsize>(size));
+    if (!file)
+    {
+        p_image->release();
+        return internal::bytecode_io(p_log, string::join("cannot read ", file_path));
+    }
+    p_image->_p_data = reinterpret_cast<const uint8_t*>(p_image->_buf.data());
+    p_image->_size = size;
+#endif // LU_MMAP
+
+    string err;
+    if (!internal::check_header(p_image->_p_data, p_image->_size, &err))
+    {
+        p_image->release();
+        return internal::bytecode_invalid(p_log, string::join(file_path, ": ", err));
+    }
+    return bytecode_result::BYTECODE_OK;
+}
+
+bytecode_result bytecode_load(const uint8_t* p_data, size_t size, intermediate_program* p_ip, diag_logger* p_log, bytecode_stats* p_stats)
+{
+    string err;
+    if (reinterpret_cast<uintptr_t>(p_data) % 8 != 0)
+    {
+        return internal::bytecode_invalid(p_log, "image is not 8 byte aligned");
+    }
+    if (!internal::check_header(p_data, size, &err))
+    {
+        return internal::bytecode_invalid(p_log, move(err));
+    }
+
+    *p_ip = intermediate_program();
+    internal::bytecode_loader bl(p_data, size, p_ip);
+    if (!bl.load())
+    {
+        *p_ip = intermediate_program();
+        return internal::bytecode_invalid(p_log, move(bl.err));
+    }
+    // an image of a program that never went through the driver's passes still has its tail calls
+    lower_tail_calls(p_ip);
+    if (p_stats)
+    {
+        p_stats->ninsts = bl.count(internal::LUC_INTERMEDIATES);
+        p_stats->nconstants = bl.count(internal::LUC_CONSTANTS);
+        p_stats->ntypes = bl.count(internal::LUC_TYPES);
+        p_stats->nsymbols = bl.count(internal::LUC_SYMBOLS);
+        p_stats->size = size;
+    }
+    return bytecode_result::BYTECODE_OK;
+}
+
+bytecode_result bytecode_load(const bytecode_image& image, intermediate_program* p_ip, diag_logger* p_log, bytecode_stats* p_stats)
+{
+    if (image.empty())
+    {
+        return internal::bytecode_invalid(p_log, "empty image");
+    }
+    return bytecode_load(image.data(), image.size(), p_ip, p_log, p_stats);
+}
+
+}
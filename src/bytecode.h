@@ -0,0 +1,109 @@
+#ifndef LU_BYTECODE_H
+#define LU_BYTECODE_H
+
+#include "intermediate.h"
+#include "diag.h"
+#include "string.h"
+#include "adt/vector.h"
+#include "internal/constexpr.h"
+
+#include <cstdint>
+
+namespace lu
+{
+
+namespace diags
+{
+    extern diag BYTECODE_UNSUPPORTED;
+    extern diag BYTECODE_INVALID;
+    extern diag BYTECODE_IO;
+}
+
+// bumped on any change to the layout, files of another version are rejected
+LU_CONSTEXPR uint32_t BYTECODE_VERSION = 1;
+
+struct bytecode_stats
+{
+    bytecode_stats() : ninsts(0), nconstants(0), ntypes(0), nsymbols(0), size(0) {}
+
+    size_t ninsts; // records, nested intermediates included
+    size_t nconstants; // records, tuple and union members included
+    size_t ntypes;
+    size_t nsymbols;
+    size_t size; // bytes
+};
+
+string to_string(const bytecode_stats&);
+
+enum class bytecode_result
+{
+    BYTECODE_OK,
+    BYTECODE_UNSUPPORTED, // the program has something with no record (pointers, non empty block locals), logged
+    BYTECODE_INVALID, // not a .luc file of this version and byte order, or its records do not check, logged
+    BYTECODE_IO, // the file could not be read or written, logged
+};
+
+LU_CONSTEXPR bool ok(bytecode_result br)
+{
+    return br == bytecode_result::BYTECODE_OK;
+}
+
+// a .luc file, read only. mapped where mmap is available, read into memory otherwise
+struct bytecode_image
+{
+    bytecode_image() : _p_data(nullptr), _size(0), _mapped(false) {}
+    bytecode_image(bytecode_image&&);
+    bytecode_image(const bytecode_image&) = delete;
+    ~bytecode_image();
+
+    bytecode_image& operator=(bytecode_image&&);
+    bytecode_image& operator=(const bytecode_image&) = delete;
+
+    bool empty() const { return _p_data == nullptr; }
+    const uint8_t* data() const { return _p_data; }
+    size_t size() const { return _size; }
+    bool mapped() const { return _mapped; }
+
+private:
+    friend bytecode_result bytecode_map(string_view, bytecode_image*, diag_logger*);
+
+    void release();
+
+    const uint8_t* _p_data;
+    size_t _size;
+    bool _mapped;
+    vector<uint64_t> _buf; // if not mapped, 8 byte aligned like a mapping
+};
+
+// serialized program (.luc): a header, then one section per table, each an array of fixed size little endian
+// records at an 8 byte aligned offset from the start of the file:
+//   - intermediates: the program's, in address order, then every nested intermediate (store evals, call args,
+//     branch conditions...) after its parent, referenced by index and count
+//   - constants: the pool, in pool order, then the members of tuples and unions the same way
+//   - types: the type registry, by class then index, and their members
+//   - symbols and intrinsics of the symbol table, by id. lexical scopes are the front end's and are not kept
+//   - frames, and the debug line table: the source line and column of each address where it changes
+//   - strings: the bytes of every name and literal, referenced by offset and size
+// nothing in the file is an address, so the image can be mapped anywhere. the front end's static values are not
+// kept, nothing that runs reads them.
+// the image is not executed in place: the interpreter, jit and passes run on intermediates that own their nested
+// evals and on constants that own their strings and members, so bytecode_load rebuilds those from the records.
+// what a .luc saves is the front end (lexing, parsing, analysis, the transform) and the passes, not the load.
+bytecode_result bytecode_write(const intermediate_program*, vector<uint8_t>* p_out, diag_logger*, bytecode_stats* = nullptr);
+
+// bytecode_write to a file at path
+bytecode_result bytecode_save(const intermediate_program*, string_view path, diag_logger*, bytecode_stats* = nullptr);
+
+// opens a .luc file and checks its header, the records are only read by bytecode_load
+bytecode_result bytecode_map(string_view path, bytecode_image*, diag_logger*);
+
+// the program of an image, replacing *p_ip: one pass over each section, with no parsing, analysis or passes other
+// than lower_tail_calls() (see lower.h). every index is bounds checked (nested records must follow their parent, so
+// a file cannot loop), register numbers only against the largest frame. the program does not refer to the image,
+// which can be released after
+bytecode_result bytecode_load(const uint8_t* p_data, size_t size, intermediate_program*, diag_logger*, bytecode_stats* = nullptr);
+bytecode_result bytecode_load(const bytecode_image&, intermediate_program*, diag_logger*, bytecode_stats* = nullptr);
+
+}
+
+#endif // LU_BYTECODE_H
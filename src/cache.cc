@@ -0,0 +1,369 @@
+#include "cache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+// entries are kept as files, listed, timed and renamed with POSIX calls
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(LU_NO_CACHE)
+#   define LU_CACHE 1
+#   include <dirent.h>
+#   include <fcntl.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#else
+#   define LU_CACHE 0
+#endif // (defined(__unix__) || defined(__APPLE__)) && !defined(LU_NO_CACHE)
+
+namespace lu
+{
+
+namespace diags
+{
+    diag CACHE_IO = diag(diag::WARN_LEVEL, 6300);
+}
+
+const char* const COMPILER_VERSION = "lu 0.1";
+
+namespace internal
+{
+    LU_CONSTEXPR uint64_t CACHE_FNV_PRIME = 1099511628211ull;
+    const char* const CACHE_SUFFIX = ".luc";
+
+    void cache_io(diag_logger* p_log, string&& msg)
+    {
+        p_log->push(diag_context(diags::CACHE_IO, source_reference(), source_location(), string::join("compile cache: ", msg)));
+    }
+
+#if LU_CACHE
+    struct cache_entry
+    {
+        string path;
+        size_t size;
+        uint64_t touched; // ns
+    };
+
+    uint64_t touched_ns(const struct stat& st)
+    {
+#   if defined(__APPLE__)
+        return static_cast<uint64_t>(st.st_mtimespec.tv_sec) * 1000000000ull + static_cast<uint64_t>(st.st_mtimespec.tv_nsec);
+#   else
+        return static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ull + static_cast<uint64_t>(st.st_mtim.tv_nsec);
+#   endif // defined(__APPLE__)
+    }
+
+    // mkdir -p, the directories made are only the user's
+    bool make_dirs(const string& dir)
+    {
+        string partial;
+        for (size_t i = 0; i <= dir.size(); ++i)
+        {
+            if (i == dir.size() || (dir[i] == '/' && i != 0))
+            {
+                if (mkdir(partial.buffer(), 0700) != 0 && errno != EEXIST)
+                {
+                    return false;
+                }
+            }
+            if (i < dir.size())
+            {
+                partial.append(dir[i]);
+            }
+        }
+        return true;
+    }
+
+    // entries are programs that will run, so only this user may write them: the directory must be a directory (not a
+    // link to one) owned by the user, that neither its group nor others can write. false with why otherwise, or
+    // with nothing if it does not exist
+    bool private_dir(const string& dir, string* p_why)
+    {
+        struct stat st;
+        if (lstat(dir.buffer(), &st) != 0)
+        {
+            return false;
+        }
+        if (!S_ISDIR(st.st_mode))
+        {
+            *p_why = string::join(dir, " is not a directory");
+        }
+        else if (st.st_uid != getuid())
+        {
+            *p_why = string::join(dir, " is owned by another user");
+        }
+        else if ((st.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+        {
+            *p_why = string::join(dir, " can be written by other users");
+        }
+        return p_why->empty();
+    }
+
+    // all of n bytes, false on an error
+    bool write_all(int fd, const uint8_t* p, size_t n)
+    {
+        while (n != 0)
+        {
+            ssize_t nwritten = write(fd, p, n);
+            if (nwritten < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            p += nwritten;
+            n -= static_cast<size_t>(nwritten);
+        }
+        return true;
+    }
+
+    bool has_suffix(const char* name, const char* suffix)
+    {
+        string_view s(name);
+        string_view x(suffix);
+        return s.size() >= x.size() && string_view(s.buffer() + s.size() - x.size(), x.size()) == x;
+    }
+
+    vector<cache_entry> list_entries(const string& dir)
+    {
+        vector<cache_entry> entries;
+        DIR* p_dir = opendir(dir.buffer());
+        if (!p_dir)
+        {
+            return entries;
+        }
+        while (dirent* p_ent = readdir(p_dir))
+        {
+            if (!has_suffix(p_ent->d_name, CACHE_SUFFIX))
+            {
+                continue;
+            }
+            cache_entry e;
+            e.path = string::join(dir, "/", p_ent->d_name);
+            struct stat st;
+            if (stat(e.path.buffer(), &st) != 0 || !S_ISREG(st.st_mode))
+            {
+                continue;
+            }
+            e.size = static_cast<size_t>(st.st_size);
+            e.touched = touched_ns(st);
+            entries.push_back(move(e));
+        }
+        closedir(p_dir);
+        return entries;
+    }
+#endif // LU_CACHE
+}
+
+uint64_t cache_hash(const void* p_data, size_t size, uint64_t h)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(p_data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        h = (h ^ p[i]) * internal::CACHE_FNV_PRIME;
+    }
+    return h;
+}
+
+uint64_t cache_key(string_view source_text, string_view options)
+{
+    // each part is followed by its size, so moving bytes between parts changes the key
+    uint64_t h = 14695981039346656037ull;
+    string_view parts[] = { source_text, COMPILER_VERSION, options };
+    for (string_view part : parts)
+    {
+        h = cache_hash(part.buffer(), part.size(), h);
+        uint64_t size = part.size();
+        h = cache_hash(&size, sizeof(size), h);
+    }
+    uint32_t version = BYTECODE_VERSION;
+    return cache_hash(&version, sizeof(version), h);
+}
+
+cache_settings::cache_settings() : max_bytes(64 * 1024 * 1024)
+{
+    const char* env = std::getenv("LU_CACHE_DIR");
+    if (env && *env)
+    {
+        dir = env;
+        return;
+    }
+    env = std::getenv("XDG_CACHE_HOME");
+    if (env && *env)
+    {
+        dir = string::join(env, "/lu");
+        return;
+    }
+    env = std::getenv("HOME");
+    if (env && *env)
+    {
+        dir = string::join(env, "/.cache/lu");
+        return;
+    }
+    // one per user, /tmp is shared
+#if LU_CACHE
+    dir = string::join("/tmp/lu-cache-", to_string(static_cast<unsigned long>(getuid())));
+#else
+    dir = "/tmp/lu-cache";
+#endif // LU_CACHE
+}
+
+string to_string(const cache_stats& stats)
+{
+    return string::join(
+        "cache: ", to_string(stats.hits), " hits, ",
+        to_string(stats.misses), " misses, ",
+        to_string(stats.writes), " writes, ",
+        to_string(stats.evictions), " evicted, ",
+        to_string(stats.size), " bytes");
+}
+
+compile_cache::compile_cache(const cache_settings& settings) : _settings(settings)
+{}
+
+string compile_cache::path(uint64_t key) const
+{
+    const char* const HEX = "0123456789abcdef";
+    string name;
+    for (int shift = 60; shift >= 0; shift -= 4)
+    {
+        name.append(HEX[(key >> shift) & 0xf]);
+    }
+    return string::join(_settings.dir, "/", name, internal::CACHE_SUFFIX);
+}
+
+bool compile_cache::lookup(uint64_t key, intermediate_program* p_ip, diag_logger* p_log)
+{
+#if LU_CACHE
+    string entry = path(key);
+    if (!private_dir(p_log) || access(entry.buffer(), R_OK) != 0)
+    {
+        ++_stats.misses;
+        return false;
+    }
+    // a damaged or older entry is not an error, it is compiled again
+    diag_logger quiet(diag::MAX_LEVEL);
+    bytecode_image image;
+    if (!ok(bytecode_map(entry, &image, &quiet)) || !ok(bytecode_load(image, p_ip, &quiet)))
+    {
+        internal::cache_io(p_log, string::join("dropped ", entry, ", it does not load"));
+        std::remove(entry.buffer());
+        ++_stats.misses;
+        return false;
+    }
+    // the time of the last use, for eviction
+    utimensat(AT_FDCWD, entry.buffer(), nullptr, 0);
+    ++_stats.hits;
+    return true;
+#else
+    (void)key;
+    (void)p_ip;
+    (void)p_log;
+    ++_stats.misses;
+    return false;
+#endif // LU_CACHE
+}
+
+bool compile_cache::store(uint64_t key, const intermediate_program* ip, diag_logger* p_log)
+{
+#if LU_CACHE
+    vector<uint8_t> bytes;
+    if (!ok(bytecode_write(ip, &bytes, p_log)))
+    {
+        return false;
+    }
+    if (!internal::make_dirs(_settings.dir))
+    {
+        internal::cache_io(p_log, string::join("cannot make ", _settings.dir));
+        return false;
+    }
+    if (!private_dir(p_log))
+    {
+        return false;
+    }
+
+    // a new file of its own for every store, by any thread or process, then renamed over the entry in one step
+    string entry = path(key);
+    string tmp = string::join(entry, ".tmp.XXXXXX");
+    int fd = mkstemp(&tmp[0]);
+    if (fd < 0)
+    {
+        internal::cache_io(p_log, string::join("cannot make ", tmp));
+        return false;
+    }
+    bool written = internal::write_all(fd, bytes.data(), bytes.size());
+    if (close(fd) != 0 || !written)
+    {
+        std::remove(tmp.buffer());
+        internal::cache_io(p_log, string::join("cannot write ", tmp));
+        return false;
+    }
+    if (std::rename(tmp.buffer(), entry.buffer()) != 0)
+    {
+        std::remove(tmp.buffer());
+        internal::cache_io(p_log, string::join("cannot rename ", tmp));
+        return false;
+    }
+    ++_stats.writes;
+    evict(entry);
+    return true;
+#else
+    (void)key;
+    (void)ip;
+    (void)p_log;
+    return false;
+#endif // LU_CACHE
+}
+
+bool compile_cache::private_dir(diag_logger* p_log) const
+{
+#if LU_CACHE
+    string why;
+    if (!internal::private_dir(_settings.dir, &why))
+    {
+        if (!why.empty())
+        {
+            internal::cache_io(p_log, string::join("not used, ", why));
+        }
+        return false;
+    }
+    return true;
+#else
+    (void)p_log;
+    return false;
+#endif // LU_CACHE
+}
+
+void compile_cache::evict(const string& keep)
+{
+#if LU_CACHE
+    vector<internal::cache_entry> entries = internal::list_entries(_settings.dir);
+    size_t total = 0;
+    for (const internal::cache_entry& e : entries)
+    {
+        total += e.size;
+    }
+    std::sort(entries.begin(), entries.end(), [](const internal::cache_entry& lhs, const internal::cache_entry& rhs) { return lhs.touched < rhs.touched; });
+    for (size_t i = 0; i < entries.size() && total > _settings.max_bytes; ++i)
+    {
+        // the entry just written stays, even if it alone is over
+        if (string_view(entries[i].path) == string_view(keep))
+        {
+            continue;
+        }
+        // another process may have removed it already
+        if (std::remove(entries[i].path.buffer()) == 0)
+        {
+            ++_stats.evictions;
+        }
+        total -= entries[i].size;
+    }
+    _stats.size = total;
+#else
+    (void)keep;
+#endif // LU_CACHE
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef LU_CACHE_H
+#define LU_CACHE_H
+
+#include "intermediate.h"
+#include "bytecode.h"
+#include "diag.h"
+#include "string.h"
+#include "internal/constexpr.h"
+
+#include <cstdint>
+
+namespace lu
+{
+
+namespace diags
+{
+    extern diag CACHE_IO;
+}
+
+// part of every cache key. bump it with any change to the front end or the passes that changes the programs they
+// make, so programs cached by an older compiler are not loaded
+extern const char* const COMPILER_VERSION;
+
+// 64 bit FNV-1a of the bytes, continued from h
+uint64_t cache_hash(const void* p_data, size_t size, uint64_t h = 14695981039346656037ull);
+
+// of the source text, COMPILER_VERSION, the bytecode version and options, which must name every setting that
+// changes the compiled program (optimization level...)
+uint64_t cache_key(string_view source_text, string_view options);
+
+struct cache_settings
+{
+    cache_settings(); // dir is $LU_CACHE_DIR, else $XDG_CACHE_HOME/lu, else $HOME/.cache/lu, else /tmp/lu-cache-<uid>
+
+    string dir;
+    size_t max_bytes; // of all entries, least recently used ones are removed past it
+};
+
+struct cache_stats
+{
+    cache_stats() : hits(0), misses(0), writes(0), evictions(0), size(0) {}
+
+    size_t hits;
+    size_t misses;
+    size_t writes;
+    size_t evictions;
+    size_t size; // bytes of all entries, after the last write
+};
+
+// one line
+string to_string(const cache_stats&);
+
+// content addressed cache of compiled programs, one .luc file (see bytecode.h) per key in a directory, shared by
+// every thread and process of the user using it. the directory is made only the user's, and a directory another
+// user could write in is not used. entries are written to a temporary file of their own then renamed, so a reader
+// sees a whole entry or none. a hit touches its entry, and every write removes the least recently touched entries
+// until all fit in max_bytes. only hosts with POSIX files have it, elsewhere every lookup misses and nothing is stored
+struct compile_cache
+{
+    explicit compile_cache(const cache_settings& = cache_settings());
+
+    // replaces *p_ip with the entry of key. false on a miss, which also drops an entry that does not load
+    bool lookup(uint64_t key, intermediate_program* p_ip, diag_logger*);
+    // false if the entry could not be written, logged
+    bool store(uint64_t key, const intermediate_program*, diag_logger*);
+
+    const cache_settings& settings() const { return _settings; }
+    const cache_stats& stats() const { return _stats; }
+    string path(uint64_t key) const;
+
+private:
+    // false if the directory does not exist, or others could write entries in it (logged)
+    bool private_dir(diag_logger*) const;
+    void evict(const string& keep);
+
+    cache_settings _settings;
+    cache_stats _stats;
+};
+
+}
+
+#endif // LU_CACHE_H
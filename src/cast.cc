@@ -3,6 +3,7 @@
 #include "except.h"
 #include "string.h"
 #include "type.h"
+#include <cerrno>
 #include <cstdlib> // for strtof etc.
 #include <limits>
 #include <type_traits>
@@ -205,6 +206,60 @@ intermediate_value string_literal_to_builtin_cast(const type_registry& types, ty
     }
 }
 
+bool literal_to_builtin_castable(const type_registry& types, type_id to, type_id from, string_view text)
+{
+    if (!from.is(LITERAL) || !to.is(BUILTIN))
+    {
+        return false;
+    }
+
+    builtin_type bint = types.find_type(to).bin;
+    switch (types.find_type(from).lit)
+    {
+    case literal_type::STRING:
+        return bint == builtin_type::ASCII && text.size() == 1;
+    case literal_type::INTEGER:
+    {
+        string digits(text);
+        char* end;
+        errno = 0;
+        unsigned long long ull = std::strtoull(digits.buffer(), &end, 10);
+        if (errno == ERANGE || end != digits.buffer() + digits.size())
+        {
+            return false;
+        }
+        switch (bint)
+        {
+        case builtin_type::INT8:
+            return int_cast_in_range<int8_t>(ull);
+        case builtin_type::INT16:
+            return int_cast_in_range<int16_t>(ull);
+        case builtin_type::INT32:
+            return int_cast_in_range<int32_t>(ull);
+        case builtin_type::INT64:
+            return int_cast_in_range<int64_t>(ull);
+        case builtin_type::UINT8:
+            return int_cast_in_range<uint8_t>(ull);
+        case builtin_type::UINT16:
+            return int_cast_in_range<uint16_t>(ull);
+        case builtin_type::UINT32:
+            return int_cast_in_range<uint32_t>(ull);
+        case builtin_type::UINT64:
+            return true;
+        default:
+            return false;
+        }
+    }
+    case literal_type::TRUE: // falltrough
+    case literal_type::FALSE:
+        return bint == builtin_type::BOOL;
+    case literal_type::DECIMAL: // TODO
+    case literal_type::EMPTY_TUPLE:
+    default:
+        return false;
+    }
+}
+
 intermediate_value literal_to_builtin_cast(const type_registry& types, type_id to, const intermediate_value& val)
 {
     type_id from = val.tid();
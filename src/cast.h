@@ -6,6 +6,7 @@
 #include "flag.h"
 #include "type.h"
 #include "value.h"
+#include "string.h"
 
 namespace lu
 {
@@ -53,6 +54,8 @@ struct cast_edge
 
 // builtin casts
 intermediate_value literal_to_builtin_cast(const type_registry&, type_id to, const intermediate_value&);
+// whether literal_to_builtin_cast converts a literal of type from, written as text, to the builtin type to (in range)
+bool literal_to_builtin_castable(const type_registry&, type_id to, type_id from, string_view text);
 
 }
 
@@ -0,0 +1,279 @@
+#include "cfg.h"
+
+#include "utility.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace lu
+{
+
+namespace internal
+{
+    // cooper, harvey and kennedy, "a simple, fast dominance algorithm"
+    cfg_block_id intersect(const vector<cfg_block>& blocks, const vector<size_t>& order, cfg_block_id a, cfg_block_id b)
+    {
+        while (a != b)
+        {
+            while (order[a] > order[b])
+            {
+                a = blocks[a].idom;
+            }
+            while (order[b] > order[a])
+            {
+                b = blocks[b].idom;
+            }
+        }
+        return a;
+    }
+}
+
+LU_CONSTEXPR cfg_block_id control_flow_graph::NONE;
+LU_CONSTEXPR intermediate_frame_id control_flow_graph::NO_FRAME;
+LU_CONSTEXPR size_t control_flow_graph::NO_LOOP;
+
+cfg_block::cfg_block(intermediate_addr first, intermediate_addr end)
+    : first(first), end(end), fid(control_flow_graph::NO_FRAME), idom(control_flow_graph::NONE),
+    loop(control_flow_graph::NO_LOOP) {}
+
+control_flow_graph::control_flow_graph(const intermediate_program& ip)
+    : _block_of(ip.size(), NONE), _entries(ip.frame_count(), NONE), _rpo(ip.frame_count()), _shared(false)
+{
+    size_t n = ip.size();
+    vector<bool> leader(n + 1, false);
+    leader[0] = true;
+    for (intermediate_frame_id fid = 0; fid < ip.frame_count(); ++fid)
+    {
+        leader[std::min(ip.frame(fid).entry, n)] = true;
+    }
+    for (intermediate_addr iaddr = 0; iaddr < n; ++iaddr)
+    {
+        const intermediate& i = ip[iaddr];
+        if (isblockend(i.op()))
+        {
+            leader[iaddr + 1] = true;
+        }
+        if (i.op() == intermediate::BRANCH && i.br.target() < n)
+        {
+            leader[i.br.target()] = true;
+        }
+    }
+
+    for (intermediate_addr iaddr = 0; iaddr < n; ++iaddr)
+    {
+        if (leader[iaddr])
+        {
+            _blocks.push_back(cfg_block(iaddr, iaddr + 1));
+        }
+        else
+        {
+            ++_blocks.back().end;
+        }
+        _block_of[iaddr] = _blocks.size() - 1;
+    }
+
+    for (cfg_block_id id = 0; id < _blocks.size(); ++id)
+    {
+        const intermediate& last = ip[_blocks[id].last()];
+        intermediate_addr next = _blocks[id].end;
+        if (last.op() == intermediate::BRANCH)
+        {
+            if (last.br.condition && next < n)
+            {
+                _blocks[id].succs.push_back(_block_of[next]);
+            }
+            if (last.br.target() < n)
+            {
+                _blocks[id].succs.push_back(_block_of[last.br.target()]);
+            }
+        }
+        else if (!isblockend(last.op()) && next < n)
+        {
+            _blocks[id].succs.push_back(_block_of[next]);
+        }
+        for (cfg_block_id succ : _blocks[id].succs)
+        {
+            _blocks[succ].preds.push_back(id);
+        }
+    }
+
+    vector<size_t> order(_blocks.size(), 0); // reverse postorder index
+    for (intermediate_frame_id fid = 0; fid < ip.frame_count(); ++fid)
+    {
+        if (ip.frame(fid).entry >= n)
+        {
+            continue;
+        }
+        cfg_block_id eb = _block_of[ip.frame(fid).entry];
+        _entries[fid] = eb;
+        if (_blocks[eb].fid != NO_FRAME)
+        {
+            _shared = true;
+            continue;
+        }
+
+        // depth first, blocks are appended in postorder
+        vector<cfg_block_id>& rpo = _rpo[fid];
+        vector<std::pair<cfg_block_id, size_t>> stack; // block, next successor
+        _blocks[eb].fid = fid;
+        stack.push_back(std::make_pair(eb, size_t(0)));
+        while (!stack.empty())
+        {
+            cfg_block_id id = stack.back().first;
+            size_t k = stack.back().second;
+            if (k < _blocks[id].succs.size())
+            {
+                ++stack.back().second;
+                cfg_block_id succ = _blocks[id].succs[k];
+                if (_blocks[succ].fid == NO_FRAME)
+                {
+                    _blocks[succ].fid = fid;
+                    stack.push_back(std::make_pair(succ, size_t(0)));
+                }
+                else if (_blocks[succ].fid != fid)
+                {
+                    _shared = true;
+                }
+            }
+            else
+            {
+                rpo.push_back(id);
+                stack.pop_back();
+            }
+        }
+        std::reverse(rpo.begin(), rpo.end());
+        for (size_t k = 0; k < rpo.size(); ++k)
+        {
+            order[rpo[k]] = k;
+        }
+
+        _blocks[eb].idom = eb;
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (size_t k = 1; k < rpo.size(); ++k)
+            {
+                cfg_block_id id = rpo[k];
+                cfg_block_id idom = NONE;
+                for (cfg_block_id pred : _blocks[id].preds)
+                {
+                    if (_blocks[pred].fid != fid || _blocks[pred].idom == NONE)
+                    {
+                        continue;
+                    }
+                    idom = idom == NONE ? pred : internal::intersect(_blocks, order, pred, idom);
+                }
+                if (idom != _blocks[id].idom)
+                {
+                    _blocks[id].idom = idom;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    if (!_shared)
+    {
+        find_loops();
+    }
+}
+
+void control_flow_graph::find_loops()
+{
+    // one loop per header, its body grows backwards from the sources of the back edges
+    vector<bool> in_body(_blocks.size(), false);
+    for (intermediate_frame_id fid = 0; fid < _rpo.size(); ++fid)
+    {
+        for (cfg_block_id header : _rpo[fid])
+        {
+            cfg_loop lp;
+            lp.header = header;
+            lp.parent = NO_LOOP;
+            lp.depth = 1;
+            vector<cfg_block_id> work;
+            for (cfg_block_id pred : _blocks[header].preds)
+            {
+                if (is_back_edge(pred, header))
+                {
+                    work.push_back(pred);
+                }
+            }
+            if (work.empty())
+            {
+                continue;
+            }
+            lp.blocks.push_back(header);
+            in_body[header] = true;
+            while (!work.empty())
+            {
+                cfg_block_id id = work.back();
+                work.pop_back();
+                if (in_body[id])
+                {
+                    continue;
+                }
+                in_body[id] = true;
+                lp.blocks.push_back(id);
+                for (cfg_block_id pred : _blocks[id].preds)
+                {
+                    if (reachable(pred) && !in_body[pred])
+                    {
+                        work.push_back(pred);
+                    }
+                }
+            }
+            for (cfg_block_id id : lp.blocks)
+            {
+                in_body[id] = false;
+            }
+            _loops.push_back(move(lp));
+        }
+    }
+
+    // nested loops are strictly smaller, so going from the largest down the last loop seen containing a block is
+    // its innermost one
+    std::sort(_loops.begin(), _loops.end(), [](const cfg_loop& a, const cfg_loop& b)
+    {
+        return a.blocks.size() != b.blocks.size() ? a.blocks.size() > b.blocks.size() : a.header < b.header;
+    });
+    for (size_t lid = 0; lid < _loops.size(); ++lid)
+    {
+        cfg_loop& lp = _loops[lid];
+        lp.parent = _blocks[lp.header].loop;
+        lp.depth = lp.parent == NO_LOOP ? 1 : _loops[lp.parent].depth + 1;
+        for (cfg_block_id id : lp.blocks)
+        {
+            _blocks[id].loop = lid;
+        }
+    }
+}
+
+bool control_flow_graph::in_loop(cfg_block_id id, size_t lid) const
+{
+    size_t inner = _blocks[id].loop;
+    while (inner != NO_LOOP && inner != lid)
+    {
+        inner = _loops[inner].parent;
+    }
+    return inner == lid;
+}
+
+bool control_flow_graph::dominates(cfg_block_id a, cfg_block_id b) const
+{
+    if (!reachable(b))
+    {
+        return false;
+    }
+    while (b != a)
+    {
+        if (_blocks[b].idom == b)
+        {
+            return false;
+        }
+        b = _blocks[b].idom;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,91 @@
+#ifndef LU_CFG_H
+#define LU_CFG_H
+
+#include "intermediate.h"
+#include "adt/vector.h"
+#include "internal/constexpr.h"
+
+#include <limits>
+
+namespace lu
+{
+
+using cfg_block_id = size_t;
+
+// a maximal run of intermediates that is only entered at first and only left after the last
+struct cfg_block
+{
+    cfg_block(intermediate_addr first, intermediate_addr end);
+
+    intermediate_addr last() const { return end - 1; }
+
+    intermediate_addr first;
+    intermediate_addr end; // one past the last
+    intermediate_frame_id fid; // frame whose entry reaches the block, control_flow_graph::NO_FRAME if none does
+    vector<cfg_block_id> preds; // a block appears twice if both edges of a branch lead here
+    vector<cfg_block_id> succs;
+    cfg_block_id idom; // immediate dominator, the frame entry is its own. NONE if unreachable
+    size_t loop; // innermost loop containing the block, control_flow_graph::NO_LOOP if none
+};
+
+// natural loop of one header: the header and every block that reaches a back edge to it without passing it
+struct cfg_loop
+{
+    cfg_block_id header;
+    size_t parent; // innermost enclosing loop, control_flow_graph::NO_LOOP if outermost
+    size_t depth; // 1 for outermost loops
+    vector<cfg_block_id> blocks; // header first
+};
+
+// control flow graph of a program, split at branch targets, frame entries and after every intermediate that
+// does not fall through (BRANCH, RETURN, TAIL_CALL, HALT). a CALL does not end a block, the callee returns to
+// the intermediate after it. blocks are numbered in address order.
+struct control_flow_graph
+{
+    LU_CONSTEXPR static cfg_block_id NONE = std::numeric_limits<cfg_block_id>::max();
+    LU_CONSTEXPR static intermediate_frame_id NO_FRAME = std::numeric_limits<intermediate_frame_id>::max();
+    LU_CONSTEXPR static size_t NO_LOOP = std::numeric_limits<size_t>::max();
+
+    control_flow_graph(const intermediate_program&);
+
+    size_t size() const { return _blocks.size(); }
+    cfg_block& operator[](cfg_block_id id) { return _blocks[id]; }
+    const cfg_block& operator[](cfg_block_id id) const { return _blocks[id]; }
+
+    cfg_block_id block_of(intermediate_addr iaddr) const { return _block_of[iaddr]; }
+    cfg_block_id entry(intermediate_frame_id fid) const { return _entries[fid]; } // NONE if the frame has no code
+    // blocks reachable from the frame entry, in reverse postorder
+    const vector<cfg_block_id>& rpo(intermediate_frame_id fid) const { return _rpo[fid]; }
+    bool reachable(cfg_block_id id) const { return _blocks[id].idom != NONE; }
+    bool dominates(cfg_block_id a, cfg_block_id b) const;
+    // true if some block is reachable from more than one frame entry, frame local analyses do not apply then
+    bool shared() const { return _shared; }
+
+    // loops of reachable blocks, found from back edges (edges to a block that dominates the source). loops with
+    // a smaller index are never nested in loops with a larger one
+    size_t loop_count() const { return _loops.size(); }
+    const cfg_loop& loop(size_t lid) const { return _loops[lid]; }
+    size_t loop_depth(cfg_block_id id) const { return _blocks[id].loop == NO_LOOP ? 0 : _loops[_blocks[id].loop].depth; }
+    bool in_loop(cfg_block_id id, size_t lid) const;
+    bool is_back_edge(cfg_block_id from, cfg_block_id to) const { return dominates(to, from); }
+
+private:
+    void find_loops();
+
+    vector<cfg_block> _blocks;
+    vector<cfg_block_id> _block_of; // per address
+    vector<cfg_block_id> _entries; // per frame
+    vector<vector<cfg_block_id>> _rpo; // per frame
+    vector<cfg_loop> _loops;
+    bool _shared;
+};
+
+// the last intermediate of its block. only a conditional BRANCH of these may continue at the next address
+LU_CONSTEXPR bool isblockend(intermediate::intermediate_op op)
+{
+    return op == intermediate::BRANCH || op == intermediate::RETURN || op == intermediate::TAIL_CALL || op == intermediate::HALT;
+}
+
+}
+
+#endif // LU_CFG_H
@@ -0,0 +1,71 @@
+#include "server.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+
+// lu_client socket [file]
+// lu_client --path socket file
+// lu_client --shutdown socket
+// sends the source of file (stdin if none) to a server started with main --serve socket, prints the program's
+// output and diagnostics as they come and exits with its exit code (see server.h). --path sends the path instead,
+// for the server to read, relative to its root (main --serve-root). --shutdown stops the server
+int main(int argc, char** argv)
+{
+    lu::server_frame kind = lu::server_frame::SOURCE;
+    int i = 1;
+    if (i < argc && std::strcmp(argv[i], "--path") == 0)
+    {
+        kind = lu::server_frame::PATH;
+        ++i;
+    }
+    else if (i < argc && std::strcmp(argv[i], "--shutdown") == 0)
+    {
+        kind = lu::server_frame::SHUTDOWN;
+        ++i;
+    }
+    if (i >= argc || (kind == lu::server_frame::PATH && i + 1 >= argc))
+    {
+        std::cerr << "usage: lu_client [--path|--shutdown] socket [file]" << "\n";
+        return 1;
+    }
+    const char* socket_path = argv[i++];
+    const char* path = i < argc ? argv[i] : nullptr;
+
+    lu::string payload;
+    if (kind == lu::server_frame::PATH)
+    {
+        payload = path;
+    }
+    else if (kind == lu::server_frame::SOURCE)
+    {
+        std::ostringstream text;
+        if (path)
+        {
+            std::ifstream file(path, std::ios::binary);
+            if (!file)
+            {
+                std::cerr << "cannot read " << path << "\n";
+                return 1;
+            }
+            text << file.rdbuf();
+        }
+        else
+        {
+            text << std::cin.rdbuf();
+        }
+        std::string s = text.str();
+        payload = lu::string(s.data(), s.size());
+    }
+
+    lu::diag_logger log(lu::diag::WARN_LEVEL);
+    int code = 0;
+    if (!ok(lu::server_request(socket_path, kind, payload, std::cout, std::cerr, &code, &log)))
+    {
+        log.flush();
+        std::cout << "CLIENT_FAIL" << "\n";
+        return 8;
+    }
+    return code;
+}
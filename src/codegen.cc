@@ -0,0 +1,485 @@
+#include "codegen.h"
+
+#include "print.h"
+#include "except.h"
+#include "internal/intermediate_printer.h"
+#include "internal/debug.h"
+
+#include <algorithm>
+
+namespace lu
+{
+
+namespace diags
+{
+    diag CODEGEN_UNSUPPORTED = diag(diag::ERROR_LEVEL, 6000);
+}
+
+namespace internal
+{
+    // lu_scalar is scalar_value, every intrinsic takes its dest by pointer and its operand by value
+    const char* const C_PREAMBLE =
+        "#include <inttypes.h>\n"
+        "#include <stdint.h>\n"
+        "#include <stdio.h>\n"
+        "#include <stdlib.h>\n"
+        "\n"
+        "typedef union\n"
+        "{\n"
+        "    _Bool b;\n"
+        "    char ascii;\n"
+        "    int8_t i8;\n"
+        "    int16_t i16;\n"
+        "    int32_t i32;\n"
+        "    int64_t i64;\n"
+        "    uint8_t u8;\n"
+        "    uint16_t u16;\n"
+        "    uint32_t u32;\n"
+        "    uint64_t u64;\n"
+        "    float f32;\n"
+        "    double f64;\n"
+        "    uint64_t bits;\n"
+        "} lu_scalar;\n"
+        "\n"
+        "typedef char lu_scalar_is_8_bytes[sizeof(lu_scalar) == 8 ? 1 : -1];\n"
+        "\n"
+        "static inline lu_scalar lu_imm(uint64_t bits) { lu_scalar s; s.bits = bits; return s; }\n"
+        "static inline void lu_halt(void) { fflush(stdout); exit(0); }\n"
+        "\n"
+        "static inline void lu_i32print(lu_scalar op) { printf(\"%\" PRId32, op.i32); }\n"
+        "static inline void lu_i64print(lu_scalar op) { printf(\"%\" PRId64, op.i64); }\n"
+        "static inline void lu_u32print(lu_scalar op) { printf(\"%\" PRIu32, op.u32); }\n"
+        "static inline void lu_u64print(lu_scalar op) { printf(\"%\" PRIu64, op.u64); }\n"
+        "static inline void lu_bprint(lu_scalar op) { fputs(op.b ? \"true\" : \"false\", stdout); }\n"
+        "static inline void lu_asciiprint(lu_scalar op) { putchar((unsigned char)op.ascii); }\n"
+        "static inline void lu_i32add(lu_scalar* dest, lu_scalar op) { dest->u32 += op.u32; }\n"
+        "static inline void lu_i64add(lu_scalar* dest, lu_scalar op) { dest->u64 += op.u64; }\n"
+        "static inline void lu_u32add(lu_scalar* dest, lu_scalar op) { dest->u32 += op.u32; }\n"
+        "static inline void lu_u64add(lu_scalar* dest, lu_scalar op) { dest->u64 += op.u64; }\n"
+        "static inline void lu_lneg(lu_scalar* dest, lu_scalar op) { (void)op; dest->b = !dest->b; }\n"
+        "static inline void lu_land(lu_scalar* dest, lu_scalar op) { dest->b = dest->b && op.b; }\n"
+        "static inline void lu_lor(lu_scalar* dest, lu_scalar op) { dest->b = dest->b || op.b; }\n"
+        "\n";
+
+    struct c_generator
+    {
+        c_generator(const intermediate_program* p_ip, string* p_out, diag_logger* p_log, codegen_stats* p_stats)
+            : p_ip(p_ip), p_out(p_out), p_log(p_log), p_stats(p_stats), printer(p_ip), n(p_ip->size()),
+            ends(p_ip->frame_count(), 0), labels(n + 1, false), fid(0), res(codegen_result::CODEGEN_OK) {}
+
+        const intermediate_program* p_ip;
+        string* p_out;
+        diag_logger* p_log;
+        codegen_stats* p_stats;
+        intermediate_printer printer;
+        size_t n;
+        vector<intermediate_addr> ends; // per frame, end of its code
+        vector<bool> labels; // per address, a branch target
+        intermediate_frame_id fid; // being generated
+        codegen_result res;
+
+        void unsupported(intermediate_addr iaddr, const intermediate& i, string_view why)
+        {
+            res = codegen_result::CODEGEN_UNSUPPORTED;
+            p_log->push(diag_context(diags::CODEGEN_UNSUPPORTED, i.srcref(), i.loc(),
+                string::join("cannot generate C for ", printer.print(iaddr, i), ": ", why)));
+        }
+
+        void line(string_view s)
+        {
+            p_out->append("    ").append(s).append('\n');
+        }
+
+        static string name(intermediate_frame_id f)
+        {
+            return string::join("lu_f", to_string(f));
+        }
+
+        static string reg(intermediate_register r)
+        {
+            return string::join("r[", to_string(r), "]");
+        }
+
+        static string bits(uint64_t b)
+        {
+            return string::join("lu_imm(UINT64_C(0x", hex(static_cast<unsigned long long>(b)), "))");
+        }
+
+        static bool isscalareval(const intermediate& eval)
+        {
+            return eval.op() == intermediate::LOAD_CONSTANT || (eval.op() == intermediate::LOAD_SYMBOL && eval.load.slot == intermediate_slot::SCALAR);
+        }
+
+        static string eval(const intermediate& e)
+        {
+            return e.op() == intermediate::LOAD_CONSTANT ? bits(e.imm.bits.bits) : reg(e.load.reg);
+        }
+
+        static const char* intrinsic_name(intrinsic_code icode)
+        {
+            switch (icode)
+            {
+            case I32PRINT:
+                return "lu_i32print";
+            case I64PRINT:
+                return "lu_i64print";
+            case U32PRINT:
+                return "lu_u32print";
+            case U64PRINT:
+                return "lu_u64print";
+            case BPRINT:
+                return "lu_bprint";
+            case ASCIIPRINT:
+                return "lu_asciiprint";
+            case I32ADD:
+                return "lu_i32add";
+            case I64ADD:
+                return "lu_i64add";
+            case U32ADD:
+                return "lu_u32add";
+            case U64ADD:
+                return "lu_u64add";
+            case LNEG:
+                return "lu_lneg";
+            case LAND:
+                return "lu_land";
+            case LOR:
+                return "lu_lor";
+            default:
+                return nullptr;
+            }
+        }
+
+        static bool isprint(intrinsic_code icode)
+        {
+            return icode == I32PRINT || icode == I64PRINT || icode == U32PRINT || icode == U64PRINT || icode == BPRINT || icode == ASCIIPRINT;
+        }
+
+        bool emit_intrinsic(intermediate_addr iaddr, const intermediate& i, const intermediate_intrinsic& intr)
+        {
+            const char* fn = intrinsic_name(intr.icode);
+            if (!fn)
+            {
+                unsupported(iaddr, i, "unknown intrinsic");
+                return false;
+            }
+            string op = intr.op_imm ? bits(intr.imm.bits) : reg(intr.op_reg);
+            if (isprint(intr.icode))
+            {
+                line(string::join(fn, "(", op, ");"));
+            }
+            else
+            {
+                line(string::join(fn, "(&", reg(intr.dest_reg), ", ", op, ");"));
+            }
+            return true;
+        }
+
+        bool emit_store(intermediate_addr iaddr, const intermediate& i)
+        {
+            const intermediate_store_symbol& store = i.store;
+            if (store.slot != intermediate_slot::SCALAR || !isscalareval(*store.eval))
+            {
+                unsupported(iaddr, i, "not a scalar");
+                return false;
+            }
+            line(string::join(reg(store.reg), " = ", eval(*store.eval), ";"));
+            return true;
+        }
+
+        // a target in the frame's code, or the end of the program
+        bool jump(intermediate_addr iaddr, const intermediate& i, intermediate_addr target, string_view indent = "")
+        {
+            if (target == n)
+            {
+                line(string::join(indent, "lu_halt();"));
+                return true;
+            }
+            if (target < p_ip->frame(fid).entry || target >= ends[fid])
+            {
+                unsupported(iaddr, i, "branch out of the frame");
+                return false;
+            }
+            line(string::join(indent, "goto L", to_string(target), ";"));
+            return true;
+        }
+
+        bool emit_branch(intermediate_addr iaddr, const intermediate& i)
+        {
+            const intermediate_branch& br = i.br;
+            if (!br.condition)
+            {
+                return jump(iaddr, i, br.target());
+            }
+            const intermediate& cond = *br.condition;
+            if (!isscalareval(cond))
+            {
+                unsupported(iaddr, i, "not a scalar condition");
+                return false;
+            }
+            if (cond.op() == intermediate::LOAD_CONSTANT)
+            {
+                if ((cond.imm.bits.bits != 0) == br.negated)
+                {
+                    return true;
+                }
+                return jump(iaddr, i, br.target());
+            }
+            line(string::join("if (", reg(cond.load.reg), ".bits ", br.negated ? "==" : "!=", " 0)"));
+            return jump(iaddr, i, br.target(), "    ");
+        }
+
+        // args are stores into the callee registers of values in the caller's. into a, at the callee register or
+        // in order if packed
+        bool emit_args(intermediate_addr iaddr, const intermediate& i, size_t nregs, bool packed)
+        {
+            const intermediate_call& call = i.call;
+            if (call.fid >= p_ip->frame_count())
+            {
+                unsupported(iaddr, i, "no such frame");
+                return false;
+            }
+            if (call.has_result() && call.result_slot != intermediate_slot::SCALAR)
+            {
+                unsupported(iaddr, i, "not a scalar result");
+                return false;
+            }
+            line(string::join("lu_scalar a[", to_string(nregs), "] = { { 0 } };"));
+            for (size_t k = 0; k < call.args.size(); ++k)
+            {
+                const intermediate_store_symbol& arg = call.args[k].store;
+                if (arg.slot != intermediate_slot::SCALAR || !isscalareval(*arg.eval))
+                {
+                    unsupported(iaddr, i, "not a scalar argument");
+                    return false;
+                }
+                line(string::join("a[", to_string(packed ? k : arg.reg), "] = ", eval(*arg.eval), ";"));
+            }
+            return true;
+        }
+
+        bool emit_call(intermediate_addr iaddr, const intermediate& i)
+        {
+            const intermediate_call& call = i.call;
+            line("{");
+            bool res = emit_args(iaddr, i, std::max<size_t>(p_ip->frame(call.fid).nscalars, 1), false);
+            line(string::join(name(call.fid), "(a, ", call.has_result() ? string::join("&", reg(call.result_reg)) : string("NULL"), ");"));
+            line("}");
+            return res;
+        }
+
+        bool emit_tail_call(intermediate_addr iaddr, const intermediate& i)
+        {
+            const intermediate_call& call = i.call;
+            line("{");
+            bool res;
+            if (call.fid == fid)
+            {
+                // args are evaluated before any of them is stored, they may read each other's registers
+                res = emit_args(iaddr, i, std::max<size_t>(call.args.size(), 1), true);
+                for (size_t k = 0; k < call.args.size(); ++k)
+                {
+                    line(string::join(reg(call.args[k].store.reg), " = a[", to_string(k), "];"));
+                }
+                line(string::join("goto L", to_string(p_ip->frame(fid).entry), ";"));
+            }
+            else
+            {
+                res = emit_args(iaddr, i, std::max<size_t>(p_ip->frame(call.fid).nscalars, 1), false);
+                line(string::join(name(call.fid), "(a, p_result);"));
+                line("return;");
+            }
+            line("}");
+            return res;
+        }
+
+        bool emit_return(intermediate_addr iaddr, const intermediate& i)
+        {
+            if (i.ret.eval)
+            {
+                if (!isscalareval(*i.ret.eval))
+                {
+                    unsupported(iaddr, i, "not a scalar result");
+                    return false;
+                }
+                line(string::join("if (p_result) *p_result = ", eval(*i.ret.eval), ";"));
+            }
+            line("return;");
+            return true;
+        }
+
+        bool emit(intermediate_addr iaddr, const intermediate& i)
+        {
+            switch (i.op())
+            {
+            case intermediate::STORE_SYMBOL:
+            case intermediate::STORE_CONSTANT:
+            case intermediate::STORE_COPY:
+                return emit_store(iaddr, i);
+            case intermediate::INTRINSIC:
+                return emit_intrinsic(iaddr, i, i.intr);
+            case intermediate::INTRINSIC_PAIR:
+                return emit_intrinsic(iaddr, i, i.intr2.first) && emit_intrinsic(iaddr, i, i.intr2.second);
+            case intermediate::INTRINSIC_TRIPLE:
+                return emit_intrinsic(iaddr, i, i.intr3.first) && emit_intrinsic(iaddr, i, i.intr3.second) && emit_intrinsic(iaddr, i, i.intr3.third);
+            case intermediate::BRANCH:
+                return emit_branch(iaddr, i);
+            case intermediate::CALL:
+                return emit_call(iaddr, i);
+            case intermediate::TAIL_CALL:
+                return emit_tail_call(iaddr, i);
+            case intermediate::RETURN:
+                return emit_return(iaddr, i);
+            case intermediate::HALT:
+                line("lu_halt();");
+                return true;
+            case intermediate::BLOCK:
+                if (i.blk.subs.size() != 0)
+                {
+                    unsupported(iaddr, i, "nested block");
+                    return false;
+                }
+                return true;
+            default:
+                if (istypedintrinsic(i.op()))
+                {
+                    return emit_intrinsic(iaddr, i, i.intr);
+                }
+                unsupported(iaddr, i, "only interpreted");
+                return false;
+            }
+        }
+
+        // control does not go on to the next address
+        static bool isterminator(const intermediate& i)
+        {
+            switch (i.op())
+            {
+            case intermediate::RETURN:
+            case intermediate::TAIL_CALL:
+            case intermediate::HALT:
+                return true;
+            case intermediate::BRANCH:
+                return !i.br.condition || (i.br.condition->op() == intermediate::LOAD_CONSTANT && (i.br.condition->imm.bits.bits != 0) != i.br.negated);
+            default:
+                return false;
+            }
+        }
+
+        void emit_frame()
+        {
+            const intermediate_frame& f = p_ip->frame(fid);
+            intermediate_addr first = std::min<intermediate_addr>(f.entry, n);
+            intermediate_addr end = ends[fid];
+            for (intermediate_addr iaddr = first; iaddr < end; ++iaddr)
+            {
+                const intermediate& i = (*p_ip)[iaddr];
+                if (i.op() == intermediate::TAIL_CALL && i.call.fid == fid)
+                {
+                    labels[first] = true;
+                }
+            }
+
+            p_out->append(string::join("\n// frame ", to_string(fid), ", code at ", to_string(first), " to ", to_string(end), "\n"));
+            p_out->append(string::join("static void ", name(fid), "(lu_scalar* r, lu_scalar* p_result)\n{\n"));
+            line("(void)r;");
+            line("(void)p_result;");
+            for (intermediate_addr iaddr = first; iaddr < end; ++iaddr)
+            {
+                if (labels[iaddr])
+                {
+                    p_out->append(string::join("L", to_string(iaddr), ":;\n"));
+                }
+                emit(iaddr, (*p_ip)[iaddr]);
+                ++p_stats->ninsts;
+            }
+            if (end == n)
+            {
+                line("lu_halt();");
+            }
+            else if (first < end && !isterminator((*p_ip)[end - 1]))
+            {
+                unsupported(end - 1, (*p_ip)[end - 1], "falls through into the next frame");
+            }
+            p_out->append("}\n");
+        }
+
+        codegen_result generate()
+        {
+            // a frame's code runs up to the next frame entry, the top frame must start the program
+            for (intermediate_frame_id f = 0; f < p_ip->frame_count(); ++f)
+            {
+                intermediate_addr entry = p_ip->frame(f).entry;
+                intermediate_addr end = n;
+                for (intermediate_frame_id other = 0; other < p_ip->frame_count(); ++other)
+                {
+                    intermediate_addr e = p_ip->frame(other).entry;
+                    if (other != f && e >= entry && e < end)
+                    {
+                        end = e;
+                    }
+                }
+                ends[f] = std::max(std::min(entry, n), end);
+                if (end == entry && entry < n)
+                {
+                    unsupported(entry, (*p_ip)[entry], "code shared by frames");
+                }
+            }
+            if (n != 0 && p_ip->frame(intermediate_frame::TOP).entry != 0)
+            {
+                unsupported(0, (*p_ip)[0], "the program does not start at the top frame");
+                return res;
+            }
+            for (intermediate_addr iaddr = 0; iaddr < n; ++iaddr)
+            {
+                const intermediate& i = (*p_ip)[iaddr];
+                if (i.op() == intermediate::BRANCH && i.br.target() < n)
+                {
+                    labels[i.br.target()] = true;
+                }
+            }
+
+            p_out->append("// generated by lu from its intermediates\n\n");
+            p_out->append(C_PREAMBLE);
+            for (intermediate_frame_id f = 0; f < p_ip->frame_count(); ++f)
+            {
+                p_out->append(string::join("static void ", name(f), "(lu_scalar* r, lu_scalar* p_result);\n"));
+            }
+            for (fid = 0; fid < p_ip->frame_count(); ++fid)
+            {
+                emit_frame();
+            }
+            p_out->append(string::join(
+                "\nint main(void)\n{\n",
+                "    lu_scalar r[", to_string(std::max<size_t>(p_ip->frame(intermediate_frame::TOP).nscalars, 1)), "] = { { 0 } };\n",
+                "    ", name(intermediate_frame::TOP), "(r, NULL);\n",
+                "    return 0;\n}\n"));
+
+            p_stats->nframes = p_ip->frame_count();
+            p_stats->size = p_out->size();
+            return res;
+        }
+    };
+}
+
+string to_string(const codegen_stats& stats)
+{
+    return string::join(
+        to_string(stats.ninsts), " intermediates in ",
+        to_string(stats.nframes), " functions, ",
+        to_string(stats.size), " bytes of C");
+}
+
+codegen_result codegen_c(const intermediate_program* ip, string* p_out, diag_logger* p_log, codegen_stats* p_stats)
+{
+    codegen_stats stats;
+    if (!p_stats)
+    {
+        p_stats = &stats;
+    }
+    *p_stats = codegen_stats();
+    *p_out = string();
+    return internal::c_generator(ip, p_out, p_log, p_stats).generate();
+}
+
+}
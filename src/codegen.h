@@ -1,7 +1,54 @@
 #ifndef LU_CODEGEN_H
 #define LU_CODEGEN_H
 
+#include "intermediate.h"
+#include "diag.h"
+#include "string.h"
+#include "internal/constexpr.h"
+
 namespace lu
-{}
+{
+
+namespace diags
+{
+    extern diag CODEGEN_UNSUPPORTED;
+}
+
+struct codegen_stats
+{
+    codegen_stats() : nframes(0), ninsts(0), size(0) {}
+
+    size_t nframes; // C functions
+    size_t ninsts;
+    size_t size; // bytes of C
+};
+
+string to_string(const codegen_stats&);
+
+enum class codegen_result
+{
+    CODEGEN_OK,
+    CODEGEN_UNSUPPORTED, // the program uses something only the interpreter runs, logged
+};
+
+LU_CONSTEXPR bool ok(codegen_result cr)
+{
+    return cr == codegen_result::CODEGEN_OK;
+}
+
+// ahead of time backend: translates the program into one C99 translation unit, with a main that runs it from the
+// top frame (see compiler.h to build it).
+//   - scalar registers are a union of the builtin types (as scalar_value), so every builtin is its C type
+//   - each frame is a C function taking its registers and the caller's result register. CALL makes the callee's
+//     registers a local array, RETURN stores its result through the pointer and returns
+//   - TAIL_CALL of the same frame stores the arguments and jumps to its entry, of another frame calls and returns
+//   - branches are gotos, intrinsics calls to static inline functions in the preamble, HALT flushes and exits
+// integer adds wrap, as in the interpreter. constants and immediates are written as their raw 8 byte payload,
+// so the C is meant for hosts of the byte order it was generated on.
+// aggregates, tuples, ILLEGAL, branches out of a frame and code shared by frames are not supported: they are
+// logged and CODEGEN_UNSUPPORTED returned, *p_out is then incomplete.
+codegen_result codegen_c(const intermediate_program*, string* p_out, diag_logger*, codegen_stats* = nullptr);
+
+}
 
 #endif // LU_CODEGEN_H
@@ -0,0 +1,84 @@
+#include "compiler.h"
+
+#include "codegen.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+namespace lu
+{
+
+namespace diags
+{
+    diag COMPILER_FAILED = diag(diag::ERROR_LEVEL, 6100);
+}
+
+namespace internal
+{
+    // single quoted for the shell, ' itself as '\''
+    string shell_quote(string_view s)
+    {
+        string q("'");
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            if (s[i] == '\'')
+            {
+                q.append("'\\''");
+            }
+            else
+            {
+                q.append(s[i]);
+            }
+        }
+        return q.append('\'');
+    }
+
+    compiler_result compiler_failed(diag_logger* p_log, string&& msg)
+    {
+        p_log->push(diag_context(diags::COMPILER_FAILED, source_reference(), source_location(), move(msg)));
+        return compiler_result::COMPILER_FAIL;
+    }
+}
+
+compiler_settings::compiler_settings() : cc("cc"), flags("-std=c99 -O2"), keep_c(true)
+{
+    const char* env = std::getenv("CC");
+    if (env && *env)
+    {
+        cc = env;
+    }
+}
+
+compiler_result compile_native(const intermediate_program* ip, string_view exe_path, diag_logger* p_log, const compiler_settings& settings)
+{
+    string c;
+    if (!ok(codegen_c(ip, &c, p_log)))
+    {
+        return compiler_result::COMPILER_UNSUPPORTED;
+    }
+
+    string c_path = string::join(exe_path, ".c");
+    {
+        std::ofstream file(c_path.buffer(), std::ios::binary);
+        file.write(c.buffer(), static_cast<std::streamsize>(c.size()));
+        if (!file)
+        {
+            return internal::compiler_failed(p_log, string::join("cannot write ", c_path));
+        }
+    }
+
+    string command = string::join(settings.cc, " ", settings.flags, " -o ", internal::shell_quote(exe_path), " ", internal::shell_quote(c_path));
+    int status = std::system(command.buffer());
+    if (!settings.keep_c)
+    {
+        std::remove(c_path.buffer());
+    }
+    if (status != 0)
+    {
+        return internal::compiler_failed(p_log, string::join("C compiler failed (", to_string(status), "): ", command));
+    }
+    return compiler_result::COMPILER_OK;
+}
+
+}
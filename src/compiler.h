@@ -2,11 +2,43 @@
 #define LU_COMPILER_H
 
 #include "intermediate.h"
+#include "diag.h"
+#include "string.h"
+#include "internal/constexpr.h"
 
 namespace lu
 {
-// compiler to VM
-//void compile();
+
+namespace diags
+{
+    extern diag COMPILER_FAILED;
+}
+
+struct compiler_settings
+{
+    compiler_settings(); // cc is $CC, or cc if it is not set
+
+    string cc; // C compiler command
+    string flags;
+    bool keep_c; // leave the generated C next to the executable
+};
+
+enum class compiler_result
+{
+    COMPILER_OK,
+    COMPILER_UNSUPPORTED, // no C for the program (see codegen.h), logged
+    COMPILER_FAIL, // the C could not be written or built, logged
+};
+
+LU_CONSTEXPR bool ok(compiler_result cr)
+{
+    return cr == compiler_result::COMPILER_OK;
+}
+
+// builds a native executable of the program ahead of time: the C of codegen_c is written to exe_path.c, then
+// built by the system C compiler. the executable runs the program like the interpreter, with no runtime
+compiler_result compile_native(const intermediate_program*, string_view exe_path, diag_logger*, const compiler_settings& = compiler_settings());
+
 }
 
 #endif // LU_COMPILER_H
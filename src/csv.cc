@@ -113,7 +113,8 @@ string csv::cell::get_string() const
         str = to_string(_int_data);
         break;
     case lu::csv::REAL:
-        str = to_string(_float_data);
+        // as a double, for its shortest round trip digits
+        str = to_string(static_cast<double>(_float_data));
         break;
     case lu::csv::TEXT:
         str = string("\"").append(_str_data.str().c_str()).append("\"");
@@ -150,7 +150,7 @@ string diag_logger::diag_level_string(diag_level lvl)
 
 void diag_logger::print(const diag_context& d)
 {
-    std::ostream& os = d.dg.level >= diag::ERROR_LEVEL ? std::cerr : std::clog;
+    std::ostream& os = _p_os ? *_p_os : d.dg.level >= diag::ERROR_LEVEL ? std::cerr : std::clog;
     string s = to_string(d.srcref.name()).append("(").append(to_string(d.loc.line)).append(", ").append(to_string(d.loc.col)).append("): ")
                 .append(diag_level_string(d.dg.level)).append(" (#").append(to_string(d.dg.code)).append("): ").append(d.msg).append('\n');
                 //.append(string(4, ' ')).append(d.srcref.text()).append("\n"); // TODO hgihlight and caret (if option on)
@@ -7,6 +7,7 @@
 #include "adt/list.h"
 #include "except.h"
 #include <cstddef>
+#include <ostream>
 //#include <limits>
 
 namespace lu
@@ -50,8 +51,10 @@ namespace lu
         diag_level min_level;
         diag_level fatal_level;
         
-        // TODO ostream too
-        diag_logger(diag_level lvl = diag::DEBUG_LEVEL, diag_level flvl = diag::MAX_LEVEL, bool ansi = true) : min_level(lvl), fatal_level(flvl), _ansi(ansi) {}
+        // prints to p_os if set, else errors to std::cerr and the rest to std::clog
+        diag_logger(diag_level lvl = diag::DEBUG_LEVEL, diag_level flvl = diag::MAX_LEVEL, bool ansi = true, std::ostream* p_os = nullptr) :
+            min_level(lvl), fatal_level(flvl), _ansi(ansi), _p_os(p_os)
+        {}
 
         void print(const diag_context&);
         void flush();
@@ -65,6 +68,7 @@ namespace lu
 
         list<diag_context> _pending;
         bool _ansi;
+        std::ostream* _p_os;
     };
 
     struct diag_except : public lu_except
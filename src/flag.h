@@ -35,6 +35,8 @@ struct flags
         return (this->_flags & mask._flags) == mask._flags;
     }
 
+    LU_CONSTEXPR flag_type raw() const { return _flags; }
+
     LU_CONSTEXPR friend flags operator|(flags lhs, flags rhs);
     LU_CONSTEXPR friend flags operator&(flags lhs, flags rhs);
     LU_CONSTEXPR friend flags operator^(flags lhs, flags rhs);
@@ -0,0 +1,399 @@
+#include "format.h"
+
+#include <cstring>
+
+namespace lu
+{
+
+namespace internal
+{
+    const char DIGIT_PAIRS[201] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+    const uint64_t POW10[] =
+    {
+        1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull, 1000000000ull,
+        10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull, 100000000000000ull, 1000000000000000ull,
+        10000000000000000ull, 100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull,
+    };
+
+    // four digits a division
+    size_t count_digits(uint64_t v)
+    {
+        size_t n = 1;
+        for (;;)
+        {
+            if (v < 10)
+            {
+                return n;
+            }
+            if (v < 100)
+            {
+                return n + 1;
+            }
+            if (v < 1000)
+            {
+                return n + 2;
+            }
+            if (v < 10000)
+            {
+                return n + 3;
+            }
+            v /= 10000;
+            n += 4;
+        }
+    }
+
+    // v in n digits, written backwards from p_buf + n
+    void write_digits(uint64_t v, char* p_buf, size_t n)
+    {
+        char* p = p_buf + n;
+        while (v >= 100)
+        {
+            size_t i = static_cast<size_t>(v % 100) * 2;
+            v /= 100;
+            p -= 2;
+            p[0] = DIGIT_PAIRS[i];
+            p[1] = DIGIT_PAIRS[i + 1];
+        }
+        if (v >= 10)
+        {
+            size_t i = static_cast<size_t>(v) * 2;
+            p -= 2;
+            p[0] = DIGIT_PAIRS[i];
+            p[1] = DIGIT_PAIRS[i + 1];
+        }
+        else
+        {
+            *--p = static_cast<char>('0' + v);
+        }
+    }
+
+    // a floating point number f * 2^e with a 64 bit significand
+    struct diy_fp
+    {
+        diy_fp() : f(0), e(0) {}
+        diy_fp(uint64_t sig, int exp) : f(sig), e(exp) {}
+
+        diy_fp operator-(const diy_fp& rhs) const { return diy_fp(f - rhs.f, e); }
+
+        // the upper 64 bits of the product, rounded
+        diy_fp operator*(const diy_fp& rhs) const
+        {
+            const uint64_t M32 = 0xffffffffu;
+            uint64_t a = f >> 32;
+            uint64_t b = f & M32;
+            uint64_t c = rhs.f >> 32;
+            uint64_t d = rhs.f & M32;
+            uint64_t ac = a * c;
+            uint64_t bc = b * c;
+            uint64_t ad = a * d;
+            uint64_t bd = b * d;
+            uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+            tmp += 1u << 31;
+            return diy_fp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + rhs.e + 64);
+        }
+
+        diy_fp normalize() const
+        {
+            diy_fp res = *this;
+            while (!(res.f & (1ull << 63)))
+            {
+                res.f <<= 1;
+                --res.e;
+            }
+            return res;
+        }
+
+        uint64_t f;
+        int e;
+    };
+
+    // 10^-348, 10^-340 .. 10^340, normalized
+    const uint64_t CACHED_POWERS_F[] =
+    {
+        0xfa8fd5a0081c0288ull, 0xbaaee17fa23ebf76ull, 0x8b16fb203055ac76ull, 0xcf42894a5dce35eaull,
+        0x9a6bb0aa55653b2dull, 0xe61acf033d1a45dfull, 0xab70fe17c79ac6caull, 0xff77b1fcbebcdc4full,
+        0xbe5691ef416bd60cull, 0x8dd01fad907ffc3cull, 0xd3515c2831559a83ull, 0x9d71ac8fada6c9b5ull,
+        0xea9c227723ee8bcbull, 0xaecc49914078536dull, 0x823c12795db6ce57ull, 0xc21094364dfb5637ull,
+        0x9096ea6f3848984full, 0xd77485cb25823ac7ull, 0xa086cfcd97bf97f4ull, 0xef340a98172aace5ull,
+        0xb23867fb2a35b28eull, 0x84c8d4dfd2c63f3bull, 0xc5dd44271ad3cdbaull, 0x936b9fcebb25c996ull,
+        0xdbac6c247d62a584ull, 0xa3ab66580d5fdaf6ull, 0xf3e2f893dec3f126ull, 0xb5b5ada8aaff80b8ull,
+        0x87625f056c7c4a8bull, 0xc9bcff6034c13053ull, 0x964e858c91ba2655ull, 0xdff9772470297ebdull,
+        0xa6dfbd9fb8e5b88full, 0xf8a95fcf88747d94ull, 0xb94470938fa89bcfull, 0x8a08f0f8bf0f156bull,
+        0xcdb02555653131b6ull, 0x993fe2c6d07b7facull, 0xe45c10c42a2b3b06ull, 0xaa242499697392d3ull,
+        0xfd87b5f28300ca0eull, 0xbce5086492111aebull, 0x8cbccc096f5088ccull, 0xd1b71758e219652cull,
+        0x9c40000000000000ull, 0xe8d4a51000000000ull, 0xad78ebc5ac620000ull, 0x813f3978f8940984ull,
+        0xc097ce7bc90715b3ull, 0x8f7e32ce7bea5c70ull, 0xd5d238a4abe98068ull, 0x9f4f2726179a2245ull,
+        0xed63a231d4c4fb27ull, 0xb0de65388cc8ada8ull, 0x83c7088e1aab65dbull, 0xc45d1df942711d9aull,
+        0x924d692ca61be758ull, 0xda01ee641a708deaull, 0xa26da3999aef774aull, 0xf209787bb47d6b85ull,
+        0xb454e4a179dd1877ull, 0x865b86925b9bc5c2ull, 0xc83553c5c8965d3dull, 0x952ab45cfa97a0b3ull,
+        0xde469fbd99a05fe3ull, 0xa59bc234db398c25ull, 0xf6c69a72a3989f5cull, 0xb7dcbf5354e9beceull,
+        0x88fcf317f22241e2ull, 0xcc20ce9bd35c78a5ull, 0x98165af37b2153dfull, 0xe2a0b5dc971f303aull,
+        0xa8d9d1535ce3b396ull, 0xfb9b7cd9a4a7443cull, 0xbb764c4ca7a44410ull, 0x8bab8eefb6409c1aull,
+        0xd01fef10a657842cull, 0x9b10a4e5e9913129ull, 0xe7109bfba19c0c9dull, 0xac2820d9623bf429ull,
+        0x80444b5e7aa7cf85ull, 0xbf21e44003acdd2dull, 0x8e679c2f5e44ff8full, 0xd433179d9c8cb841ull,
+        0x9e19db92b4e31ba9ull, 0xeb96bf6ebadf77d9ull, 0xaf87023b9bf0ee6bull,
+    };
+    const int16_t CACHED_POWERS_E[] =
+    {
+        -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927, -901, -874, -847, -821,
+        -794, -768, -741, -715, -688, -661, -635, -608, -582, -555, -529, -502, -475, -449, -422, -396,
+        -369, -343, -316, -289, -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+        56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348, 375, 402, 428, 455,
+        481, 508, 534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+        907, 933, 960, 986, 1013, 1039, 1066,
+    };
+
+    // a power of ten c = 10^-k, so the binary exponent of w * c lands in [-60, -32]
+    diy_fp cached_power(int e, int* p_k)
+    {
+        double dk = (-61 - e) * 0.30102999566398114 + 347; // log10(2)
+        int k = static_cast<int>(dk);
+        if (dk - k > 0.0)
+        {
+            ++k;
+        }
+        size_t index = static_cast<size_t>((k >> 3) + 1);
+        *p_k = -(-348 + static_cast<int>(index << 3));
+        return diy_fp(CACHED_POWERS_F[index], CACHED_POWERS_E[index]);
+    }
+
+    // moves the last digit towards w while the number stays inside the boundaries
+    void grisu_round(char* p_buf, size_t len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+    {
+        while (rest < wp_w && delta - rest >= ten_kappa && (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+        {
+            --p_buf[len - 1];
+            rest += ten_kappa;
+        }
+    }
+
+    // the digits of w, as few as keep the number above the lower boundary of mp, delta below it
+    void digit_gen(const diy_fp& w, const diy_fp& mp, uint64_t delta, char* p_buf, size_t* p_len, int* p_k)
+    {
+        const diy_fp one(1ull << -mp.e, mp.e);
+        const diy_fp wp_w = mp - w;
+        uint32_t p1 = static_cast<uint32_t>(mp.f >> -one.e);
+        uint64_t p2 = mp.f & (one.f - 1);
+        int kappa = static_cast<int>(count_digits(p1));
+        size_t len = 0;
+        while (kappa > 0)
+        {
+            uint32_t div = static_cast<uint32_t>(POW10[kappa - 1]);
+            uint32_t d = p1 / div;
+            p1 %= div;
+            if (d || len)
+            {
+                p_buf[len++] = static_cast<char>('0' + d);
+            }
+            --kappa;
+            uint64_t rest = (static_cast<uint64_t>(p1) << -one.e) + p2;
+            if (rest <= delta)
+            {
+                *p_k += kappa;
+                grisu_round(p_buf, len, delta, rest, POW10[kappa] << -one.e, wp_w.f);
+                *p_len = len;
+                return;
+            }
+        }
+        for (;;)
+        {
+            p2 *= 10;
+            delta *= 10;
+            char d = static_cast<char>(p2 >> -one.e);
+            if (d || len)
+            {
+                p_buf[len++] = static_cast<char>('0' + d);
+            }
+            p2 &= one.f - 1;
+            --kappa;
+            if (p2 < delta)
+            {
+                *p_k += kappa;
+                int index = -kappa;
+                grisu_round(p_buf, len, delta, p2, one.f, wp_w.f * (index < 20 ? POW10[index] : 0));
+                *p_len = len;
+                return;
+            }
+        }
+    }
+
+    // digits and decimal exponent of f * 2^e, which is positive. its neighbours are 2^e apart, or 2^(e - 1) below
+    // when lower_closer (the significand is a power of 2)
+    void grisu2(uint64_t f, int e, bool lower_closer, char* p_buf, size_t* p_len, int* p_k)
+    {
+        diy_fp v(f, e);
+        diy_fp plus = diy_fp((f << 1) + 1, e - 1).normalize();
+        diy_fp minus = lower_closer ? diy_fp((f << 2) - 1, e - 2) : diy_fp((f << 1) - 1, e - 1);
+        minus.f <<= minus.e - plus.e;
+        minus.e = plus.e;
+
+        diy_fp c_mk = cached_power(plus.e, p_k);
+        diy_fp w = v.normalize() * c_mk;
+        diy_fp wp = plus * c_mk;
+        diy_fp wm = minus * c_mk;
+        ++wm.f;
+        --wp.f;
+        digit_gen(w, wp, wp.f - wm.f, p_buf, p_len, p_k);
+    }
+
+    // e, the sign and as many digits as the exponent has (see format.h)
+    size_t write_exponent(int k, char* p_buf)
+    {
+        char* p = p_buf;
+        *p++ = 'e';
+        if (k < 0)
+        {
+            *p++ = '-';
+            k = -k;
+        }
+        else
+        {
+            *p++ = '+';
+        }
+        size_t n = count_digits(static_cast<uint64_t>(k));
+        write_digits(static_cast<uint64_t>(k), p, n);
+        return static_cast<size_t>(p - p_buf) + n;
+    }
+
+    // len digits d1 d2 .. times 10^k, laid out in place
+    size_t prettify(char* p_buf, size_t len, int k)
+    {
+        int n = static_cast<int>(len);
+        int kk = n + k; // 10^(kk - 1) <= v < 10^kk
+        if (0 <= k && kk <= 21)
+        {
+            // 1234e7 -> 12340000000.0
+            for (int i = n; i < kk; ++i)
+            {
+                p_buf[i] = '0';
+            }
+            p_buf[kk] = '.';
+            p_buf[kk + 1] = '0';
+            return static_cast<size_t>(kk + 2);
+        }
+        if (0 < kk && kk <= 21)
+        {
+            // 1234e-2 -> 12.34
+            std::memmove(p_buf + kk + 1, p_buf + kk, static_cast<size_t>(n - kk));
+            p_buf[kk] = '.';
+            return len + 1;
+        }
+        if (-6 < kk && kk <= 0)
+        {
+            // 1234e-6 -> 0.001234
+            int offset = 2 - kk;
+            std::memmove(p_buf + offset, p_buf, len);
+            p_buf[0] = '0';
+            p_buf[1] = '.';
+            for (int i = 2; i < offset; ++i)
+            {
+                p_buf[i] = '0';
+            }
+            return len + static_cast<size_t>(offset);
+        }
+        if (n == 1)
+        {
+            // 1e30
+            return 1 + write_exponent(kk - 1, p_buf + 1);
+        }
+        // 1234e30 -> 1.234e+33
+        std::memmove(p_buf + 2, p_buf + 1, len - 1);
+        p_buf[1] = '.';
+        return len + 1 + write_exponent(kk - 1, p_buf + len + 1);
+    }
+
+    // sign, then the special values or the digits of f * 2^e
+    size_t format_binary(bool negative, bool nan, bool inf, uint64_t f, int e, bool lower_closer, char* p_buf)
+    {
+        char* p = p_buf;
+        if (nan)
+        {
+            std::memcpy(p, "nan", 3);
+            return 3;
+        }
+        if (negative)
+        {
+            *p++ = '-';
+        }
+        if (inf)
+        {
+            std::memcpy(p, "inf", 3);
+            return static_cast<size_t>(p - p_buf) + 3;
+        }
+        if (f == 0)
+        {
+            std::memcpy(p, "0.0", 3);
+            return static_cast<size_t>(p - p_buf) + 3;
+        }
+        size_t len = 0;
+        int k = 0;
+        grisu2(f, e, lower_closer, p, &len, &k);
+        return static_cast<size_t>(p - p_buf) + prettify(p, len, k);
+    }
+}
+
+size_t format_uint(uint64_t v, char* p_buf)
+{
+    size_t n = internal::count_digits(v);
+    internal::write_digits(v, p_buf, n);
+    return n;
+}
+
+size_t format_int(int64_t v, char* p_buf)
+{
+    if (v < 0)
+    {
+        *p_buf = '-';
+        // negated unsigned, so the most negative value does not overflow
+        return 1 + format_uint(0 - static_cast<uint64_t>(v), p_buf + 1);
+    }
+    return format_uint(static_cast<uint64_t>(v), p_buf);
+}
+
+size_t format_double(double v, char* p_buf)
+{
+    const uint64_t FRACTION_MASK = (1ull << 52) - 1;
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    uint64_t fraction = bits & FRACTION_MASK;
+    int biased = static_cast<int>((bits >> 52) & 0x7ff);
+    bool negative = (bits >> 63) != 0;
+    if (biased == 0x7ff)
+    {
+        return internal::format_binary(negative, fraction != 0, fraction == 0, 0, 0, false, p_buf);
+    }
+    // subnormals have no hidden bit and the exponent of the smallest normals
+    uint64_t f = biased ? fraction | (1ull << 52) : fraction;
+    int e = (biased ? biased : 1) - 1075;
+    return internal::format_binary(negative, false, false, f, e, biased > 1 && fraction == 0, p_buf);
+}
+
+size_t format_float(float v, char* p_buf)
+{
+    const uint32_t FRACTION_MASK = (1u << 23) - 1;
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    uint32_t fraction = bits & FRACTION_MASK;
+    int biased = static_cast<int>((bits >> 23) & 0xff);
+    bool negative = (bits >> 31) != 0;
+    if (biased == 0xff)
+    {
+        return internal::format_binary(negative, fraction != 0, fraction == 0, 0, 0, false, p_buf);
+    }
+    uint64_t f = biased ? fraction | (1u << 23) : fraction;
+    int e = (biased ? biased : 1) - 150;
+    return internal::format_binary(negative, false, false, f, e, biased > 1 && fraction == 0, p_buf);
+}
+
+}
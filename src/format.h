@@ -0,0 +1,31 @@
+#ifndef LU_FORMAT_H
+#define LU_FORMAT_H
+
+#include "internal/constexpr.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace lu
+{
+
+// numbers written into a buffer of the caller, without allocating. each returns the number of chars written, there
+// is no terminating null
+
+LU_CONSTEXPR size_t FORMAT_INT_SIZE = 20; // any 64 bit integer, with its sign
+LU_CONSTEXPR size_t FORMAT_FLOAT_SIZE = 32; // any float or double
+
+// decimal digits, two at a time from a table
+size_t format_uint(uint64_t, char* p_buf);
+size_t format_int(int64_t, char* p_buf);
+
+// digits that read back (strtod, strtof) as the same value, found with Grisu2 (Loitsch, "Printing Floating-Point
+// Numbers Quickly and Accurately with Integers"), the shortest for nearly every value. decimal notation for magnitudes
+// in [1e-6, 1e21), with .0 if there is no fraction (3.0, 0.000001), scientific otherwise. the exponent of scientific
+// notation always has its sign and never leading zeros, unlike %g (1e+21, 1.5e-7, 1e+300). nan, inf and -inf as such
+size_t format_double(double, char* p_buf);
+size_t format_float(float, char* p_buf);
+
+}
+
+#endif // LU_FORMAT_H
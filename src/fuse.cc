@@ -0,0 +1,217 @@
+#include "fuse.h"
+
+#include "intrinsic.h"
+#include "utility.h"
+#include "internal/debug.h"
+
+#include <algorithm>
+
+namespace lu
+{
+
+namespace internal
+{
+    LU_CONSTEXPR opcode_key OPCODE_SUB_BITS = 16;
+    LU_CONSTEXPR opcode_key OPCODE_SUB_MASK = (opcode_key(1) << OPCODE_SUB_BITS) - 1;
+
+    LU_CONSTEXPR opcode_key make_opcode_key(intermediate::intermediate_op op, opcode_key sub)
+    {
+        return (static_cast<opcode_key>(op) << OPCODE_SUB_BITS) | sub;
+    }
+
+    LU_CONSTEXPR uint64_t make_pair_key(opcode_key first, opcode_key second)
+    {
+        return (static_cast<uint64_t>(first) << 32) | second;
+    }
+
+    bool iscontrolflow(const intermediate& i)
+    {
+        switch (i.op())
+        {
+        case intermediate::BLOCK:
+        case intermediate::CALL:
+        case intermediate::TAIL_CALL:
+        case intermediate::RETURN:
+        case intermediate::BRANCH:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    struct fuser
+    {
+        fuser(intermediate_program* ip, const fuse_settings& settings) : p_ip(ip), settings(settings) {}
+
+        intermediate_program* p_ip;
+        const fuse_settings& settings;
+
+        size_t intrinsic_run(intermediate_addr iaddr) const
+        {
+            size_t n = 0;
+            size_t max = std::min(settings.max_intrinsic_run, size_t(3));
+            while (n < max && iaddr + n < p_ip->size() && (*p_ip)[iaddr + n].op() == intermediate::INTRINSIC)
+            {
+                ++n;
+            }
+            return n;
+        }
+
+        // fuses starting from iaddr, returns the number of intermediates consumed
+        size_t fuse_one(intermediate_addr iaddr, vector<intermediate>* p_out)
+        {
+            intermediate& i = (*p_ip)[iaddr];
+            if (settings.stores && i.op() == intermediate::STORE_SYMBOL)
+            {
+                switch (i.store.eval->op())
+                {
+                case intermediate::LOAD_CONSTANT:
+                    p_out->push_back(intermediate::create_store_constant(move(i.store)));
+                    return 1;
+                case intermediate::LOAD_SYMBOL:
+                    p_out->push_back(intermediate::create_store_copy(move(i.store)));
+                    return 1;
+                default:
+                    break;
+                }
+            }
+            else if (settings.intrinsics && i.op() == intermediate::INTRINSIC)
+            {
+                switch (intrinsic_run(iaddr))
+                {
+                case 3:
+                    p_out->push_back(intermediate::create_intrinsic_triple(intermediate_intrinsic_triple(i.intr, (*p_ip)[iaddr + 1].intr, (*p_ip)[iaddr + 2].intr)));
+                    return 3;
+                case 2:
+                    p_out->push_back(intermediate::create_intrinsic_pair(intermediate_intrinsic_pair(i.intr, (*p_ip)[iaddr + 1].intr)));
+                    return 2;
+                default:
+                    break;
+                }
+            }
+            p_out->push_back(move(i));
+            return 1;
+        }
+
+        fuse_result fuse()
+        {
+            for (intermediate_addr iaddr = 0; iaddr < p_ip->size(); ++iaddr)
+            {
+                if (iscontrolflow((*p_ip)[iaddr]))
+                {
+                    return fuse_result::FUSE_SKIPPED;
+                }
+            }
+
+            // old address -> fused address, for the frame entries
+            vector<intermediate_addr> remap(p_ip->size() + 1);
+            vector<intermediate> out;
+            out.reserve(p_ip->size());
+            intermediate_addr iaddr = 0;
+            while (iaddr < p_ip->size())
+            {
+                intermediate_addr faddr = out.size();
+                size_t n = fuse_one(iaddr, &out);
+                for (size_t k = 0; k < n; ++k)
+                {
+                    remap[iaddr + k] = faddr;
+                }
+                iaddr += n;
+            }
+            remap[p_ip->size()] = out.size();
+
+            for (intermediate_frame_id fid = 0; fid < p_ip->frame_count(); ++fid)
+            {
+                intermediate_frame& f = p_ip->frame(fid);
+                f.entry = remap[f.entry];
+            }
+            p_ip->rewrite(move(out));
+            return fuse_result::FUSE_OK;
+        }
+    };
+}
+
+opcode_key make_opcode_key(const intermediate& i)
+{
+    switch (i.op())
+    {
+    case intermediate::INTRINSIC:
+        return internal::make_opcode_key(i.op(), static_cast<opcode_key>(i.intr.icode));
+    case intermediate::STORE_SYMBOL:
+        return internal::make_opcode_key(i.op(), static_cast<opcode_key>(i.store.eval->op()));
+    default:
+        return internal::make_opcode_key(i.op(), 0);
+    }
+}
+
+string opcode_key_name(opcode_key key)
+{
+    intermediate::intermediate_op op = static_cast<intermediate::intermediate_op>(key >> internal::OPCODE_SUB_BITS);
+    opcode_key sub = key & internal::OPCODE_SUB_MASK;
+    switch (op)
+    {
+    case intermediate::INTRINSIC:
+        return string::join(intermediate_op_cstr(op), "(", intrinsic_code_cstr(static_cast<intrinsic_code>(sub)), ")");
+    case intermediate::STORE_SYMBOL:
+        return string::join(intermediate_op_cstr(op), "(", intermediate_op_cstr(static_cast<intermediate::intermediate_op>(sub)), ")");
+    default:
+        return string(intermediate_op_cstr(op));
+    }
+}
+
+void opcode_pair_profile::count(const intermediate& i)
+{
+    opcode_key key = make_opcode_key(i);
+    if (_prev != NONE)
+    {
+        ++_pairs[internal::make_pair_key(_prev, key)];
+    }
+    _prev = key;
+    ++_dispatches;
+}
+
+void opcode_pair_profile::merge(const opcode_pair_profile& other)
+{
+    for (const auto& kv : other._pairs)
+    {
+        _pairs[kv.first] += kv.second;
+    }
+    _dispatches += other._dispatches;
+}
+
+vector<opcode_pair_profile::pair_count> opcode_pair_profile::top(size_t n) const
+{
+    vector<pair_count> counts;
+    counts.reserve(_pairs.size());
+    for (const auto& kv : _pairs)
+    {
+        pair_count pc;
+        pc.first = static_cast<opcode_key>(kv.first >> 32);
+        pc.second = static_cast<opcode_key>(kv.first);
+        pc.count = kv.second;
+        counts.push_back(pc);
+    }
+    std::sort(counts.begin(), counts.end(), [](const pair_count& a, const pair_count& b) { return a.count > b.count; });
+    if (counts.size() > n)
+    {
+        counts.resize(n);
+    }
+    return counts;
+}
+
+string to_string(const opcode_pair_profile& prof, size_t ntop)
+{
+    string s = string::join(to_string(prof.dispatches()), " dispatches\n");
+    for (const opcode_pair_profile::pair_count& pc : prof.top(ntop))
+    {
+        s.append(string::join(to_string(pc.count), "\t", opcode_key_name(pc.first), " -> ", opcode_key_name(pc.second), "\n"));
+    }
+    return s;
+}
+
+fuse_result fuse(intermediate_program* ip, const fuse_settings& settings)
+{
+    return internal::fuser(ip, settings).fuse();
+}
+
+}
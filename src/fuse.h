@@ -0,0 +1,90 @@
+#ifndef LU_FUSE_H
+#define LU_FUSE_H
+
+#include "intermediate.h"
+#include "string.h"
+#include "adt/vector.h"
+#include "adt/map.h"
+#include "internal/constexpr.h"
+
+#include <cstdint>
+#include <limits>
+
+namespace lu
+{
+
+// superinstruction fusion: rewrites common sequences of intermediates into a single fused
+// intermediate, so they only pay for one dispatch.
+//
+// the fused set is picked from opcode pair profiles (see opcode_pair_profile) over real scripts:
+//   STORE_SYMBOL(LOAD_CONSTANT) -> STORE_CONSTANT
+//   STORE_SYMBOL(LOAD_SYMBOL)   -> STORE_COPY
+//   INTRINSIC, INTRINSIC        -> INTRINSIC_PAIR
+//   INTRINSIC x3                -> INTRINSIC_TRIPLE
+
+// dispatch relevant opcode of an intermediate: the op, plus the intrinsic code for intrinsics
+// or the evaluated op for stores.
+using opcode_key = uint32_t;
+
+opcode_key make_opcode_key(const intermediate&);
+string opcode_key_name(opcode_key);
+
+// counts executed opcodes and adjacent opcode pairs, can be accumulated over a corpus of scripts.
+struct opcode_pair_profile
+{
+    struct pair_count
+    {
+        opcode_key first;
+        opcode_key second;
+        size_t count;
+    };
+
+    opcode_pair_profile() : _dispatches(0), _prev(NONE) {}
+
+    // one executed intermediate
+    void count(const intermediate&);
+    // forget the previous opcode, so pairs do not span two runs
+    void reset_sequence() { _prev = NONE; }
+    void merge(const opcode_pair_profile&);
+
+    size_t dispatches() const { return _dispatches; }
+    // most frequent pairs first
+    vector<pair_count> top(size_t n) const;
+
+private:
+    LU_CONSTEXPR static opcode_key NONE = std::numeric_limits<opcode_key>::max();
+
+    unordered_map<uint64_t, size_t> _pairs;
+    size_t _dispatches;
+    opcode_key _prev;
+};
+
+string to_string(const opcode_pair_profile&, size_t ntop = 10);
+
+struct fuse_settings
+{
+    fuse_settings() : stores(true), intrinsics(true), max_intrinsic_run(3) {}
+
+    bool stores;
+    bool intrinsics;
+    size_t max_intrinsic_run; // 1 disables intrinsic fusion, at most 3
+};
+
+enum class fuse_result
+{
+    FUSE_OK,
+    FUSE_SKIPPED, // program was left as is
+};
+
+LU_CONSTEXPR bool ok(fuse_result fr)
+{
+    return fr == fuse_result::FUSE_OK;
+}
+
+// frame entries are remapped to the fused addresses. programs with control flow are skipped for now,
+// since fusing would have to stop at every branch target.
+fuse_result fuse(intermediate_program*, const fuse_settings& = fuse_settings());
+
+}
+
+#endif // LU_FUSE_H
@@ -0,0 +1,462 @@
+#include "inline.h"
+
+#include "cfg.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace lu
+{
+
+namespace internal
+{
+    // where an emitted branch goes, resolved once the round has placed every intermediate
+    struct inline_target
+    {
+        enum target_kind
+        {
+            OLD, // address before the round
+            NEW, // address after the round
+            PAST_END, // end of the program plus offset
+        };
+
+        inline_target(target_kind kind, size_t value) : kind(kind), value(value) {}
+
+        target_kind kind;
+        size_t value;
+    };
+
+    LU_CONSTEXPR size_t NOT_INLINABLE = std::numeric_limits<size_t>::max();
+
+    bool isintrinsic_op(intermediate::intermediate_op op)
+    {
+        return op == intermediate::INTRINSIC || istypedintrinsic(op);
+    }
+
+    bool isfused_op(intermediate::intermediate_op op)
+    {
+        return op == intermediate::STORE_CONSTANT || op == intermediate::STORE_COPY || op == intermediate::INTRINSIC_PAIR || op == intermediate::INTRINSIC_TRIPLE;
+    }
+
+    // moves the callee frame of one call site into the caller frame: registers move up by the register count the
+    // caller had, symbols are replaced by hidden copies (see symbol_table::declare_hidden), one per site, so the
+    // caller frame still has one register per symbol
+    struct frame_renamer
+    {
+        frame_renamer(symbol_table* p_syms, intermediate_register sbase, intermediate_register abase, size_t site)
+            : p_syms(p_syms), sbase(sbase), abase(abase), site(site) {}
+
+        symbol_table* p_syms;
+        intermediate_register sbase;
+        intermediate_register abase;
+        size_t site; // numbers the copies
+        unordered_map<symbol_id, symbol_id> sids;
+
+        symbol_id sym(symbol_id sid)
+        {
+            auto it = sids.find(sid);
+            if (it != sids.end())
+            {
+                return it->second;
+            }
+            symbol copy((*p_syms)[sid]);
+            copy.name = string::join(copy.name, ".", to_string(site));
+            symbol_id renamed = p_syms->declare_hidden(move(copy)).sid;
+            sids[sid] = renamed;
+            return renamed;
+        }
+
+        intermediate_register reg(intermediate_slot slot, intermediate_register r) const
+        {
+            return r + (slot == intermediate_slot::SCALAR ? sbase : abase);
+        }
+
+        // every register of i, and of the intermediates it evaluates, in the frame it runs in
+        void rename(intermediate& i)
+        {
+            switch (i.op())
+            {
+            case intermediate::LOAD_SYMBOL:
+                i.load.sid = sym(i.load.sid);
+                i.load.reg = reg(i.load.slot, i.load.reg);
+                break;
+            case intermediate::STORE_SYMBOL:
+                i.store.sid = sym(i.store.sid);
+                i.store.reg = reg(i.store.slot, i.store.reg);
+                rename(*i.store.eval);
+                break;
+            case intermediate::TUPLE:
+                for (size_t k = 0; k < i.tup.subs.size(); ++k)
+                {
+                    rename(i.tup.subs[k]);
+                }
+                break;
+            case intermediate::BLOCK:
+                for (size_t k = 0; k < i.blk.subs.size(); ++k)
+                {
+                    rename(i.blk.subs[k]);
+                }
+                break;
+            case intermediate::CALL:
+            case intermediate::TAIL_CALL:
+                // args store into the callee frame, but are evaluated in this one
+                for (size_t k = 0; k < i.call.args.size(); ++k)
+                {
+                    rename(*i.call.args[k].store.eval);
+                }
+                if (i.call.has_result())
+                {
+                    i.call.result = sym(i.call.result);
+                    i.call.result_reg = reg(i.call.result_slot, i.call.result_reg);
+                }
+                break;
+            case intermediate::RETURN:
+                if (i.ret.eval)
+                {
+                    rename(*i.ret.eval);
+                }
+                break;
+            case intermediate::BRANCH:
+                if (i.br.condition)
+                {
+                    rename(*i.br.condition);
+                }
+                break;
+            default:
+                if (isintrinsic_op(i.op()))
+                {
+                    if (i.intr.dest != symbol::INVALID_ID)
+                    {
+                        i.intr.dest = sym(i.intr.dest);
+                        i.intr.dest_reg += sbase;
+                    }
+                    if (!i.intr.op_imm && i.intr.op != symbol::INVALID_ID)
+                    {
+                        i.intr.op = sym(i.intr.op);
+                        i.intr.op_reg += sbase;
+                    }
+                }
+                break;
+            }
+        }
+    };
+
+    struct inliner
+    {
+        inliner(intermediate_program* p_ip, const inline_settings& settings, const edge_profile* p_profile, inline_stats* p_stats, size_t max_insts)
+            : p_ip(p_ip), settings(settings), p_profile(p_profile), p_stats(p_stats), cfg(*p_ip), n(p_ip->size()),
+            max_insts(max_insts), sizes(p_ip->frame_count(), NOT_INLINABLE), body(n, 0) {}
+
+        intermediate_program* p_ip;
+        const inline_settings& settings;
+        const edge_profile* p_profile; // null unless it matches the program, first round only
+        inline_stats* p_stats;
+        control_flow_graph cfg;
+        size_t n;
+        size_t max_insts;
+        vector<size_t> sizes; // per frame, NOT_INLINABLE if the frame cannot be inlined
+        vector<intermediate_addr> body; // per old address of the callee being copied, its new address
+
+        vector<intermediate> out;
+        vector<inline_target> targets; // per emitted intermediate, only read for branches
+
+        void measure()
+        {
+            for (intermediate_frame_id fid = 0; fid < p_ip->frame_count(); ++fid)
+            {
+                if (fid == intermediate_frame::TOP || cfg.entry(fid) == control_flow_graph::NONE)
+                {
+                    continue;
+                }
+                size_t size = 0;
+                for (cfg_block_id id : cfg.rpo(fid))
+                {
+                    for (intermediate_addr iaddr = cfg[id].first; iaddr < cfg[id].end; ++iaddr)
+                    {
+                        const intermediate& i = (*p_ip)[iaddr];
+                        if (i.op() == intermediate::TAIL_CALL || (i.op() == intermediate::CALL && i.call.fid == fid))
+                        {
+                            size = NOT_INLINABLE;
+                            break;
+                        }
+                        ++size;
+                    }
+                    if (size == NOT_INLINABLE)
+                    {
+                        break;
+                    }
+                }
+                sizes[fid] = size;
+            }
+        }
+
+        bool inlinable_args(const intermediate_call& call) const
+        {
+            for (size_t k = 0; k < call.args.size(); ++k)
+            {
+                const intermediate_store_symbol& arg = call.args[k].store;
+                if (arg.eval->op() != intermediate::LOAD_CONSTANT
+                    && (arg.eval->op() != intermediate::LOAD_SYMBOL || arg.eval->load.slot != arg.slot))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // decides the call site, counting it in the stats
+        bool should_inline(intermediate_addr site, size_t projected)
+        {
+            const intermediate& i = (*p_ip)[site];
+            cfg_block_id id = cfg.block_of(site);
+            intermediate_frame_id caller = cfg[id].fid;
+            size_t size = sizes[i.call.fid];
+            if (caller == control_flow_graph::NO_FRAME || caller == i.call.fid || size == NOT_INLINABLE || !inlinable_args(i.call))
+            {
+                return false;
+            }
+            bool hot = false;
+            if (p_profile && p_profile->executed(cfg[cfg.entry(caller)].first) != 0)
+            {
+                uint64_t ncalls = p_profile->executed(site);
+                if (ncalls == 0)
+                {
+                    ++p_stats->ncold;
+                    return false;
+                }
+                hot = ncalls >= settings.hot_calls;
+            }
+            if (size > (hot ? std::max(settings.max_size, settings.max_hot_size) : settings.max_size)
+                || projected + size + i.call.args.size() > max_insts)
+            {
+                return false;
+            }
+            if (size > settings.max_size)
+            {
+                ++p_stats->nhot;
+            }
+            return true;
+        }
+
+        void push(intermediate&& i, inline_target target)
+        {
+            out.push_back(move(i));
+            targets.push_back(target);
+        }
+
+        void push(intermediate&& i)
+        {
+            push(move(i), inline_target(inline_target::NEW, 0));
+        }
+
+        static intermediate jump()
+        {
+            return intermediate::emplace_branch(0, nullptr, intermediate_branch::branch_offset());
+        }
+
+        inline_target target_of(intermediate_addr iaddr) const
+        {
+            return iaddr < n ? inline_target(inline_target::OLD, iaddr) : inline_target(inline_target::PAST_END, iaddr - n);
+        }
+
+        // args, then the callee body with renamed registers in place of the call
+        void emit_inline(intermediate_addr site)
+        {
+            const intermediate_call& call = (*p_ip)[site].call;
+            bool tail = (*p_ip)[site].op() == intermediate::TAIL_CALL;
+            intermediate_frame& caller = p_ip->frame(cfg[cfg.block_of(site)].fid);
+            const intermediate_frame& callee = p_ip->frame(call.fid);
+            intermediate_register sbase = caller.nscalars;
+            intermediate_register abase = caller.naggregates;
+            caller.nscalars += callee.nscalars;
+            caller.naggregates += callee.naggregates;
+
+            frame_renamer fr(&p_ip->context().symbols(), sbase, abase, p_stats->ninlined);
+            for (size_t k = 0; k < call.args.size(); ++k)
+            {
+                const intermediate_store_symbol& arg = call.args[k].store;
+                push(intermediate::emplace_store_symbol(fr.sym(arg.sid), arg.slot, fr.reg(arg.slot, arg.reg), make_unique(new intermediate(*arg.eval))));
+            }
+
+            // blocks in address order, so a block falls through into the next one copied
+            vector<cfg_block_id> blocks(cfg.rpo(call.fid));
+            std::sort(blocks.begin(), blocks.end());
+            size_t first = out.size();
+            vector<size_t> continues; // branches to the intermediate after the site
+            for (size_t k = 0; k < blocks.size(); ++k)
+            {
+                const cfg_block& b = cfg[blocks[k]];
+                bool last_block = k + 1 == blocks.size();
+                for (intermediate_addr iaddr = b.first; iaddr < b.end; ++iaddr)
+                {
+                    body[iaddr] = out.size();
+                    intermediate i((*p_ip)[iaddr]);
+                    fr.rename(i);
+                    if (i.op() == intermediate::BRANCH)
+                    {
+                        intermediate_addr target = i.br.target();
+                        push(move(i), target < n ? inline_target(inline_target::OLD, target) : inline_target(inline_target::PAST_END, target - n));
+                    }
+                    else if (i.op() == intermediate::RETURN && !tail)
+                    {
+                        if (call.has_result() && i.ret.eval)
+                        {
+                            push(intermediate::emplace_store_symbol(call.result, call.result_slot, call.result_reg, move(i.ret.eval)));
+                        }
+                        if (!last_block || iaddr != b.last())
+                        {
+                            continues.push_back(out.size());
+                            push(jump());
+                        }
+                    }
+                    else
+                    {
+                        push(move(i));
+                    }
+                }
+                const intermediate& last = (*p_ip)[b.last()];
+                bool falls = !isblockend(last.op()) || (last.op() == intermediate::BRANCH && last.br.condition);
+                if (falls && b.end >= n)
+                {
+                    push(jump(), inline_target(inline_target::PAST_END, 0));
+                }
+            }
+
+            // branches of the body go to the copy, fixed up here as the copy is not in the old addresses
+            for (size_t k = first; k < out.size(); ++k)
+            {
+                if (out[k].op() == intermediate::BRANCH && targets[k].kind == inline_target::OLD)
+                {
+                    targets[k] = inline_target(inline_target::NEW, body[targets[k].value]);
+                }
+            }
+            for (size_t k : continues)
+            {
+                targets[k] = inline_target(inline_target::NEW, out.size());
+            }
+        }
+
+        // one pass over the program, true if some call was inlined. the old program is only copied from, a callee
+        // body may be copied after its own address was passed
+        bool round()
+        {
+            measure();
+
+            out.reserve(n + n / 4);
+            targets.reserve(n + n / 4);
+            vector<intermediate_addr> remap(n + 1, 0);
+            size_t ninlined = p_stats->ninlined;
+            size_t projected = n;
+            for (intermediate_addr iaddr = 0; iaddr < n; ++iaddr)
+            {
+                remap[iaddr] = out.size();
+                const intermediate& i = (*p_ip)[iaddr];
+                bool site = i.op() == intermediate::CALL || i.op() == intermediate::TAIL_CALL;
+                if (site && p_stats->nrounds == 0)
+                {
+                    ++p_stats->nsites;
+                }
+                if (site && should_inline(iaddr, projected))
+                {
+                    projected += sizes[i.call.fid] + i.call.args.size();
+                    ++p_stats->ninlined;
+                    emit_inline(iaddr);
+                }
+                else if (i.op() == intermediate::BRANCH)
+                {
+                    push(intermediate(i), target_of(i.br.target()));
+                }
+                else
+                {
+                    push(intermediate(i));
+                }
+            }
+            remap[n] = out.size();
+
+            for (intermediate_addr iaddr = 0; iaddr < out.size(); ++iaddr)
+            {
+                intermediate& i = out[iaddr];
+                if (i.op() != intermediate::BRANCH)
+                {
+                    continue;
+                }
+                const inline_target& t = targets[iaddr];
+                intermediate_addr target = t.kind == inline_target::OLD ? remap[t.value] : t.kind == inline_target::NEW ? t.value : out.size() + t.value;
+                i.br.base = iaddr;
+                i.br.offset = target >= iaddr
+                    ? intermediate_branch::branch_offset(intermediate_branch::branch_offset::POSITIVE, target - iaddr)
+                    : intermediate_branch::branch_offset(intermediate_branch::branch_offset::NEGATIVE, iaddr - target);
+            }
+            for (intermediate_frame_id fid = 0; fid < p_ip->frame_count(); ++fid)
+            {
+                intermediate_frame& f = p_ip->frame(fid);
+                f.entry = remap[std::min(f.entry, n)];
+            }
+            ++p_stats->nrounds;
+            if (ninlined == p_stats->ninlined)
+            {
+                return false;
+            }
+            p_ip->rewrite(move(out));
+            return true;
+        }
+    };
+}
+
+string to_string(const inline_stats& stats)
+{
+    return string::join(
+        to_string(stats.ninsts_before), " -> ", to_string(stats.ninsts_after), " intermediates: ",
+        to_string(stats.nsites), " call sites, ",
+        to_string(stats.ninlined), " inlined in ", to_string(stats.nrounds), " rounds, ",
+        to_string(stats.nhot), " hot, ",
+        to_string(stats.ncold), " cold");
+}
+
+inline_result inline_calls(intermediate_program* ip, const inline_settings& settings, const edge_profile* p_profile, inline_stats* p_stats)
+{
+    inline_stats stats;
+    stats.ninsts_before = ip->size();
+    if (p_profile && p_profile->size() != ip->size())
+    {
+        p_profile = nullptr;
+    }
+
+    for (intermediate_addr iaddr = 0; iaddr < ip->size(); ++iaddr)
+    {
+        if (internal::isfused_op((*ip)[iaddr].op()))
+        {
+            stats.ninsts_after = ip->size();
+            if (p_stats)
+            {
+                *p_stats = stats;
+            }
+            return inline_result::INLINE_SKIPPED;
+        }
+    }
+
+    size_t max_insts = ip->size() + ip->size() * settings.max_growth_percent / 100;
+    inline_result result = inline_result::INLINE_OK;
+    for (size_t k = 0; k < settings.max_rounds; ++k)
+    {
+        internal::inliner inl(ip, settings, k == 0 ? p_profile : nullptr, &stats, max_insts);
+        if (inl.cfg.shared())
+        {
+            result = k == 0 ? inline_result::INLINE_SKIPPED : result;
+            break;
+        }
+        if (!inl.round())
+        {
+            break;
+        }
+    }
+    stats.ninsts_after = ip->size();
+    if (p_stats)
+    {
+        *p_stats = stats;
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef LU_INLINE_H
+#define LU_INLINE_H
+
+#include "intermediate.h"
+#include "layout.h"
+#include "string.h"
+#include "internal/constexpr.h"
+
+#include <cstdint>
+
+namespace lu
+{
+
+struct inline_settings
+{
+    inline_settings() : max_size(6), max_hot_size(24), hot_calls(1000), max_growth_percent(100), max_rounds(3) {}
+
+    size_t max_size; // callees of at most this many intermediates are inlined at every call site
+    size_t max_hot_size; // with a profile, callees up to this size are inlined at sites run at least hot_calls times
+    uint64_t hot_calls;
+    size_t max_growth_percent; // of the program size before inlining
+    size_t max_rounds; // each round also inlines the calls the previous one copied in
+};
+
+struct inline_stats
+{
+    inline_stats() : ninsts_before(0), ninsts_after(0), nsites(0), ninlined(0), nhot(0), ncold(0), nrounds(0) {}
+
+    size_t ninsts_before;
+    size_t ninsts_after;
+    size_t nsites; // call sites seen in the first round
+    size_t ninlined; // over all rounds
+    size_t nhot; // inlined only because the profile ran them often
+    size_t ncold; // left as calls because the profile never ran them
+    size_t nrounds;
+};
+
+string to_string(const inline_stats&);
+
+enum class inline_result
+{
+    INLINE_OK,
+    INLINE_SKIPPED, // program was left as is
+};
+
+LU_CONSTEXPR bool ok(inline_result ir)
+{
+    return ir == inline_result::INLINE_OK;
+}
+
+// replaces CALL and TAIL_CALL sites of small functions by a copy of the callee body (see cfg.h for the blocks
+// copied), so short helpers do not pay for a frame push, argument copies and a return.
+//
+// the callee registers are renamed into fresh registers appended to the caller frame, the args become stores
+// into the renamed parameters. each RETURN of an inlined CALL stores its eval into the result register (dropped if
+// the result is discarded) and branches to the intermediate after the call site, the last one falls through.
+// a RETURN of an inlined TAIL_CALL stays a RETURN of the caller frame. callees that tail call or call themselves
+// are not inlined, nor are call sites whose args are not a constant or a load of the parameter's slot.
+//
+// with an edge profile of the program (see interpret_settings), sites run at least hot_calls times may inline
+// larger callees and sites the profile never ran are left alone. the profile only applies to the first round.
+// the callee frame and body are kept for the calls left. runs before optimize, programs with fused intermediates
+// or code shared by frames are skipped.
+inline_result inline_calls(intermediate_program*, const inline_settings& = inline_settings(), const edge_profile* = nullptr, inline_stats* = nullptr);
+
+}
+
+#endif // LU_INLINE_H
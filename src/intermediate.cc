@@ -20,18 +20,26 @@ namespace diags
     diag INTERMEDIATE_INFO = diag(diag::DEBUG_LEVEL, 4900);
 }
 
-intermediate_store_symbol::intermediate_store_symbol(intermediate_store_symbol&& other) : sid(move(other.sid)), eval(move(other.eval))
+intermediate_store_symbol::intermediate_store_symbol(intermediate_store_symbol&& other) : sid(move(other.sid)), slot(other.slot), reg(other.reg), eval(move(other.eval))
 {}
 
-intermediate_store_symbol::intermediate_store_symbol(const intermediate_store_symbol& other) : sid((other.sid)), eval(make_unique(new intermediate(*other.eval)))
+intermediate_store_symbol::intermediate_store_symbol(const intermediate_store_symbol& other) : sid((other.sid)), slot(other.slot), reg(other.reg), eval(make_unique(new intermediate(*other.eval)))
 {}
 
 
-intermediate_branch::intermediate_branch(intermediate_branch&& other) : base(move(other.base)), condition(move(other.condition)), offset(move(other.offset))
+intermediate_branch::intermediate_branch(intermediate_branch&& other) : base(move(other.base)), condition(move(other.condition)), offset(move(other.offset)), negated(other.negated)
 {
 }
 
-intermediate_branch::intermediate_branch(const intermediate_branch& other) : base((other.base)), condition(make_unique(new intermediate(*other.condition))), offset(other.offset)
+intermediate_branch::intermediate_branch(const intermediate_branch& other) : base((other.base)), condition(other.condition ? make_unique(new intermediate(*other.condition)) : nullptr), offset(other.offset), negated(other.negated)
+{
+}
+
+intermediate_return::intermediate_return(intermediate_return&& other) : eval(move(other.eval))
+{
+}
+
+intermediate_return::intermediate_return(const intermediate_return& other) : eval(other.eval ? make_unique(new intermediate(*other.eval)) : nullptr)
 {
 }
 
@@ -79,6 +87,14 @@ intermediate intermediate::create_call(intermediate_call&& call)
     return i;
 }
 
+intermediate intermediate::create_tail_call(intermediate_call&& call)
+{
+    intermediate i;
+    i._inst = TAIL_CALL;
+    new (&i.call) intermediate_call(move(call));
+    return i;
+}
+
 intermediate intermediate::create_tuple(intermediate_tuple&& tup)
 {
     intermediate i;
@@ -87,6 +103,30 @@ intermediate intermediate::create_tuple(intermediate_tuple&& tup)
     return i;
 }
 
+intermediate intermediate::create_return(intermediate_return&& ret)
+{
+    intermediate i;
+    i._inst = RETURN;
+    new (&i.ret) intermediate_return(move(ret));
+    return i;
+}
+
+intermediate intermediate::create_branch(intermediate_branch&& br)
+{
+    intermediate i;
+    i._inst = BRANCH;
+    new (&i.br) intermediate_branch(move(br));
+    return i;
+}
+
+intermediate intermediate::create_block()
+{
+    intermediate i;
+    i._inst = BLOCK;
+    new (&i.blk) intermediate_block();
+    return i;
+}
+
 intermediate intermediate::create_halt()
 {
     intermediate i;
@@ -94,6 +134,91 @@ intermediate intermediate::create_halt()
     return i;
 }
 
+intermediate intermediate::create_store_constant(intermediate_store_symbol&& store)
+{
+    assert(store.eval->op() == LOAD_CONSTANT);
+
+    intermediate i = create_store_symbol(move(store));
+    i._inst = STORE_CONSTANT;
+    return i;
+}
+
+intermediate intermediate::create_store_copy(intermediate_store_symbol&& store)
+{
+    assert(store.eval->op() == LOAD_SYMBOL);
+
+    intermediate i = create_store_symbol(move(store));
+    i._inst = STORE_COPY;
+    return i;
+}
+
+intermediate intermediate::create_intrinsic_pair(intermediate_intrinsic_pair intr2)
+{
+    intermediate i;
+    i._inst = INTRINSIC_PAIR;
+    i.intr2 = intr2;
+    return i;
+}
+
+intermediate intermediate::create_intrinsic_triple(intermediate_intrinsic_triple intr3)
+{
+    intermediate i;
+    i._inst = INTRINSIC_TRIPLE;
+    i.intr3 = intr3;
+    return i;
+}
+
+intermediate intermediate::create_typed_intrinsic(intermediate_intrinsic intr)
+{
+    intermediate i = create_intrinsic(intr);
+    switch (intr.icode)
+    {
+    case I32PRINT:
+        i._inst = intr.op_imm ? I32PRINT_IMM : I32PRINT_REG;
+        break;
+    case I64PRINT:
+        i._inst = intr.op_imm ? I64PRINT_IMM : I64PRINT_REG;
+        break;
+    case U32PRINT:
+        i._inst = intr.op_imm ? U32PRINT_IMM : U32PRINT_REG;
+        break;
+    case U64PRINT:
+        i._inst = intr.op_imm ? U64PRINT_IMM : U64PRINT_REG;
+        break;
+    case I32ADD:
+        i._inst = intr.op_imm ? I32ADD_IMM : I32ADD_REG;
+        break;
+    case I64ADD:
+        i._inst = intr.op_imm ? I64ADD_IMM : I64ADD_REG;
+        break;
+    case U32ADD:
+        i._inst = intr.op_imm ? U32ADD_IMM : U32ADD_REG;
+        break;
+    case U64ADD:
+        i._inst = intr.op_imm ? U64ADD_IMM : U64ADD_REG;
+        break;
+    case BPRINT:
+        i._inst = intr.op_imm ? BPRINT_IMM : BPRINT_REG;
+        break;
+    case ASCIIPRINT:
+        i._inst = intr.op_imm ? ASCIIPRINT_IMM : ASCIIPRINT_REG;
+        break;
+    case LNEG:
+        assert(!intr.op_imm);
+        i._inst = LNEG_REG;
+        break;
+    case LAND:
+        i._inst = intr.op_imm ? LAND_IMM : LAND_REG;
+        break;
+    case LOR:
+        i._inst = intr.op_imm ? LOR_IMM : LOR_REG;
+        break;
+    default:
+        throw internal_except_unhandled_switch(intrinsic_code_cstr(intr.icode));
+    }
+    return i;
+}
+
 intermediate::intermediate() : _inst(ILLEGAL) {}
 
 intermediate::~intermediate()
@@ -136,15 +261,24 @@ intermediate& intermediate::create(intermediate&& other)
         new(&this->load) intermediate_load_symbol(move(other.load));
         break;
     case intermediate::STORE_SYMBOL:
+    case intermediate::STORE_CONSTANT:
+    case intermediate::STORE_COPY:
         new(&this->store) intermediate_store_symbol(move(other.store));
         break;
     case intermediate::INTRINSIC:
         new(&this->intr) intermediate_intrinsic(move(other.intr));
         break;
+    case intermediate::INTRINSIC_PAIR:
+        new(&this->intr2) intermediate_intrinsic_pair(move(other.intr2));
+        break;
+    case intermediate::INTRINSIC_TRIPLE:
+        new(&this->intr3) intermediate_intrinsic_triple(move(other.intr3));
+        break;
     case intermediate::BLOCK:
         new(&this->blk) intermediate_block(move(other.blk));
         break;
     case intermediate::CALL:
+    case intermediate::TAIL_CALL:
         new(&this->call) intermediate_call(move(other.call));
         break;
     case intermediate::TUPLE:
@@ -159,6 +293,11 @@ intermediate& intermediate::create(intermediate&& other)
     case intermediate::HALT:
         break;
     default:
+        if (istypedintrinsic(_inst))
+        {
+            new(&this->intr) intermediate_intrinsic(move(other.intr));
+            break;
+        }
         throw internal_except_unhandled_switch(to_string(_inst));
     }
     return *this;
@@ -178,15 +317,24 @@ intermediate& intermediate::create(const intermediate& other)
         new(&this->load) intermediate_load_symbol((other.load));
         break;
     case intermediate::STORE_SYMBOL:
+    case intermediate::STORE_CONSTANT:
+    case intermediate::STORE_COPY:
         new(&this->store) intermediate_store_symbol((other.store));
         break;
     case intermediate::INTRINSIC:
         new(&this->intr) intermediate_intrinsic((other.intr));
         break;
+    case intermediate::INTRINSIC_PAIR:
+        new(&this->intr2) intermediate_intrinsic_pair((other.intr2));
+        break;
+    case intermediate::INTRINSIC_TRIPLE:
+        new(&this->intr3) intermediate_intrinsic_triple((other.intr3));
+        break;
     case intermediate::BLOCK:
         new(&this->blk) intermediate_block((other.blk));
         break;
     case intermediate::CALL:
+    case intermediate::TAIL_CALL:
         new(&this->call) intermediate_call((other.call));
         break;
     case intermediate::TUPLE:
@@ -201,6 +349,11 @@ intermediate& intermediate::create(const intermediate& other)
     case intermediate::HALT:
         break;
     default:
+        if (istypedintrinsic(_inst))
+        {
+            new(&this->intr) intermediate_intrinsic((other.intr));
+            break;
+        }
         throw internal_except_unhandled_switch(to_string(_inst));
     }
     return *this;
@@ -231,15 +384,24 @@ void intermediate::destroy()
         load.~intermediate_load_symbol();
         break;
     case intermediate::STORE_SYMBOL:
+    case intermediate::STORE_CONSTANT:
+    case intermediate::STORE_COPY:
         store.~intermediate_store_symbol();
         break;
     case intermediate::INTRINSIC:
         intr.~intermediate_intrinsic();
         break;
+    case intermediate::INTRINSIC_PAIR:
+        intr2.~intermediate_intrinsic_pair();
+        break;
+    case intermediate::INTRINSIC_TRIPLE:
+        intr3.~intermediate_intrinsic_triple();
+        break;
     case intermediate::BLOCK:
         blk.~intermediate_block();
         break;
     case intermediate::CALL:
+    case intermediate::TAIL_CALL:
         call.~intermediate_call();
         break;
     case intermediate::TUPLE:
@@ -254,6 +416,11 @@ void intermediate::destroy()
     case intermediate::HALT:
         break;
     default:
+        if (istypedintrinsic(_inst))
+        {
+            intr.~intermediate_intrinsic();
+            break;
+        }
         throw internal_except_unhandled_switch(to_string(_inst));
     }
 }
@@ -265,6 +432,148 @@ intermediate_context::intermediate_context(analyze_context&& ac)
     _svals = move(ac.static_values());
 }
 
+namespace internal
+{
+    LU_CONSTEXPR uint64_t FNV_OFFSET = 14695981039346656037ull;
+    LU_CONSTEXPR uint64_t FNV_PRIME = 1099511628211ull;
+
+    uint64_t hash_combine(uint64_t h, uint64_t v)
+    {
+        for (size_t i = 0; i < sizeof(v); ++i)
+        {
+            h = (h ^ ((v >> (i * 8)) & 0xff)) * FNV_PRIME;
+        }
+        return h;
+    }
+
+    // only builtins, literals and tuples of them are deduplicated
+    bool isinternable(const intermediate_value& val)
+    {
+        switch (val.tid().tclass)
+        {
+        case type_class::BUILTIN:
+        case type_class::LITERAL:
+            return true;
+        case type_class::TUPLE:
+            for (size_t i = 0; i < val.tup.vals.size(); ++i)
+            {
+                if (!isinternable(val.tup.vals[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    uint64_t constant_hash(const intermediate_value& val)
+    {
+        uint64_t h = hash_combine(hash_combine(FNV_OFFSET, static_cast<uint64_t>(val.tid().tclass)), val.tid().idx);
+        switch (val.tid().tclass)
+        {
+        case type_class::BUILTIN:
+            return hash_combine(h, to_scalar(val.bin).bits);
+        case type_class::LITERAL:
+            for (size_t i = 0; i < val.lit.text.size(); ++i)
+            {
+                h = (h ^ static_cast<unsigned char>(val.lit.text[i])) * FNV_PRIME;
+            }
+            return h;
+        case type_class::TUPLE:
+            for (size_t i = 0; i < val.tup.vals.size(); ++i)
+            {
+                h = hash_combine(h, constant_hash(val.tup.vals[i]));
+            }
+            return h;
+        default:
+            throw internal_except_unhandled_switch(to_string(val.tid().tclass));
+        }
+    }
+
+    bool constant_equal(const intermediate_value& lhs, const intermediate_value& rhs)
+    {
+        if (lhs.tid() != rhs.tid())
+        {
+            return false;
+        }
+        switch (lhs.tid().tclass)
+        {
+        case type_class::BUILTIN:
+            return to_scalar(lhs.bin).bits == to_scalar(rhs.bin).bits;
+        case type_class::LITERAL:
+            return string_view(lhs.lit.text) == string_view(rhs.lit.text);
+        case type_class::TUPLE:
+            if (lhs.tup.vals.size() != rhs.tup.vals.size())
+            {
+                return false;
+            }
+            for (size_t i = 0; i < lhs.tup.vals.size(); ++i)
+            {
+                if (!constant_equal(lhs.tup.vals[i], rhs.tup.vals[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        default:
+            throw internal_except_unhandled_switch(to_string(lhs.tid().tclass));
+        }
+    }
+}
+
+intermediate_constant intermediate_constant_pool::intern(intermediate_value&& val)
+{
+    if (!internal::isinternable(val))
+    {
+        _vals.push_back(move(val));
+        return static_cast<intermediate_constant>(_vals.size() - 1);
+    }
+    vector<intermediate_constant>& same_hash = _index[internal::constant_hash(val)];
+    for (size_t i = 0; i < same_hash.size(); ++i)
+    {
+        if (internal::constant_equal(_vals[same_hash[i]], val))
+        {
+            return same_hash[i];
+        }
+    }
+    assert(_vals.size() < std::numeric_limits<intermediate_constant>::max());
+
+    _vals.push_back(move(val));
+    same_hash.push_back(static_cast<intermediate_constant>(_vals.size() - 1));
+    return same_hash.back();
+}
+
+intermediate intermediate_program::make_load_constant(intermediate_value&& val)
+{
+    scalar_value bits;
+    bits.bits = 0;
+    if (val.tid().is(BUILTIN))
+    {
+        bits = to_scalar(val.bin);
+    }
+    return intermediate::emplace_load_constant(_consts.intern(move(val)), bits);
+}
+
+intermediate intermediate_program::make_tuple(type_id tid, array<intermediate>&& subs)
+{
+    for (size_t i = 0; i < subs.size(); ++i)
+    {
+        if (subs[i].op() != intermediate::LOAD_CONSTANT)
+        {
+            return intermediate::emplace_tuple(tid, move(subs));
+        }
+    }
+    intermediate_value val(tid);
+    val.tup.vals = array<intermediate_value>(subs.size());
+    for (size_t i = 0; i < subs.size(); ++i)
+    {
+        val.tup.vals[i] = _consts[subs[i].imm.idx];
+    }
+    return make_load_constant(move(val));
+}
+
 void intermediate_program::set_context(analyze_context&& ac)
 {
     // TODO perform context merge, for now just replace:
@@ -294,11 +603,42 @@ intermediate_addr intermediate_program::push(intermediate&& i)
 
 //intermediate_addr intermediate_program::write(intermediate_addr, intermediate&&); // overwrite if needed - only use for hard-coded addresses (probably unnecessary)
 
+void intermediate_program::rewrite(vector<intermediate>&& insts)
+{
+    _insts = move(insts);
+}
+
 size_t intermediate_program::size() const
 {
     return _insts.size();
 }
 
+intermediate_frame_id intermediate_program::push_frame(intermediate_frame&& f)
+{
+    intermediate_frame_id fid = _frames.size();
+    _frames.push_back(move(f));
+    return fid;
+}
+
+intermediate_frame& intermediate_program::frame(intermediate_frame_id fid)
+{
+    assert(fid < _frames.size());
+
+    return _frames[fid];
+}
+
+const intermediate_frame& intermediate_program::frame(intermediate_frame_id fid) const
+{
+    assert(fid < _frames.size());
+
+    return _frames[fid];
+}
+
+size_t intermediate_program::frame_count() const
+{
+    return _frames.size();
+}
+
 const char* intermediate_op_cstr(intermediate::intermediate_op op)
 {
     switch (op)
@@ -317,6 +657,8 @@ const char* intermediate_op_cstr(intermediate::intermediate_op op)
         return "BLOCK";
     case intermediate::CALL:
         return "CALL";
+    case intermediate::TAIL_CALL:
+        return "TAIL_CALL";
     case intermediate::TUPLE:
         return "TUPLE";
     case intermediate::RETURN:
@@ -325,6 +667,64 @@ const char* intermediate_op_cstr(intermediate::intermediate_op op)
         return "BRANCH";
     case intermediate::HALT:
         return "HALT";
+    case intermediate::STORE_CONSTANT:
+        return "STORE_CONSTANT";
+    case intermediate::STORE_COPY:
+        return "STORE_COPY";
+    case intermediate::INTRINSIC_PAIR:
+        return "INTRINSIC_PAIR";
+    case intermediate::INTRINSIC_TRIPLE:
+        return "INTRINSIC_TRIPLE";
+    case intermediate::I32PRINT_REG:
+        return "I32PRINT_REG";
+    case intermediate::I32PRINT_IMM:
+        return "I32PRINT_IMM";
+    case intermediate::I64PRINT_REG:
+        return "I64PRINT_REG";
+    case intermediate::I64PRINT_IMM:
+        return "I64PRINT_IMM";
+    case intermediate::U32PRINT_REG:
+        return "U32PRINT_REG";
+    case intermediate::U32PRINT_IMM:
+        return "U32PRINT_IMM";
+    case intermediate::U64PRINT_REG:
+        return "U64PRINT_REG";
+    case intermediate::U64PRINT_IMM:
+        return "U64PRINT_IMM";
+    case intermediate::I32ADD_REG:
+        return "I32ADD_REG";
+    case intermediate::I32ADD_IMM:
+        return "I32ADD_IMM";
+    case intermediate::I64ADD_REG:
+        return "I64ADD_REG";
+    case intermediate::I64ADD_IMM:
+        return "I64ADD_IMM";
+    case intermediate::U32ADD_REG:
+        return "U32ADD_REG";
+    case intermediate::U32ADD_IMM:
+        return "U32ADD_IMM";
+    case intermediate::U64ADD_REG:
+        return "U64ADD_REG";
+    case intermediate::U64ADD_IMM:
+        return "U64ADD_IMM";
+    case intermediate::BPRINT_REG:
+        return "BPRINT_REG";
+    case intermediate::BPRINT_IMM:
+        return "BPRINT_IMM";
+    case intermediate::ASCIIPRINT_REG:
+        return "ASCIIPRINT_REG";
+    case intermediate::ASCIIPRINT_IMM:
+        return "ASCIIPRINT_IMM";
+    case intermediate::LNEG_REG:
+        return "LNEG_REG";
+    case intermediate::LAND_REG:
+        return "LAND_REG";
+    case intermediate::LAND_IMM:
+        return "LAND_IMM";
+    case intermediate::LOR_REG:
+        return "LOR_REG";
+    case intermediate::LOR_IMM:
+        return "LOR_IMM";
     default:
         throw internal_except_unhandled_switch(to_string(op));
     }   
@@ -381,6 +781,7 @@ namespace internal
             : p_aet(aet), p_ip(ip), p_log(log), idx(0), printer(ip)
         {
             p_ip->set_context(move(p_aet->context()));
+            fid = p_ip->push_frame(intermediate_frame(p_ip->size(), 0, 0));
         }
 
         analyze_expr_tree* p_aet;
@@ -388,6 +789,8 @@ namespace internal
         diag_logger* p_log;
         size_t idx; // 0..size of aet
         intermediate_printer printer;
+        intermediate_frame_id fid; // frame being emitted
+        unordered_map<symbol_id, intermediate_register> regs; // symbol -> register in current frame
 
         diag_context make_intermediate_info(intermediate_addr iaddr, const intermediate& i)
         {
@@ -424,6 +827,39 @@ namespace internal
             return p_ip->context().symbols();
         }
 
+        intermediate_slot slot(symbol_id sid)
+        {
+            return slot_for(types(), symbols()[sid].tid);
+        }
+
+        // registers are handed out on first reference from the bank of the symbol's static type,
+        // so the frame size is the count of distinct symbols used
+        intermediate_register reg(symbol_id sid)
+        {
+            assert(sid != symbol::INVALID_ID);
+
+            auto it = regs.find(sid);
+            if (it != regs.end())
+            {
+                return it->second;
+            }
+            intermediate_frame& f = p_ip->frame(fid);
+            size_t& n = slot(sid) == intermediate_slot::SCALAR ? f.nscalars : f.naggregates;
+            intermediate_register r = n++;
+            regs.insert(std::pair<symbol_id, intermediate_register>(sid, r));
+            return r;
+        }
+
+        // registers of intrinsic operands are always scalars
+        intermediate_register scalar_reg(symbol_id sid)
+        {
+            if (slot(sid) != intermediate_slot::SCALAR)
+            {
+                throw internal_except("intrinsic operand is not a builtin");
+            }
+            return reg(sid);
+        }
+
         void emit(intermediate&& i)
         {
             intermediate_addr iaddr = p_ip->push(move(i));
@@ -447,7 +883,11 @@ namespace internal
 
         intermediate make_load_literal(const analyze_expr& ae)
         {
-            //ae.eval_type();
+            return make_load_literal(ae, ae.eval_type());
+        }
+
+        intermediate make_load_literal(const analyze_expr& ae, type_id etid)
+        {
             intermediate_value val(ae.base_type());
             if (val.tid().is(LITERAL))
             {
@@ -461,24 +901,23 @@ namespace internal
             {
                 throw internal_except_with_location("invalid type for literal conversion");
             }
-            if (ae.base_type() != ae.eval_type())
+            if (ae.base_type() != etid)
             {
                 // todo cast
-                val = (value_static_cast(ae.eval_type(), move(val)));
+                val = (value_static_cast(etid, move(val)));
             }
-            intermediate i = (intermediate::emplace_load_constant(move(val)));
-            return i;
+            return p_ip->make_load_constant(move(val));
         }
 
         intermediate make_load_variable(const analyze_expr& ae)
         {
             if (istypedvariable(ae))
             {
-                return (intermediate::emplace_load_symbol(ae.sid()));
+                return (intermediate::emplace_load_symbol(ae.sid(), symbols()[ae.sid()].tid, slot(ae.sid()), reg(ae.sid())));
             }
             else
             {
-                return (intermediate::emplace_load_symbol(ae.sid()));
+                return (intermediate::emplace_load_symbol(ae.sid(), symbols()[ae.sid()].tid, slot(ae.sid()), reg(ae.sid())));
             }
             throw internal_except("TODO???");
         }
@@ -488,12 +927,22 @@ namespace internal
             assert(istuple(ae));
             assert(ae.base_type().is(TUPLE));
 
+            // eval types are not set on the members, so literals are converted to the member type here,
+            // otherwise a tuple stored into a typed tuple would hold literal values
+            const type& ty = types().find_type(ae.eval_type());
             array<intermediate> subs(ae.arity());
             for (size_t i = 0; i < ae.arity(); ++i)
             {
-                subs[i] = make_rhs(ae[i]);
+                if (isliteral(ae[i]) && ty.tclass == TUPLE && ty.tup[i].tid.is(BUILTIN))
+                {
+                    subs[i] = make_load_literal(ae[i], ty.tup[i].tid);
+                }
+                else
+                {
+                    subs[i] = make_rhs(ae[i]);
+                }
             }
-            return intermediate::emplace_tuple(move(subs));
+            return p_ip->make_tuple(ae.eval_type(), move(subs));
         }
 
         symbol_id get_target_sid(const analyze_expr& ae)
@@ -546,6 +995,7 @@ namespace internal
                 const type& ty = types().find_type(callee.base_type());
                 symbol_id dest = symbol::INVALID_ID;
                 symbol_id op = symbol::INVALID_ID;
+                const analyze_expr* p_imm = nullptr; // literal op
 
                 switch (ty.intr.config)
                 {
@@ -566,26 +1016,51 @@ namespace internal
                 case intrinsic_type::OP_ONLY:
                 {
                     assert(args.arity() == 1);
-                    assert(args[0].is(expr::VARIABLE));
 
-                    op = args[0].sid();
+                    if (isliteral(args[0]))
+                    {
+                        p_imm = &args[0];
+                    }
+                    else
+                    {
+                        assert(args[0].is(expr::VARIABLE));
+
+                        op = args[0].sid();
+                    }
                     break;
                 }
                 case intrinsic_type::BOTH:
                 {
                     assert(args.arity() == 2);
                     assert(args[0].is(expr::VARIABLE));
-                    assert(args[1].is(expr::VARIABLE));
 
                     dest = args[0].sid();
-                    op = args[1].sid();
+                    if (isliteral(args[1]))
+                    {
+                        p_imm = &args[1];
+                    }
+                    else
+                    {
+                        assert(args[1].is(expr::VARIABLE));
+
+                        op = args[1].sid();
+                    }
                     break;
                 }
                 default:
                     throw internal_except_unhandled_switch(to_string(ty.intr.config));
                 }
                 const intrinsic& intr = symbols().find_intrinsic(callee.iid());
-                return (intermediate::emplace_intrinsic(intr.icode, callee.iid(), dest, op));
+                intermediate_register dest_reg = dest != symbol::INVALID_ID ? scalar_reg(dest) : 0;
+                if (p_imm)
+                {
+                    intermediate i = make_load_literal(*p_imm);
+                    assert(p_ip->constants()[i.imm.idx].tid().is(BUILTIN));
+
+                    return (intermediate::emplace_intrinsic(intr.icode, callee.iid(), dest, dest_reg, i.imm.bits));
+                }
+                intermediate_register op_reg = op != symbol::INVALID_ID ? scalar_reg(op) : 0;
+                return (intermediate::emplace_intrinsic(intr.icode, callee.iid(), dest, op, dest_reg, op_reg));
             }
             else
             {
@@ -595,6 +1070,16 @@ namespace internal
             
         }
 
+        intermediate make_store(symbol_id dest, const analyze_expr& rhsexpr)
+        {
+            intermediate_slot dslot = slot(dest);
+            intermediate rhs = (dslot == intermediate_slot::SCALAR && isliteral(rhsexpr) && !rhsexpr.eval_type().is(BUILTIN))
+                // scalars are stored without a type, so the constant must already be the builtin
+                ? make_load_literal(rhsexpr, symbols()[dest].tid)
+                : make_rhs(rhsexpr);
+            return intermediate::emplace_store_symbol(dest, dslot, reg(dest), make_unique(new intermediate(move(rhs))));
+        }
+
         intermediate make_halt()
         {
             return intermediate::create_halt();
@@ -626,8 +1111,7 @@ namespace internal
                 if (isvariable(target))
                 {
                     symbol_id dest = get_target_sid(target);
-                    intermediate rhs = make_rhs(rhsexpr);
-                    emit(intermediate::emplace_store_symbol(dest, make_unique(new intermediate(move(rhs)))));
+                    emit(make_store(dest, rhsexpr));
                 }
                 else if (istuple(target))
                 {
@@ -642,7 +1126,8 @@ namespace internal
                             assert(isvariable(target[i]));
                             //assert(target[i].eval_type() == rhsexpr[i].eval_type()); // TODO convertible, if needed
 
-                            emit(intermediate::emplace_store_symbol(get_target_sid(target[i]), make_unique(new intermediate(make_rhs(rhsexpr[i])))));
+                            symbol_id dest = get_target_sid(target[i]);
+                            emit(make_store(dest, rhsexpr[i]));
                         }
                     }
                     else if (rhsexpr.base_type().is(TUPLE))
@@ -719,6 +1204,192 @@ namespace internal
     };
 };
 
+namespace internal
+{
+    struct slot_verifier
+    {
+        slot_verifier(const intermediate_program& ip, string* p_err) : ip(ip), p_err(p_err), p_frame(nullptr) {}
+
+        struct slot_ref
+        {
+            intermediate_slot slot;
+            intermediate_register reg;
+        };
+
+        const intermediate_program& ip;
+        string* p_err;
+        const intermediate_frame* p_frame;
+        unordered_map<symbol_id, slot_ref> sids; // symbol -> register in current frame
+        unordered_map<uint64_t, symbol_id> owners; // register -> symbol in current frame
+
+        static uint64_t owner_key(intermediate_slot slot, intermediate_register reg)
+        {
+            return (static_cast<uint64_t>(reg) << 1) | (slot == intermediate_slot::SCALAR ? 0 : 1);
+        }
+
+        bool fail(intermediate_addr iaddr, const char* what, symbol_id sid)
+        {
+            *p_err = string::join(hex(iaddr), ": ", what, " (symbol #", to_string(sid), ")");
+            return false;
+        }
+
+        bool check(intermediate_addr iaddr, symbol_id sid, intermediate_slot slot, intermediate_register reg)
+        {
+            if (!ip.context().symbols().exists(sid))
+            {
+                return fail(iaddr, "register of unknown symbol", sid);
+            }
+            if (slot_for(ip.context().types(), ip.context().symbols()[sid].tid) != slot)
+            {
+                return fail(iaddr, "register bank does not match the static type", sid);
+            }
+            if (reg >= p_frame->nregs(slot))
+            {
+                return fail(iaddr, "register out of frame", sid);
+            }
+            auto it = sids.find(sid);
+            if (it != sids.end() && (it->second.slot != slot || it->second.reg != reg))
+            {
+                return fail(iaddr, "symbol moved to another register", sid);
+            }
+            auto oit = owners.find(owner_key(slot, reg));
+            if (oit != owners.end() && oit->second != sid)
+            {
+                return fail(iaddr, "register shared by two symbols", sid);
+            }
+            sids[sid] = { slot, reg };
+            owners[owner_key(slot, reg)] = sid;
+            return true;
+        }
+
+        bool check_intrinsic(intermediate_addr iaddr, const intermediate_intrinsic& intr)
+        {
+            return (intr.dest == symbol::INVALID_ID || check(iaddr, intr.dest, intermediate_slot::SCALAR, intr.dest_reg))
+                && (intr.op_imm || intr.op == symbol::INVALID_ID || check(iaddr, intr.op, intermediate_slot::SCALAR, intr.op_reg));
+        }
+
+        // arguments are stored into the callee frame, so only their bank is checked there
+        bool check_call(intermediate_addr iaddr, const intermediate_call& call)
+        {
+            if (call.fid >= ip.frame_count())
+            {
+                *p_err = string::join(hex(iaddr), ": call to unknown frame");
+                return false;
+            }
+            const intermediate_frame& callee = ip.frame(call.fid);
+            for (size_t k = 0; k < call.args.size(); ++k)
+            {
+                const intermediate& arg = call.args[k];
+                if (arg.op() != intermediate::STORE_SYMBOL)
+                {
+                    return fail(iaddr, "argument is not a store", symbol::INVALID_ID);
+                }
+                if (!check(iaddr, *arg.store.eval))
+                {
+                    return false;
+                }
+                if (!ip.context().symbols().exists(arg.store.sid)
+                    || slot_for(ip.context().types(), ip.context().symbols()[arg.store.sid].tid) != arg.store.slot
+                    || arg.store.reg >= callee.nregs(arg.store.slot))
+                {
+                    return fail(iaddr, "parameter register does not match the callee frame", arg.store.sid);
+                }
+            }
+            return !call.has_result() || check(iaddr, call.result, call.result_slot, call.result_reg);
+        }
+
+        bool check(intermediate_addr iaddr, const intermediate& i)
+        {
+            switch (i.op())
+            {
+            case intermediate::LOAD_SYMBOL:
+                return check(iaddr, i.load.sid, i.load.slot, i.load.reg);
+            case intermediate::STORE_SYMBOL:
+            case intermediate::STORE_CONSTANT:
+            case intermediate::STORE_COPY:
+                return check(iaddr, i.store.sid, i.store.slot, i.store.reg) && check(iaddr, *i.store.eval);
+            case intermediate::TUPLE:
+                for (size_t k = 0; k < i.tup.subs.size(); ++k)
+                {
+                    if (!check(iaddr, i.tup.subs[k]))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            case intermediate::INTRINSIC:
+                return check_intrinsic(iaddr, i.intr);
+            case intermediate::CALL:
+            case intermediate::TAIL_CALL:
+                return check_call(iaddr, i.call);
+            case intermediate::RETURN:
+                return !i.ret.eval || check(iaddr, *i.ret.eval);
+            case intermediate::BRANCH:
+                return !i.br.condition || check(iaddr, *i.br.condition);
+            case intermediate::INTRINSIC_PAIR:
+                return check_intrinsic(iaddr, i.intr2.first) && check_intrinsic(iaddr, i.intr2.second);
+            case intermediate::INTRINSIC_TRIPLE:
+                return check_intrinsic(iaddr, i.intr3.first) && check_intrinsic(iaddr, i.intr3.second) && check_intrinsic(iaddr, i.intr3.third);
+            default:
+                return !istypedintrinsic(i.op()) || check_intrinsic(iaddr, i.intr);
+            }
+        }
+
+        // the frame an address belongs to is the one with the closest entry at or before it
+        const intermediate_frame* frame_of(intermediate_addr iaddr) const
+        {
+            const intermediate_frame* p_f = nullptr;
+            for (intermediate_frame_id fid = 0; fid < ip.frame_count(); ++fid)
+            {
+                const intermediate_frame& f = ip.frame(fid);
+                if (f.entry <= iaddr && (!p_f || f.entry >= p_f->entry))
+                {
+                    p_f = &f;
+                }
+            }
+            return p_f;
+        }
+
+        bool verify()
+        {
+            for (intermediate_addr iaddr = 0; iaddr < ip.size(); ++iaddr)
+            {
+                const intermediate_frame* p_f = frame_of(iaddr);
+                if (!p_f)
+                {
+                    *p_err = string::join(hex(iaddr), ": outside of any frame");
+                    return false;
+                }
+                if (p_f != p_frame)
+                {
+                    p_frame = p_f;
+                    sids.clear();
+                    owners.clear();
+                }
+                if (!check(iaddr, ip[iaddr]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+}
+
+intermediate_slot slot_for(const type_registry& types, type_id tid)
+{
+    if (tid.is(BUILTIN) && tid != types.find_builtin_type_id(builtin_type::TYPEID))
+    {
+        return intermediate_slot::SCALAR;
+    }
+    return intermediate_slot::AGGREGATE;
+}
+
+bool verify_slots(const intermediate_program& ip, string* p_err)
+{
+    return internal::slot_verifier(ip, p_err).verify();
+}
+
 intermediate_transform_result intermediate_transform(analyze_expr_tree* p_aet, intermediate_program* p_ip, diag_logger* p_log)
 {
     intermediate_transform_result res = intermediate_transform_result::INTERMEDIATE_TRANSFORM_OK;
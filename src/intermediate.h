@@ -7,6 +7,7 @@
 #include "string.h"
 #include "adt/array.h"
 #include "adt/vector.h"
+#include "adt/map.h"
 
 #include "symbol.h"
 #include "scope.h" // for symbol table
@@ -56,39 +57,74 @@ namespace diags
 //     intermediate_value val;
 // };
 
+// symbols are kept for diagnostics, but are executed through their frame relative register
 struct intermediate_load_symbol
 {
-    intermediate_load_symbol(symbol_id sid) : sid(sid) {}
+    intermediate_load_symbol(symbol_id sid, type_id tid, intermediate_slot slot, intermediate_register reg) : sid(sid), tid(tid), slot(slot), reg(reg) {}
 
     symbol_id sid;
+    type_id tid; // static type of the symbol, scalars do not carry one at runtime
+    intermediate_slot slot;
+    intermediate_register reg;
 };
 
 // temp from last load -> sid
 struct intermediate_store_symbol
 {
-    intermediate_store_symbol(symbol_id sid, unique<intermediate>&& eval) : sid(sid), eval(move(eval)) {}
+    intermediate_store_symbol(symbol_id sid, intermediate_slot slot, intermediate_register reg, unique<intermediate>&& eval) : sid(sid), slot(slot), reg(reg), eval(move(eval)) {}
     intermediate_store_symbol(intermediate_store_symbol&&);
     intermediate_store_symbol(const intermediate_store_symbol&);
 
     symbol_id sid;
+    intermediate_slot slot;
+    intermediate_register reg;
     unique<intermediate> eval;
 };
 
+// constants live in the program's constant pool. builtins are also kept inline as their scalar payload,
+// so scalar loads do not touch the pool
 struct intermediate_load_constant
 {
-    intermediate_load_constant(intermediate_value&& val) : val(move(val)) {}
+    intermediate_load_constant(intermediate_constant idx, scalar_value bits) : idx(idx), bits(bits) {}
 
-    intermediate_value val;
+    intermediate_constant idx;
+    scalar_value bits; // if the constant is a builtin
 };
 
 struct intermediate_intrinsic
 {
-    intermediate_intrinsic(intrinsic_code icode, intrinsic_id iid, symbol_id dest, symbol_id op) : icode(icode), iid(iid), dest(dest), op(op) {}
+    intermediate_intrinsic(intrinsic_code icode, intrinsic_id iid, symbol_id dest, symbol_id op, intermediate_register dest_reg, intermediate_register op_reg)
+        : icode(icode), iid(iid), dest(dest), op(op), dest_reg(dest_reg), op_reg(op_reg), op_imm(false), imm() {}
+    // op is an immediate (already converted to the op param type), not a register
+    intermediate_intrinsic(intrinsic_code icode, intrinsic_id iid, symbol_id dest, intermediate_register dest_reg, scalar_value imm)
+        : icode(icode), iid(iid), dest(dest), op(symbol::INVALID_ID), dest_reg(dest_reg), op_reg(0), op_imm(true), imm(imm) {}
 
     intrinsic_code icode;
     intrinsic_id iid;
     symbol_id dest;
     symbol_id op;
+    intermediate_register dest_reg;
+    intermediate_register op_reg;
+    bool op_imm;
+    scalar_value imm;
+};
+
+// superinstructions for runs of intrinsics, see fuse.h
+struct intermediate_intrinsic_pair
+{
+    intermediate_intrinsic_pair(const intermediate_intrinsic& first, const intermediate_intrinsic& second) : first(first), second(second) {}
+
+    intermediate_intrinsic first;
+    intermediate_intrinsic second;
+};
+
+struct intermediate_intrinsic_triple
+{
+    intermediate_intrinsic_triple(const intermediate_intrinsic& first, const intermediate_intrinsic& second, const intermediate_intrinsic& third) : first(first), second(second), third(third) {}
+
+    intermediate_intrinsic first;
+    intermediate_intrinsic second;
+    intermediate_intrinsic third;
 };
 
 struct intermediate_block
@@ -97,49 +133,87 @@ struct intermediate_block
     array<intermediate> subs;
 };
 
+// register file layout of a callable unit. the register count is fixed at transform time,
+// so a frame can be bump allocated on the interpreter stack. the top level program is frame 0.
+struct intermediate_frame
+{
+    LU_CONSTEXPR static intermediate_frame_id TOP = 0;
+
+    intermediate_frame(intermediate_addr entry, size_t nscalars, size_t naggregates) : entry(entry), nscalars(nscalars), naggregates(naggregates) {}
+
+    size_t nregs(intermediate_slot slot) const { return slot == intermediate_slot::SCALAR ? nscalars : naggregates; }
+
+    intermediate_addr entry;
+    size_t nscalars;
+    size_t naggregates;
+};
+
 struct intermediate_tuple
 {
-    intermediate_tuple(array<intermediate>&& subs) : subs(subs) {}
+    intermediate_tuple(type_id tid, array<intermediate>&& subs) : tid(tid), subs(move(subs)) {}
 
+    type_id tid; // of the evaluated tuple value
     array<intermediate> subs;
 };
 
+// calls the function of frame fid, whose body starts at the frame entry. a new frame is pushed and each arg,
+// a STORE_SYMBOL into a parameter register of the callee frame whose eval is a constant or a load from the caller frame,
+// is copied into it. the value returned by the callee goes to the result register of the caller, if any
 struct intermediate_call
 {
-    intermediate_call(intermediate_addr faddr, array<intermediate>&& args) : body(faddr), args(move(args)) {}
+    intermediate_call(intermediate_frame_id fid, array<intermediate>&& args)
+        : fid(fid), args(move(args)), result(symbol::INVALID_ID), result_slot(intermediate_slot::SCALAR), result_reg(0) {}
+    intermediate_call(intermediate_frame_id fid, array<intermediate>&& args, symbol_id result, intermediate_slot result_slot, intermediate_register result_reg)
+        : fid(fid), args(move(args)), result(result), result_slot(result_slot), result_reg(result_reg) {}
 
-    intermediate_addr body; // should go to a "block"
+    bool has_result() const { return result != symbol::INVALID_ID; }
+
+    intermediate_frame_id fid;
     array<intermediate> args;
+    symbol_id result; // INVALID_ID if discarded
+    intermediate_slot result_slot;
+    intermediate_register result_reg;
 };
 
+// pops the current frame and resumes at the return address kept in it. eval is evaluated in the returning frame
+// and written to the caller's result register, or is null for no value. returning from the top frame ends the program
 struct intermediate_return
 {
-    intermediate_addr ra;
+    intermediate_return(unique<intermediate>&& eval) : eval(move(eval)) {}
+    intermediate_return(intermediate_return&&);
+    intermediate_return(const intermediate_return&);
+
+    unique<intermediate> eval;
 };
 
+// jumps to base + offset (or base - offset if negative) if condition, evaluated to a scalar, is non zero
+// (zero if negated). a null condition always jumps
 struct intermediate_branch
 {
-    struct offset
+    struct branch_offset
     {
         LU_CONSTEXPR static bool NEGATIVE = true;
         LU_CONSTEXPR static bool POSITIVE = false;
 
-        offset() : sign(POSITIVE), abs_offset(0) {}
-        offset(bool sign, size_t offset) : sign(sign), abs_offset(offset) {}
+        branch_offset() : sign(POSITIVE), abs_offset(0) {}
+        branch_offset(bool sign, size_t offset) : sign(sign), abs_offset(offset) {}
 
         bool sign;
         size_t abs_offset;
     };
 
-    intermediate_branch() : base(), condition(nullptr), offset() {}
+    intermediate_branch() : base(), condition(nullptr), offset(), negated(false) {}
+    intermediate_branch(intermediate_addr base, unique<intermediate>&& condition, branch_offset offset, bool negated = false)
+        : base(base), condition(move(condition)), offset(offset), negated(negated) {}
     intermediate_branch(intermediate_branch&&);
     intermediate_branch(const intermediate_branch&);
 
+    intermediate_addr target() const { return offset.sign == branch_offset::NEGATIVE ? base - offset.abs_offset : base + offset.abs_offset; }
+
     intermediate_addr base;
     unique<intermediate> condition; 
-    offset offset;
-    // sign? negative offset : positive offset
-    
+    branch_offset offset;
+    bool negated; // jump if the condition is zero, set by block layout (see layout.h)
 };
 
 struct intermediate
@@ -156,7 +230,41 @@ struct intermediate
         CALL, // jump to intermediate, assign parameters with called intermeidates
         RETURN,
         BRANCH, // uncoditional can just be br true
+        TAIL_CALL, // CALL in tail position, reuses the current frame (see lower.h)
         HALT,
+        // superinstructions, only produced by the fusion pass (see fuse.h)
+        STORE_CONSTANT, // STORE_SYMBOL(LOAD_CONSTANT)
+        STORE_COPY, // STORE_SYMBOL(LOAD_SYMBOL)
+        INTRINSIC_PAIR, // INTRINSIC, INTRINSIC
+        INTRINSIC_TRIPLE, // INTRINSIC, INTRINSIC, INTRINSIC
+        // typed intrinsics, lowered from INTRINSIC (see lower.h). the op is a register (_REG) or an inline immediate (_IMM)
+        _label_TYPED_INTRINSIC_FIRST,
+        I32PRINT_REG = _label_TYPED_INTRINSIC_FIRST,
+        I32PRINT_IMM,
+        I64PRINT_REG,
+        I64PRINT_IMM,
+        U32PRINT_REG,
+        U32PRINT_IMM,
+        U64PRINT_REG,
+        U64PRINT_IMM,
+        I32ADD_REG,
+        I32ADD_IMM,
+        I64ADD_REG,
+        I64ADD_IMM,
+        U32ADD_REG,
+        U32ADD_IMM,
+        U64ADD_REG,
+        U64ADD_IMM,
+        BPRINT_REG,
+        BPRINT_IMM,
+        ASCIIPRINT_REG,
+        ASCIIPRINT_IMM,
+        LNEG_REG,
+        LAND_REG,
+        LAND_IMM,
+        LOR_REG,
+        LOR_IMM,
+        _label_TYPED_INTRINSIC_LAST = LOR_IMM,
     };
 
     template <typename... ArgsT> static intermediate emplace_load_constant(ArgsT&&... args) { return create_load_constant(intermediate_load_constant(forward<ArgsT>(args)...)); }
@@ -165,14 +273,25 @@ struct intermediate
     template <typename... ArgsT> static intermediate emplace_intrinsic(ArgsT&&... args) { return create_intrinsic(intermediate_intrinsic(forward<ArgsT>(args)...)); }
     template <typename... ArgsT> static intermediate emplace_call(ArgsT&&... args) { return create_call(intermediate_call(forward<ArgsT>(args)...)); }
     template <typename... ArgsT> static intermediate emplace_tuple(ArgsT&&... args) { return create_tuple(intermediate_tuple(forward<ArgsT>(args)...)); }
+    template <typename... ArgsT> static intermediate emplace_return(ArgsT&&... args) { return create_return(intermediate_return(forward<ArgsT>(args)...)); }
+    template <typename... ArgsT> static intermediate emplace_branch(ArgsT&&... args) { return create_branch(intermediate_branch(forward<ArgsT>(args)...)); }
     
     static intermediate create_load_constant(intermediate_load_constant&&);
     static intermediate create_load_symbol(intermediate_load_symbol);
     static intermediate create_store_symbol(intermediate_store_symbol&&);//...
     static intermediate create_intrinsic(intermediate_intrinsic);
     static intermediate create_call(intermediate_call&&);
+    static intermediate create_tail_call(intermediate_call&&);
     static intermediate create_tuple(intermediate_tuple&&);
+    static intermediate create_return(intermediate_return&&);
+    static intermediate create_branch(intermediate_branch&&);
+    static intermediate create_block(); // basic block header, see interpreter
     static intermediate create_halt();
+    static intermediate create_store_constant(intermediate_store_symbol&&);
+    static intermediate create_store_copy(intermediate_store_symbol&&);
+    static intermediate create_intrinsic_pair(intermediate_intrinsic_pair);
+    static intermediate create_intrinsic_triple(intermediate_intrinsic_triple);
+    static intermediate create_typed_intrinsic(intermediate_intrinsic);
 
     intermediate();
 
@@ -187,6 +306,7 @@ struct intermediate
     const source_reference& srcref() const { return _srcref; }
     const source_location& loc() const { return _loc; }
     intermediate_op op() const { return _inst; }
+    void set_loc(const source_location& loc) { _loc = loc; } // for programs not built from source (see bytecode.h)
 
     union
     {
@@ -194,6 +314,8 @@ struct intermediate
         intermediate_load_symbol load;
         intermediate_store_symbol store;
         intermediate_intrinsic intr;
+        intermediate_intrinsic_pair intr2;
+        intermediate_intrinsic_triple intr3;
         intermediate_block blk;
         intermediate_call call;
         intermediate_tuple tup;
@@ -235,6 +357,11 @@ private:
 
 };
 
+LU_CONSTEXPR bool istypedintrinsic(intermediate::intermediate_op op)
+{
+    return intermediate::_label_TYPED_INTRINSIC_FIRST <= op && op <= intermediate::_label_TYPED_INTRINSIC_LAST;
+}
+
 const char* intermediate_op_cstr(intermediate::intermediate_op op);
 
 string to_string(const intermediate&);
@@ -256,10 +383,10 @@ struct intermediate_context
 
     symbol_table& symbols() { return _syms; }
     type_registry& types() { return _types; }
-    intermediate_value_table static_values() { return _svals; }
+    intermediate_value_table& static_values() { return _svals; }
     const symbol_table& symbols() const { return _syms; }
     const type_registry& types() const { return _types; }
-    const intermediate_value_table static_values() const { return _svals; }
+    const intermediate_value_table& static_values() const { return _svals; }
 
 private:
     type_registry _types;
@@ -270,6 +397,21 @@ private:
     //value_table values;
 };
 
+// interned constants of a program: each distinct builtin, literal or tuple value is stored once, already converted
+// to the type it is loaded as, and referenced by index from LOAD_CONSTANT
+struct intermediate_constant_pool
+{
+    intermediate_constant intern(intermediate_value&&);
+
+    const intermediate_value& operator[](intermediate_constant idx) const { return _vals[idx]; }
+    size_t size() const { return _vals.size(); }
+    const intermediate_value* data() const { return _vals.data(); }
+
+private:
+    vector<intermediate_value> _vals;
+    unordered_map<uint64_t, vector<intermediate_constant>> _index; // hash -> constants with that hash
+};
+
 enum class intermediate_transform_result
 {
     INTERMEDIATE_TRANSFORM_OK,
@@ -291,14 +433,30 @@ struct intermediate_program
 
     intermediate_addr push(intermediate&&);
     intermediate_addr write(intermediate_addr, intermediate&&); // overwrite if needed - only use for hard-coded addresses (probably unnecessary)
+    void rewrite(vector<intermediate>&&); // replace all intermediates, for passes over the whole program
 
     size_t size() const;
+    const intermediate* data() const { return _insts.data(); }
+
+    intermediate_frame_id push_frame(intermediate_frame&&);
+    intermediate_frame& frame(intermediate_frame_id);
+    const intermediate_frame& frame(intermediate_frame_id) const;
+    size_t frame_count() const;
 
     intermediate_context& context() { return _ctxt; }
     const intermediate_context& context() const { return _ctxt; }
 
+    intermediate_constant_pool& constants() { return _consts; }
+    const intermediate_constant_pool& constants() const { return _consts; }
+    // LOAD_CONSTANT of val, interned into the pool
+    intermediate make_load_constant(intermediate_value&& val);
+    // TUPLE of subs, or a LOAD_CONSTANT of the pooled tuple if every sub is a constant
+    intermediate make_tuple(type_id tid, array<intermediate>&& subs);
+
 private:
     vector<intermediate> _insts;
+    vector<intermediate_frame> _frames;
+    intermediate_constant_pool _consts;
     // context...
     intermediate_context _ctxt;
 };
@@ -306,6 +464,13 @@ private:
 // intermed. is evaluatable:
 //void evaluate(intermediate_block*, context*);
 
+// register bank of a symbol with static type tid
+intermediate_slot slot_for(const type_registry&, type_id);
+
+// debug check of register references against the symbol table: the bank matches the symbol's static type,
+// each symbol keeps one register, and no two symbols share a register. on mismatch, describes the first one in p_err
+bool verify_slots(const intermediate_program&, string* p_err);
+
 intermediate_transform_result intermediate_transform(analyze_expr_tree*, intermediate_program*, diag_logger*);
 
 }
@@ -1,12 +1,26 @@
 #ifndef LU_INTERMEDIATE_COMMON_H
 #define LU_INTERMEDIATE_COMMON_H
 
+#include <cstddef>
+#include <cstdint>
+
 namespace lu
 {
 
 using intermediate_addr = size_t;
 using intermediate_offset = size_t;
+using intermediate_register = size_t; // frame relative register index
+using intermediate_frame_id = size_t;
+using intermediate_constant = uint32_t; // index into the program's constant pool
+
+// registers are split into two banks by the static type of their symbol, each numbered from 0 per frame:
+// builtins are unboxed 8 byte scalars, everything else is an aggregate (tagged_value)
+enum class intermediate_slot
+{
+    SCALAR,
+    AGGREGATE,
+};
 
 }
 
-#endif // LU_INTERMEDIATE_COMMON_H
\ No newline at end of file
+#endif // LU_INTERMEDIATE_COMMON_H
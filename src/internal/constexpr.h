@@ -3,6 +3,13 @@
 
 #define LU_INLINE inline
 
+// for rarely taken paths, keeps them out of line from hot code
+#if defined(__GNUC__)
+#define LU_COLD __attribute__((noinline, cold))
+#else
+#define LU_COLD
+#endif // defined(__GNUC__)
+
 #if __cpp_constexpr >= 200704L
 #define LU_CONSTEXPR constexpr
 #else
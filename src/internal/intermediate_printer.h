@@ -15,13 +15,13 @@ struct intermediate_printer
 {
     intermediate_printer(const intermediate_program* ip) : p_ip(ip) {}
 
-    string print(intermediate_addr iaddr, const intermediate& i)
+    string print(intermediate_addr iaddr, const intermediate& i) const
     {
         string s = string::join(hex(iaddr), " ",  intermediate_op_cstr(i.op()), " ", print(i));
         return s;
     }
 
-    string print(const intermediate& i)
+    string print(const intermediate& i) const
     {
         switch (i.op())
         {
@@ -36,34 +36,46 @@ struct intermediate_printer
         case intermediate::INTRINSIC:
             return print_intrinsic(i.intr);
         case intermediate::BLOCK:
-            return "TODO";
+            return "";
         case intermediate::TUPLE:
-            return "TODO";
+            return print_tuple(i.tup);
         case intermediate::CALL:
-            return "TODO";
+        case intermediate::TAIL_CALL:
+            return print_call(i.call);
         case intermediate::RETURN:
-            return "TODO";
+            return i.ret.eval ? print(*i.ret.eval) : "";
         case intermediate::BRANCH:
-            return "TODO";
+            return print_branch(i.br);
         case intermediate::HALT:
             return print_halt();
+        case intermediate::STORE_CONSTANT:
+        case intermediate::STORE_COPY:
+            return print_store(i.store);
+        case intermediate::INTRINSIC_PAIR:
+            return string::join(print_intrinsic(i.intr2.first), "; ", print_intrinsic(i.intr2.second));
+        case intermediate::INTRINSIC_TRIPLE:
+            return string::join(print_intrinsic(i.intr3.first), "; ", print_intrinsic(i.intr3.second), "; ", print_intrinsic(i.intr3.third));
         default:
+            if (istypedintrinsic(i.op()))
+            {
+                return print_intrinsic(i.intr);
+            }
             throw internal_except_unhandled_switch(intermediate_op_cstr(i.op()));
         }
     }
 
 private:
-    string print_halt()
+    string print_halt() const
     {
         return "";
     }
 
-    string print_constant(const intermediate_load_constant& imm)
+    string print_constant(const intermediate_load_constant& imm) const
     {
-        return intermediate_value_printer().print(p_ip->context().symbols(), p_ip->context().types(), imm.val);
+        return string::join("#", to_string(imm.idx), " ", intermediate_value_printer().print(p_ip->context().symbols(), p_ip->context().types(), p_ip->constants()[imm.idx]));
     }
 
-    string print_intrinsic(const intermediate_intrinsic& intr)
+    string print_intrinsic(const intermediate_intrinsic& intr) const
     {
         auto config = p_ip->context().symbols().find_intrinsic(intr.iid).itype.config;
         switch (config)
@@ -80,7 +92,7 @@ private:
             return string::join(
                 intrinsic_code_cstr(intr.icode),
                 " (",
-                print_symbol(p_ip->context().symbols()[intr.dest]),
+                print_register(intermediate_slot::SCALAR, intr.dest_reg, p_ip->context().symbols()[intr.dest]),
                 ")"
             );
         }
@@ -89,7 +101,7 @@ private:
             return string::join(
                 intrinsic_code_cstr(intr.icode),
                 " (",
-                print_symbol(p_ip->context().symbols()[intr.op]),
+                print_operand(intr),
                 ")"
             );
         }
@@ -98,9 +110,9 @@ private:
             return string::join(
                 intrinsic_code_cstr(intr.icode),
                 " (",
-                print_symbol(p_ip->context().symbols()[intr.dest]),
+                print_register(intermediate_slot::SCALAR, intr.dest_reg, p_ip->context().symbols()[intr.dest]),
                 ", ",
-                print_symbol(p_ip->context().symbols()[intr.op]),
+                print_operand(intr),
                 ")"
             );
         }
@@ -109,19 +121,79 @@ private:
         }
     }
 
-    string print_store(const intermediate_store_symbol& store)
+    string print_call(const intermediate_call& call) const
+    {
+        string s = string::join("frame ", to_string(call.fid), " (");
+        for (size_t i = 0; i < call.args.size(); ++i)
+        {
+            if (i > 0)
+            {
+                s.append(", ");
+            }
+            s.append(print(call.args[i]));
+        }
+        s.append(")");
+        if (call.has_result())
+        {
+            s.append(string::join(" -> ", print_register(call.result_slot, call.result_reg, p_ip->context().symbols()[call.result])));
+        }
+        return s;
+    }
+
+    string print_branch(const intermediate_branch& br) const
+    {
+        string s = hex(br.target());
+        if (br.condition)
+        {
+            s.append(string::join(br.negated ? " if !" : " if ", print(*br.condition)));
+        }
+        return s;
+    }
+
+    string print_tuple(const intermediate_tuple& tup) const
+    {
+        string s("(");
+        for (size_t i = 0; i < tup.subs.size(); ++i)
+        {
+            if (i > 0)
+            {
+                s.append(", ");
+            }
+            s.append(print(tup.subs[i]));
+        }
+        s.append(")");
+        return s;
+    }
+
+    string print_operand(const intermediate_intrinsic& intr) const
+    {
+        if (intr.op_imm)
+        {
+            intermediate_value val(p_ip->context().symbols().find_intrinsic(intr.iid).itype[intrinsic_type::OP_PARAM]);
+            set_scalar(&val.bin, intr.imm);
+            return string::join("imm ", intermediate_value_printer().print(p_ip->context().symbols(), p_ip->context().types(), val));
+        }
+        return print_register(intermediate_slot::SCALAR, intr.op_reg, p_ip->context().symbols()[intr.op]);
+    }
+
+    string print_store(const intermediate_store_symbol& store) const
     {
         const symbol& sym = p_ip->context().symbols()[store.sid];
-        return string::join(print_symbol(sym), " <- ", print(*store.eval));
+        return string::join(print_register(store.slot, store.reg, sym), " <- ", print(*store.eval));
     }
 
-    string print_load(const intermediate_load_symbol& load)
+    string print_load(const intermediate_load_symbol& load) const
     {
         const symbol& sym = p_ip->context().symbols()[load.sid];
-        return print_symbol(sym);
+        return print_register(load.slot, load.reg, sym);
+    }
+
+    string print_register(intermediate_slot slot, intermediate_register reg, const symbol& sym) const
+    {
+        return string::join(slot == intermediate_slot::SCALAR ? "s" : "a", to_string(reg), " ", print_symbol(sym));
     }
 
-    string print_symbol(const symbol& sym)
+    string print_symbol(const symbol& sym) const
     {
         return string::join("#", to_string(sym.sid), " ", sym.name, " [", type_printer().print(p_ip->context().types(), sym.tid) , "]");//, hex(sym.flags.));
     }
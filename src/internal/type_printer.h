@@ -15,18 +15,18 @@ struct type_printer
     type_printer()
     {}
 
-    string print(const type_registry& types, const type& t)
+    string print(const type_registry& types, const type& t) const
     {
         return print_type(types, t);
     }
 
-    string print(const type_registry& types, type_id tid)
+    string print(const type_registry& types, type_id tid) const
     {
         return print_type_from_type_id(types, tid);
     }
 
 private:
-    string print_type(const type_registry& types, const type& t)
+    string print_type(const type_registry& types, const type& t) const
     {
         switch (t.tclass)
         {
@@ -118,7 +118,7 @@ private:
         }
     }
 
-    string print_type_from_type_id(const type_registry& types, type_id tid)
+    string print_type_from_type_id(const type_registry& types, type_id tid) const
     {   
         const type& t = types.find_type(tid);
         return print_type(types, t);
@@ -12,7 +12,7 @@ namespace internal
 {
 struct intermediate_value_printer
 {
-    string print(const symbol_table& syms, const type_registry& types, const intermediate_value& ival)
+    string print(const symbol_table& syms, const type_registry& types, const intermediate_value& ival) const
     {
         switch (ival.tid().tclass)
         {
@@ -62,7 +62,7 @@ struct intermediate_value_printer
     }
 
 private:
-    string print_builtin(builtin_type bt, builtin_value bin)
+    string print_builtin(builtin_type bt, builtin_value bin) const
     {
         switch (bt)
         {
@@ -5,34 +5,101 @@
 #include "internal/intermediate_printer.h"
 #include "print.h"
 
+// computed goto (labels as values) is a GNU extension, supported by gcc and clang
+#if defined(__GNUC__) && !defined(LU_NO_THREADED_DISPATCH)
+#   define LU_THREADED_DISPATCH 1
+#   ifdef __clang__
+#       define LU_BEGIN_THREADED_DISPATCH \
+            _Pragma("clang diagnostic push") \
+            _Pragma("clang diagnostic ignored \"-Wgnu-label-as-value\"")
+#       define LU_END_THREADED_DISPATCH _Pragma("clang diagnostic pop")
+#   else
+#       define LU_BEGIN_THREADED_DISPATCH \
+            _Pragma("GCC diagnostic push") \
+            _Pragma("GCC diagnostic ignored \"-Wpedantic\"")
+#       define LU_END_THREADED_DISPATCH _Pragma("GCC diagnostic pop")
+#   endif // __clang__
+#else
+#   define LU_THREADED_DISPATCH 0
+#endif // defined(__GNUC__) && !defined(LU_NO_THREADED_DISPATCH)
+
 namespace lu
 {
 
 namespace diags
 {
     diag INTERPRET_ILLEGAL = diag(diag::ERROR_LEVEL, 5000);
+    diag INTERPRET_UNSUPPORTED = diag(diag::ERROR_LEVEL, 5001);
 }
 
-void intermediate_interpreter_state::probe(symbol_id sid)
+intermediate_interpreter_state::intermediate_interpreter_state(size_t stack_size)
+    : _scalars(stack_size), _aggregates(stack_size), _scalar_top(0), _aggregate_top(0), _max_depth(0), _scalar_base(_scalars.data()), _aggregate_base(_aggregates.data()),
+    _cout(std::cout), _p_out(nullptr)
+{}
+
+void intermediate_interpreter_state::push_frame(const intermediate_frame& f, intermediate_addr ra, intermediate_slot result_slot, intermediate_register result_reg)
 {
-    if (_vals.size() <= sid)
+    // only place the stacks may move, so refresh bases
+    if (_scalar_top + f.nscalars > _scalars.size())
     {
-        _vals.resize(sid + 1);
+        _scalars.resize(std::max(_scalars.size() * 2, _scalar_top + f.nscalars));
     }
+    if (_aggregate_top + f.naggregates > _aggregates.size())
+    {
+        _aggregates.resize(std::max(_aggregates.size() * 2, _aggregate_top + f.naggregates));
+    }
+    _frames.push_back({ _scalar_top, f.nscalars, _aggregate_top, f.naggregates, ra, result_slot, result_reg });
+    _scalar_base = _scalars.data() + _scalar_top;
+    _aggregate_base = _aggregates.data() + _aggregate_top;
+    _scalar_top += f.nscalars;
+    _aggregate_top += f.naggregates;
+    _max_depth = std::max(_max_depth, _frames.size());
 }
 
-intermediate_value& intermediate_interpreter_state::operator[](symbol_id sid)
+void intermediate_interpreter_state::replace_frame(const intermediate_frame& f)
 {
-    assert(sid < _vals.size());
+    assert(!_frames.empty());
 
-    return _vals[sid];
+    frame_record& fr = _frames.back();
+    if (fr.scalar_base + f.nscalars > _scalars.size())
+    {
+        _scalars.resize(std::max(_scalars.size() * 2, fr.scalar_base + f.nscalars));
+    }
+    if (fr.aggregate_base + f.naggregates > _aggregates.size())
+    {
+        _aggregates.resize(std::max(_aggregates.size() * 2, fr.aggregate_base + f.naggregates));
+    }
+    fr.nscalars = f.nscalars;
+    fr.naggregates = f.naggregates;
+    _scalar_base = _scalars.data() + fr.scalar_base;
+    _aggregate_base = _aggregates.data() + fr.aggregate_base;
+    _scalar_top = fr.scalar_base + f.nscalars;
+    _aggregate_top = fr.aggregate_base + f.naggregates;
 }
 
-const intermediate_value& intermediate_interpreter_state::operator[](symbol_id sid) const
+intermediate_addr intermediate_interpreter_state::pop_frame()
 {
-    assert(sid < _vals.size());
+    assert(!_frames.empty());
 
-    return _vals[sid];
+    frame_record fr = _frames.back();
+    _frames.pop_back();
+    // registers are left as they are, the next frame pushed here stores into them before reading
+    _scalar_top = fr.scalar_base;
+    _aggregate_top = fr.aggregate_base;
+    _scalar_base = _scalars.data() + (_frames.empty() ? 0 : _frames.back().scalar_base);
+    _aggregate_base = _aggregates.data() + (_frames.empty() ? 0 : _frames.back().aggregate_base);
+    return fr.ra;
+}
+
+intermediate_value intermediate_interpreter_state::value(type_id tid, intermediate_slot slot, intermediate_register reg) const
+{
+    if (slot == intermediate_slot::AGGREGATE)
+    {
+        return aggregate(reg).to_intermediate();
+    }
+    intermediate_value val(tid);
+    set_scalar(&val.bin, scalar(reg));
+    return val;
 }
 
 namespace internal
@@ -40,13 +107,23 @@ namespace internal
     struct interpreter
     {
         interpreter(const intermediate_program* ip, intermediate_interpreter_state* is, intermediate_addr iaddr, diag_logger* log)
-            : p_ip(ip), p_state(is), iaddr(iaddr), p_log(log), printer(ip) {}
+            : p_ip(ip), p_insts(ip->data()), ninsts(ip->size()), p_consts(ip->constants().data()), p_state(is), iaddr(iaddr), p_log(log), printer(ip), res(interpret_result::INTERPRET_OK) {}
 
         const intermediate_program* p_ip;
+        const intermediate* p_insts; // cached, so fetching an intermediate is not a call
+        size_t ninsts;
+        const intermediate_value* p_consts; // cached constant pool
         intermediate_interpreter_state* p_state;
         intermediate_addr iaddr;
         diag_logger* p_log;
         intermediate_printer printer;
+        interpret_result res;
+        // arguments of a tail call, evaluated before the frame they are read from is replaced. kept to reuse their storage
+        vector<scalar_value> tail_scalars;
+        vector<tagged_value> tail_aggregates;
+        // trap register: failed instructions latch a diagnostic here and execution carries on,
+        // the dispatch loop only looks at it on block boundaries (control flow, halt, end of program)
+        vector<diag_context> traps;
 
         diag_context make_intermediate_illegal(intermediate_addr iaddr, const intermediate& i)
         {
@@ -58,24 +135,54 @@ namespace internal
             );
         }
 
-        intermediate_value& get(symbol_id sid)
+        diag_context make_intermediate_unsupported(intermediate_addr iaddr, const intermediate& i)
         {
-            return (*p_state)[sid];
+            return diag_context(
+                diags::INTERPRET_UNSUPPORTED,
+                i.srcref(),
+                i.loc(),
+                string::join("unsupported intermediate: ", printer.print(iaddr, i))
+            );
         }
 
-        const intermediate_value& get(symbol_id sid) const
+        const intermediate_value& constant(const intermediate_load_constant& imm) const
         {
-            return (*p_state)[sid];
+            return p_consts[imm.idx];
+        }
+
+        output_sink& out()
+        {
+            return p_state->out();
+        }
+
+        scalar_value& scalar(intermediate_register reg)
+        {
+            return p_state->scalar(reg);
+        }
+
+        const scalar_value& scalar(intermediate_register reg) const
+        {
+            return p_state->scalar(reg);
+        }
+
+        tagged_value& aggregate(intermediate_register reg)
+        {
+            return p_state->aggregate(reg);
+        }
+
+        const tagged_value& aggregate(intermediate_register reg) const
+        {
+            return p_state->aggregate(reg);
         }
 
         bool stop() const
         {
-            return iaddr >= p_ip->size();
+            return iaddr >= ninsts;
         }
 
         const intermediate& curr() const
         {
-            return (*p_ip)[iaddr];
+            return p_insts[iaddr];
         }
 
         void advance()
@@ -83,10 +190,48 @@ namespace internal
             ++iaddr;
         }
 
-        void throw_diag(const diag_context& dc)
+        LU_COLD void trap_illegal()
+        {
+            traps.push_back(make_intermediate_illegal(iaddr, curr()));
+        }
+
+        LU_COLD void trap_unsupported()
+        {
+            traps.push_back(make_intermediate_unsupported(iaddr, curr()));
+        }
+
+        // false if execution must abort
+        bool check_traps()
+        {
+            return traps.empty() || handle_traps();
+        }
+
+        LU_COLD bool handle_traps()
+        {
+            bool abort = false;
+            for (size_t i = 0; i < traps.size() && !abort; ++i)
+            {
+                res = interpret_result::INTERPRET_FAIL;
+                p_log->push(traps[i]);
+                abort = p_log->fatal(traps[i].dg);
+            }
+            traps.clear();
+            return !abort;
+        }
+
+        scalar_value& dest(const intermediate_intrinsic& intr)
         {
-            p_log->push(dc);
-            throw interpret_except(dc.dg);
+            return scalar(intr.dest_reg);
+        }
+
+        const scalar_value& reg_op(const intermediate_intrinsic& intr) const
+        {
+            return scalar(intr.op_reg);
+        }
+
+        const scalar_value& op(const intermediate_intrinsic& intr) const
+        {
+            return intr.op_imm ? intr.imm : reg_op(intr);
         }
 
         void invoke_intrinsic(const intermediate_intrinsic& intr)
@@ -94,151 +239,892 @@ namespace internal
             switch (intr.icode)
             {
             case I32PRINT:
-                print(to_string(get(intr.op).bin.i32));
+                out().put_int(op(intr).i32);
                 break;
             case I64PRINT:
-                print(to_string(get(intr.op).bin.i64));
+                out().put_int(op(intr).i64);
                 break;
             case U32PRINT:
-                print(to_string(get(intr.op).bin.u32));
+                out().put_uint(op(intr).u32);
                 break;
             case U64PRINT:
-                print(to_string(get(intr.op).bin.u64));
+                out().put_uint(op(intr).u64);
                 break;
+            // signed adds go through the unsigned fields, so overflow wraps as in optimize's fold and the back ends
             case I32ADD:
-                get(intr.dest).bin.i32 += get(intr.op).bin.i32;
+                dest(intr).u32 += op(intr).u32;
                 break;
             case I64ADD:
-                get(intr.dest).bin.i64 += get(intr.op).bin.i64;
+                dest(intr).u64 += op(intr).u64;
                 break;
             case U32ADD:
-                get(intr.dest).bin.u32 += get(intr.op).bin.u32;
+                dest(intr).u32 += op(intr).u32;
                 break;
             case U64ADD:
-                get(intr.dest).bin.u64 += get(intr.op).bin.u64;
+                dest(intr).u64 += op(intr).u64;
                 break;
             case BPRINT:
-                print(get(intr.op).bin.b ? "true" : "false");
+                out().put_bool(op(intr).b);
                 break;
             case ASCIIPRINT:
-                putascii(get(intr.op).bin.ascii);
+                out().put(op(intr).ascii);
                 break;
             case LNEG:
-                get(intr.dest).bin.b = !get(intr.dest).bin.b;
+                dest(intr).b = !dest(intr).b;
+                break;
+            case LAND:
+                dest(intr).b = dest(intr).b && op(intr).b;
+                break;
+            case LOR:
+                dest(intr).b = dest(intr).b || op(intr).b;
                 break;
-            // case LAND:
-            //     return "LAND";
-            // case LOR:
-            //     return "LOR";
             default:
-                throw internal_except_todo();
+                trap_unsupported();
+                break;
             }
         }
 
-        intermediate_value interpret_intermediate_eval(const intermediate& intm)
+        // evaluates straight into dest, reusing its storage where possible instead of returning a temporary
+        void interpret_intermediate_eval(scalar_value& dest, const intermediate& intm)
         {
             switch (intm.op())
             {
+            case intermediate::LOAD_CONSTANT:
+                dest = intm.imm.bits;
+                break;
+            case intermediate::LOAD_SYMBOL:
+                if (intm.load.slot == intermediate_slot::SCALAR)
+                {
+                    dest = scalar(intm.load.reg);
+                }
+                else if (!aggregate(intm.load.reg).boxed())
+                {
+                    dest = aggregate(intm.load.reg).bin;
+                }
+                else
+                {
+                    trap_illegal();
+                }
+                break;
             case intermediate::ILLEGAL:
-                throw_diag(make_intermediate_illegal(iaddr, intm));
+                trap_illegal();
+                break;
+            default:
+                trap_unsupported();
+                break;
+            }
+        }
+
+        void interpret_intermediate_eval(tagged_value& dest, const intermediate& intm)
+        {
+            switch (intm.op())
+            {
             case intermediate::LOAD_CONSTANT:
-                return intm.imm.val;
+                dest.assign(constant(intm.imm));
+                break;
             case intermediate::LOAD_SYMBOL:
-                return (*p_state)[intm.load.sid];
-            case intermediate::STORE_SYMBOL:
-                throw internal_except_todo();
-            case intermediate::INTRINSIC:
-                throw internal_except_todo();
-            case intermediate::BLOCK:
-                throw internal_except_todo();
+                if (intm.load.slot == intermediate_slot::SCALAR)
+                {
+                    dest.assign_scalar(intm.load.tid, scalar(intm.load.reg));
+                }
+                else
+                {
+                    dest = aggregate(intm.load.reg);
+                }
+                break;
             case intermediate::TUPLE:
-                throw internal_except_todo();
-            case intermediate::CALL:
-                throw internal_except_todo();
-            case intermediate::RETURN:
-                throw internal_except_todo();
-            case intermediate::BRANCH:
-                throw internal_except_todo();
+                interpret_tuple_eval(dest.box(intm.tup.tid), intm.tup);
+                break;
+            case intermediate::ILLEGAL:
+                trap_illegal();
+                break;
             default:
-                throw internal_except_unhandled_switch(intermediate_op_cstr(intm.op()));
+                trap_unsupported();
+                break;
             }
         }
 
-        void interpret_intermediate_top(const intermediate& intm)
+        // aggregate members are kept as intermediate_values inside the box
+        void interpret_intermediate_eval(intermediate_value& dest, const intermediate& intm)
         {
             switch (intm.op())
             {
-            case intermediate::ILLEGAL:
-                throw_diag(make_intermediate_illegal(iaddr, intm));
             case intermediate::LOAD_CONSTANT:
-                throw internal_except_todo();
+                dest = constant(intm.imm);
+                break;
             case intermediate::LOAD_SYMBOL:
-                throw internal_except_todo();
+                if (intm.load.slot == intermediate_slot::SCALAR)
+                {
+                    if (dest.tid() != intm.load.tid)
+                    {
+                        dest = intermediate_value(intm.load.tid);
+                    }
+                    set_scalar(&dest.bin, scalar(intm.load.reg));
+                }
+                else
+                {
+                    aggregate(intm.load.reg).copy_to(&dest);
+                }
+                break;
+            case intermediate::TUPLE:
+                if (dest.tid() != intm.tup.tid)
+                {
+                    dest = intermediate_value(intm.tup.tid);
+                }
+                interpret_tuple_eval(dest, intm.tup);
+                break;
+            case intermediate::ILLEGAL:
+                trap_illegal();
+                break;
+            default:
+                trap_unsupported();
+                break;
+            }
+        }
+
+        void interpret_tuple_eval(intermediate_value& dest, const intermediate_tuple& tup)
+        {
+            size_t n = tup.subs.size();
+            if (dest.tup.vals.size() != n)
+            {
+                // first store into this register
+                dest.tup.vals = array<intermediate_value>(n);
+            }
+            for (size_t i = 0; i < n; ++i)
+            {
+                interpret_intermediate_eval(dest.tup.vals[i], tup.subs[i]);
+            }
+        }
+
+        void interpret_store(const intermediate_store_symbol& store)
+        {
+            if (store.slot == intermediate_slot::SCALAR)
+            {
+                interpret_intermediate_eval(scalar(store.reg), *store.eval);
+            }
+            else
+            {
+                interpret_intermediate_eval(aggregate(store.reg), *store.eval);
+            }
+        }
+
+        void interpret_store_constant(const intermediate_store_symbol& store)
+        {
+            if (store.slot == intermediate_slot::SCALAR)
+            {
+                scalar(store.reg) = store.eval->imm.bits;
+            }
+            else
+            {
+                aggregate(store.reg).assign(constant(store.eval->imm));
+            }
+        }
+
+        void interpret_store_copy(const intermediate_store_symbol& store)
+        {
+            if (store.slot == intermediate_slot::SCALAR && store.eval->load.slot == intermediate_slot::SCALAR)
+            {
+                scalar(store.reg) = scalar(store.eval->load.reg);
+            }
+            else
+            {
+                interpret_store(store);
+            }
+        }
+
+        void invoke_intrinsic_pair(const intermediate_intrinsic_pair& intr2)
+        {
+            invoke_intrinsic(intr2.first);
+            invoke_intrinsic(intr2.second);
+        }
+
+        void invoke_intrinsic_triple(const intermediate_intrinsic_triple& intr3)
+        {
+            invoke_intrinsic(intr3.first);
+            invoke_intrinsic(intr3.second);
+            invoke_intrinsic(intr3.third);
+        }
+
+        // copies one argument from the caller frame into a parameter register of the (just pushed) callee frame
+        void interpret_arg(const intermediate_store_symbol& arg)
+        {
+            const intermediate& eval = *arg.eval;
+            if (eval.op() == intermediate::LOAD_CONSTANT)
+            {
+                if (arg.slot == intermediate_slot::SCALAR)
+                {
+                    scalar(arg.reg) = eval.imm.bits;
+                }
+                else
+                {
+                    aggregate(arg.reg).assign(constant(eval.imm));
+                }
+                return;
+            }
+            if (eval.op() != intermediate::LOAD_SYMBOL)
+            {
+                trap_illegal();
+                return;
+            }
+            if (arg.slot == intermediate_slot::SCALAR)
+            {
+                if (eval.load.slot == intermediate_slot::SCALAR)
+                {
+                    scalar(arg.reg) = p_state->caller_scalar(eval.load.reg);
+                }
+                else if (!p_state->caller_aggregate(eval.load.reg).boxed())
+                {
+                    scalar(arg.reg) = p_state->caller_aggregate(eval.load.reg).bin;
+                }
+                else
+                {
+                    trap_illegal();
+                }
+            }
+            else if (eval.load.slot == intermediate_slot::SCALAR)
+            {
+                aggregate(arg.reg).assign_scalar(eval.load.tid, p_state->caller_scalar(eval.load.reg));
+            }
+            else
+            {
+                aggregate(arg.reg) = p_state->caller_aggregate(eval.load.reg);
+            }
+        }
+
+        void interpret_call(const intermediate_call& call)
+        {
+            const intermediate_frame& f = p_ip->frame(call.fid);
+            p_state->push_frame(f, iaddr + 1, call.result_slot, call.has_result() ? call.result_reg : intermediate_interpreter_state::NO_RESULT);
+            for (size_t i = 0; i < call.args.size(); ++i)
+            {
+                interpret_arg(call.args[i].store);
+            }
+            iaddr = f.entry;
+        }
+
+        void interpret_tail_call(const intermediate_call& call)
+        {
+            // arguments may read the very registers they overwrite, so all are evaluated first
+            size_t ns = 0;
+            size_t na = 0;
+            for (size_t i = 0; i < call.args.size(); ++i)
+            {
+                const intermediate_store_symbol& arg = call.args[i].store;
+                if (arg.slot == intermediate_slot::SCALAR)
+                {
+                    if (ns == tail_scalars.size())
+                    {
+                        tail_scalars.push_back(scalar_value());
+                    }
+                    interpret_intermediate_eval(tail_scalars[ns++], *arg.eval);
+                }
+                else
+                {
+                    if (na == tail_aggregates.size())
+                    {
+                        tail_aggregates.push_back(tagged_value());
+                    }
+                    interpret_intermediate_eval(tail_aggregates[na++], *arg.eval);
+                }
+            }
+
+            const intermediate_frame& f = p_ip->frame(call.fid);
+            p_state->replace_frame(f);
+            ns = 0;
+            na = 0;
+            for (size_t i = 0; i < call.args.size(); ++i)
+            {
+                const intermediate_store_symbol& arg = call.args[i].store;
+                if (arg.slot == intermediate_slot::SCALAR)
+                {
+                    scalar(arg.reg) = tail_scalars[ns++];
+                }
+                else
+                {
+                    aggregate(arg.reg) = tail_aggregates[na++];
+                }
+            }
+            iaddr = f.entry;
+        }
+
+        void interpret_return(const intermediate_return& ret)
+        {
+            if (p_state->depth() <= 1)
+            {
+                // the top frame is kept, so the final registers can still be inspected
+                iaddr = ninsts;
+                return;
+            }
+            intermediate_register reg = p_state->result_reg();
+            if (ret.eval && reg != intermediate_interpreter_state::NO_RESULT)
+            {
+                // evaluated in the returning frame, straight into the caller's register
+                if (p_state->result_slot() == intermediate_slot::SCALAR)
+                {
+                    interpret_intermediate_eval(p_state->caller_scalar(reg), *ret.eval);
+                }
+                else
+                {
+                    interpret_intermediate_eval(p_state->caller_aggregate(reg), *ret.eval);
+                }
+            }
+            iaddr = p_state->pop_frame();
+        }
+
+        void interpret_branch(const intermediate_branch& br)
+        {
+            intermediate_addr target = br.target();
+            if (target > ninsts)
+            {
+                trap_illegal();
+                iaddr = ninsts;
+                return;
+            }
+            if (!br.condition)
+            {
+                iaddr = target;
+                return;
+            }
+            scalar_value cond{};
+            interpret_intermediate_eval(cond, *br.condition);
+            if (!traps.empty())
+            {
+                // the condition trapped and may not be written, fall through. the caller checks the trap
+                ++iaddr;
+                return;
+            }
+            iaddr = (cond.bits != 0) != br.negated ? target : iaddr + 1;
+        }
+
+        // a basic block header. blocks are flattened by the transform, so only an empty block can be executed
+        void interpret_block(const intermediate_block& blk)
+        {
+            if (blk.subs.size() != 0)
+            {
+                trap_unsupported();
+            }
+        }
+
+        void interpret_halt()
+        {
+            // TODO cleanup before exit
+            iaddr = ninsts;
+        }
+
+        // executes the current intermediate, false if execution must stop
+        bool step()
+        {
+            const intermediate& intm = curr();
+            switch (intm.op())
+            {
             case intermediate::STORE_SYMBOL:
-                p_state->probe(intm.store.sid);
-                (*p_state)[intm.store.sid] = interpret_intermediate_eval(*intm.store.eval);
+                interpret_store(intm.store);
+                break;
+            case intermediate::STORE_CONSTANT:
+                interpret_store_constant(intm.store);
+                break;
+            case intermediate::STORE_COPY:
+                interpret_store_copy(intm.store);
                 break;
             case intermediate::INTRINSIC:
                 invoke_intrinsic(intm.intr);
                 break;
+            case intermediate::INTRINSIC_PAIR:
+                invoke_intrinsic_pair(intm.intr2);
+                break;
+            case intermediate::INTRINSIC_TRIPLE:
+                invoke_intrinsic_triple(intm.intr3);
+                break;
+            case intermediate::I32PRINT_REG:
+                out().put_int(reg_op(intm.intr).i32);
+                break;
+            case intermediate::I32PRINT_IMM:
+                out().put_int(intm.intr.imm.i32);
+                break;
+            case intermediate::I64PRINT_REG:
+                out().put_int(reg_op(intm.intr).i64);
+                break;
+            case intermediate::I64PRINT_IMM:
+                out().put_int(intm.intr.imm.i64);
+                break;
+            case intermediate::U32PRINT_REG:
+                out().put_uint(reg_op(intm.intr).u32);
+                break;
+            case intermediate::U32PRINT_IMM:
+                out().put_uint(intm.intr.imm.u32);
+                break;
+            case intermediate::U64PRINT_REG:
+                out().put_uint(reg_op(intm.intr).u64);
+                break;
+            case intermediate::U64PRINT_IMM:
+                out().put_uint(intm.intr.imm.u64);
+                break;
+            case intermediate::I32ADD_REG:
+                dest(intm.intr).u32 += reg_op(intm.intr).u32;
+                break;
+            case intermediate::I32ADD_IMM:
+                dest(intm.intr).u32 += intm.intr.imm.u32;
+                break;
+            case intermediate::I64ADD_REG:
+                dest(intm.intr).u64 += reg_op(intm.intr).u64;
+                break;
+            case intermediate::I64ADD_IMM:
+                dest(intm.intr).u64 += intm.intr.imm.u64;
+                break;
+            case intermediate::U32ADD_REG:
+                dest(intm.intr).u32 += reg_op(intm.intr).u32;
+                break;
+            case intermediate::U32ADD_IMM:
+                dest(intm.intr).u32 += intm.intr.imm.u32;
+                break;
+            case intermediate::U64ADD_REG:
+                dest(intm.intr).u64 += reg_op(intm.intr).u64;
+                break;
+            case intermediate::U64ADD_IMM:
+                dest(intm.intr).u64 += intm.intr.imm.u64;
+                break;
+            case intermediate::BPRINT_REG:
+                out().put_bool(reg_op(intm.intr).b);
+                break;
+            case intermediate::BPRINT_IMM:
+                out().put_bool(intm.intr.imm.b);
+                break;
+            case intermediate::ASCIIPRINT_REG:
+                out().put(reg_op(intm.intr).ascii);
+                break;
+            case intermediate::ASCIIPRINT_IMM:
+                out().put(intm.intr.imm.ascii);
+                break;
+            case intermediate::LNEG_REG:
+                dest(intm.intr).b = !dest(intm.intr).b;
+                break;
+            case intermediate::LAND_REG:
+                dest(intm.intr).b = dest(intm.intr).b && reg_op(intm.intr).b;
+                break;
+            case intermediate::LAND_IMM:
+                dest(intm.intr).b = dest(intm.intr).b && intm.intr.imm.b;
+                break;
+            case intermediate::LOR_REG:
+                dest(intm.intr).b = dest(intm.intr).b || reg_op(intm.intr).b;
+                break;
+            case intermediate::LOR_IMM:
+                dest(intm.intr).b = dest(intm.intr).b || intm.intr.imm.b;
+                break;
+            case intermediate::HALT:
+                interpret_halt();
+                check_traps();
+                return false;
+            case intermediate::ILLEGAL:
+                trap_illegal();
+                break;
+            // block boundaries, control flow sets iaddr itself
             case intermediate::BLOCK:
-                throw internal_except_todo();
-            case intermediate::TUPLE:
-                throw internal_except_todo();
+                interpret_block(intm.blk);
+                if (!check_traps())
+                {
+                    return false;
+                }
+                break;
             case intermediate::CALL:
-                throw internal_except_todo();
+                interpret_call(intm.call);
+                return check_traps();
+            case intermediate::TAIL_CALL:
+                interpret_tail_call(intm.call);
+                return check_traps();
             case intermediate::RETURN:
-                throw internal_except_todo();
+                interpret_return(intm.ret);
+                return check_traps();
             case intermediate::BRANCH:
-                throw internal_except_todo();
-            case intermediate::HALT:
-                // TODO cleanup before exit
-                iaddr =  p_ip->size();
-                break;
+                interpret_branch(intm.br);
+                return check_traps();
             default:
-                throw internal_except_unhandled_switch(intermediate_op_cstr(intm.op()));
+                trap_unsupported();
+                break;
             }
+            advance();
+            return true;
         }
 
-        void interpret_next()
+        // portable dispatch, one switch per instruction
+        void run_switch()
         {
-            interpret_intermediate_top(curr());
-            advance();
+            while (!stop())
+            {
+                if (!step())
+                {
+                    return;
+                }
+            }
+            check_traps();
         }
 
-        void interpret()
+        // switch dispatch that also counts every dispatched opcode pair and/or executed address
+        void run_profile(opcode_pair_profile* p_profile, edge_profile* p_edges)
         {
-            if (stop())
+            if (p_profile)
+            {
+                p_profile->reset_sequence();
+            }
+            if (p_edges)
+            {
+                p_edges->resize(ninsts);
+            }
+            while (!stop())
+            {
+                const intermediate& i = curr();
+                intermediate_addr at = iaddr;
+                if (p_profile)
+                {
+                    p_profile->count(i);
+                }
+                if (p_edges)
+                {
+                    p_edges->count(at);
+                }
+                if (!step())
+                {
+                    return;
+                }
+                if (p_edges && i.op() == intermediate::BRANCH && iaddr != at + 1)
+                {
+                    p_edges->count_taken(at);
+                }
+            }
+            check_traps();
+        }
+
+#if LU_THREADED_DISPATCH
+        // direct threaded dispatch: every instruction is resolved to its handler's label once,
+        // then each handler jumps straight to the handler of the next instruction.
+        void run_threaded()
+        {
+LU_BEGIN_THREADED_DISPATCH
+            static const void* const handlers[] =
+            {
+                &&do_ILLEGAL,
+                &&do_UNSUPPORTED, // LOAD_CONSTANT
+                &&do_UNSUPPORTED, // LOAD_SYMBOL
+                &&do_STORE_SYMBOL,
+                &&do_INTRINSIC,
+                &&do_BLOCK,
+                &&do_UNSUPPORTED, // TUPLE
+                &&do_CALL,
+                &&do_RETURN,
+                &&do_BRANCH,
+                &&do_TAIL_CALL,
+                &&do_HALT,
+                &&do_STORE_CONSTANT,
+                &&do_STORE_COPY,
+                &&do_INTRINSIC_PAIR,
+                &&do_INTRINSIC_TRIPLE,
+                &&do_I32PRINT_REG,
+                &&do_I32PRINT_IMM,
+                &&do_I64PRINT_REG,
+                &&do_I64PRINT_IMM,
+                &&do_U32PRINT_REG,
+                &&do_U32PRINT_IMM,
+                &&do_U64PRINT_REG,
+                &&do_U64PRINT_IMM,
+                &&do_I32ADD_REG,
+                &&do_I32ADD_IMM,
+                &&do_I64ADD_REG,
+                &&do_I64ADD_IMM,
+                &&do_U32ADD_REG,
+                &&do_U32ADD_IMM,
+                &&do_U64ADD_REG,
+                &&do_U64ADD_IMM,
+                &&do_BPRINT_REG,
+                &&do_BPRINT_IMM,
+                &&do_ASCIIPRINT_REG,
+                &&do_ASCIIPRINT_IMM,
+                &&do_LNEG_REG,
+                &&do_LAND_REG,
+                &&do_LAND_IMM,
+                &&do_LOR_REG,
+                &&do_LOR_IMM,
+            };
+
+            static_assert(sizeof(handlers) / sizeof(handlers[0]) == intermediate::_label_TYPED_INTRINSIC_LAST + 1, "missing threaded handler");
+
+            vector<const void*> threaded(p_ip->size() + 1);
+            for (intermediate_addr i = 0; i < p_ip->size(); ++i)
+            {
+                threaded[i] = handlers[(*p_ip)[i].op()];
+            }
+            threaded[p_ip->size()] = &&do_END; // falling off the end stops
+            const void* const* code = threaded.data();
+
+#define LU_DISPATCH() goto *code[iaddr]
+#define LU_NEXT() do { advance(); LU_DISPATCH(); } while (0)
+
+            LU_DISPATCH();
+
+        do_STORE_SYMBOL:
+            interpret_store(curr().store);
+            LU_NEXT();
+        do_INTRINSIC:
+            invoke_intrinsic(curr().intr);
+            LU_NEXT();
+        do_STORE_CONSTANT:
+            interpret_store_constant(curr().store);
+            LU_NEXT();
+        do_STORE_COPY:
+            interpret_store_copy(curr().store);
+            LU_NEXT();
+        do_INTRINSIC_PAIR:
+            invoke_intrinsic_pair(curr().intr2);
+            LU_NEXT();
+        do_INTRINSIC_TRIPLE:
+            invoke_intrinsic_triple(curr().intr3);
+            LU_NEXT();
+        do_I32PRINT_REG:
+            out().put_int(reg_op(curr().intr).i32);
+            LU_NEXT();
+        do_I32PRINT_IMM:
+            out().put_int(curr().intr.imm.i32);
+            LU_NEXT();
+        do_I64PRINT_REG:
+            out().put_int(reg_op(curr().intr).i64);
+            LU_NEXT();
+        do_I64PRINT_IMM:
+            out().put_int(curr().intr.imm.i64);
+            LU_NEXT();
+        do_U32PRINT_REG:
+            out().put_uint(reg_op(curr().intr).u32);
+            LU_NEXT();
+        do_U32PRINT_IMM:
+            out().put_uint(curr().intr.imm.u32);
+            LU_NEXT();
+        do_U64PRINT_REG:
+            out().put_uint(reg_op(curr().intr).u64);
+            LU_NEXT();
+        do_U64PRINT_IMM:
+            out().put_uint(curr().intr.imm.u64);
+            LU_NEXT();
+        do_I32ADD_REG:
+            dest(curr().intr).u32 += reg_op(curr().intr).u32;
+            LU_NEXT();
+        do_I32ADD_IMM:
+            dest(curr().intr).u32 += curr().intr.imm.u32;
+            LU_NEXT();
+        do_I64ADD_REG:
+            dest(curr().intr).u64 += reg_op(curr().intr).u64;
+            LU_NEXT();
+        do_I64ADD_IMM:
+            dest(curr().intr).u64 += curr().intr.imm.u64;
+            LU_NEXT();
+        do_U32ADD_REG:
+            dest(curr().intr).u32 += reg_op(curr().intr).u32;
+            LU_NEXT();
+        do_U32ADD_IMM:
+            dest(curr().intr).u32 += curr().intr.imm.u32;
+            LU_NEXT();
+        do_U64ADD_REG:
+            dest(curr().intr).u64 += reg_op(curr().intr).u64;
+            LU_NEXT();
+        do_U64ADD_IMM:
+            dest(curr().intr).u64 += curr().intr.imm.u64;
+            LU_NEXT();
+        do_BPRINT_REG:
+            out().put_bool(reg_op(curr().intr).b);
+            LU_NEXT();
+        do_BPRINT_IMM:
+            out().put_bool(curr().intr.imm.b);
+            LU_NEXT();
+        do_ASCIIPRINT_REG:
+            out().put(reg_op(curr().intr).ascii);
+            LU_NEXT();
+        do_ASCIIPRINT_IMM:
+            out().put(curr().intr.imm.ascii);
+            LU_NEXT();
+        do_LNEG_REG:
+            dest(curr().intr).b = !dest(curr().intr).b;
+            LU_NEXT();
+        do_LAND_REG:
+            dest(curr().intr).b = dest(curr().intr).b && reg_op(curr().intr).b;
+            LU_NEXT();
+        do_LAND_IMM:
+            dest(curr().intr).b = dest(curr().intr).b && curr().intr.imm.b;
+            LU_NEXT();
+        do_LOR_REG:
+            dest(curr().intr).b = dest(curr().intr).b || reg_op(curr().intr).b;
+            LU_NEXT();
+        do_LOR_IMM:
+            dest(curr().intr).b = dest(curr().intr).b || curr().intr.imm.b;
+            LU_NEXT();
+        do_HALT:
+            interpret_halt();
+            check_traps();
+            return;
+        do_END:
+            check_traps();
+            return;
+        do_ILLEGAL:
+            trap_illegal();
+            LU_NEXT();
+        do_UNSUPPORTED:
+            trap_unsupported();
+            LU_NEXT();
+        do_BLOCK:
+            interpret_block(curr().blk);
+            if (!check_traps())
+            {
+                return;
+            }
+            LU_NEXT();
+        do_CALL:
+            interpret_call(curr().call);
+            if (!check_traps())
+            {
+                return;
+            }
+            LU_DISPATCH();
+        do_TAIL_CALL:
+            interpret_tail_call(curr().call);
+            if (!check_traps())
+            {
+                return;
+            }
+            LU_DISPATCH();
+        do_RETURN:
+            interpret_return(curr().ret);
+            if (!check_traps())
+            {
+                return;
+            }
+            LU_DISPATCH();
+        do_BRANCH:
+            interpret_branch(curr().br);
+            if (!check_traps())
             {
                 return;
             }
-            interpret_next();
+            LU_DISPATCH();
+
+#undef LU_NEXT
+#undef LU_DISPATCH
+LU_END_THREADED_DISPATCH
         }
-    };
-};
+#endif // LU_THREADED_DISPATCH
 
-interpret_result interpret(const intermediate_program* ip, intermediate_interpreter_state* is, intermediate_addr iaddr, diag_logger* log)
-{
-    interpret_result res = interpret_result::INTERPRET_OK;
+        // switch dispatch that counts calls and backward jumps, and stops once one gets hot or control flow
+        // reaches native code. the stop is after the intermediate that caused it, at a block boundary
+        void run_tiered(tier_counters* p_tiers)
+        {
+            p_tiers->stop = tier_counters::NONE;
+            while (!stop())
+            {
+                const intermediate& i = curr();
+                intermediate_addr at = iaddr;
+                if (!step())
+                {
+                    return;
+                }
+                switch (i.op())
+                {
+                case intermediate::CALL:
+                case intermediate::TAIL_CALL:
+                    if (++p_tiers->calls[i.call.fid] == p_tiers->call_threshold)
+                    {
+                        yield(p_tiers, tier_counters::HOT_CALL, i.call.fid);
+                        return;
+                    }
+                    break;
+                case intermediate::BRANCH:
+                    if (iaddr <= at && ++p_tiers->backedges[at] == p_tiers->backedge_threshold)
+                    {
+                        yield(p_tiers, tier_counters::HOT_LOOP, at);
+                        return;
+                    }
+                    break;
+                case intermediate::RETURN:
+                    break;
+                default:
+                    continue;
+                }
+                if (p_tiers->native[iaddr])
+                {
+                    yield(p_tiers, tier_counters::NATIVE, iaddr);
+                    return;
+                }
+            }
+            check_traps();
+        }
 
-    internal::interpreter itpr(ip, is, iaddr, log);
-    while (!itpr.stop())
-    {
-        try
+        LU_COLD void yield(tier_counters* p_tiers, tier_counters::stop_reason why, size_t hot)
         {
-            itpr.interpret();
+            p_tiers->stop = why;
+            p_tiers->stop_addr = iaddr;
+            p_tiers->hot = hot;
         }
-        catch(const interpret_except& e)
+
+        void run(const interpret_settings& settings)
         {
-            res = interpret_result::INTERPRET_FAIL;
-            if (log->fatal(e.dg))
+            if (settings.p_tiers)
             {
-                break;
+                run_tiered(settings.p_tiers);
+                return;
             }
-            itpr.advance();
+            if (settings.p_profile || settings.p_edges)
+            {
+                run_profile(settings.p_profile, settings.p_edges);
+                return;
+            }
+#if LU_THREADED_DISPATCH
+            if (settings.dispatch == interpret_dispatch::THREADED)
+            {
+                run_threaded();
+                return;
+            }
+#endif // LU_THREADED_DISPATCH
+            run_switch();
         }
+    };
+};
+
+void tier_counters::resize(size_t nframes, size_t ninsts)
+{
+    calls.resize(nframes, 0);
+    backedges.resize(ninsts, 0);
+    native.resize(ninsts + 1, false);
+}
+
+bool has_threaded_dispatch()
+{
+    return LU_THREADED_DISPATCH;
+}
+
+interpret_result interpret(const intermediate_program* ip, intermediate_interpreter_state* is, intermediate_addr iaddr, diag_logger* log, const interpret_settings& settings)
+{
+    // scalar registers carry no type, so a wrong bank would silently reinterpret bits
+    debug(
+        string err;
+        if (!verify_slots(*ip, &err))
+        {
+            throw internal_except_with_location(string::join("register slots do not match the symbol table: ", err));
+        }
+    )
+    if (is->depth() == 0)
+    {
+        is->push_frame(ip->frame(intermediate_frame::TOP), ip->size());
+    }
+
+    internal::interpreter itpr(ip, is, iaddr, log);
+    itpr.run(settings);
+    return itpr.res;
+}
+
+intermediate_addr interpret_step(const intermediate_program* ip, intermediate_interpreter_state* is, intermediate_addr iaddr, diag_logger* log, interpret_result* p_res)
+{
+    assert(is->depth() != 0);
+
+    internal::interpreter itpr(ip, is, iaddr, log);
+    bool more = !itpr.stop() && itpr.step() && itpr.check_traps();
+    if (!ok(itpr.res))
+    {
+        *p_res = itpr.res;
     }
-    return res;
+    return more ? itpr.iaddr : ip->size();
 }
 
 }
\ No newline at end of file
@@ -4,9 +4,16 @@
 #include "intermediate.h"
 #include "symbol.h"
 #include "value.h"
+#include "tagged_value.h"
 #include "diag.h"
+#include "fuse.h"
+#include "layout.h"
+#include "sink.h"
 
 #include "adt/vector.h"
+#include "internal/debug.h"
+
+#include <limits>
 
 namespace lu
 {
@@ -14,6 +21,7 @@ namespace lu
 namespace diags
 {
     extern diag INTERPRET_ILLEGAL;
+    extern diag INTERPRET_UNSUPPORTED;
 }
 
 enum class interpret_result
@@ -32,23 +40,163 @@ struct interpret_except : public diag_except
     interpret_except(const diag& d) : diag_except(d) {}
 };
 
-// TODO maybe just use vaue table value.h
+// registers live on two contiguous stacks, one per bank (see intermediate_slot). each frame is bump allocated
+// on top of the previous one, with its size fixed by intermediate_frame, so register access is base + index with no growth check.
+// scalars are raw 8 byte builtins with no tag or destructor, aggregates are tagged_values.
+// the stacks and frame records only grow, popped frames are kept as a pool for the next call: no allocation per call
+// once the deepest call has been reached, and aggregate registers keep their boxes to be reused by the next frame.
 struct intermediate_interpreter_state
 {
-    intermediate_interpreter_state() {}
+    LU_CONSTEXPR static size_t DEFAULT_STACK_SIZE = 256;
+    LU_CONSTEXPR static intermediate_register NO_RESULT = std::numeric_limits<intermediate_register>::max();
+
+    intermediate_interpreter_state(size_t stack_size = DEFAULT_STACK_SIZE);
+
+    // the result register is in the pushing (caller) frame, and receives the value of RETURN
+    void push_frame(const intermediate_frame&, intermediate_addr ra, intermediate_slot result_slot = intermediate_slot::SCALAR, intermediate_register result_reg = NO_RESULT);
+    intermediate_addr pop_frame(); // returns return address of popped frame
+    // replaces the top frame with one for f, keeping its return address and result register (tail call)
+    void replace_frame(const intermediate_frame&);
+    size_t depth() const { return _frames.size(); }
+    size_t max_depth() const { return _max_depth; } // deepest the frame stack has been
+    // of the frame at depth i counting from the bottom, for code replaced while it runs (see tier.h)
+    intermediate_addr return_address(size_t i) const { return _frames[i].ra; }
+    void set_return_address(size_t i, intermediate_addr ra) { _frames[i].ra = ra; }
+
+    intermediate_slot result_slot() const { return _frames.back().result_slot; }
+    intermediate_register result_reg() const { return _frames.back().result_reg; }
+
+    // relative to the top frame
+    scalar_value& scalar(intermediate_register reg)
+    {
+        assert(!_frames.empty() && reg < _frames.back().nscalars);
+
+        return _scalar_base[reg];
+    }
+
+    const scalar_value& scalar(intermediate_register reg) const
+    {
+        assert(!_frames.empty() && reg < _frames.back().nscalars);
+
+        return _scalar_base[reg];
+    }
+
+    tagged_value& aggregate(intermediate_register reg)
+    {
+        assert(!_frames.empty() && reg < _frames.back().naggregates);
+
+        return _aggregate_base[reg];
+    }
+
+    const tagged_value& aggregate(intermediate_register reg) const
+    {
+        assert(!_frames.empty() && reg < _frames.back().naggregates);
+
+        return _aggregate_base[reg];
+    }
+
+    // relative to the frame below the top one, for passing arguments and results
+    scalar_value& caller_scalar(intermediate_register reg)
+    {
+        assert(_frames.size() >= 2 && reg < _frames[_frames.size() - 2].nscalars);
+
+        return _scalars[_frames[_frames.size() - 2].scalar_base + reg];
+    }
+
+    tagged_value& caller_aggregate(intermediate_register reg)
+    {
+        assert(_frames.size() >= 2 && reg < _frames[_frames.size() - 2].naggregates);
+
+        return _aggregates[_frames[_frames.size() - 2].aggregate_base + reg];
+    }
+
+    // scalar registers of the top frame, for compiled code (see jit.h). only valid until the next frame push or pop
+    scalar_value* scalar_base() { return _scalar_base; }
 
-    void probe(symbol_id);
-    intermediate_value& operator[](symbol_id);
-    const intermediate_value& operator[](symbol_id) const;
+    // register of a symbol with static type tid, as a value
+    intermediate_value value(type_id tid, intermediate_slot, intermediate_register) const;
 
-    // TODO stdout, sstdint etc.
+    // where the print intrinsics write: a sink of std::cout unless set, flushed when the state is destroyed. a sink
+    // that is set is flushed by its owner. states run on other threads each need their own
+    output_sink& out() { return _p_out ? *_p_out : _cout; }
+    void set_out(output_sink* p_out) { _p_out = p_out; }
 private:
-    // symbol id -> value
-    vector<intermediate_value> _vals;
+    struct frame_record
+    {
+        size_t scalar_base;
+        size_t nscalars;
+        size_t aggregate_base;
+        size_t naggregates;
+        intermediate_addr ra;
+        intermediate_slot result_slot;
+        intermediate_register result_reg;
+    };
+
+    vector<scalar_value> _scalars;
+    vector<tagged_value> _aggregates;
+    vector<frame_record> _frames;
+    size_t _scalar_top; // first free scalar
+    size_t _aggregate_top; // first free aggregate
+    size_t _max_depth;
+    scalar_value* _scalar_base; // registers of top frame
+    tagged_value* _aggregate_base;
+    ostream_sink _cout;
+    output_sink* _p_out;
 };
 
+enum class interpret_dispatch
+{
+    SWITCH, // portable
+    THREADED, // computed goto, falls back to SWITCH if the compiler does not support it
+};
+
+// counters of tiered execution (see tier.h): calls of each frame and backward jumps taken by each branch.
+// the interpreter stops as soon as one reaches its threshold, or control flow reaches an address marked native,
+// with the state consistent to continue at stop_addr
+struct tier_counters
+{
+    enum stop_reason
+    {
+        NONE, // the program stopped
+        HOT_CALL, // hot is the frame called
+        HOT_LOOP, // hot is the address of the branch, stop_addr its target
+        NATIVE,
+    };
+
+    tier_counters() : call_threshold(0), backedge_threshold(0), stop(NONE), stop_addr(0), hot(0) {}
+
+    void resize(size_t nframes, size_t ninsts);
+
+    vector<uint64_t> calls; // per frame, entries through CALL or TAIL_CALL
+    vector<uint64_t> backedges; // per address
+    vector<bool> native; // per address, plus the end of the program
+    uint64_t call_threshold;
+    uint64_t backedge_threshold;
+
+    stop_reason stop;
+    intermediate_addr stop_addr;
+    size_t hot;
+};
+
+struct interpret_settings
+{
+    interpret_settings() : dispatch(interpret_dispatch::THREADED), p_profile(nullptr), p_edges(nullptr), p_tiers(nullptr) {}
+
+    interpret_dispatch dispatch;
+    opcode_pair_profile* p_profile; // if set, every dispatch is counted (switch dispatch only, slow)
+    edge_profile* p_edges; // if set, every executed intermediate and taken branch is counted (switch dispatch only, slow)
+    tier_counters* p_tiers; // if set, calls and backward jumps are counted (switch dispatch only)
+};
+
+bool has_threaded_dispatch();
+
 // start interpreting from givne intrusction/address
-interpret_result interpret(const intermediate_program*, intermediate_interpreter_state*, intermediate_addr, diag_logger*);
+interpret_result interpret(const intermediate_program*, intermediate_interpreter_state*, intermediate_addr, diag_logger*, const interpret_settings& = interpret_settings());
+
+// executes only the intermediate at the address, on a state with its frames already pushed. returns the address to
+// continue at, the program size once execution stopped. failures are logged and set *p_res to INTERPRET_FAIL,
+// they do not stop execution unless fatal (for the jit fallback, see jit.h)
+intermediate_addr interpret_step(const intermediate_program*, intermediate_interpreter_state*, intermediate_addr, diag_logger*, interpret_result* p_res);
 
 }
 
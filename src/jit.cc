@@ -0,0 +1,792 @@
+#include "jit.h"
+
+#include "print.h"
+#include "except.h"
+#include "internal/debug.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <initializer_list>
+#include <new>
+
+// the code generator only targets x86-64 with the System V calling convention, and maps its pages with mmap
+#if defined(__x86_64__) && defined(__linux__) && !defined(LU_NO_JIT)
+#   define LU_JIT 1
+#   include <sys/mman.h>
+#   include <unistd.h>
+#else
+#   define LU_JIT 0
+#endif // defined(__x86_64__) && defined(__linux__) && !defined(LU_NO_JIT)
+
+namespace lu
+{
+
+namespace diags
+{
+    diag JIT_TRAP = diag(diag::ERROR_LEVEL, 5100);
+}
+
+namespace internal
+{
+    // state shared by the machine code and its helpers. the code keeps the context in rbx, the scalar registers
+    // of the top frame in r12 and the native address table in r13
+    struct jit_context
+    {
+        scalar_value* p_scalars; // refreshed by every helper that pushes or pops a frame, then reloaded by the code
+        const void* const* p_natives;
+        const intermediate_program* p_ip;
+        intermediate_interpreter_state* p_state;
+        vector<scalar_value>* p_tail_args; // tail call args, evaluated before the frame they read is replaced
+        const void* p_trapped; // the intermediate (or intrinsic in it) whose helper failed, the code then exits
+        const char* trap; // what failed
+    };
+
+    // enters the code at a native address, returns the address of the intermediate to interpret next
+    // (the program size once it stopped)
+    using jit_entry = uint64_t (*)(jit_context*, const void*);
+
+    // scalar eval of a store, an arg or a return: a constant or a scalar register
+    bool isscalareval(const intermediate& eval)
+    {
+        return eval.op() == intermediate::LOAD_CONSTANT || (eval.op() == intermediate::LOAD_SYMBOL && eval.load.slot == intermediate_slot::SCALAR);
+    }
+
+    bool hasscalarargs(const intermediate_call& call)
+    {
+        for (size_t i = 0; i < call.args.size(); ++i)
+        {
+            const intermediate_store_symbol& arg = call.args[i].store;
+            if (arg.slot != intermediate_slot::SCALAR || !isscalareval(*arg.eval))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    scalar_value eval_scalar(const scalar_value* p_regs, const intermediate& eval)
+    {
+        return eval.op() == intermediate::LOAD_CONSTANT ? eval.imm.bits : p_regs[eval.load.reg];
+    }
+
+    // helpers called from the machine code. they must not throw, there is no unwind information for the code:
+    // each runs its body through jit_guard, which records anything thrown as a trap in the context and returns the
+    // end of the program. control helpers return it as the address to continue at, which exits the code; after a
+    // print the code checks the trap itself. jit_enter reports it
+
+    template <typename BodyT>
+    uint64_t jit_guard(jit_context* ctx, const void* p_at, BodyT body) noexcept
+    {
+        try
+        {
+            return body();
+        }
+        catch (const std::bad_alloc&)
+        {
+            ctx->trap = "out of memory";
+        }
+        catch (const std::exception&)
+        {
+            ctx->trap = "exception";
+        }
+        catch (...)
+        {
+            ctx->trap = "unknown exception";
+        }
+        ctx->p_trapped = p_at;
+        return ctx->p_ip->size();
+    }
+
+    void jit_print(jit_context* ctx, const intermediate_intrinsic* p_intr) noexcept
+    {
+        jit_guard(ctx, p_intr, [&]() -> uint64_t
+        {
+            scalar_value op = p_intr->op_imm ? p_intr->imm : ctx->p_scalars[p_intr->op_reg];
+            switch (p_intr->icode)
+            {
+            case I32PRINT:
+                ctx->p_state->out().put_int(op.i32);
+                break;
+            case I64PRINT:
+                ctx->p_state->out().put_int(op.i64);
+                break;
+            case U32PRINT:
+                ctx->p_state->out().put_uint(op.u32);
+                break;
+            case U64PRINT:
+                ctx->p_state->out().put_uint(op.u64);
+                break;
+            case BPRINT:
+                ctx->p_state->out().put_bool(op.b);
+                break;
+            case ASCIIPRINT:
+                ctx->p_state->out().put(op.ascii);
+                break;
+            default:
+                break;
+            }
+            return 0;
+        });
+    }
+
+    uint64_t call_frame(jit_context* ctx, const intermediate* p_call)
+    {
+        const intermediate_call& call = p_call->call;
+        const intermediate_frame& f = ctx->p_ip->frame(call.fid);
+        intermediate_addr ra = static_cast<intermediate_addr>(p_call - ctx->p_ip->data()) + 1;
+        intermediate_interpreter_state* p_state = ctx->p_state;
+        p_state->push_frame(f, ra, call.result_slot, call.has_result() ? call.result_reg : intermediate_interpreter_state::NO_RESULT);
+        for (size_t i = 0; i < call.args.size(); ++i)
+        {
+            const intermediate_store_symbol& arg = call.args[i].store;
+            const intermediate& eval = *arg.eval;
+            p_state->scalar(arg.reg) = eval.op() == intermediate::LOAD_CONSTANT ? eval.imm.bits : p_state->caller_scalar(eval.load.reg);
+        }
+        ctx->p_scalars = p_state->scalar_base();
+        return f.entry;
+    }
+
+    uint64_t tail_call_frame(jit_context* ctx, const intermediate* p_call)
+    {
+        const intermediate_call& call = p_call->call;
+        vector<scalar_value>& args = *ctx->p_tail_args;
+        args.resize(call.args.size());
+        for (size_t i = 0; i < call.args.size(); ++i)
+        {
+            args[i] = eval_scalar(ctx->p_scalars, *call.args[i].store.eval);
+        }
+
+        const intermediate_frame& f = ctx->p_ip->frame(call.fid);
+        intermediate_interpreter_state* p_state = ctx->p_state;
+        p_state->replace_frame(f);
+        for (size_t i = 0; i < call.args.size(); ++i)
+        {
+            p_state->scalar(call.args[i].store.reg) = args[i];
+        }
+        ctx->p_scalars = p_state->scalar_base();
+        return f.entry;
+    }
+
+    uint64_t return_frame(jit_context* ctx, const intermediate* p_ret)
+    {
+        intermediate_interpreter_state* p_state = ctx->p_state;
+        if (p_state->depth() <= 1)
+        {
+            // the top frame is kept, as by the interpreter
+            return ctx->p_ip->size();
+        }
+        intermediate_register reg = p_state->result_reg();
+        if (p_ret->ret.eval && reg != intermediate_interpreter_state::NO_RESULT)
+        {
+            const intermediate& eval = *p_ret->ret.eval;
+            if (p_state->result_slot() == intermediate_slot::SCALAR)
+            {
+                p_state->caller_scalar(reg) = eval_scalar(ctx->p_scalars, eval);
+            }
+            else if (eval.op() == intermediate::LOAD_CONSTANT)
+            {
+                p_state->caller_aggregate(reg).assign(ctx->p_ip->constants()[eval.imm.idx]);
+            }
+            else
+            {
+                p_state->caller_aggregate(reg).assign_scalar(eval.load.tid, ctx->p_scalars[eval.load.reg]);
+            }
+        }
+        intermediate_addr ra = p_state->pop_frame();
+        ctx->p_scalars = p_state->scalar_base();
+        return ra;
+    }
+
+    uint64_t jit_call(jit_context* ctx, const intermediate* p_call) noexcept
+    {
+        return jit_guard(ctx, p_call, [&]() { return call_frame(ctx, p_call); });
+    }
+
+    uint64_t jit_tail_call(jit_context* ctx, const intermediate* p_call) noexcept
+    {
+        return jit_guard(ctx, p_call, [&]() { return tail_call_frame(ctx, p_call); });
+    }
+
+    uint64_t jit_return(jit_context* ctx, const intermediate* p_ret) noexcept
+    {
+        return jit_guard(ctx, p_ret, [&]() { return return_frame(ctx, p_ret); });
+    }
+
+    // the few x86-64 instructions the templates are made of. scalar register operands are [r12 + reg * 8]
+    struct x64_assembler
+    {
+        // machine registers, by encoding
+        enum gpr : uint8_t
+        {
+            RAX = 0,
+            RSI = 6,
+            RDI = 7,
+        };
+
+        // ModRM reg field of the group opcodes (0x80, 0x81, 0x83)
+        enum group_op : uint8_t
+        {
+            ADD = 0,
+            OR = 1,
+            AND = 4,
+            XOR = 6,
+            CMP = 7,
+        };
+
+        vector<uint8_t> code;
+
+        size_t size() const { return code.size(); }
+
+        void emit(std::initializer_list<uint8_t> bytes)
+        {
+            code.insert(code.end(), bytes.begin(), bytes.end());
+        }
+
+        void emit32(uint32_t v)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                code.push_back(static_cast<uint8_t>(v >> (8 * i)));
+            }
+        }
+
+        void emit64(uint64_t v)
+        {
+            for (int i = 0; i < 8; ++i)
+            {
+                code.push_back(static_cast<uint8_t>(v >> (8 * i)));
+            }
+        }
+
+        static bool fits32(int64_t v)
+        {
+            return v >= INT32_MIN && v <= INT32_MAX;
+        }
+
+        // rex (W for 64 bit), opcode, then the [r12 + disp32] operand with the given reg field
+        void scalar_op(bool wide, uint8_t opcode, uint8_t reg_field, intermediate_register reg)
+        {
+            emit({ static_cast<uint8_t>(wide ? 0x49 : 0x41), opcode, static_cast<uint8_t>(0x84 | (reg_field << 3)), 0x24 });
+            emit32(static_cast<uint32_t>(reg * sizeof(scalar_value)));
+        }
+
+        // mov rax, [r12 + reg * 8]
+        void load_rax(intermediate_register reg) { scalar_op(true, 0x8b, RAX, reg); }
+        // mov [r12 + reg * 8], rax
+        void store_rax(intermediate_register reg) { scalar_op(true, 0x89, RAX, reg); }
+        // mov al, [r12 + reg * 8]
+        void load_al(intermediate_register reg) { scalar_op(false, 0x8a, RAX, reg); }
+
+        // mov rax, imm64
+        void mov_rax(uint64_t imm)
+        {
+            emit({ 0x48, 0xb8 });
+            emit64(imm);
+        }
+
+        // mov qword [r12 + reg * 8], imm
+        void store_imm(intermediate_register reg, uint64_t imm)
+        {
+            int64_t simm = static_cast<int64_t>(imm);
+            if (fits32(simm))
+            {
+                scalar_op(true, 0xc7, 0, reg);
+                emit32(static_cast<uint32_t>(simm));
+                return;
+            }
+            mov_rax(imm);
+            store_rax(reg);
+        }
+
+        // mov eax, imm32
+        void mov_eax(uint32_t imm)
+        {
+            emit({ 0xb8 });
+            emit32(imm);
+        }
+
+        // mov rdi, rbx; mov rsi, arg; mov rax, fn; call rax
+        void call_helper(uint64_t fn, uint64_t arg)
+        {
+            emit({ 0x48, 0x89, 0xdf, 0x48, 0xbe });
+            emit64(arg);
+            mov_rax(fn);
+            emit({ 0xff, 0xd0 });
+        }
+
+        // mov r12, [rbx + p_scalars]; jmp [r13 + rax * 8]
+        void dispatch_rax()
+        {
+            emit({ 0x4c, 0x8b, 0x63, static_cast<uint8_t>(offsetof(jit_context, p_scalars)) });
+            emit({ 0x41, 0xff, 0x64, 0xc5, 0x00 });
+        }
+
+        // jmp rel32 or jcc rel32 (cc the low nibble of the 0x0f 0x8_ opcode), returns the position of rel32
+        size_t jmp()
+        {
+            emit({ 0xe9 });
+            emit32(0);
+            return size() - 4;
+        }
+
+        size_t jcc(uint8_t cc)
+        {
+            emit({ 0x0f, static_cast<uint8_t>(0x80 | cc) });
+            emit32(0);
+            return size() - 4;
+        }
+
+        void patch(size_t at, size_t target)
+        {
+            uint32_t rel = static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+            for (int i = 0; i < 4; ++i)
+            {
+                code[at + i] = static_cast<uint8_t>(rel >> (8 * i));
+            }
+        }
+    };
+
+    struct jit_compiler
+    {
+        // condition codes of jcc
+        enum cc : uint8_t
+        {
+            CC_E = 0x4,
+            CC_NE = 0x5,
+        };
+
+        struct fixup
+        {
+            size_t at; // of the rel32
+            intermediate_addr target;
+        };
+
+        jit_compiler(const intermediate_program* p_ip, const vector<bool>* p_addrs, jit_stats* p_stats)
+            : p_ip(p_ip), p_addrs(p_addrs), p_stats(p_stats), n(p_ip->size()), offsets(n + 1, 0), epilogue(0) {}
+
+        const intermediate_program* p_ip;
+        const vector<bool>* p_addrs;
+        jit_stats* p_stats;
+        size_t n;
+        x64_assembler as;
+        vector<size_t> offsets; // of the code of each intermediate, and of the end of the program
+        vector<fixup> fixups;
+        size_t epilogue;
+
+        // entry(ctx, native): saves the callee saved registers it uses (which also aligns the stack for helper
+        // calls), loads the context registers and jumps to native. the epilogue returns eax
+        void emit_entry()
+        {
+            as.emit({ 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57 }); // push rbx, r12, r13, r14, r15
+            as.emit({ 0x48, 0x89, 0xfb }); // mov rbx, rdi
+            as.emit({ 0x4c, 0x8b, 0x63, static_cast<uint8_t>(offsetof(jit_context, p_scalars)) }); // mov r12, [rbx + p_scalars]
+            as.emit({ 0x4c, 0x8b, 0x6b, static_cast<uint8_t>(offsetof(jit_context, p_natives)) }); // mov r13, [rbx + p_natives]
+            as.emit({ 0xff, 0xe6 }); // jmp rsi
+            epilogue = as.size();
+            as.emit({ 0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3 }); // pop r15, r14, r13, r12, rbx; ret
+        }
+
+        void exit(intermediate_addr iaddr)
+        {
+            as.mov_eax(static_cast<uint32_t>(iaddr));
+            as.patch(as.jmp(), epilogue);
+        }
+
+        void jump(intermediate_addr target)
+        {
+            fixups.push_back({ as.jmp(), target });
+        }
+
+        bool supported(const intermediate_intrinsic& intr) const
+        {
+            switch (intr.icode)
+            {
+            case I32PRINT:
+            case I64PRINT:
+            case U32PRINT:
+            case U64PRINT:
+            case BPRINT:
+            case ASCIIPRINT:
+            case I32ADD:
+            case I64ADD:
+            case U32ADD:
+            case U64ADD:
+            case LNEG:
+            case LAND:
+            case LOR:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        // false if it calls a helper
+        bool emit_intrinsic(const intermediate_intrinsic& intr)
+        {
+            switch (intr.icode)
+            {
+            case I32ADD:
+            case U32ADD:
+                if (intr.op_imm)
+                {
+                    as.scalar_op(false, 0x81, x64_assembler::ADD, intr.dest_reg); // add dword [dest], imm32
+                    as.emit32(intr.imm.u32);
+                    return true;
+                }
+                as.load_rax(intr.op_reg);
+                as.scalar_op(false, 0x01, x64_assembler::RAX, intr.dest_reg); // add dword [dest], eax
+                return true;
+            case I64ADD:
+            case U64ADD:
+                if (intr.op_imm && x64_assembler::fits32(intr.imm.i64))
+                {
+                    as.scalar_op(true, 0x81, x64_assembler::ADD, intr.dest_reg); // add qword [dest], imm32
+                    as.emit32(static_cast<uint32_t>(intr.imm.i64));
+                    return true;
+                }
+                if (intr.op_imm)
+                {
+                    as.mov_rax(intr.imm.u64);
+                }
+                else
+                {
+                    as.load_rax(intr.op_reg);
+                }
+                as.scalar_op(true, 0x01, x64_assembler::RAX, intr.dest_reg); // add qword [dest], rax
+                return true;
+            case LNEG:
+                as.scalar_op(false, 0x80, x64_assembler::XOR, intr.dest_reg); // xor byte [dest], 1
+                as.emit({ 1 });
+                return true;
+            case LAND:
+            case LOR:
+                if (intr.op_imm)
+                {
+                    as.scalar_op(false, 0x80, intr.icode == LAND ? x64_assembler::AND : x64_assembler::OR, intr.dest_reg); // and/or byte [dest], imm8
+                    as.emit({ static_cast<uint8_t>(intr.imm.b ? 1 : 0) });
+                    return true;
+                }
+                as.load_al(intr.op_reg);
+                as.scalar_op(false, intr.icode == LAND ? 0x20 : 0x08, x64_assembler::RAX, intr.dest_reg); // and/or byte [dest], al
+                return true;
+            default:
+                as.call_helper(reinterpret_cast<uint64_t>(&jit_print), reinterpret_cast<uint64_t>(&intr));
+                // cmp qword [rbx + p_trapped], 0; jne end
+                as.emit({ 0x48, 0x83, 0x7b, static_cast<uint8_t>(offsetof(jit_context, p_trapped)), 0 });
+                fixups.push_back({ as.jcc(CC_NE), n });
+                return false;
+            }
+        }
+
+        bool emit_intrinsics(std::initializer_list<const intermediate_intrinsic*> intrs)
+        {
+            for (const intermediate_intrinsic* p_intr : intrs)
+            {
+                if (!supported(*p_intr))
+                {
+                    return false;
+                }
+            }
+            bool native = true;
+            for (const intermediate_intrinsic* p_intr : intrs)
+            {
+                native = emit_intrinsic(*p_intr) && native;
+            }
+            count(native);
+            return true;
+        }
+
+        bool emit_store(const intermediate_store_symbol& store)
+        {
+            const intermediate& eval = *store.eval;
+            if (store.slot != intermediate_slot::SCALAR || !isscalareval(eval))
+            {
+                return false;
+            }
+            if (eval.op() == intermediate::LOAD_CONSTANT)
+            {
+                as.store_imm(store.reg, eval.imm.bits.bits);
+            }
+            else
+            {
+                as.load_rax(eval.load.reg);
+                as.store_rax(store.reg);
+            }
+            count(true);
+            return true;
+        }
+
+        bool emit_branch(const intermediate_branch& br)
+        {
+            intermediate_addr target = br.target();
+            if (target > n)
+            {
+                // trapped by the interpreter
+                return false;
+            }
+            if (!br.condition)
+            {
+                jump(target);
+                count(true);
+                return true;
+            }
+            const intermediate& cond = *br.condition;
+            if (!isscalareval(cond))
+            {
+                return false;
+            }
+            if (cond.op() == intermediate::LOAD_CONSTANT)
+            {
+                if ((cond.imm.bits.bits != 0) != br.negated)
+                {
+                    jump(target);
+                }
+                count(true);
+                return true;
+            }
+            as.scalar_op(true, 0x83, x64_assembler::CMP, cond.load.reg); // cmp qword [cond], 0
+            as.emit({ 0 });
+            fixups.push_back({ as.jcc(br.negated ? CC_E : CC_NE), target });
+            count(true);
+            return true;
+        }
+
+        // the helper returns the address to continue at
+        bool emit_control(uint64_t helper, const intermediate& i)
+        {
+            as.call_helper(helper, reinterpret_cast<uint64_t>(&i));
+            as.dispatch_rax();
+            count(false);
+            return true;
+        }
+
+        void count(bool native)
+        {
+            ++(native ? p_stats->nnative : p_stats->nhelper);
+        }
+
+        // false to leave it to the interpreter
+        bool emit(const intermediate& i)
+        {
+            switch (i.op())
+            {
+            case intermediate::STORE_SYMBOL:
+            case intermediate::STORE_CONSTANT:
+            case intermediate::STORE_COPY:
+                return emit_store(i.store);
+            case intermediate::INTRINSIC:
+                return emit_intrinsics({ &i.intr });
+            case intermediate::INTRINSIC_PAIR:
+                return emit_intrinsics({ &i.intr2.first, &i.intr2.second });
+            case intermediate::INTRINSIC_TRIPLE:
+                return emit_intrinsics({ &i.intr3.first, &i.intr3.second, &i.intr3.third });
+            case intermediate::BRANCH:
+                return emit_branch(i.br);
+            case intermediate::CALL:
+                return hasscalarargs(i.call) && emit_control(reinterpret_cast<uint64_t>(&jit_call), i);
+            case intermediate::TAIL_CALL:
+                return hasscalarargs(i.call) && emit_control(reinterpret_cast<uint64_t>(&jit_tail_call), i);
+            case intermediate::RETURN:
+                return (!i.ret.eval || isscalareval(*i.ret.eval)) && emit_control(reinterpret_cast<uint64_t>(&jit_return), i);
+            case intermediate::HALT:
+                exit(n);
+                count(true);
+                return true;
+            case intermediate::BLOCK:
+                if (i.blk.subs.size() != 0)
+                {
+                    return false;
+                }
+                count(true);
+                return true;
+            default:
+                if (istypedintrinsic(i.op()))
+                {
+                    return emit_intrinsics({ &i.intr });
+                }
+                return false;
+            }
+        }
+
+        void compile()
+        {
+            emit_entry();
+            for (intermediate_addr iaddr = 0; iaddr < n; ++iaddr)
+            {
+                offsets[iaddr] = as.size();
+                if ((p_addrs && !(*p_addrs)[iaddr]) || !emit((*p_ip)[iaddr]))
+                {
+                    exit(iaddr);
+                    ++p_stats->nfallback;
+                }
+            }
+            offsets[n] = as.size();
+            exit(n);
+            for (const fixup& f : fixups)
+            {
+                as.patch(f.at, offsets[f.target]);
+            }
+        }
+    };
+}
+
+jit_code::jit_code(jit_code&& other) : _p_ip(other._p_ip), _p_code(other._p_code), _size(other._size), _natives(move(other._natives))
+{
+    other._p_code = nullptr;
+    other._size = 0;
+}
+
+jit_code::~jit_code()
+{
+    release();
+}
+
+jit_code& jit_code::operator=(jit_code&& other)
+{
+    if (this != &other)
+    {
+        release();
+        _p_ip = other._p_ip;
+        _p_code = other._p_code;
+        _size = other._size;
+        _natives = move(other._natives);
+        other._p_code = nullptr;
+        other._size = 0;
+    }
+    return *this;
+}
+
+void jit_code::release()
+{
+#if LU_JIT
+    if (_p_code)
+    {
+        munmap(_p_code, _size);
+    }
+#endif // LU_JIT
+    _p_code = nullptr;
+    _size = 0;
+    _natives.clear();
+}
+
+string to_string(const jit_stats& stats)
+{
+    return string::join(
+        to_string(stats.ninsts), " intermediates: ",
+        to_string(stats.nnative), " native, ",
+        to_string(stats.nhelper), " through helpers, ",
+        to_string(stats.nfallback), " interpreted, ",
+        to_string(stats.code_size), " bytes of code");
+}
+
+bool has_jit()
+{
+    return LU_JIT;
+}
+
+jit_result jit_compile(const intermediate_program* ip, jit_code* p_code, jit_stats* p_stats, const vector<bool>* p_addrs)
+{
+    jit_stats stats;
+    if (!p_stats)
+    {
+        p_stats = &stats;
+    }
+    *p_stats = jit_stats();
+    p_code->release();
+    p_code->_p_ip = ip;
+#if LU_JIT
+    // addresses are exit codes in eax
+    if (ip->size() >= INT32_MAX)
+    {
+        return jit_result::JIT_UNSUPPORTED;
+    }
+    internal::jit_compiler jc(ip, p_addrs, p_stats);
+    jc.compile();
+    p_stats->ninsts = ip->size();
+    p_stats->code_size = jc.as.size();
+
+    // written while only writable, then only executable
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t size = (jc.as.size() + page - 1) / page * page;
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+    {
+        return jit_result::JIT_UNSUPPORTED;
+    }
+    std::memcpy(p, jc.as.code.data(), jc.as.size());
+    if (mprotect(p, size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(p, size);
+        return jit_result::JIT_UNSUPPORTED;
+    }
+    p_code->_p_code = p;
+    p_code->_size = size;
+    p_code->_natives.resize(ip->size() + 1);
+    for (intermediate_addr iaddr = 0; iaddr <= ip->size(); ++iaddr)
+    {
+        p_code->_natives[iaddr] = static_cast<const uint8_t*>(p) + jc.offsets[iaddr];
+    }
+    return jit_result::JIT_OK;
+#else
+    return jit_result::JIT_UNSUPPORTED;
+#endif // LU_JIT
+}
+
+interpret_result jit_run(const jit_code* p_code, intermediate_interpreter_state* is, intermediate_addr iaddr, diag_logger* log)
+{
+    const intermediate_program* ip = p_code->program();
+    if (p_code->empty())
+    {
+        return interpret(ip, is, iaddr, log);
+    }
+    debug(
+        string err;
+        if (!verify_slots(*ip, &err))
+        {
+            throw internal_except_with_location(string::join("register slots do not match the symbol table: ", err));
+        }
+    )
+    if (is->depth() == 0)
+    {
+        is->push_frame(ip->frame(intermediate_frame::TOP), ip->size());
+    }
+
+    interpret_result res = interpret_result::INTERPRET_OK;
+    while (iaddr < ip->size())
+    {
+        iaddr = jit_enter(p_code, is, iaddr, log, &res);
+        if (iaddr < ip->size())
+        {
+            iaddr = interpret_step(ip, is, iaddr, log, &res);
+        }
+    }
+    return res;
+}
+
+intermediate_addr jit_enter(const jit_code* p_code, intermediate_interpreter_state* is, intermediate_addr iaddr, diag_logger* log, interpret_result* p_res)
+{
+    assert(!p_code->empty() && is->depth() != 0);
+
+    // the interpreter may have pushed or popped frames since the last exit
+    vector<scalar_value> tail_args;
+    const intermediate_program* ip = p_code->program();
+    internal::jit_context ctx = { is->scalar_base(), p_code->_natives.data(), ip, is, &tail_args, nullptr, nullptr };
+    internal::jit_entry entry = reinterpret_cast<internal::jit_entry>(p_code->_p_code);
+    iaddr = static_cast<intermediate_addr>(entry(&ctx, p_code->_natives[iaddr]));
+    if (ctx.p_trapped)
+    {
+        // the trap points into an intermediate, or at an intrinsic inside one
+        intermediate_addr at = static_cast<intermediate_addr>(
+            (static_cast<const char*>(ctx.p_trapped) - reinterpret_cast<const char*>(ip->data())) / sizeof(intermediate));
+        const intermediate& i = (*ip)[at];
+        log->push(diag_context(diags::JIT_TRAP, i.srcref(), i.loc(),
+            string::join(ctx.trap, " in the runtime helper of ", intermediate_op_cstr(i.op()), " at ", to_string(at))));
+        *p_res = interpret_result::INTERPRET_FAIL;
+        return ip->size();
+    }
+    return iaddr;
+}
+
+}
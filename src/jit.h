@@ -0,0 +1,99 @@
+#ifndef LU_JIT_H
+#define LU_JIT_H
+
+#include "intermediate.h"
+#include "interpreter.h"
+#include "diag.h"
+#include "string.h"
+#include "adt/vector.h"
+#include "internal/constexpr.h"
+
+namespace lu
+{
+
+namespace diags
+{
+    extern diag JIT_TRAP;
+}
+
+struct jit_stats
+{
+    jit_stats() : ninsts(0), nnative(0), nhelper(0), nfallback(0), code_size(0) {}
+
+    size_t ninsts;
+    size_t nnative; // translated to inline machine code
+    size_t nhelper; // translated to a call into a runtime helper (prints, calls, returns)
+    size_t nfallback; // left to the interpreter
+    size_t code_size; // bytes of machine code
+};
+
+string to_string(const jit_stats&);
+
+enum class jit_result
+{
+    JIT_OK,
+    JIT_UNSUPPORTED, // the host is not x86-64 linux, or executable memory could not be mapped
+};
+
+LU_CONSTEXPR bool ok(jit_result jr)
+{
+    return jr == jit_result::JIT_OK;
+}
+
+// machine code of one program, owns its executable pages. the program must outlive it and not change,
+// the code points into its intermediates
+struct jit_code
+{
+    jit_code() : _p_ip(nullptr), _p_code(nullptr), _size(0) {}
+    jit_code(jit_code&&);
+    jit_code(const jit_code&) = delete;
+    ~jit_code();
+
+    jit_code& operator=(jit_code&&);
+    jit_code& operator=(const jit_code&) = delete;
+
+    bool empty() const { return _p_code == nullptr; }
+    const intermediate_program* program() const { return _p_ip; }
+    size_t size() const { return _size; }
+
+private:
+    friend jit_result jit_compile(const intermediate_program*, jit_code*, jit_stats*, const vector<bool>*);
+    friend intermediate_addr jit_enter(const jit_code*, intermediate_interpreter_state*, intermediate_addr, diag_logger*, interpret_result*);
+
+    void release();
+
+    const intermediate_program* _p_ip;
+    void* _p_code;
+    size_t _size; // of the mapping
+    vector<const void*> _natives; // machine code address of each intermediate, plus the end of the program
+};
+
+bool has_jit();
+
+// baseline template jit: every intermediate is translated on its own into a fixed machine code sequence, in address
+// order, so branches become direct jumps and fall throughs stay fall throughs. scalar registers are addressed from
+// the top frame's base, kept in a machine register.
+//   - scalar stores of a constant or a scalar register, and branches on one, are inline code
+//   - the typed intrinsics (and fused runs of them) are inline code, except prints which call a helper
+//   - CALL, TAIL_CALL and RETURN with scalar args call a helper that pushes or pops the frame, then jump to the
+//     code of the address it returns
+//   - everything else (aggregates, tuples, ILLEGAL...) exits to jit_run, which interprets that one intermediate
+//     (see interpret_step) and enters the machine code again after it
+// the code is written into mapped pages which are then made executable and no longer writable (W^X).
+// on other hosts, or if the pages cannot be mapped executable, code is left empty (but still runs the program
+// through jit_run) and JIT_UNSUPPORTED returned.
+// if p_addrs is set, only the intermediates at the addresses it marks are translated, the others exit
+jit_result jit_compile(const intermediate_program*, jit_code*, jit_stats* = nullptr, const vector<bool>* p_addrs = nullptr);
+
+// runs the compiled program like interpret. code that failed to compile is interpreted
+interpret_result jit_run(const jit_code*, intermediate_interpreter_state*, intermediate_addr, diag_logger*);
+
+// runs the machine code from the address, on a state with its frames already pushed, until it exits. returns the
+// address it exited at: the end of the program, or an intermediate left to the interpreter. code must not be empty.
+// a runtime helper that failed (out of memory...) is logged as JIT_TRAP, sets *p_res to INTERPRET_FAIL and ends
+// the run at the end of the program
+intermediate_addr jit_enter(const jit_code*, intermediate_interpreter_state*, intermediate_addr, diag_logger*, interpret_result* p_res);
+
+}
+
+#endif // LU_JIT_H
@@ -0,0 +1,368 @@
+#include "layout.h"
+
+#include "cfg.h"
+#include "utility.h"
+
+#include <algorithm>
+
+namespace lu
+{
+
+namespace internal
+{
+    // where an emitted branch goes, resolved once every block has its new address
+    struct layout_target
+    {
+        enum target_kind
+        {
+            BLOCK,
+            PAST_END, // end of the program plus offset
+        };
+
+        layout_target(target_kind kind, size_t value) : kind(kind), value(value) {}
+
+        target_kind kind;
+        size_t value; // block id or offset
+    };
+
+    struct block_layout
+    {
+        block_layout(intermediate_program* p_ip, const edge_profile* p_profile, layout_stats* p_stats)
+            : p_ip(p_ip), p_profile(p_profile), p_stats(p_stats), cfg(*p_ip), n(p_ip->size()),
+            cold(cfg.size(), false), placed(cfg.size(), false), region(0) {}
+
+        intermediate_program* p_ip;
+        const edge_profile* p_profile; // null unless it matches the program and executed it
+        layout_stats* p_stats;
+        control_flow_graph cfg;
+        size_t n;
+        vector<bool> cold; // per block
+        vector<bool> placed;
+        vector<cfg_block_id> order;
+        vector<intermediate_addr> entries; // distinct frame entries in address order
+        vector<size_t> regions; // per block, index of the last entry at or before it
+        size_t region; // being placed
+
+        // block at the address, NONE past the last block
+        cfg_block_id block_at(intermediate_addr iaddr) const
+        {
+            return iaddr < n ? cfg.block_of(iaddr) : control_flow_graph::NONE;
+        }
+
+        void find_cold()
+        {
+            for (cfg_block_id id = 0; id < cfg.size(); ++id)
+            {
+                const cfg_block& b = cfg[id];
+                if (!cfg.reachable(id))
+                {
+                    continue;
+                }
+                if (p_profile && p_profile->executed(cfg[cfg.entry(b.fid)].first) != 0 && p_profile->executed(b.first) == 0)
+                {
+                    cold[id] = true;
+                    continue;
+                }
+                for (intermediate_addr iaddr = b.first; iaddr < b.end; ++iaddr)
+                {
+                    if ((*p_ip)[iaddr].op() == intermediate::ILLEGAL)
+                    {
+                        cold[id] = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        // successor that should follow the block, NONE if it does not continue in the program
+        cfg_block_id likely(cfg_block_id id) const
+        {
+            const cfg_block& b = cfg[id];
+            const intermediate& last = (*p_ip)[b.last()];
+            if (last.op() != intermediate::BRANCH || !last.br.condition)
+            {
+                return b.succs.empty() ? control_flow_graph::NONE : b.succs[0];
+            }
+
+            cfg_block_id fall = block_at(b.end);
+            cfg_block_id taken = block_at(last.br.target());
+            if (p_profile && p_profile->executed(b.last()) != 0)
+            {
+                uint64_t ntaken = p_profile->taken(b.last());
+                return ntaken > p_profile->executed(b.last()) - ntaken ? taken : fall;
+            }
+            if (taken != control_flow_graph::NONE && cfg.is_back_edge(id, taken))
+            {
+                return taken;
+            }
+            if (fall != control_flow_graph::NONE && cfg.is_back_edge(id, fall))
+            {
+                return fall;
+            }
+            if (b.loop != control_flow_graph::NO_LOOP)
+            {
+                bool taken_in = taken != control_flow_graph::NONE && cfg.in_loop(taken, b.loop);
+                bool fall_in = fall != control_flow_graph::NONE && cfg.in_loop(fall, b.loop);
+                if (taken_in != fall_in)
+                {
+                    return taken_in ? taken : fall;
+                }
+            }
+            bool taken_cold = taken != control_flow_graph::NONE && cold[taken];
+            bool fall_cold = fall != control_flow_graph::NONE && cold[fall];
+            if (taken_cold != fall_cold)
+            {
+                return taken_cold ? fall : taken;
+            }
+            return fall;
+        }
+
+        bool placeable(cfg_block_id id) const
+        {
+            return id != control_flow_graph::NONE && !placed[id] && !cold[id] && regions[id] == region;
+        }
+
+        // places the block, then follows likely successors while they are free
+        void place_chain(cfg_block_id id)
+        {
+            while (id != control_flow_graph::NONE && !placed[id])
+            {
+                placed[id] = true;
+                order.push_back(id);
+                cfg_block_id next = likely(id);
+                if (!placeable(next))
+                {
+                    next = control_flow_graph::NONE;
+                    for (cfg_block_id succ : cfg[id].succs)
+                    {
+                        if (placeable(succ))
+                        {
+                            next = succ;
+                            break;
+                        }
+                    }
+                }
+                id = next;
+            }
+        }
+
+        // the code of a frame runs from its entry to the next entry (see verify_slots), every
+        // block stays in the range it started in, with the entry first. false if address 0 is not an entry
+        bool find_regions()
+        {
+            for (intermediate_frame_id fid = 0; fid < p_ip->frame_count(); ++fid)
+            {
+                if (p_ip->frame(fid).entry < n)
+                {
+                    entries.push_back(p_ip->frame(fid).entry);
+                }
+            }
+            std::sort(entries.begin(), entries.end());
+            entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+            if (entries.empty() || entries[0] != 0)
+            {
+                return false;
+            }
+            regions.assign(cfg.size(), 0);
+            for (cfg_block_id id = 0; id < cfg.size(); ++id)
+            {
+                regions[id] = static_cast<size_t>(std::upper_bound(entries.begin(), entries.end(), cfg[id].first) - entries.begin()) - 1;
+            }
+            return true;
+        }
+
+        void place()
+        {
+            for (region = 0; region < entries.size(); ++region)
+            {
+                cfg_block_id entry = cfg.block_of(entries[region]);
+                place_chain(entry);
+                if (cfg[entry].fid != control_flow_graph::NO_FRAME)
+                {
+                    for (cfg_block_id id : cfg.rpo(cfg[entry].fid))
+                    {
+                        if (placeable(id))
+                        {
+                            place_chain(id);
+                        }
+                    }
+                }
+                // cold blocks, then the ones nothing reaches
+                for (int reached = 1; reached >= 0; --reached)
+                {
+                    for (cfg_block_id id = 0; id < cfg.size(); ++id)
+                    {
+                        if (!placed[id] && regions[id] == region && cfg.reachable(id) == (reached != 0))
+                        {
+                            placed[id] = true;
+                            order.push_back(id);
+                            ++p_stats->ncold;
+                        }
+                    }
+                }
+            }
+        }
+
+        layout_target target_of(intermediate_addr iaddr) const
+        {
+            return iaddr < n ? layout_target(layout_target::BLOCK, cfg.block_of(iaddr)) : layout_target(layout_target::PAST_END, iaddr - n);
+        }
+
+        void emit()
+        {
+            vector<intermediate> out;
+            out.reserve(n + n / 4);
+            vector<layout_target> targets; // per emitted intermediate, only read for branches
+            targets.reserve(n + n / 4);
+            vector<intermediate_addr> starts(cfg.size(), 0);
+            for (size_t k = 0; k < order.size(); ++k)
+            {
+                cfg_block_id id = order[k];
+                const cfg_block& b = cfg[id];
+                cfg_block_id next = k + 1 < order.size() ? order[k + 1] : control_flow_graph::NONE;
+                if (k != 0 && id != order[k - 1] + 1)
+                {
+                    ++p_stats->nmoved;
+                }
+                starts[id] = out.size();
+                for (intermediate_addr iaddr = b.first; iaddr < b.last(); ++iaddr)
+                {
+                    out.push_back(move((*p_ip)[iaddr]));
+                    targets.push_back(layout_target(layout_target::BLOCK, 0));
+                }
+
+                intermediate& last = (*p_ip)[b.last()];
+                cfg_block_id fall = block_at(b.end);
+                if (last.op() != intermediate::BRANCH)
+                {
+                    bool falls = !isblockend(last.op());
+                    out.push_back(move(last));
+                    targets.push_back(layout_target(layout_target::BLOCK, 0));
+                    if (falls && fall != next)
+                    {
+                        out.push_back(intermediate::emplace_branch(0, nullptr, intermediate_branch::branch_offset()));
+                        targets.push_back(target_of(b.end));
+                        ++p_stats->nbranches_added;
+                    }
+                    continue;
+                }
+
+                layout_target target = target_of(last.br.target());
+                bool to_next = target.kind == layout_target::BLOCK && target.value == next;
+                if (!last.br.condition)
+                {
+                    if (to_next)
+                    {
+                        ++p_stats->nbranches_removed;
+                        continue;
+                    }
+                    out.push_back(move(last));
+                    targets.push_back(target);
+                    continue;
+                }
+                if (fall == next)
+                {
+                    out.push_back(move(last));
+                    targets.push_back(target);
+                    continue;
+                }
+                if (to_next)
+                {
+                    last.br.negated = !last.br.negated;
+                    out.push_back(move(last));
+                    targets.push_back(target_of(b.end));
+                    ++p_stats->ninverted;
+                    continue;
+                }
+                out.push_back(move(last));
+                targets.push_back(target);
+                out.push_back(intermediate::emplace_branch(0, nullptr, intermediate_branch::branch_offset()));
+                targets.push_back(target_of(b.end));
+                ++p_stats->nbranches_added;
+            }
+
+            for (intermediate_addr iaddr = 0; iaddr < out.size(); ++iaddr)
+            {
+                intermediate& i = out[iaddr];
+                if (i.op() != intermediate::BRANCH)
+                {
+                    continue;
+                }
+                const layout_target& t = targets[iaddr];
+                intermediate_addr target = t.kind == layout_target::BLOCK ? starts[t.value] : out.size() + t.value;
+                i.br.base = iaddr;
+                i.br.offset = target >= iaddr
+                    ? intermediate_branch::branch_offset(intermediate_branch::branch_offset::POSITIVE, target - iaddr)
+                    : intermediate_branch::branch_offset(intermediate_branch::branch_offset::NEGATIVE, iaddr - target);
+            }
+            for (intermediate_frame_id fid = 0; fid < p_ip->frame_count(); ++fid)
+            {
+                intermediate_frame& f = p_ip->frame(fid);
+                f.entry = f.entry < n ? starts[cfg.block_of(f.entry)] : out.size();
+            }
+            p_ip->rewrite(move(out));
+        }
+    };
+}
+
+void edge_profile::resize(size_t ninsts)
+{
+    if (ninsts != _executed.size())
+    {
+        _executed.assign(ninsts, 0);
+        _taken.assign(ninsts, 0);
+    }
+}
+
+uint64_t edge_profile::taken_total() const
+{
+    uint64_t total = 0;
+    for (uint64_t t : _taken)
+    {
+        total += t;
+    }
+    return total;
+}
+
+string to_string(const layout_stats& stats)
+{
+    return string::join(
+        to_string(stats.nblocks), " blocks (", stats.profiled ? "profiled" : "static", "): ",
+        to_string(stats.nmoved), " moved, ",
+        to_string(stats.ncold), " cold, ",
+        to_string(stats.ninverted), " inverted, ",
+        to_string(stats.nbranches_added), " branches added, ",
+        to_string(stats.nbranches_removed), " removed");
+}
+
+layout_result layout_blocks(intermediate_program* ip, const edge_profile* p_profile, layout_stats* p_stats)
+{
+    layout_stats stats;
+    if (!p_stats)
+    {
+        p_stats = &stats;
+    }
+    *p_stats = layout_stats();
+    if (ip->size() == 0)
+    {
+        return layout_result::LAYOUT_OK;
+    }
+    if (p_profile && (p_profile->size() != ip->size() || p_profile->executed(0) == 0))
+    {
+        p_profile = nullptr;
+    }
+
+    internal::block_layout bl(ip, p_profile, p_stats);
+    if (bl.cfg.shared() || !bl.find_regions())
+    {
+        return layout_result::LAYOUT_SKIPPED;
+    }
+    p_stats->nblocks = bl.cfg.size();
+    p_stats->profiled = p_profile != nullptr;
+    bl.find_cold();
+    bl.place();
+    bl.emit();
+    return layout_result::LAYOUT_OK;
+}
+
+}
@@ -0,0 +1,81 @@
+#ifndef LU_LAYOUT_H
+#define LU_LAYOUT_H
+
+#include "intermediate.h"
+#include "string.h"
+#include "adt/vector.h"
+#include "internal/constexpr.h"
+
+#include <cstdint>
+
+namespace lu
+{
+
+// per address execution counts of one or more interpreter runs (see interpret_settings), can be accumulated
+// over runs of the same program.
+struct edge_profile
+{
+    // clears the counts if the program size changed
+    void resize(size_t ninsts);
+    // one executed intermediate
+    void count(intermediate_addr iaddr) { ++_executed[iaddr]; }
+    // one branch that jumped to its target
+    void count_taken(intermediate_addr iaddr) { ++_taken[iaddr]; }
+
+    size_t size() const { return _executed.size(); }
+    uint64_t executed(intermediate_addr iaddr) const { return _executed[iaddr]; }
+    uint64_t taken(intermediate_addr iaddr) const { return _taken[iaddr]; }
+    // total of taken branches, every one is a break in the fetched instruction stream
+    uint64_t taken_total() const;
+
+private:
+    vector<uint64_t> _executed;
+    vector<uint64_t> _taken;
+};
+
+struct layout_stats
+{
+    layout_stats() : nblocks(0), nmoved(0), ncold(0), ninverted(0), nbranches_added(0), nbranches_removed(0), profiled(false) {}
+
+    size_t nblocks;
+    size_t nmoved; // blocks no longer after their original predecessor in address order
+    size_t ncold; // blocks placed at the end
+    size_t ninverted; // conditional branches negated so the likely successor falls through
+    size_t nbranches_added; // unconditional branches for fall throughs that lost their successor
+    size_t nbranches_removed; // unconditional branches to the next block
+    bool profiled; // an edge profile decided the likely successors
+};
+
+string to_string(const layout_stats&);
+
+enum class layout_result
+{
+    LAYOUT_OK,
+    LAYOUT_SKIPPED, // program was left as is
+};
+
+LU_CONSTEXPR bool ok(layout_result lr)
+{
+    return lr == layout_result::LAYOUT_OK;
+}
+
+// reorders the blocks of each frame (see cfg.h) so the likely successor of every block is the next one, then
+// places cold blocks and blocks nothing reaches at the end of the frame's code.
+//
+// the likely successor of a conditional branch comes from the edge profile if it executed the branch, otherwise
+// it is predicted statically, first rule that applies:
+//   - the back edge of a loop is taken
+//   - an edge leaving the innermost loop is not taken
+//   - an edge to a cold block is not taken
+//   - the branch falls through
+// a block is cold if it contains ILLEGAL (an error path), or if the profile ran its frame but never the block.
+// chains of likely successors are placed starting at the frame entry. the code of each frame keeps its address
+// range, from its entry up to the next frame's, so the program still starts at address 0. branches are negated,
+// added and removed so every block keeps its successors, and addresses, branch offsets and frame entries are
+// renumbered. a profile of another program size is ignored. programs with code shared by frames, or that do not
+// start at a frame entry, are skipped.
+layout_result layout_blocks(intermediate_program*, const edge_profile* = nullptr, layout_stats* = nullptr);
+
+}
+
+#endif // LU_LAYOUT_H
@@ -0,0 +1,57 @@
+#include "lower.h"
+
+namespace lu
+{
+
+namespace internal
+{
+    bool istailreturn(const intermediate_call& call, const intermediate& next)
+    {
+        if (next.op() != intermediate::RETURN)
+        {
+            return false;
+        }
+        if (!next.ret.eval)
+        {
+            return !call.has_result();
+        }
+        const intermediate& eval = *next.ret.eval;
+        return call.has_result()
+            && eval.op() == intermediate::LOAD_SYMBOL
+            && eval.load.sid == call.result
+            && eval.load.slot == call.result_slot
+            && eval.load.reg == call.result_reg;
+    }
+}
+
+size_t lower_intrinsics(intermediate_program* ip)
+{
+    size_t nlowered = 0;
+    for (intermediate_addr iaddr = 0; iaddr < ip->size(); ++iaddr)
+    {
+        intermediate& i = (*ip)[iaddr];
+        if (i.op() == intermediate::INTRINSIC)
+        {
+            i = intermediate::create_typed_intrinsic(i.intr);
+            ++nlowered;
+        }
+    }
+    return nlowered;
+}
+
+size_t lower_tail_calls(intermediate_program* ip)
+{
+    size_t ntail = 0;
+    for (intermediate_addr iaddr = 0; iaddr + 1 < ip->size(); ++iaddr)
+    {
+        intermediate& i = (*ip)[iaddr];
+        if (i.op() == intermediate::CALL && internal::istailreturn(i.call, (*ip)[iaddr + 1]))
+        {
+            i = intermediate::create_tail_call(move(i.call));
+            ++ntail;
+        }
+    }
+    return ntail;
+}
+
+}
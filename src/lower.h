@@ -0,0 +1,24 @@
+#ifndef LU_LOWER_H
+#define LU_LOWER_H
+
+#include "intermediate.h"
+
+namespace lu
+{
+
+// rewrites every generic INTRINSIC into its typed opcode (see intermediate::_label_TYPED_INTRINSIC_FIRST),
+// so the interpreter dispatches straight to the operation instead of switching on the intrinsic code.
+// addresses do not change. returns the number of lowered intermediates.
+size_t lower_intrinsics(intermediate_program*);
+
+// rewrites every CALL in tail position, one immediately followed by a RETURN of exactly its result
+// (or of nothing, if the result is discarded), into a TAIL_CALL. a TAIL_CALL replaces the current frame
+// with the callee's and leaves the return address and result register as they are, so tail recursion
+// runs in constant stack depth. the RETURN is kept, addresses do not change. returns the number of tail calls.
+// tail calls are guaranteed at every level: run by the driver before its passes, by tiered_program and by
+// bytecode_load, on every program that can hold a CALL.
+size_t lower_tail_calls(intermediate_program*);
+
+}
+
+#endif // LU_LOWER_H
@@ -8,12 +8,31 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <cassert>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
 #include <set>
 
 #include "analyze.h"
 #include "intermediate.h"
 #include "interpreter.h"
+#include "sink.h"
+#include "fuse.h"
+#include "lower.h"
+#include "optimize.h"
+#include "layout.h"
+#include "inline.h"
+#include "jit.h"
+#include "tier.h"
+#include "compiler.h"
+#include "bytecode.h"
+#include "cache.h"
+#include "server.h"
+#include "batch.h"
+#include "timer.h"
 
 //#include "adt/internal/avl.h"
 #include "profile.h"
@@ -21,52 +40,418 @@
 #include "byte.h"
 #include "internal/debug.h"
 
-int main(int, char**)
+namespace
 {
+
+// digits only, at least 1 and at most INT_MAX
+bool positive_int(const char* p_text, int* p_value)
+{
+    if (*p_text < '0' || *p_text > '9')
+    {
+        return false;
+    }
+    char* p_end = nullptr;
+    errno = 0;
+    long value = std::strtol(p_text, &p_end, 10);
+    if (*p_end != '\0' || errno == ERANGE || value <= 0 || value > INT_MAX)
+    {
+        return false;
+    }
+    *p_value = static_cast<int>(value);
+    return true;
+}
+
+// front end and passes up to a runnable program, only the front end if tiered (see tier.h). returns the driver
+// exit code of the failing stage, or 0
+int compile(const lu::source* p_src, lu::optimize_level level, lu::intermediate_program* p_ip, lu::diag_logger* p_log, lu::optimize_stats* p_stats,
+    bool tiered = false)
+{
+    lu::parse_expr_tree pet;
+    if (!ok(lu::parse(p_src, &pet, p_log)))
+    {
+        p_log->flush();
+        std::cout << "PARSE_FAIL" << "\n";
+        return 1;
+    }
+
+    lu::analyze_expr_tree aet;
+    if (!ok(lu::analyze(&pet, &aet, p_log)))
+    {
+        p_log->flush();
+        std::cout << "ANALYZE_FAIL" << "\n";
+        return 2;
+    }
+
+    if (!ok(lu::intermediate_transform(&aet, p_ip, p_log)))
+    {
+        p_log->flush();
+        std::cout << "INTM_FAIL" << "\n";
+        return 3;
+    }
+    if (tiered)
+    {
+        return 0;
+    }
+
+    // tail calls are guaranteed at every level, not an optimization
+    lu::lower_tail_calls(p_ip);
+    lu::optimize_settings settings(level);
+    if (settings.inline_calls)
+    {
+        lu::inline_calls(p_ip);
+    }
+    lu::optimize(p_ip, settings, p_stats);
+    if (settings.layout)
+    {
+        lu::layout_blocks(p_ip);
+    }
+    lu::fuse(p_ip);
+    lu::lower_intrinsics(p_ip);
+    return 0;
+}
+
+// compiles at every level and runs each one, output is captured and must match the unoptimized run.
+// reports the intermediate count and the mean runtime per level
+int report_levels(const lu::source* p_src)
+{
+    const size_t NRUNS = 1000;
+    const lu::optimize_level levels[] = { lu::optimize_level::O0, lu::optimize_level::O1, lu::optimize_level::O2 };
+    lu::string expected;
+    for (lu::optimize_level level : levels)
+    {
+        lu::diag_logger log(lu::diag::ERROR_LEVEL);
+        lu::intermediate_program ip;
+        lu::optimize_stats stats;
+        int code = compile(p_src, level, &ip, &log, &stats);
+        if (code != 0)
+        {
+            return code;
+        }
+
+        lu::memory_sink out;
+        lu::stopwatch sw;
+        sw.start();
+        for (size_t k = 0; k < NRUNS; ++k)
+        {
+            lu::intermediate_interpreter_state iis;
+            iis.set_out(&out);
+            if (!ok(lu::interpret(&ip, &iis, 0, &log)))
+            {
+                log.flush();
+                std::cout << "INTR_FAIL" << "\n";
+                return 4;
+            }
+        }
+        double seconds = sw.lap().count();
+
+        lu::string output = out.str();
+        if (level == lu::optimize_level::O0)
+        {
+            expected = output;
+        }
+        else if (output != expected)
+        {
+            std::cout << "-" << lu::optimize_level_cstr(level) << " output differs from -O0" << "\n";
+            return 5;
+        }
+        std::cout << "-" << lu::optimize_level_cstr(level) << ": " << to_string(stats) << ", "
+            << seconds * 1000 / NRUNS << " ms/run" << "\n";
+    }
+    return 0;
+}
+
+// the --batch driver, see main
+int batch_main(const char* batch_path, const char* batch_out, lu::optimize_level level)
+{
+    lu::diag_logger log(lu::diag::WARN_LEVEL);
+    lu::vector<lu::string> paths;
+    if (!ok(lu::batch_paths(batch_path, &paths, &log)))
+    {
+        log.flush();
+        std::cout << "BATCH_FAIL" << "\n";
+        return 9;
+    }
+    lu::batch_settings settings;
+    settings.level = level;
+    lu::vector<lu::batch_script> scripts;
+    lu::batch_stats stats;
+    lu::run_batch(paths, settings, &scripts, &stats);
+
+    bool written = true;
+    for (const lu::batch_script& script : scripts)
+    {
+        if (!batch_out)
+        {
+            std::cout << "== " << script.path << "\n" << script.output;
+            if (script.diags.size() > 0)
+            {
+                std::cerr << "== " << script.path << "\n" << script.diags;
+            }
+            continue;
+        }
+        size_t name = script.path.size();
+        while (name > 0 && script.path[name - 1] != '/')
+        {
+            --name;
+        }
+        lu::string base = lu::string::join(batch_out, "/", lu::string_view(script.path).subview(name));
+        std::ofstream out(lu::string::join(base, ".out").buffer(), std::ios::binary);
+        std::ofstream err(lu::string::join(base, ".err").buffer(), std::ios::binary);
+        out.write(script.output.buffer(), static_cast<std::streamsize>(script.output.size()));
+        err.write(script.diags.buffer(), static_cast<std::streamsize>(script.diags.size()));
+        written = written && out && err;
+    }
+    std::cerr << to_string(stats) << "\n";
+    if (!written)
+    {
+        std::cerr << "cannot write the output to " << batch_out << "\n";
+    }
+    if (!written || stats.failures > 0)
+    {
+        std::cout << "BATCH_FAIL" << "\n";
+        return 9;
+    }
+    return 0;
+}
+
+}
+
+// main [-O0|-O1|-O2] [--opt-report] [--jit] [--tiered] [--aot exe] [--emit-luc out.luc] [--cache] [--cache-dir dir] [file],
+// main [-O0|-O1|-O2] --serve socket [--serve-root dir] [--serve-timeout ms]
+// main [-O0|-O1|-O2] --batch dir|manifest [--batch-out dir]
+// file defaults to test.lu.
+// --tiered ignores the level and reports the tier changes on stderr. --aot builds a native executable through C
+// (see compiler.h) instead of running the program, --emit-luc writes the compiled program (see bytecode.h).
+// a file ending in .luc is such a program, loaded instead of compiled. --cache looks the compiled program up in
+// the compile cache (see cache.h) before compiling, and reports hits and misses on stderr. --serve runs scripts sent
+// by lu_client over the socket at the level until one asks it to stop (see server.h). it reads PATH requests below
+// --serve-root (the working directory by default) and drops a client stalling longer than --serve-timeout ms. --batch
+// runs every script of a directory or manifest in this process (see batch.h), each one's output goes to stdout after
+// a "== path" line, or to dir/name.out with --batch-out, its diagnostics likewise to stderr or dir/name.err. a summary
+// ends on stderr
+int main(int argc, char** argv)
+{
+    lu::optimize_level level = lu::optimize_level::O0;
+    bool opt_report = false;
+    bool jit = false;
+    bool tiered = false;
+    const char* aot_path = nullptr;
+    const char* luc_path = nullptr;
+    bool use_cache = false;
+    lu::cache_settings cache_settings;
+    const char* serve_path = nullptr;
+    lu::server_settings serve_settings;
+    const char* batch_path = nullptr;
+    const char* batch_out = nullptr;
+    const char* path = "test.lu";
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-O0") == 0)
+        {
+            level = lu::optimize_level::O0;
+        }
+        else if (std::strcmp(argv[i], "-O1") == 0)
+        {
+            level = lu::optimize_level::O1;
+        }
+        else if (std::strcmp(argv[i], "-O2") == 0)
+        {
+            level = lu::optimize_level::O2;
+        }
+        else if (std::strcmp(argv[i], "--opt-report") == 0)
+        {
+            opt_report = true;
+        }
+        else if (std::strcmp(argv[i], "--jit") == 0)
+        {
+            jit = true;
+        }
+        else if (std::strcmp(argv[i], "--tiered") == 0)
+        {
+            tiered = true;
+        }
+        else if (std::strcmp(argv[i], "--aot") == 0 && i + 1 < argc)
+        {
+            aot_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--emit-luc") == 0 && i + 1 < argc)
+        {
+            luc_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--cache") == 0)
+        {
+            use_cache = true;
+        }
+        else if (std::strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc)
+        {
+            use_cache = true;
+            cache_settings.dir = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+        {
+            serve_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--serve-root") == 0 && i + 1 < argc)
+        {
+            serve_settings.root = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--serve-timeout") == 0 && i + 1 < argc)
+        {
+            if (!positive_int(argv[++i], &serve_settings.timeout_ms))
+            {
+                std::cerr << "--serve-timeout takes a positive number of milliseconds, not " << argv[i] << "\n";
+                std::cout << "SERVE_FAIL" << "\n";
+                return 8;
+            }
+        }
+        else if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            batch_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--batch-out") == 0 && i + 1 < argc)
+        {
+            batch_out = argv[++i];
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    if (serve_path)
+    {
+        serve_settings.socket_path = serve_path;
+        serve_settings.level = level;
+        lu::diag_logger log(lu::diag::WARN_LEVEL);
+        lu::server_stats stats;
+        lu::server_result res = lu::serve(serve_settings, &log, &stats);
+        log.flush();
+        std::cerr << to_string(stats) << "\n";
+        if (!ok(res))
+        {
+            std::cout << "SERVE_FAIL" << "\n";
+            return 8;
+        }
+        return 0;
+    }
+
+    if (batch_path)
+    {
+        return batch_main(batch_path, batch_out, level);
+    }
+
     //lu::source src = lu::source::from_string("abc", "a: int32 = 3; $i32print (a), 123.99, \"abc\"\n(a, b) = (2, 3); $haha(me)");//"a = 3; 123.0; \"abc\"\n\nf: int -> (int = 0, s: int = 3, (int) = 7) = a -> (a, a, void); g: (X -> Y, A) -> B -> (C -> D) -> E\ne: () = ()\nxy: (x: int, y: int) #todo try defaulting values\na: int\n(b: float, c) <- (d, x) <- (1, 0); x, y = a, b = c = 4, d <- 6");//"x: int, y := 3, 2.0\n\n(x, y) <- (2, 3.0)\n(a,\nb\n); + a = 4; int(0, int(2.0, (), (2, 3), {})); ??? 234.0; 3331239(234); { {}\n{ (abc)(1); { def(); }\n }\n br @here\n { a; b; }; ret  \n br 3; }; br @there COND; ret @other\n\n ret @func expr \"a string that doesn't end { a = x; }");
-    std::ifstream file("test.lu");
-    lu::source src = lu::source::from_stream("test.lu", file);
+    size_t path_len = std::strlen(path);
+    bool luc = path_len >= 4 && std::strcmp(path + path_len - 4, ".luc") == 0;
+    std::ifstream file;
+    if (!luc)
+    {
+        file.open(path);
+    }
+    lu::source src = lu::source::from_stream(path, file);
     //std::cout << src2.size() << "\n" << lu::to_string(456).size() << lu::to_string(456).append("123") << "\n";
 
     try
     {
+        if (opt_report)
+        {
+            int code = report_levels(&src);
+            if (code != 0)
+            {
+                return code;
+            }
+        }
+
         lu::diag_logger log(lu::diag::DEBUG_LEVEL);
-        lu::parse_expr_tree pet;
-        if (!ok(lu::parse(&src, &pet, &log)))
+        lu::intermediate_program ip;
+        if (luc)
         {
-            log.flush();
-            std::cout << "PARSE_FAIL" << "\n";
-            return 1;
+            // compiled already, as it was written
+            lu::bytecode_image image;
+            if (!ok(lu::bytecode_map(path, &image, &log)) || !ok(lu::bytecode_load(image, &ip, &log)))
+            {
+                log.flush();
+                std::cout << "LUC_FAIL" << "\n";
+                return 7;
+            }
+        }
+        else if (use_cache)
+        {
+            lu::compile_cache cache(cache_settings);
+            uint64_t key = lu::cache_key(src.read(0), lu::string::join("-", lu::optimize_level_cstr(level), tiered ? " --tiered" : ""));
+            if (!cache.lookup(key, &ip, &log))
+            {
+                int code = compile(&src, level, &ip, &log, nullptr, tiered);
+                if (code != 0)
+                {
+                    return code;
+                }
+                cache.store(key, &ip, &log);
+            }
+            std::cerr << to_string(cache.stats()) << "\n";
+        }
+        else
+        {
+            int code = compile(&src, level, &ip, &log, nullptr, tiered);
+            if (code != 0)
+            {
+                return code;
+            }
         }
 
-        // TODO temp test
-        // int x = 1234;
-        // int y = 8642;
-        // lu::intrinsics::i32add(&x, &y);
-        // lu::intrinsics::i32print(nullptr, &x);
+        log.flush();
 
-        lu::analyze_expr_tree aet;
-        if (!ok(lu::analyze(&pet, &aet, &log)))
+        if (luc_path)
         {
-            log.flush();
-            std::cout << "ANALYZE_FAIL" << "\n";
-            return 2;
+            if (!ok(lu::bytecode_save(&ip, luc_path, &log)))
+            {
+                log.flush();
+                std::cout << "LUC_FAIL" << "\n";
+                return 7;
+            }
+            return 0;
         }
 
-        lu::intermediate_program ip;
-        if (!ok(lu::intermediate_transform(&aet, &ip, &log)))
+        if (aot_path)
         {
-            log.flush();
-            std::cout << "INTM_FAIL" << "\n";
-            return 3;
+            if (!ok(lu::compile_native(&ip, aot_path, &log)))
+            {
+                log.flush();
+                std::cout << "AOT_FAIL" << "\n";
+                return 6;
+            }
+            return 0;
         }
 
-        log.flush();
-
         std::cout << ">>\n";
-
+        // the program's output goes straight to stdout, after what is buffered for it
+        std::cout.flush();
+        lu::fd_sink out;
         lu::intermediate_interpreter_state iis;
-        if (!ok(lu::interpret(&ip, &iis, 0, &log)))
+        iis.set_out(&out);
+        lu::interpret_result res;
+        if (tiered)
+        {
+            lu::tiered_program tp(lu::move(ip));
+            lu::tier_stats stats;
+            res = lu::tiered_run(&tp, &iis, &log, &stats);
+            std::cerr << to_string(stats) << "\n";
+        }
+        else if (jit)
+        {
+            lu::jit_code code;
+            if (!ok(lu::jit_compile(&ip, &code)))
+            {
+                std::cerr << "jit not supported here, interpreting" << "\n";
+            }
+            res = lu::jit_run(&code, &iis, 0, &log);
+        }
+        else
+        {
+            res = lu::interpret(&ip, &iis, 0, &log);
+        }
+        out.flush();
+        if (!ok(res))
         {
             log.flush();
             std::cout << "INTR_FAIL" << "\n";
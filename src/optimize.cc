@@ -0,0 +1,1131 @@
+#include "optimize.h"
+
+#include "cfg.h"
+#include "intrinsic.h"
+#include "utility.h"
+#include "internal/debug.h"
+
+#include <limits>
+
+namespace lu
+{
+
+namespace internal
+{
+    using ssa_value_id = size_t;
+
+    LU_CONSTEXPR ssa_value_id NO_VALUE = std::numeric_limits<ssa_value_id>::max();
+
+    // sparse conditional constant propagation lattice: UNKNOWN (no executable definition yet) above CONSTANT above VARYING
+    struct lattice
+    {
+        enum lattice_kind
+        {
+            UNKNOWN,
+            CONSTANT,
+            VARYING,
+        };
+
+        lattice() : kind(UNKNOWN), idx(0) { bits.bits = 0; }
+
+        static lattice varying()
+        {
+            lattice l;
+            l.kind = VARYING;
+            return l;
+        }
+
+        static lattice scalar(scalar_value bits)
+        {
+            lattice l;
+            l.kind = CONSTANT;
+            l.bits = bits;
+            return l;
+        }
+
+        static lattice aggregate(intermediate_constant idx)
+        {
+            lattice l;
+            l.kind = CONSTANT;
+            l.idx = idx;
+            return l;
+        }
+
+        bool operator==(const lattice& other) const { return kind == other.kind && bits.bits == other.bits.bits && idx == other.idx; }
+        bool operator!=(const lattice& other) const { return !(*this == other); }
+
+        lattice meet(const lattice& other) const
+        {
+            if (kind == UNKNOWN)
+            {
+                return other;
+            }
+            if (other.kind == UNKNOWN || *this == other)
+            {
+                return *this;
+            }
+            return varying();
+        }
+
+        lattice_kind kind;
+        scalar_value bits; // constant of a scalar register
+        intermediate_constant idx; // constant of an aggregate register
+    };
+
+    struct ssa_value
+    {
+        enum ssa_kind
+        {
+            ENTRY, // whatever the register holds when the frame is entered
+            DEF,
+            PHI,
+        };
+
+        ssa_value(ssa_kind kind, size_t var, symbol_id sid, intermediate_slot slot, intermediate_register reg, cfg_block_id block, intermediate_addr iaddr)
+            : kind(kind), var(var), sid(sid), slot(slot), reg(reg), block(block), iaddr(iaddr), copy_of(NO_VALUE), live(false) {}
+
+        ssa_kind kind;
+        size_t var; // of the frame it was made in
+        symbol_id sid; // of the variable, kept once the next frame is converted
+        intermediate_slot slot;
+        intermediate_register reg;
+        cfg_block_id block;
+        intermediate_addr iaddr; // of a DEF
+        vector<ssa_value_id> args; // of a PHI, one per predecessor of the block
+        ssa_value_id copy_of; // a DEF storing another value of the same bank and type, NO_VALUE otherwise
+        lattice lat;
+        bool live;
+        vector<intermediate_addr> inst_users;
+        vector<ssa_value_id> phi_users;
+    };
+
+    // a register read by an intermediate
+    struct use_site
+    {
+        enum use_kind
+        {
+            LOAD,
+            INTRINSIC_DEST, // read and written in place, so never replaced
+            INTRINSIC_OP,
+        };
+
+        use_site(use_kind kind, intermediate* p_i, bool aggregate_consumer) : kind(kind), p_i(p_i), aggregate_consumer(aggregate_consumer) {}
+
+        intermediate_slot slot() const { return kind == LOAD ? p_i->load.slot : intermediate_slot::SCALAR; }
+        intermediate_register reg() const
+        {
+            switch (kind)
+            {
+            case LOAD:
+                return p_i->load.reg;
+            case INTRINSIC_DEST:
+                return p_i->intr.dest_reg;
+            default:
+                return p_i->intr.op_reg;
+            }
+        }
+
+        use_kind kind;
+        intermediate* p_i; // the LOAD_SYMBOL, or the intrinsic
+        bool aggregate_consumer; // the load is evaluated into an aggregate, which any constant can be
+    };
+
+    enum class branch_state
+    {
+        UNKNOWN,
+        TAKEN,
+        NOT_TAKEN,
+        BOTH,
+    };
+
+    bool isintrinsic(intermediate::intermediate_op op)
+    {
+        return op == intermediate::INTRINSIC || istypedintrinsic(op);
+    }
+
+    bool isfused(intermediate::intermediate_op op)
+    {
+        return op == intermediate::STORE_CONSTANT || op == intermediate::STORE_COPY || op == intermediate::INTRINSIC_PAIR || op == intermediate::INTRINSIC_TRIPLE;
+    }
+
+    // only writes its dest
+    bool ispure(const intermediate_intrinsic& intr)
+    {
+        if (intr.dest == symbol::INVALID_ID)
+        {
+            return false;
+        }
+        switch (intr.icode)
+        {
+        case I32ADD:
+        case I64ADD:
+        case U32ADD:
+        case U64ADD:
+        case LNEG:
+        case LAND:
+        case LOR:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // same arithmetic as the interpreter, dest is updated in place so its unused upper bits are kept
+    scalar_value fold(intrinsic_code icode, scalar_value dest, scalar_value op)
+    {
+        scalar_value r = dest;
+        switch (icode)
+        {
+        case I32ADD:
+        case U32ADD:
+            r.u32 = dest.u32 + op.u32;
+            break;
+        case I64ADD:
+        case U64ADD:
+            r.u64 = dest.u64 + op.u64;
+            break;
+        case LNEG:
+            r.b = !dest.b;
+            break;
+        case LAND:
+            r.b = dest.b && op.b;
+            break;
+        case LOR:
+            r.b = dest.b || op.b;
+            break;
+        default:
+            throw internal_except_unhandled_switch(intrinsic_code_cstr(icode));
+        }
+        return r;
+    }
+
+    // a store, or an intrinsic that only writes its dest, can be removed if nothing reads what it writes
+    bool isremovable(const intermediate& i)
+    {
+        return i.op() == intermediate::STORE_SYMBOL || (isintrinsic(i.op()) && ispure(i.intr));
+    }
+
+    void collect_eval_uses(intermediate& eval, bool aggregate_consumer, vector<use_site>* p_sites)
+    {
+        switch (eval.op())
+        {
+        case intermediate::LOAD_SYMBOL:
+            p_sites->push_back(use_site(use_site::LOAD, &eval, aggregate_consumer));
+            break;
+        case intermediate::TUPLE:
+            for (size_t k = 0; k < eval.tup.subs.size(); ++k)
+            {
+                collect_eval_uses(eval.tup.subs[k], true, p_sites);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // registers read by i, always in the same order
+    void collect_uses(intermediate& i, vector<use_site>* p_sites)
+    {
+        p_sites->clear();
+        switch (i.op())
+        {
+        case intermediate::STORE_SYMBOL:
+            collect_eval_uses(*i.store.eval, i.store.slot == intermediate_slot::AGGREGATE, p_sites);
+            break;
+        case intermediate::CALL:
+        case intermediate::TAIL_CALL:
+            // args store into the callee frame, but are evaluated in this one
+            for (size_t k = 0; k < i.call.args.size(); ++k)
+            {
+                collect_eval_uses(*i.call.args[k].store.eval, i.call.args[k].store.slot == intermediate_slot::AGGREGATE, p_sites);
+            }
+            break;
+        case intermediate::RETURN:
+            if (i.ret.eval)
+            {
+                collect_eval_uses(*i.ret.eval, false, p_sites);
+            }
+            break;
+        case intermediate::BRANCH:
+            if (i.br.condition)
+            {
+                collect_eval_uses(*i.br.condition, false, p_sites);
+            }
+            break;
+        default:
+            if (isintrinsic(i.op()))
+            {
+                if (i.intr.dest != symbol::INVALID_ID)
+                {
+                    p_sites->push_back(use_site(use_site::INTRINSIC_DEST, &i, false));
+                }
+                if (!i.intr.op_imm && i.intr.op != symbol::INVALID_ID)
+                {
+                    p_sites->push_back(use_site(use_site::INTRINSIC_OP, &i, false));
+                }
+            }
+            break;
+        }
+    }
+
+    // register written by i in its own frame, if any
+    bool find_def(const intermediate& i, symbol_id* p_sid, intermediate_slot* p_slot, intermediate_register* p_reg)
+    {
+        if (i.op() == intermediate::STORE_SYMBOL)
+        {
+            *p_sid = i.store.sid;
+            *p_slot = i.store.slot;
+            *p_reg = i.store.reg;
+            return true;
+        }
+        if (isintrinsic(i.op()) && i.intr.dest != symbol::INVALID_ID)
+        {
+            *p_sid = i.intr.dest;
+            *p_slot = intermediate_slot::SCALAR;
+            *p_reg = i.intr.dest_reg;
+            return true;
+        }
+        if (i.op() == intermediate::CALL && i.call.has_result())
+        {
+            *p_sid = i.call.result;
+            *p_slot = i.call.result_slot;
+            *p_reg = i.call.result_reg;
+            return true;
+        }
+        return false;
+    }
+
+    struct optimizer
+    {
+        optimizer(intermediate_program* ip, const optimize_settings& settings, optimize_stats* p_stats, vector<intermediate_addr>* p_remap)
+            : p_ip(ip), settings(settings), p_stats(p_stats), p_remap(p_remap), cfg(*ip), uses(ip->size()), defs(ip->size(), NO_VALUE),
+            branches(ip->size(), branch_state::UNKNOWN), removed(ip->size(), false), live(ip->size(), false),
+            phis(cfg.size()), executable(cfg.size(), false), edges(cfg.size())
+        {
+            for (cfg_block_id b = 0; b < cfg.size(); ++b)
+            {
+                edges[b].assign(cfg[b].preds.size(), false);
+            }
+        }
+
+        intermediate_program* p_ip;
+        const optimize_settings& settings;
+        optimize_stats* p_stats;
+        vector<intermediate_addr>* p_remap; // input address to output address, if asked for
+        control_flow_graph cfg;
+
+        vector<ssa_value> values;
+        vector<vector<ssa_value_id>> uses; // per address, the value read by each use site
+        vector<ssa_value_id> defs; // per address
+        vector<branch_state> branches; // per address
+        vector<bool> removed; // per address
+        vector<bool> live; // per address
+        vector<vector<ssa_value_id>> phis; // per block
+        vector<bool> executable; // per block
+        vector<vector<bool>> edges; // per block, executable edge from each predecessor
+
+        // frame being converted to ssa, variables are the scalar registers then the aggregate ones
+        size_t nscalars;
+        vector<vector<ssa_value_id>> stacks; // per variable, current value while renaming
+        vector<symbol_id> var_sids; // per variable
+        vector<vector<cfg_block_id>> children; // dominator tree
+
+        vector<cfg_block_id> block_work;
+        vector<ssa_value_id> value_work;
+
+        size_t var(intermediate_slot slot, intermediate_register reg) const
+        {
+            return slot == intermediate_slot::SCALAR ? reg : nscalars + reg;
+        }
+
+        intermediate_slot var_slot(size_t v) const
+        {
+            return v < nscalars ? intermediate_slot::SCALAR : intermediate_slot::AGGREGATE;
+        }
+
+        intermediate_register var_reg(size_t v) const
+        {
+            return v < nscalars ? v : v - nscalars;
+        }
+
+        ssa_value_id make_value(ssa_value::ssa_kind kind, size_t v, cfg_block_id block, intermediate_addr iaddr)
+        {
+            values.push_back(ssa_value(kind, v, var_sids[v], var_slot(v), var_reg(v), block, iaddr));
+            return values.size() - 1;
+        }
+
+        ssa_value_id top(size_t v) const
+        {
+            return stacks[v].back();
+        }
+
+        // the oldest value of the copy chain whose register still holds it
+        ssa_value_id resolve_copy(ssa_value_id id) const
+        {
+            ssa_value_id best = id;
+            while (values[id].copy_of != NO_VALUE)
+            {
+                id = values[id].copy_of;
+                if (top(values[id].var) == id)
+                {
+                    best = id;
+                }
+            }
+            return best;
+        }
+
+        void build_ssa(intermediate_frame_id fid)
+        {
+            const intermediate_frame& f = p_ip->frame(fid);
+            const vector<cfg_block_id>& rpo = cfg.rpo(fid);
+            nscalars = f.nscalars;
+            size_t nvars = f.nscalars + f.naggregates;
+            var_sids.assign(nvars, symbol_id(symbol::INVALID_ID));
+            stacks.assign(nvars, vector<ssa_value_id>());
+            children.assign(cfg.size(), vector<cfg_block_id>());
+
+            vector<use_site> sites;
+            vector<vector<cfg_block_id>> def_blocks(nvars);
+            for (cfg_block_id b : rpo)
+            {
+                if (cfg[b].idom != b)
+                {
+                    children[cfg[b].idom].push_back(b);
+                }
+                for (intermediate_addr iaddr = cfg[b].first; iaddr < cfg[b].end; ++iaddr)
+                {
+                    intermediate& i = (*p_ip)[iaddr];
+                    collect_uses(i, &sites);
+                    for (const use_site& s : sites)
+                    {
+                        var_sids[var(s.slot(), s.reg())] = s.kind == use_site::LOAD ? s.p_i->load.sid : s.kind == use_site::INTRINSIC_DEST ? i.intr.dest : i.intr.op;
+                    }
+                    symbol_id sid;
+                    intermediate_slot slot;
+                    intermediate_register reg;
+                    if (find_def(i, &sid, &slot, &reg))
+                    {
+                        var_sids[var(slot, reg)] = sid;
+                        def_blocks[var(slot, reg)].push_back(b);
+                    }
+                }
+            }
+
+            // dominance frontiers
+            vector<vector<cfg_block_id>> frontiers(cfg.size());
+            for (cfg_block_id b : rpo)
+            {
+                if (cfg[b].preds.size() < 2)
+                {
+                    continue;
+                }
+                for (cfg_block_id pred : cfg[b].preds)
+                {
+                    if (!cfg.reachable(pred) || cfg[pred].fid != fid)
+                    {
+                        continue;
+                    }
+                    cfg_block_id runner = pred;
+                    while (runner != cfg[b].idom)
+                    {
+                        if (frontiers[runner].empty() || frontiers[runner].back() != b)
+                        {
+                            frontiers[runner].push_back(b);
+                        }
+                        runner = cfg[runner].idom;
+                    }
+                }
+            }
+
+            // phis at the iterated frontiers of the definitions, the entry defines every variable
+            cfg_block_id entry = cfg.entry(fid);
+            vector<size_t> has_phi(cfg.size(), 0); // last variable + 1 with a phi here
+            vector<size_t> queued(cfg.size(), 0);
+            for (size_t v = 0; v < nvars; ++v)
+            {
+                vector<cfg_block_id> work(def_blocks[v]);
+                work.push_back(entry);
+                for (cfg_block_id b : work)
+                {
+                    queued[b] = v + 1;
+                }
+                while (!work.empty())
+                {
+                    cfg_block_id b = work.back();
+                    work.pop_back();
+                    for (cfg_block_id d : frontiers[b])
+                    {
+                        if (has_phi[d] == v + 1)
+                        {
+                            continue;
+                        }
+                        has_phi[d] = v + 1;
+                        ssa_value_id phi = make_value(ssa_value::PHI, v, d, 0);
+                        values[phi].args.assign(cfg[d].preds.size(), NO_VALUE);
+                        phis[d].push_back(phi);
+                        if (queued[d] != v + 1)
+                        {
+                            queued[d] = v + 1;
+                            work.push_back(d);
+                        }
+                    }
+                }
+                ssa_value_id in = make_value(ssa_value::ENTRY, v, entry, 0);
+                values[in].lat = lattice::varying();
+                stacks[v].push_back(in);
+            }
+
+            rename(entry);
+        }
+
+        void rename(cfg_block_id b)
+        {
+            vector<size_t> pushed;
+            for (ssa_value_id phi : phis[b])
+            {
+                stacks[values[phi].var].push_back(phi);
+                pushed.push_back(values[phi].var);
+            }
+
+            vector<use_site> sites;
+            for (intermediate_addr iaddr = cfg[b].first; iaddr < cfg[b].end; ++iaddr)
+            {
+                intermediate& i = (*p_ip)[iaddr];
+                collect_uses(i, &sites);
+                uses[iaddr].clear();
+                for (const use_site& s : sites)
+                {
+                    ssa_value_id id = top(var(s.slot(), s.reg()));
+                    uses[iaddr].push_back(s.kind == use_site::INTRINSIC_DEST ? id : resolve_copy(id));
+                }
+
+                symbol_id sid;
+                intermediate_slot slot;
+                intermediate_register reg;
+                if (find_def(i, &sid, &slot, &reg))
+                {
+                    size_t v = var(slot, reg);
+                    ssa_value_id def = make_value(ssa_value::DEF, v, b, iaddr);
+                    if (i.op() == intermediate::STORE_SYMBOL && i.store.eval->op() == intermediate::LOAD_SYMBOL
+                        && i.store.eval->load.slot == slot && i.store.eval->load.tid == p_ip->context().symbols()[sid].tid)
+                    {
+                        values[def].copy_of = uses[iaddr][0];
+                    }
+                    defs[iaddr] = def;
+                    stacks[v].push_back(def);
+                    pushed.push_back(v);
+                }
+            }
+
+            for (cfg_block_id succ : cfg[b].succs)
+            {
+                for (size_t k = 0; k < cfg[succ].preds.size(); ++k)
+                {
+                    if (cfg[succ].preds[k] != b)
+                    {
+                        continue;
+                    }
+                    for (ssa_value_id phi : phis[succ])
+                    {
+                        values[phi].args[k] = top(values[phi].var);
+                    }
+                }
+            }
+
+            for (cfg_block_id child : children[b])
+            {
+                rename(child);
+            }
+
+            for (size_t v : pushed)
+            {
+                stacks[v].pop_back();
+            }
+        }
+
+        void link_users(intermediate_frame_id fid)
+        {
+            for (cfg_block_id b : cfg.rpo(fid))
+            {
+                for (intermediate_addr iaddr = cfg[b].first; iaddr < cfg[b].end; ++iaddr)
+                {
+                    for (ssa_value_id id : uses[iaddr])
+                    {
+                        values[id].inst_users.push_back(iaddr);
+                    }
+                }
+                for (ssa_value_id phi : phis[b])
+                {
+                    for (ssa_value_id arg : values[phi].args)
+                    {
+                        if (arg != NO_VALUE)
+                        {
+                            values[arg].phi_users.push_back(phi);
+                        }
+                    }
+                }
+            }
+        }
+
+        void update(ssa_value_id id, const lattice& l)
+        {
+            lattice merged = values[id].lat.meet(l);
+            if (merged != values[id].lat)
+            {
+                values[id].lat = merged;
+                value_work.push_back(id);
+            }
+        }
+
+        void add_edge(cfg_block_id from, cfg_block_id to)
+        {
+            bool added = false;
+            for (size_t k = 0; k < cfg[to].preds.size(); ++k)
+            {
+                if (cfg[to].preds[k] == from && !edges[to][k])
+                {
+                    edges[to][k] = true;
+                    added = true;
+                }
+            }
+            if (added)
+            {
+                block_work.push_back(to);
+            }
+        }
+
+        lattice evaluate(intermediate_addr iaddr) const
+        {
+            const intermediate& i = (*p_ip)[iaddr];
+            if (!settings.propagate || i.op() == intermediate::CALL)
+            {
+                return lattice::varying();
+            }
+            if (i.op() == intermediate::STORE_SYMBOL)
+            {
+                const intermediate& eval = *i.store.eval;
+                if (eval.op() == intermediate::LOAD_CONSTANT)
+                {
+                    return i.store.slot == intermediate_slot::SCALAR ? lattice::scalar(eval.imm.bits) : lattice::aggregate(eval.imm.idx);
+                }
+                if (eval.op() == intermediate::LOAD_SYMBOL && eval.load.slot == i.store.slot)
+                {
+                    return values[uses[iaddr][0]].lat;
+                }
+                return lattice::varying();
+            }
+            if (!ispure(i.intr))
+            {
+                return lattice::varying();
+            }
+            const lattice& dest = values[uses[iaddr][0]].lat;
+            lattice op = lattice::scalar(i.intr.imm);
+            if (!i.intr.op_imm && i.intr.op != symbol::INVALID_ID)
+            {
+                op = values[uses[iaddr][1]].lat;
+            }
+            if (dest.kind == lattice::UNKNOWN || op.kind == lattice::UNKNOWN)
+            {
+                return lattice();
+            }
+            if (dest.kind == lattice::CONSTANT && op.kind == lattice::CONSTANT)
+            {
+                return lattice::scalar(fold(i.intr.icode, dest.bits, op.bits));
+            }
+            return lattice::varying();
+        }
+
+        lattice evaluate_condition(intermediate_addr iaddr) const
+        {
+            const intermediate& cond = *(*p_ip)[iaddr].br.condition;
+            if (!settings.propagate)
+            {
+                return lattice::varying();
+            }
+            if (cond.op() == intermediate::LOAD_CONSTANT)
+            {
+                return lattice::scalar(cond.imm.bits);
+            }
+            if (cond.op() == intermediate::LOAD_SYMBOL && cond.load.slot == intermediate_slot::SCALAR)
+            {
+                return values[uses[iaddr][0]].lat;
+            }
+            return lattice::varying();
+        }
+
+        void visit_branch(intermediate_addr iaddr)
+        {
+            const intermediate_branch& br = (*p_ip)[iaddr].br;
+            branch_state state = branch_state::TAKEN;
+            if (br.condition)
+            {
+                lattice cond = evaluate_condition(iaddr);
+                switch (cond.kind)
+                {
+                case lattice::UNKNOWN:
+                    return;
+                case lattice::CONSTANT:
+                    state = (cond.bits.bits != 0) != br.negated ? branch_state::TAKEN : branch_state::NOT_TAKEN;
+                    break;
+                default:
+                    state = branch_state::BOTH;
+                    break;
+                }
+            }
+            if (branches[iaddr] != branch_state::UNKNOWN && branches[iaddr] != state)
+            {
+                state = branch_state::BOTH;
+            }
+            branches[iaddr] = state;
+
+            cfg_block_id b = cfg.block_of(iaddr);
+            if (state != branch_state::NOT_TAKEN && br.target() < p_ip->size())
+            {
+                add_edge(b, cfg.block_of(br.target()));
+            }
+            if (state != branch_state::TAKEN && iaddr + 1 < p_ip->size())
+            {
+                add_edge(b, cfg.block_of(iaddr + 1));
+            }
+        }
+
+        void visit(intermediate_addr iaddr)
+        {
+            if (defs[iaddr] != NO_VALUE)
+            {
+                update(defs[iaddr], evaluate(iaddr));
+            }
+            if ((*p_ip)[iaddr].op() == intermediate::BRANCH)
+            {
+                visit_branch(iaddr);
+            }
+        }
+
+        void visit_phi(ssa_value_id phi)
+        {
+            const ssa_value& val = values[phi];
+            lattice l;
+            for (size_t k = 0; k < val.args.size(); ++k)
+            {
+                if (edges[val.block][k])
+                {
+                    l = l.meet(settings.propagate ? values[val.args[k]].lat : lattice::varying());
+                }
+            }
+            update(phi, l);
+        }
+
+        void visit_block(cfg_block_id b)
+        {
+            for (ssa_value_id phi : phis[b])
+            {
+                visit_phi(phi);
+            }
+            if (executable[b])
+            {
+                return;
+            }
+            executable[b] = true;
+            for (intermediate_addr iaddr = cfg[b].first; iaddr < cfg[b].end; ++iaddr)
+            {
+                visit(iaddr);
+            }
+            if ((*p_ip)[cfg[b].last()].op() != intermediate::BRANCH)
+            {
+                for (cfg_block_id succ : cfg[b].succs)
+                {
+                    add_edge(b, succ);
+                }
+            }
+        }
+
+        void propagate()
+        {
+            for (intermediate_frame_id fid = 0; fid < p_ip->frame_count(); ++fid)
+            {
+                if (cfg.entry(fid) != control_flow_graph::NONE)
+                {
+                    block_work.push_back(cfg.entry(fid));
+                }
+            }
+            while (!block_work.empty() || !value_work.empty())
+            {
+                if (!block_work.empty())
+                {
+                    cfg_block_id b = block_work.back();
+                    block_work.pop_back();
+                    visit_block(b);
+                    continue;
+                }
+                ssa_value_id id = value_work.back();
+                value_work.pop_back();
+                for (intermediate_addr iaddr : values[id].inst_users)
+                {
+                    if (executable[cfg.block_of(iaddr)])
+                    {
+                        visit(iaddr);
+                    }
+                }
+                for (ssa_value_id phi : values[id].phi_users)
+                {
+                    if (executable[values[phi].block])
+                    {
+                        visit_phi(phi);
+                    }
+                }
+            }
+        }
+
+        intermediate make_scalar_constant(type_id tid, scalar_value bits)
+        {
+            intermediate_value val(tid);
+            set_scalar(&val.bin, bits);
+            return p_ip->make_load_constant(move(val));
+        }
+
+        bool substitutable(const use_site& s, const lattice& l) const
+        {
+            if (l.kind != lattice::CONSTANT || s.kind == use_site::INTRINSIC_DEST)
+            {
+                return false;
+            }
+            // an aggregate constant is only read as a scalar if it is a builtin
+            return s.slot() == intermediate_slot::SCALAR || s.aggregate_consumer || p_ip->constants()[l.idx].tid().is(BUILTIN);
+        }
+
+        // replaces reads of constants and copies in the intermediate at iaddr, keeps the values still read in uses
+        void rewrite(intermediate_addr iaddr)
+        {
+            intermediate& i = (*p_ip)[iaddr];
+            if (isintrinsic(i.op()) && defs[iaddr] != NO_VALUE && values[defs[iaddr]].lat.kind == lattice::CONSTANT)
+            {
+                const symbol& dest = p_ip->context().symbols()[i.intr.dest];
+                intermediate_register dest_reg = i.intr.dest_reg;
+                i = intermediate::emplace_store_symbol(i.intr.dest, intermediate_slot::SCALAR, dest_reg, make_unique(new intermediate(make_scalar_constant(dest.tid, values[defs[iaddr]].lat.bits))));
+                uses[iaddr].clear();
+                ++p_stats->nfolded;
+                return;
+            }
+            if (i.op() == intermediate::BRANCH && (branches[iaddr] == branch_state::TAKEN || branches[iaddr] == branch_state::NOT_TAKEN))
+            {
+                if (branches[iaddr] == branch_state::TAKEN)
+                {
+                    i.br.condition = nullptr;
+                    i.br.negated = false;
+                }
+                else
+                {
+                    removed[iaddr] = true;
+                }
+                uses[iaddr].clear();
+                return;
+            }
+
+            vector<use_site> sites;
+            collect_uses(i, &sites);
+            vector<ssa_value_id> remaining;
+            bool to_imm = false;
+            for (size_t k = 0; k < sites.size(); ++k)
+            {
+                const use_site& s = sites[k];
+                const ssa_value& val = values[uses[iaddr][k]];
+                if (substitutable(s, val.lat))
+                {
+                    if (s.kind == use_site::LOAD)
+                    {
+                        *s.p_i = s.slot() == intermediate_slot::SCALAR
+                            ? make_scalar_constant(s.p_i->load.tid, val.lat.bits)
+                            : intermediate::emplace_load_constant(val.lat.idx, p_ip->constants()[val.lat.idx].tid().is(BUILTIN) ? to_scalar(p_ip->constants()[val.lat.idx].bin) : scalar_value());
+                    }
+                    else
+                    {
+                        i.intr.op = symbol::INVALID_ID;
+                        i.intr.op_reg = 0;
+                        i.intr.op_imm = true;
+                        i.intr.imm = val.lat.bits;
+                        to_imm = true;
+                    }
+                    ++p_stats->nconstants;
+                    continue;
+                }
+                if (val.slot != s.slot() || val.reg != s.reg())
+                {
+                    if (s.kind == use_site::LOAD)
+                    {
+                        s.p_i->load.sid = val.sid;
+                        s.p_i->load.reg = val.reg;
+                    }
+                    else
+                    {
+                        i.intr.op = val.sid;
+                        i.intr.op_reg = val.reg;
+                    }
+                    ++p_stats->ncopies;
+                }
+                remaining.push_back(uses[iaddr][k]);
+            }
+            uses[iaddr] = move(remaining);
+
+            if (to_imm && istypedintrinsic(i.op()))
+            {
+                i = intermediate::create_typed_intrinsic(i.intr);
+            }
+            if (i.op() == intermediate::STORE_SYMBOL && i.store.eval->op() == intermediate::TUPLE)
+            {
+                type_id tid = i.store.eval->tup.tid;
+                *i.store.eval = p_ip->make_tuple(tid, move(i.store.eval->tup.subs));
+            }
+        }
+
+        void mark_live(const vector<intermediate_addr>& roots)
+        {
+            vector<intermediate_addr> work(roots);
+            vector<ssa_value_id> pending;
+            while (!work.empty())
+            {
+                intermediate_addr iaddr = work.back();
+                work.pop_back();
+                pending.insert(pending.end(), uses[iaddr].begin(), uses[iaddr].end());
+                while (!pending.empty())
+                {
+                    ssa_value& val = values[pending.back()];
+                    pending.pop_back();
+                    if (val.live)
+                    {
+                        continue;
+                    }
+                    val.live = true;
+                    if (val.kind == ssa_value::DEF && !live[val.iaddr])
+                    {
+                        live[val.iaddr] = true;
+                        work.push_back(val.iaddr);
+                    }
+                    else if (val.kind == ssa_value::PHI)
+                    {
+                        for (size_t k = 0; k < val.args.size(); ++k)
+                        {
+                            if (edges[val.block][k])
+                            {
+                                pending.push_back(val.args[k]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // removes the intermediates that are not kept, then fixes up branches and frame entries
+        void compact(const vector<bool>& keep)
+        {
+            size_t n = p_ip->size();
+            vector<intermediate_addr> remap(n + 1); // first kept address at or after
+            intermediate_addr next = 0;
+            for (intermediate_addr iaddr = 0; iaddr < n; ++iaddr)
+            {
+                remap[iaddr] = next;
+                if (keep[iaddr])
+                {
+                    ++next;
+                }
+            }
+            remap[n] = next;
+            if (p_remap)
+            {
+                for (intermediate_addr& a : *p_remap)
+                {
+                    a = remap[a];
+                }
+            }
+
+            vector<intermediate> out;
+            out.reserve(next);
+            for (intermediate_addr iaddr = 0; iaddr < n; ++iaddr)
+            {
+                if (!keep[iaddr])
+                {
+                    continue;
+                }
+                intermediate& i = (*p_ip)[iaddr];
+                if (i.op() == intermediate::BRANCH)
+                {
+                    // a target past the end stays as far past it
+                    intermediate_addr target = i.br.target();
+                    target = target <= n ? remap[target] : remap[n] + (target - n);
+                    i.br.base = out.size();
+                    i.br.offset = target >= i.br.base
+                        ? intermediate_branch::branch_offset(intermediate_branch::branch_offset::POSITIVE, target - i.br.base)
+                        : intermediate_branch::branch_offset(intermediate_branch::branch_offset::NEGATIVE, i.br.base - target);
+                }
+                out.push_back(move(i));
+            }
+            for (intermediate_frame_id fid = 0; fid < p_ip->frame_count(); ++fid)
+            {
+                intermediate_frame& f = p_ip->frame(fid);
+                f.entry = remap[std::min(f.entry, n)];
+            }
+            p_ip->rewrite(move(out));
+        }
+
+        // a branch to the next address does nothing, its condition has no effect either
+        bool remove_branches_to_next()
+        {
+            vector<bool> keep(p_ip->size(), true);
+            bool any = false;
+            for (intermediate_addr iaddr = 0; iaddr < p_ip->size(); ++iaddr)
+            {
+                const intermediate& i = (*p_ip)[iaddr];
+                if (i.op() == intermediate::BRANCH && i.br.target() == iaddr + 1)
+                {
+                    keep[iaddr] = false;
+                    any = true;
+                }
+            }
+            if (any)
+            {
+                compact(keep);
+            }
+            return any;
+        }
+
+        optimize_result optimize()
+        {
+            p_stats->ninsts_before = p_ip->size();
+            for (intermediate_addr iaddr = 0; iaddr < p_ip->size(); ++iaddr)
+            {
+                if (isfused((*p_ip)[iaddr].op()))
+                {
+                    return optimize_result::OPTIMIZE_SKIPPED;
+                }
+            }
+            if (cfg.shared())
+            {
+                return optimize_result::OPTIMIZE_SKIPPED;
+            }
+
+            for (intermediate_frame_id fid = 0; fid < p_ip->frame_count(); ++fid)
+            {
+                if (cfg.entry(fid) != control_flow_graph::NONE)
+                {
+                    build_ssa(fid);
+                    link_users(fid);
+                }
+            }
+            propagate();
+
+            vector<intermediate_addr> roots;
+            for (cfg_block_id b = 0; b < cfg.size(); ++b)
+            {
+                if (!executable[b])
+                {
+                    continue;
+                }
+                for (intermediate_addr iaddr = cfg[b].first; iaddr < cfg[b].end; ++iaddr)
+                {
+                    if (settings.propagate)
+                    {
+                        rewrite(iaddr);
+                    }
+                    if (!removed[iaddr] && !isremovable((*p_ip)[iaddr]))
+                    {
+                        live[iaddr] = true;
+                        roots.push_back(iaddr);
+                    }
+                }
+            }
+            if (settings.dead_stores)
+            {
+                mark_live(roots);
+            }
+
+            vector<bool> keep(p_ip->size(), false);
+            for (cfg_block_id b = 0; b < cfg.size(); ++b)
+            {
+                for (intermediate_addr iaddr = cfg[b].first; iaddr < cfg[b].end; ++iaddr)
+                {
+                    if (!executable[b])
+                    {
+                        ++p_stats->nunreachable;
+                    }
+                    else if (settings.dead_stores && !removed[iaddr] && !live[iaddr])
+                    {
+                        ++p_stats->ndead;
+                    }
+                    else
+                    {
+                        keep[iaddr] = !removed[iaddr];
+                    }
+                }
+            }
+            compact(keep);
+            while (remove_branches_to_next())
+            {
+            }
+            p_stats->ninsts_after = p_ip->size();
+            return optimize_result::OPTIMIZE_OK;
+        }
+    };
+}
+
+const char* optimize_level_cstr(optimize_level level)
+{
+    switch (level)
+    {
+    case optimize_level::O0:
+        return "O0";
+    case optimize_level::O1:
+        return "O1";
+    case optimize_level::O2:
+        return "O2";
+    default:
+        throw internal_except_unhandled_switch(to_string(static_cast<int>(level)));
+    }
+}
+
+optimize_settings::optimize_settings(optimize_level level)
+    : inline_calls(level == optimize_level::O2), propagate(level != optimize_level::O0), dead_stores(level == optimize_level::O2),
+    layout(level == optimize_level::O2) {}
+
+string to_string(const optimize_stats& stats)
+{
+    return string::join(
+        to_string(stats.ninsts_before), " -> ", to_string(stats.ninsts_after), " intermediates: ",
+        to_string(stats.nconstants), " constant reads, ",
+        to_string(stats.ncopies), " copy reads, ",
+        to_string(stats.nfolded), " folded, ",
+        to_string(stats.ndead), " dead stores, ",
+        to_string(stats.nunreachable), " unreachable");
+}
+
+optimize_result optimize(intermediate_program* ip, const optimize_settings& settings, optimize_stats* p_stats, vector<intermediate_addr>* p_remap)
+{
+    if (p_remap)
+    {
+        p_remap->resize(ip->size() + 1);
+        for (intermediate_addr iaddr = 0; iaddr < p_remap->size(); ++iaddr)
+        {
+            (*p_remap)[iaddr] = iaddr;
+        }
+    }
+    optimize_stats stats;
+    if (!settings.propagate && !settings.dead_stores)
+    {
+        stats.ninsts_before = stats.ninsts_after = ip->size();
+        if (p_stats)
+        {
+            *p_stats = stats;
+        }
+        return optimize_result::OPTIMIZE_SKIPPED;
+    }
+    optimize_result result = internal::optimizer(ip, settings, &stats, p_remap).optimize();
+    if (!ok(result))
+    {
+        stats.ninsts_after = ip->size();
+    }
+    if (p_stats)
+    {
+        *p_stats = stats;
+    }
+    return result;
+}
+
+}
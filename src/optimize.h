@@ -0,0 +1,79 @@
+#ifndef LU_OPTIMIZE_H
+#define LU_OPTIMIZE_H
+
+#include "intermediate.h"
+#include "string.h"
+#include "adt/vector.h"
+#include "internal/constexpr.h"
+
+namespace lu
+{
+
+// optimization levels of the driver (-O0, -O1, -O2)
+enum class optimize_level
+{
+    O0, // as emitted by the transform
+    O1, // constant and copy propagation, constant folding, unreachable code removal
+    O2, // O1, inlining of small functions (see inline.h), dead store elimination and block layout (see layout.h)
+};
+
+const char* optimize_level_cstr(optimize_level);
+
+struct optimize_settings
+{
+    optimize_settings() : inline_calls(true), propagate(true), dead_stores(true), layout(true) {}
+    explicit optimize_settings(optimize_level);
+
+    bool inline_calls; // not done by optimize, the driver runs inline_calls before it
+    bool propagate;
+    bool dead_stores;
+    bool layout; // not done by optimize, the driver runs layout_blocks after it
+};
+
+struct optimize_stats
+{
+    optimize_stats() : ninsts_before(0), ninsts_after(0), nconstants(0), ncopies(0), nfolded(0), ndead(0), nunreachable(0) {}
+
+    size_t ninsts_before;
+    size_t ninsts_after;
+    size_t nconstants; // register reads replaced by a constant
+    size_t ncopies; // register reads redirected to the source of a copy
+    size_t nfolded; // intrinsics evaluated at compile time
+    size_t ndead; // stores removed
+    size_t nunreachable; // intermediates removed
+};
+
+string to_string(const optimize_stats&);
+
+enum class optimize_result
+{
+    OPTIMIZE_OK,
+    OPTIMIZE_SKIPPED, // program was left as is
+};
+
+LU_CONSTEXPR bool ok(optimize_result opr)
+{
+    return opr == optimize_result::OPTIMIZE_OK;
+}
+
+// optimizes each frame in ssa form over its control flow graph (see cfg.h), then writes the program back.
+//
+// registers are the ssa variables: every store, intrinsic with a dest and call result defines a new value,
+// phis are placed at the iterated dominance frontiers. sparse conditional constant propagation finds the
+// constant values and the blocks that can execute. then
+//   - reads of constant values become constants (immediates for intrinsics), intrinsics of constants are folded
+//     into a store of the result, branches on constants are resolved
+//   - reads of a copy whose source register still holds the same value read the source instead
+//   - values nothing reads are not stored, if their store has no other effect
+//   - blocks that cannot execute are removed
+// each symbol keeps its register, so leaving ssa needs no copies. addresses, branch offsets and frame
+// entries are renumbered. runs on the output of intermediate_transform, before fuse and lower_intrinsics
+// (typed intrinsics are fine, fused intermediates are not). programs with code shared by frames are skipped.
+// if p_remap is set it receives, for every address of the input and its end, the address execution continues at
+// in the output: the first intermediate kept at or after it. a running program can switch over at any of them
+// with its registers as they are (see tier.h)
+optimize_result optimize(intermediate_program*, const optimize_settings& = optimize_settings(), optimize_stats* = nullptr, vector<intermediate_addr>* p_remap = nullptr);
+
+}
+
+#endif // LU_OPTIMIZE_H
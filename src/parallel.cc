@@ -0,0 +1,77 @@
+#include "parallel.h"
+#include "timer.h"
+
+#include <exception>
+#include <sstream>
+#include <string>
+
+namespace lu
+{
+
+string to_string(const parallel_stats& stats)
+{
+    double rate = stats.seconds > 0 ? static_cast<double>(stats.instances) / stats.seconds : 0;
+    std::ostringstream line;
+    line << "parallel: " << stats.instances << " instances on " << stats.threads << " threads, " << stats.failures << " failed, "
+        << stats.seconds * 1000 << " ms, " << rate << " instances/s";
+    std::string s = line.str();
+    return string(s.data(), s.size());
+}
+
+void run_parallel(const intermediate_program* p_ip, size_t n, task_scheduler* p_sched, const parallel_settings& settings,
+    vector<parallel_run>* p_runs, parallel_stats* p_stats)
+{
+    p_runs->clear();
+    p_runs->resize(n);
+    interpret_settings is;
+    is.dispatch = settings.dispatch;
+    std::atomic<size_t> failures(0);
+    stopwatch sw;
+    sw.start();
+    p_sched->parallel_for(0, n, 1, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+        {
+            parallel_run& run = (*p_runs)[i];
+            memory_sink out;
+            std::ostringstream err;
+            try
+            {
+                intermediate_interpreter_state iis;
+                iis.set_out(&out);
+                diag_logger log(settings.log_level, diag::MAX_LEVEL, false, &err);
+                run.res = interpret(p_ip, &iis, 0, &log, is);
+                log.flush();
+            }
+            catch (const std::exception& e)
+            {
+                err << e.what() << "\n";
+                run.res = interpret_result::INTERPRET_FAIL;
+            }
+            if (!ok(run.res))
+            {
+                ++failures;
+            }
+            std::string diags = err.str();
+            run.output = out.str();
+            run.diags = string(diags.data(), diags.size());
+        }
+    });
+
+    if (p_stats)
+    {
+        p_stats->instances = n;
+        p_stats->failures = failures;
+        p_stats->threads = p_sched->size();
+        p_stats->seconds = sw.lap().count();
+    }
+}
+
+void run_parallel(const intermediate_program* p_ip, size_t n, const parallel_settings& settings, vector<parallel_run>* p_runs,
+    parallel_stats* p_stats)
+{
+    task_scheduler sched(settings.nthreads);
+    run_parallel(p_ip, n, &sched, settings, p_runs, p_stats);
+}
+
+}
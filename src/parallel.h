@@ -0,0 +1,58 @@
+#ifndef LU_PARALLEL_H
+#define LU_PARALLEL_H
+
+#include "intermediate.h"
+#include "interpreter.h"
+#include "scheduler.h"
+#include "diag.h"
+#include "string.h"
+#include "adt/vector.h"
+
+namespace lu
+{
+
+struct parallel_settings
+{
+    parallel_settings() : nthreads(0), dispatch(interpret_dispatch::THREADED), log_level(diag::WARN_LEVEL) {}
+
+    size_t nthreads; // 0 for one per hardware thread, ignored when given a scheduler
+    interpret_dispatch dispatch;
+    diag_level log_level; // of each instance's logger
+};
+
+// what one instance printed and logged, kept apart from every other instance
+struct parallel_run
+{
+    parallel_run() : res(interpret_result::INTERPRET_OK) {}
+
+    string output;
+    string diags;
+    interpret_result res;
+};
+
+struct parallel_stats
+{
+    parallel_stats() : instances(0), failures(0), threads(0), seconds(0) {}
+
+    size_t instances;
+    size_t failures;
+    size_t threads;
+    double seconds;
+};
+
+// one line, with instances per second
+string to_string(const parallel_stats&);
+
+// runs n instances of the program from address 0, one task each on the scheduler. the program (and the types,
+// symbols and static values of its context) is only read, so one copy serves every thread; each instance has its
+// own interpreter state, output stream and diag_logger, captured in (*p_runs)[i]. instances must not depend on each
+// other's output or order
+void run_parallel(const intermediate_program*, size_t n, task_scheduler*, const parallel_settings&, vector<parallel_run>* p_runs,
+    parallel_stats* = nullptr);
+
+// same, with a scheduler of settings.nthreads threads made for this run
+void run_parallel(const intermediate_program*, size_t n, const parallel_settings&, vector<parallel_run>* p_runs, parallel_stats* = nullptr);
+
+}
+
+#endif // LU_PARALLEL_H
@@ -35,6 +35,32 @@ void putascii(char c, std::ostream& = std::cout);
 void print(string_view, std::ostream& = std::cout);
 void println(string_view, std::ostream& = std::cout);
 
+// std::cout to out, std::cerr and std::clog (diagnostics) to err while it lives, for output kept apart per script
+struct stdio_redirect
+{
+    stdio_redirect(std::streambuf* p_out, std::streambuf* p_err) :
+        _p_cout(std::cout.rdbuf(p_out)), _p_cerr(std::cerr.rdbuf(p_err)), _p_clog(std::clog.rdbuf(p_err))
+    {}
+
+    ~stdio_redirect()
+    {
+        std::cout.flush();
+        std::cerr.flush();
+        std::clog.flush();
+        std::cout.rdbuf(_p_cout);
+        std::cerr.rdbuf(_p_cerr);
+        std::clog.rdbuf(_p_clog);
+    }
+
+    stdio_redirect(const stdio_redirect&) = delete;
+    stdio_redirect& operator=(const stdio_redirect&) = delete;
+
+private:
+    std::streambuf* _p_cout;
+    std::streambuf* _p_cerr;
+    std::streambuf* _p_clog;
+};
+
 //using locale = std::locale;
 //using cout = std::basic_ostream<ascii>;
 //using ucout = std::basic_ostream<unicode>;
@@ -0,0 +1,373 @@
+#include "scheduler.h"
+#include "internal/constexpr.h"
+
+namespace lu
+{
+
+namespace internal
+{
+    LU_CONSTEXPR int SPINS = 64; // rounds of looking for work before a worker parks
+
+    struct scheduler_worker
+    {
+        scheduler_worker(task_scheduler* p_sched, size_t i) : p_owner(p_sched), index(i), spawned(0), executed(0), stolen(0), parks(0) {}
+
+        task_scheduler* p_owner;
+        size_t index;
+        task_deque deque;
+        std::thread thread;
+        // written by this worker only, read for stats
+        std::atomic<uint64_t> spawned;
+        std::atomic<uint64_t> executed;
+        std::atomic<uint64_t> stolen;
+        std::atomic<uint64_t> parks;
+    };
+
+    thread_local scheduler_worker* p_current_worker = nullptr;
+
+    void count(std::atomic<uint64_t>& counter)
+    {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    task_deque::task_deque(size_t capacity) : _top(0), _bottom(0)
+    {
+        _rings.emplace_back(new ring(capacity));
+        _p_ring.store(_rings.back().get(), std::memory_order_relaxed);
+    }
+
+    task_deque::ring* task_deque::grow(ring* p_old, int64_t top, int64_t bottom)
+    {
+        ring* p_new = new ring((p_old->mask + 1) * 2);
+        _rings.emplace_back(p_new);
+        for (int64_t i = top; i < bottom; ++i)
+        {
+            (*p_new)[i].store((*p_old)[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        _p_ring.store(p_new, std::memory_order_release);
+        return p_new;
+    }
+
+    void task_deque::push(task* p_task)
+    {
+        int64_t b = _bottom.load(std::memory_order_relaxed);
+        int64_t t = _top.load(std::memory_order_acquire);
+        ring* p_ring = _p_ring.load(std::memory_order_relaxed);
+        if (b - t > static_cast<int64_t>(p_ring->mask))
+        {
+            p_ring = grow(p_ring, t, b);
+        }
+        (*p_ring)[b].store(p_task, std::memory_order_relaxed);
+        // publishes the task to thieves reading the bottom
+        _bottom.store(b + 1, std::memory_order_release);
+    }
+
+    task* task_deque::pop()
+    {
+        int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+        ring* p_ring = _p_ring.load(std::memory_order_relaxed);
+        // the bottom is claimed before the top is read, or a thief and the owner could both take the last task
+        _bottom.store(b, std::memory_order_seq_cst);
+        int64_t t = _top.load(std::memory_order_seq_cst);
+        if (t > b)
+        {
+            _bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        task* p_task = (*p_ring)[b].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+            // the last one, thieves race for it on the top
+            if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                p_task = nullptr;
+            }
+            _bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return p_task;
+    }
+
+    task* task_deque::steal()
+    {
+        int64_t t = _top.load(std::memory_order_seq_cst);
+        int64_t b = _bottom.load(std::memory_order_seq_cst);
+        if (t >= b)
+        {
+            return nullptr;
+        }
+        ring* p_ring = _p_ring.load(std::memory_order_acquire);
+        task* p_task = (*p_ring)[t].load(std::memory_order_relaxed);
+        if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return p_task;
+    }
+
+    bool task_deque::empty() const
+    {
+        return _bottom.load(std::memory_order_relaxed) <= _top.load(std::memory_order_relaxed);
+    }
+}
+
+string to_string(const scheduler_stats& stats)
+{
+    return string::join(
+        "scheduler: ", to_string(stats.workers), " workers, ",
+        to_string(stats.spawned), " spawned, ",
+        to_string(stats.injected), " injected, ",
+        to_string(stats.executed), " executed, ",
+        to_string(stats.stolen), " stolen, ",
+        to_string(stats.parks), " parks");
+}
+
+task_scheduler::task_scheduler(size_t nthreads) : _p_external(new internal::scheduler_worker(this, 0)), _ninjected(0), _epoch(0),
+    _parked(0), _waiting(0), _stop(false)
+{
+    if (nthreads == 0)
+    {
+        nthreads = std::thread::hardware_concurrency();
+    }
+    for (size_t i = 1; i < nthreads; ++i)
+    {
+        _workers.emplace_back(new internal::scheduler_worker(this, _workers.size()));
+    }
+    // started once every worker exists, they steal from each other
+    for (std::unique_ptr<internal::scheduler_worker>& p_worker : _workers)
+    {
+        p_worker->thread = std::thread(&task_scheduler::work, this, p_worker.get());
+    }
+}
+
+task_scheduler::~task_scheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(_park_mutex);
+        _stop = true;
+    }
+    _park.notify_all();
+    for (std::unique_ptr<internal::scheduler_worker>& p_worker : _workers)
+    {
+        p_worker->thread.join();
+    }
+    while (internal::task* p_task = find(nullptr))
+    {
+        execute(p_task, nullptr);
+    }
+}
+
+internal::scheduler_worker* task_scheduler::current() const
+{
+    internal::scheduler_worker* p_worker = internal::p_current_worker;
+    return p_worker && p_worker->p_owner == this ? p_worker : nullptr;
+}
+
+void task_scheduler::spawn(internal::task* p_task)
+{
+    internal::scheduler_worker* p_self = current();
+    if (p_self)
+    {
+        internal::count(p_self->spawned);
+        p_self->deque.push(p_task);
+    }
+    else
+    {
+        internal::count(_p_external->spawned);
+        std::lock_guard<std::mutex> lock(_inject_mutex);
+        _injected.push_back(p_task);
+        _ninjected.fetch_add(1);
+    }
+    // a worker about to park sees the epoch change, or is counted as parked and woken here
+    _epoch.fetch_add(1);
+    if (_parked.load() > 0 || _waiting.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(_park_mutex);
+        _park.notify_one();
+        _finished.notify_one();
+    }
+}
+
+internal::task* task_scheduler::find(internal::scheduler_worker* p_self)
+{
+    if (p_self)
+    {
+        if (internal::task* p_task = p_self->deque.pop())
+        {
+            return p_task;
+        }
+    }
+    if (_ninjected.load(std::memory_order_relaxed) > 0)
+    {
+        std::lock_guard<std::mutex> lock(_inject_mutex);
+        if (!_injected.empty())
+        {
+            internal::task* p_task = _injected.front();
+            _injected.pop_front();
+            _ninjected.fetch_sub(1);
+            return p_task;
+        }
+    }
+    size_t n = _workers.size();
+    size_t first = p_self ? p_self->index + 1 : 0;
+    for (size_t k = 0; k < n; ++k)
+    {
+        internal::scheduler_worker* p_victim = _workers[(first + k) % n].get();
+        if (p_victim == p_self || p_victim->deque.empty())
+        {
+            continue;
+        }
+        if (internal::task* p_task = p_victim->deque.steal())
+        {
+            internal::count(p_self ? p_self->stolen : _p_external->stolen);
+            return p_task;
+        }
+    }
+    return nullptr;
+}
+
+void task_scheduler::execute(internal::task* p_task, internal::scheduler_worker* p_self)
+{
+    p_task->run();
+    p_task->done.store(true);
+    // a thread waiting on it sees it done, or is counted as waiting and woken here
+    if (_waiting.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(_park_mutex);
+        _finished.notify_all();
+    }
+    p_task->release();
+    internal::count(p_self ? p_self->executed : _p_external->executed);
+}
+
+void task_scheduler::park(internal::scheduler_worker* p_self, uint64_t epoch)
+{
+    std::unique_lock<std::mutex> lock(_park_mutex);
+    _parked.fetch_add(1);
+    if (!_stop && _epoch.load() == epoch)
+    {
+        internal::count(p_self->parks);
+        _park.wait(lock, [&] { return _stop || _epoch.load() != epoch; });
+    }
+    _parked.fetch_sub(1);
+}
+
+void task_scheduler::work(internal::scheduler_worker* p_self)
+{
+    internal::p_current_worker = p_self;
+    for (;;)
+    {
+        uint64_t epoch = _epoch.load();
+        internal::task* p_task = find(p_self);
+        for (int spin = 0; !p_task && spin < internal::SPINS && !_stop; ++spin)
+        {
+            std::this_thread::yield();
+            p_task = find(p_self);
+        }
+        if (p_task)
+        {
+            execute(p_task, p_self);
+        }
+        else if (_stop)
+        {
+            return;
+        }
+        else
+        {
+            park(p_self, epoch);
+        }
+    }
+}
+
+void task_scheduler::wait(internal::task* p_task)
+{
+    internal::scheduler_worker* p_self = current();
+    while (!p_task->done.load(std::memory_order_acquire))
+    {
+        if (internal::task* p_other = find(p_self))
+        {
+            execute(p_other, p_self);
+        }
+        else if (p_self)
+        {
+            // a worker keeps looking, the task runs on another one and may spawn more
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::unique_lock<std::mutex> lock(_park_mutex);
+            _waiting.fetch_add(1);
+            // woken by every task done and every spawn, to look for work again
+            uint64_t epoch = _epoch.load();
+            _finished.wait(lock, [&] { return p_task->done.load() || _epoch.load() != epoch; });
+            _waiting.fetch_sub(1);
+        }
+    }
+}
+
+void task_scheduler::parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& f)
+{
+    if (grain == 0)
+    {
+        grain = 1;
+    }
+    vector<task_future<void>> halves;
+    while (end - begin > grain)
+    {
+        size_t mid = begin + (end - begin) / 2;
+        halves.push_back(submit([this, mid, end, grain, &f] { parallel_for(mid, end, grain, f); }));
+        end = mid;
+    }
+    // every half is waited on before returning, f and this range outlive them
+    std::exception_ptr error;
+    try
+    {
+        if (begin < end)
+        {
+            f(begin, end);
+        }
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    for (size_t i = halves.size(); i-- > 0;)
+    {
+        try
+        {
+            halves[i].get();
+        }
+        catch (...)
+        {
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+scheduler_stats task_scheduler::stats() const
+{
+    scheduler_stats stats;
+    stats.workers = _workers.size();
+    stats.injected = _p_external->spawned.load();
+    auto add = [&](const internal::scheduler_worker& w)
+    {
+        stats.spawned += w.spawned.load();
+        stats.executed += w.executed.load();
+        stats.stolen += w.stolen.load();
+        stats.parks += w.parks.load();
+    };
+    add(*_p_external);
+    for (const std::unique_ptr<internal::scheduler_worker>& p_worker : _workers)
+    {
+        add(*p_worker);
+    }
+    return stats;
+}
+
+}
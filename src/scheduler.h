@@ -0,0 +1,279 @@
+#ifndef LU_SCHEDULER_H
+#define LU_SCHEDULER_H
+
+#include "string.h"
+#include "adt/vector.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace lu
+{
+
+struct task_scheduler;
+
+namespace internal
+{
+    // a unit of work, shared by the queue it waits in and the futures of its result
+    struct task
+    {
+        task() : refs(1), done(false) {}
+        virtual ~task() {}
+
+        virtual void run() = 0;
+
+        void acquire() { refs.fetch_add(1, std::memory_order_relaxed); }
+        void release()
+        {
+            if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                delete this;
+            }
+        }
+
+        std::atomic<uint32_t> refs;
+        std::atomic<bool> done;
+    };
+
+    // Chase-Lev deque (Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models"). its owner pushes and
+    // pops at the bottom without a lock, other threads steal from the top. it grows when full; the old rings are kept
+    // until it is destroyed, since a thief may still read one
+    struct task_deque
+    {
+        explicit task_deque(size_t capacity = 256); // a power of 2
+        task_deque(const task_deque&) = delete;
+        task_deque& operator=(const task_deque&) = delete;
+
+        void push(task*); // owner only
+        task* pop(); // owner only, newest first, nullptr if empty
+        task* steal(); // any thread, oldest first, nullptr if empty or another thread took it first
+        bool empty() const;
+
+    private:
+        struct ring
+        {
+            explicit ring(size_t capacity) : mask(capacity - 1), slots(new std::atomic<task*>[capacity]) {}
+
+            std::atomic<task*>& operator[](int64_t i) { return slots[static_cast<size_t>(i) & mask]; }
+
+            size_t mask;
+            std::unique_ptr<std::atomic<task*>[]> slots;
+        };
+
+        ring* grow(ring*, int64_t top, int64_t bottom);
+
+        std::atomic<int64_t> _top; // thieves take here
+        std::atomic<int64_t> _bottom; // the owner pushes and pops here
+        std::atomic<ring*> _p_ring;
+        vector<std::unique_ptr<ring>> _rings; // every ring so far, the last is current
+    };
+
+    template <typename T>
+    struct future_state : task
+    {
+        T value;
+        std::exception_ptr error;
+    };
+
+    template <>
+    struct future_state<void> : task
+    {
+        std::exception_ptr error;
+    };
+
+    template <typename T, typename FunctionT>
+    struct future_task : future_state<T>
+    {
+        explicit future_task(FunctionT&& fn) : f(std::move(fn)) {}
+
+        void run() override
+        {
+            try
+            {
+                this->value = f();
+            }
+            catch (...)
+            {
+                this->error = std::current_exception();
+            }
+        }
+
+        FunctionT f;
+    };
+
+    template <typename FunctionT>
+    struct future_task<void, FunctionT> : future_state<void>
+    {
+        explicit future_task(FunctionT&& fn) : f(std::move(fn)) {}
+
+        void run() override
+        {
+            try
+            {
+                f();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+        }
+
+        FunctionT f;
+    };
+
+    template <typename T>
+    T future_value(const future_state<T>* p_state)
+    {
+        return p_state->value;
+    }
+
+    inline void future_value(const future_state<void>*) {}
+
+    struct scheduler_worker;
+}
+
+// the result of a submitted task. copies share it
+template <typename T>
+struct task_future
+{
+    task_future() : _p_sched(nullptr), _p_state(nullptr) {}
+    task_future(const task_future& other) : _p_sched(other._p_sched), _p_state(other._p_state)
+    {
+        if (_p_state)
+        {
+            _p_state->acquire();
+        }
+    }
+    task_future(task_future&& other) : _p_sched(other._p_sched), _p_state(other._p_state)
+    {
+        other._p_state = nullptr;
+    }
+    ~task_future()
+    {
+        if (_p_state)
+        {
+            _p_state->release();
+        }
+    }
+
+    task_future& operator=(task_future other)
+    {
+        std::swap(_p_sched, other._p_sched);
+        std::swap(_p_state, other._p_state);
+        return *this;
+    }
+
+    bool valid() const { return _p_state != nullptr; }
+    bool ready() const { return _p_state->done.load(std::memory_order_acquire); }
+
+    // runs other tasks until this one is done, then returns its result or throws what it threw
+    T get();
+
+private:
+    friend struct task_scheduler;
+
+    task_future(task_scheduler* p_sched, internal::future_state<T>* p_state) : _p_sched(p_sched), _p_state(p_state) {}
+
+    task_scheduler* _p_sched;
+    internal::future_state<T>* _p_state;
+};
+
+struct scheduler_stats
+{
+    scheduler_stats() : workers(0), spawned(0), injected(0), executed(0), stolen(0), parks(0) {}
+
+    size_t workers;
+    uint64_t spawned;
+    uint64_t injected; // spawned from threads that are not workers, through the global queue
+    uint64_t executed;
+    uint64_t stolen; // executed by a thread other than the one that spawned them
+    uint64_t parks; // times a worker found nothing to do and slept
+};
+
+// one line
+string to_string(const scheduler_stats&);
+
+// work-stealing task scheduler. a task spawned on a worker goes to the bottom of that worker's deque, where the
+// worker takes it back first; idle workers steal the oldest tasks of the others. tasks spawned from other threads
+// go through a global injection queue. workers with nothing to do spin briefly, then park until a task is spawned.
+// a thread waiting on a future runs other tasks meanwhile, so tasks may wait on the tasks they spawn (fork-join)
+// without holding a thread. one scheduler can serve every phase: lexing, parsing and analyzing independent sources
+// (each with its own trees, context copy and diag_logger, see builtin_context()), and interpreter instances over
+// one program (see run_parallel())
+struct task_scheduler
+{
+    // 0 for one per hardware thread. the thread waiting on the results is one of them, so nthreads - 1 workers start
+    explicit task_scheduler(size_t nthreads = 0);
+    // runs whatever is still queued, on this thread once the workers stopped
+    ~task_scheduler();
+
+    task_scheduler(const task_scheduler&) = delete;
+    task_scheduler& operator=(const task_scheduler&) = delete;
+
+    size_t size() const { return _workers.size() + 1; }
+
+    template <typename FunctionT>
+    task_future<typename std::result_of<FunctionT()>::type> submit(FunctionT f)
+    {
+        typedef typename std::result_of<FunctionT()>::type T;
+        internal::future_task<T, FunctionT>* p_task = new internal::future_task<T, FunctionT>(std::move(f));
+        p_task->acquire(); // the future's
+        spawn(p_task);
+        return task_future<T>(this, p_task);
+    }
+
+    // calls f(first, last) for pieces of [begin, end) of at most grain indices, splitting the range in halves as
+    // tasks, and returns when every piece is done. rethrows the first exception thrown
+    void parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& f);
+
+    // runs other tasks until the task is done
+    void wait(internal::task*);
+
+    // exact once every submitted task is done
+    scheduler_stats stats() const;
+
+private:
+    void spawn(internal::task*);
+    internal::task* find(internal::scheduler_worker*);
+    void execute(internal::task*, internal::scheduler_worker*);
+    void work(internal::scheduler_worker*);
+    void park(internal::scheduler_worker*, uint64_t epoch);
+    internal::scheduler_worker* current() const;
+
+    vector<std::unique_ptr<internal::scheduler_worker>> _workers;
+    std::unique_ptr<internal::scheduler_worker> _p_external; // counters of the threads that are not workers
+    std::mutex _inject_mutex;
+    std::deque<internal::task*> _injected;
+    std::atomic<size_t> _ninjected;
+    std::mutex _park_mutex;
+    std::condition_variable _park; // workers
+    std::condition_variable _finished; // threads that are not workers, waiting on a future
+    std::atomic<uint64_t> _epoch; // changes with every spawn
+    std::atomic<size_t> _parked;
+    std::atomic<size_t> _waiting;
+    std::atomic<bool> _stop;
+};
+
+template <typename T>
+T task_future<T>::get()
+{
+    _p_sched->wait(_p_state);
+    if (_p_state->error)
+    {
+        std::rethrow_exception(_p_state->error);
+    }
+    return internal::future_value(_p_state);
+}
+
+}
+
+#endif // LU_SCHEDULER_H
@@ -34,6 +34,18 @@ lexical_scope* lexical_scope::push_sub()
     return p_sub;
 }
 
+lexical_scope* lexical_scope::clone(lexical_scope* p_parent) const
+{
+    lexical_scope* p_copy = new lexical_scope(_label);
+    p_copy->_sym_map = _sym_map;
+    p_copy->_parent = p_parent;
+    for (const lexical_scope* p_sub : _subs)
+    {
+        p_copy->_subs.push_back(p_sub->clone(p_copy));
+    }
+    return p_copy;
+}
+
 symbol_id lexical_scope::find_innermost_local(string_view sname)
 {
     symbol_id ret = find_local(sname);
@@ -70,6 +82,11 @@ symbol_table::symbol_table(symbol_table&& other)
     this->create(move(other));
 }
 
+symbol_table::symbol_table(const symbol_table& other)
+{
+    this->create(other);
+}
+
 symbol_table& symbol_table::operator=(symbol_table&& other)
 {
     this->destroy();
@@ -77,6 +94,16 @@ symbol_table& symbol_table::operator=(symbol_table&& other)
     return *this;
 }
 
+symbol_table& symbol_table::operator=(const symbol_table& other)
+{
+    if (this != &other)
+    {
+        this->destroy();
+        this->create(other);
+    }
+    return *this;
+}
+
 lexical_scope* symbol_table::top()
 {
     if (_top == nullptr)
@@ -127,6 +154,13 @@ symbol& symbol_table::declare_global(symbol&& sym)
     return _syms.back();
 }
 
+symbol& symbol_table::declare_hidden(symbol&& sym)
+{
+    sym.sid = next_id();
+    _syms.push_back(move(sym));
+    return _syms.back();
+}
+
 symbol_id symbol_table::find_global(string_view sname) const
 {
     auto it = _globs.find(sname);
@@ -194,4 +228,14 @@ void symbol_table::create(symbol_table&& other)
     other._top = nullptr;
 }
 
+void symbol_table::create(const symbol_table& other)
+{
+    this->_top = other._top != nullptr ? other._top->clone(nullptr) : nullptr;
+    this->_intr_map = other._intr_map;
+    this->_globs = other._globs;
+
+    this->_intrs = other._intrs;
+    this->_syms = other._syms;
+}
+
 }
\ No newline at end of file
@@ -31,6 +31,8 @@ public:
     lexical_scope* up() { return _parent; }
 
     lexical_scope* push_sub();
+    // a deep copy of this scope and its subs, under p_parent
+    lexical_scope* clone(lexical_scope* p_parent) const;
     
     symbol_id find_innermost_local(string_view);
     symbol_id find_local(string_view);
@@ -54,8 +56,10 @@ struct symbol_table
     ~symbol_table();
 
     symbol_table(symbol_table&&);
+    symbol_table(const symbol_table&);
 
     symbol_table& operator=(symbol_table&&);
+    symbol_table& operator=(const symbol_table&);
 
     lexical_scope* top();
 
@@ -67,6 +71,8 @@ struct symbol_table
     // unlike most languages, user definitions in top level are still considered file scoped, not global. global can added using keyword or be added by compiler for needed vars that are not intrinsic functions
     symbol& declare_global(symbol&&);
     symbol_id find_global(string_view) const;
+    // a symbol no scope can find by name, for symbols made up by passes over the intermediates (see inline.h)
+    symbol& declare_hidden(symbol&&);
 
     intrinsic& declare_intrinsic(intrinsic&&);
     intrinsic& find_intrinsic(intrinsic_id);
@@ -79,6 +85,8 @@ struct symbol_table
     void merge(const symbol_table&);
 
     bool exists(symbol_id sid) const { return sid < _syms.size(); }
+    size_t size() const { return _syms.size(); }
+    size_t intrinsic_count() const { return _intrs.size(); }
 
 private:
     symbol_id next_id() const
@@ -93,6 +101,7 @@ private:
 
     void destroy();
     void create(symbol_table&&);
+    void create(const symbol_table&);
 
     lexical_scope* _top;
     flat_map<string, intrinsic_id> _intr_map;
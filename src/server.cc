@@ -0,0 +1,549 @@
+#include "server.h"
+#include "source.h"
+#include "parse.h"
+#include "analyze.h"
+#include "intermediate.h"
+#include "interpreter.h"
+#include "inline.h"
+#include "layout.h"
+#include "fuse.h"
+#include "lower.h"
+#include "print.h"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <streambuf>
+
+// unix domain sockets
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(LU_NO_SERVER)
+#   define LU_SERVER 1
+#   include <fcntl.h>
+#   include <poll.h>
+#   include <sys/socket.h>
+#   include <sys/stat.h>
+#   include <sys/time.h>
+#   include <sys/un.h>
+#   include <unistd.h>
+#else
+#   define LU_SERVER 0
+#endif // (defined(__unix__) || defined(__APPLE__)) && !defined(LU_NO_SERVER)
+
+namespace lu
+{
+
+namespace diags
+{
+    diag SERVER_IO = diag(diag::ERROR_LEVEL, 6400);
+}
+
+namespace internal
+{
+    void server_io(diag_logger* p_log, string&& msg)
+    {
+        p_log->push(diag_context(diags::SERVER_IO, source_reference(), source_location(), string::join("server: ", msg)));
+    }
+
+#if LU_SERVER
+    LU_CONSTEXPR size_t FRAME_HEADER_SIZE = 5;
+
+    bool socket_address(string_view path, sockaddr_un* p_addr)
+    {
+        *p_addr = sockaddr_un();
+        p_addr->sun_family = AF_UNIX;
+        if (path.size() == 0 || path.size() >= sizeof(p_addr->sun_path))
+        {
+            return false;
+        }
+        for (size_t i = 0; i < path.size(); ++i)
+        {
+            p_addr->sun_path[i] = path[i];
+        }
+        return true;
+    }
+
+    bool write_all(int fd, const void* p_data, size_t size)
+    {
+        const char* p = static_cast<const char*>(p_data);
+        while (size > 0)
+        {
+            ssize_t n = write(fd, p, size);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return false;
+            }
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    typedef std::chrono::steady_clock::time_point deadline;
+
+    // false on an error, the end of the stream or once the deadline (if any) passes
+    bool read_all(int fd, void* p_data, size_t size, const deadline* p_deadline)
+    {
+        char* p = static_cast<char*>(p_data);
+        while (size > 0)
+        {
+            if (p_deadline)
+            {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(*p_deadline - std::chrono::steady_clock::now()).count();
+                pollfd pfd;
+                pfd.fd = fd;
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                int ready = left > 0 ? poll(&pfd, 1, static_cast<int>(left)) : 0;
+                if (ready < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (ready <= 0)
+                {
+                    return false;
+                }
+            }
+            ssize_t n = read(fd, p, size);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return false;
+            }
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    void put_u32(uint8_t* p, uint32_t x)
+    {
+        for (size_t i = 0; i < 4; ++i)
+        {
+            p[i] = static_cast<uint8_t>(x >> (8 * i));
+        }
+    }
+
+    uint32_t get_u32(const uint8_t* p)
+    {
+        uint32_t x = 0;
+        for (size_t i = 0; i < 4; ++i)
+        {
+            x |= static_cast<uint32_t>(p[i]) << (8 * i);
+        }
+        return x;
+    }
+
+    bool write_frame(int fd, server_frame kind, const void* p_data, size_t size)
+    {
+        uint8_t header[FRAME_HEADER_SIZE];
+        header[0] = static_cast<uint8_t>(kind);
+        put_u32(header + 1, static_cast<uint32_t>(size));
+        return write_all(fd, header, sizeof(header)) && write_all(fd, p_data, size);
+    }
+
+    // the whole frame within timeout_ms, or without a limit if it is negative
+    bool read_frame(int fd, server_frame* p_kind, vector<char>* p_payload, size_t max_size, int timeout_ms)
+    {
+        deadline end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        const deadline* p_end = timeout_ms >= 0 ? &end : nullptr;
+        uint8_t header[FRAME_HEADER_SIZE];
+        if (!read_all(fd, header, sizeof(header), p_end))
+        {
+            return false;
+        }
+        *p_kind = static_cast<server_frame>(header[0]);
+        size_t size = get_u32(header + 1);
+        if (size > max_size)
+        {
+            return false;
+        }
+        p_payload->resize(size);
+        return read_all(fd, p_payload->data(), size, p_end);
+    }
+
+    // path opened below root (itself resolved), -1 if it cannot be, is not a regular file or leaves root. the
+    // descriptor is checked, not the name: the file opened must be the one the name resolves to inside root
+    // afterwards, so a link changed in between is refused
+    int open_below(const string& root, const string& path)
+    {
+        if (path.size() == 0 || path[0] == '/')
+        {
+            return -1;
+        }
+        string joined = string::join(root, "/", path);
+        // a fifo must not block the server
+        int fd = open(joined.buffer(), O_RDONLY | O_NONBLOCK | O_NOCTTY);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        struct stat opened;
+        char* p_real = nullptr;
+        if (fstat(fd, &opened) != 0 || !S_ISREG(opened.st_mode) || !(p_real = realpath(joined.buffer(), nullptr)))
+        {
+            close(fd);
+            return -1;
+        }
+        string resolved(p_real);
+        std::free(p_real);
+        string_view prefix(root);
+        struct stat named;
+        bool below = string_view(resolved).size() > prefix.size() && string_view(resolved).subview(0, prefix.size()) == prefix
+            && (prefix[prefix.size() - 1] == '/' || resolved[prefix.size()] == '/');
+        if (!below || stat(resolved.buffer(), &named) != 0 || named.st_dev != opened.st_dev || named.st_ino != opened.st_ino)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    bool read_fd(int fd, string* p_text)
+    {
+        char buf[4096];
+        for (;;)
+        {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n < 0)
+            {
+                return false;
+            }
+            if (n == 0)
+            {
+                return true;
+            }
+            p_text->append(buf, static_cast<size_t>(n));
+        }
+    }
+
+    // frames of one kind from what is written to it, dropped once the client is gone
+    struct frame_buf : public std::streambuf
+    {
+        frame_buf(int fd, server_frame kind) : fd(fd), kind(kind), connected(true)
+        {
+            setp(buf, buf + sizeof(buf));
+        }
+
+        int_type overflow(int_type c) override
+        {
+            send();
+            if (!traits_type::eq_int_type(c, traits_type::eof()))
+            {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override
+        {
+            send();
+            return 0;
+        }
+
+        void send()
+        {
+            size_t size = static_cast<size_t>(pptr() - pbase());
+            if (size > 0 && connected)
+            {
+                connected = write_frame(fd, kind, pbase(), size);
+            }
+            setp(buf, buf + sizeof(buf));
+        }
+
+        int fd;
+        server_frame kind;
+        bool connected;
+        char buf[4096];
+    };
+
+    int run_request(int fd, server_frame kind, const string& payload, const server_settings& settings, const string& root,
+        const analyze_context& builtins)
+    {
+        frame_buf out(fd, server_frame::OUTPUT);
+        frame_buf err(fd, server_frame::DIAGS);
+        stdio_redirect redirect(&out, &err);
+        int code = 0;
+        try
+        {
+            string text;
+            if (kind == server_frame::PATH)
+            {
+                int file = open_below(root, payload);
+                if (file < 0)
+                {
+                    std::cerr << "cannot read " << payload << " inside " << root << "\n";
+                    return 1;
+                }
+                bool read = read_fd(file, &text);
+                close(file);
+                if (!read)
+                {
+                    std::cerr << "cannot read " << payload << "\n";
+                    return 1;
+                }
+            }
+            source src = kind == server_frame::PATH ? source::from_string(string(payload), move(text)) : source::from_string("request", string(payload));
+            // diagnostics point into the source
+            diag_logger log(diag::WARN_LEVEL, diag::MAX_LEVEL, false);
+            code = lu::run_script(&src, builtins, settings.level, &log);
+            log.flush();
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            code = 1;
+        }
+        return code;
+    }
+
+    // one connection, false if it asked the server to stop
+    bool handle(int fd, const server_settings& settings, const string& root, const analyze_context& builtins, server_stats* p_stats,
+        diag_logger* p_log)
+    {
+        // a reply the client does not read fails its write rather than blocking
+        timeval tv;
+        tv.tv_sec = settings.timeout_ms / 1000;
+        tv.tv_usec = (settings.timeout_ms % 1000) * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        server_frame kind;
+        vector<char> bytes;
+        if (!read_frame(fd, &kind, &bytes, settings.max_request, settings.timeout_ms))
+        {
+            server_io(p_log, "dropped a request that was cut short, too large or too slow");
+            return true;
+        }
+        if (kind == server_frame::SHUTDOWN)
+        {
+            return false;
+        }
+
+        int code = 1;
+        if (kind == server_frame::SOURCE || kind == server_frame::PATH)
+        {
+            ++p_stats->requests;
+            code = run_request(fd, kind, string(bytes.data(), bytes.size()), settings, root, builtins);
+        }
+        else
+        {
+            const char msg[] = "not a request\n";
+            write_frame(fd, server_frame::DIAGS, msg, sizeof(msg) - 1);
+        }
+        if (code != 0)
+        {
+            ++p_stats->failures;
+        }
+        uint8_t exit_code[4];
+        put_u32(exit_code, static_cast<uint32_t>(code));
+        write_frame(fd, server_frame::EXIT, exit_code, sizeof(exit_code));
+        return true;
+    }
+#endif // LU_SERVER
+}
+
+int run_script(const source* p_src, const analyze_context& builtins, optimize_level level, diag_logger* p_log)
+{
+    parse_expr_tree pet;
+    if (!ok(parse(p_src, &pet, p_log)))
+    {
+        return 1;
+    }
+    analyze_expr_tree aet(builtins);
+    if (!ok(analyze(&pet, &aet, p_log)))
+    {
+        return 2;
+    }
+    intermediate_program ip;
+    if (!ok(intermediate_transform(&aet, &ip, p_log)))
+    {
+        return 3;
+    }
+
+    // tail calls are guaranteed at every level, not an optimization
+    lower_tail_calls(&ip);
+    optimize_settings settings(level);
+    if (settings.inline_calls)
+    {
+        inline_calls(&ip);
+    }
+    optimize(&ip, settings);
+    if (settings.layout)
+    {
+        layout_blocks(&ip);
+    }
+    fuse(&ip);
+    lower_intrinsics(&ip);
+
+    intermediate_interpreter_state iis;
+    if (!ok(interpret(&ip, &iis, 0, p_log)))
+    {
+        return 4;
+    }
+    return 0;
+}
+
+string to_string(const server_stats& stats)
+{
+    return string::join("server: ", to_string(stats.requests), " requests, ", to_string(stats.failures), " failed");
+}
+
+server_result serve(const server_settings& settings, diag_logger* p_log, server_stats* p_stats)
+{
+#if LU_SERVER
+    server_stats stats;
+    if (p_stats == nullptr)
+    {
+        p_stats = &stats;
+    }
+    sockaddr_un addr;
+    if (!internal::socket_address(settings.socket_path, &addr))
+    {
+        internal::server_io(p_log, string::join("bad socket path ", settings.socket_path));
+        return server_result::SERVER_IO;
+    }
+    char* p_root = realpath(settings.root.size() == 0 ? "." : settings.root.buffer(), nullptr);
+    if (!p_root)
+    {
+        internal::server_io(p_log, string::join("cannot resolve the root ", settings.root));
+        return server_result::SERVER_IO;
+    }
+    string root(p_root);
+    std::free(p_root);
+
+    // a socket left by an earlier server is replaced, anything else at the path is kept
+    struct stat st;
+    if (stat(addr.sun_path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        unlink(addr.sun_path);
+    }
+    // only this user may connect: the socket is made 0600 rather than changed after it appears
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    mode_t mask = umask(0177);
+    bool bound = fd >= 0 && bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+    umask(mask);
+    if (!bound || listen(fd, 64) != 0)
+    {
+        internal::server_io(p_log, string::join("cannot listen on ", settings.socket_path));
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return server_result::SERVER_IO;
+    }
+    // a client gone in the middle of its reply must not stop the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    analyze_context builtins = builtin_context();
+    server_result res = server_result::SERVER_OK;
+    bool serving = true;
+    while (serving)
+    {
+        int conn = accept(fd, nullptr, nullptr);
+        if (conn < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            internal::server_io(p_log, string::join("cannot accept on ", settings.socket_path));
+            res = server_result::SERVER_IO;
+            break;
+        }
+        serving = internal::handle(conn, settings, root, builtins, p_stats, p_log);
+        close(conn);
+    }
+    close(fd);
+    unlink(addr.sun_path);
+    return res;
+#else
+    (void)settings;
+    (void)p_log;
+    (void)p_stats;
+    return server_result::SERVER_UNSUPPORTED;
+#endif // LU_SERVER
+}
+
+server_result server_request(string_view socket_path, server_frame kind, string_view payload, std::ostream& out,
+    std::ostream& err, int* p_code, diag_logger* p_log)
+{
+#if LU_SERVER
+    sockaddr_un addr;
+    if (!internal::socket_address(socket_path, &addr))
+    {
+        internal::server_io(p_log, string::join("bad socket path ", socket_path));
+        return server_result::SERVER_IO;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        internal::server_io(p_log, string::join("cannot connect to ", socket_path));
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return server_result::SERVER_IO;
+    }
+    if (!internal::write_frame(fd, kind, payload.buffer(), payload.size()))
+    {
+        internal::server_io(p_log, "cannot send the request");
+        close(fd);
+        return server_result::SERVER_IO;
+    }
+    *p_code = 0;
+    if (kind == server_frame::SHUTDOWN)
+    {
+        close(fd);
+        return server_result::SERVER_OK;
+    }
+
+    server_frame reply;
+    vector<char> bytes;
+    while (internal::read_frame(fd, &reply, &bytes, ~static_cast<uint32_t>(0), -1))
+    {
+        if (reply == server_frame::OUTPUT)
+        {
+            out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            out.flush();
+        }
+        else if (reply == server_frame::DIAGS)
+        {
+            err.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            err.flush();
+        }
+        else if (reply == server_frame::EXIT && bytes.size() == 4)
+        {
+            *p_code = static_cast<int>(internal::get_u32(reinterpret_cast<const uint8_t*>(bytes.data())));
+            close(fd);
+            return server_result::SERVER_OK;
+        }
+    }
+    internal::server_io(p_log, "the server closed the connection before the exit code");
+    close(fd);
+    return server_result::SERVER_IO;
+#else
+    (void)socket_path;
+    (void)kind;
+    (void)payload;
+    (void)out;
+    (void)err;
+    (void)p_code;
+    (void)p_log;
+    return server_result::SERVER_UNSUPPORTED;
+#endif // LU_SERVER
+}
+
+}
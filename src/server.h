@@ -0,0 +1,90 @@
+#ifndef LU_SERVER_H
+#define LU_SERVER_H
+
+#include "optimize.h"
+#include "analyze.h"
+#include "source.h"
+#include "diag.h"
+#include "string.h"
+#include "internal/constexpr.h"
+
+#include <cstdint>
+#include <ostream>
+
+namespace lu
+{
+
+namespace diags
+{
+    extern diag SERVER_IO;
+}
+
+// requests and replies over the socket are frames: a 1 byte kind, a 4 byte little endian size, then size bytes.
+// a client sends one SOURCE, PATH or SHUTDOWN frame per connection. the server replies to the first two with OUTPUT
+// and DIAGS frames while the program runs, then an EXIT frame of the 4 byte little endian exit code
+enum class server_frame : uint8_t
+{
+    SOURCE = 's', // script text
+    PATH = 'p', // of a script the server reads, relative to its root (see server_settings) and inside it
+    SHUTDOWN = 'q', // empty, the server stops after it
+    OUTPUT = 'o', // what the program printed
+    DIAGS = 'e', // diagnostics
+    EXIT = 'x', // the driver's exit code: 0, 1 parse (or an unreadable path), 2 analyze, 3 intermediate, 4 interpret
+};
+
+struct server_settings
+{
+    server_settings() : level(optimize_level::O2), max_request(64 * 1024 * 1024), timeout_ms(5000) {}
+
+    string socket_path;
+    string root; // PATH requests are read below it, the working directory if empty
+    optimize_level level;
+    size_t max_request; // bytes, larger requests are refused
+    // for a whole request to arrive and for each write of the reply. a connection is dropped once it passes, so a
+    // client that stalls holds the others up no longer than this. positive
+    int timeout_ms;
+};
+
+struct server_stats
+{
+    server_stats() : requests(0), failures(0) {}
+
+    size_t requests;
+    size_t failures; // requests not exiting 0
+};
+
+// one line
+string to_string(const server_stats&);
+
+enum class server_result
+{
+    SERVER_OK,
+    SERVER_UNSUPPORTED, // no unix domain sockets here
+    SERVER_IO, // logged
+};
+
+LU_CONSTEXPR bool ok(server_result res)
+{
+    return res == server_result::SERVER_OK;
+}
+
+// what the driver does for a source: compiles it from a copy of builtins (see builtin_context()) through the passes
+// of the level and runs it with a fresh interpreter state. returns the driver's exit code (see server_frame::EXIT)
+int run_script(const source*, const analyze_context& builtins, optimize_level, diag_logger*);
+
+// listens on a unix domain socket until a SHUTDOWN request, for many small scripts that would otherwise pay for a
+// process each. the keywords, builtin types and intrinsics are made once (see builtin_context()), every request is
+// compiled from them through the passes of the level and run with a fresh interpreter state. requests are served
+// one at a time in the order they connect, output is sent as the state's sink flushes it (see output_sink). a PATH
+// that resolves (symbolic links and all) outside the root, or is not a regular file, is refused like an unreadable
+// one. the socket is made 0600, only this user may connect
+server_result serve(const server_settings&, diag_logger*, server_stats* = nullptr);
+
+// client side: sends one request of kind SOURCE, PATH or SHUTDOWN and copies the OUTPUT and DIAGS frames of the
+// reply to out and err as they arrive. *p_code is the EXIT code, 0 for SHUTDOWN
+server_result server_request(string_view socket_path, server_frame kind, string_view payload, std::ostream& out,
+    std::ostream& err, int* p_code, diag_logger*);
+
+}
+
+#endif // LU_SERVER_H
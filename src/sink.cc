@@ -0,0 +1,119 @@
+#include "sink.h"
+#include "format.h"
+
+#include <cstdio>
+#include <cstring>
+
+// file descriptors are written with POSIX calls, elsewhere through stdio
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(LU_NO_SINK_FD)
+#   define LU_SINK_FD 1
+#   include <cerrno>
+#   include <unistd.h>
+#else
+#   define LU_SINK_FD 0
+#endif // (defined(__unix__) || defined(__APPLE__)) && !defined(LU_NO_SINK_FD)
+
+namespace lu
+{
+
+output_sink::output_sink(size_t capacity) : _capacity(capacity > FORMAT_INT_SIZE ? capacity : FORMAT_INT_SIZE),
+    _p_next(nullptr), _p_end(nullptr)
+{}
+
+void output_sink::spill(size_t n)
+{
+    if (_buf.empty())
+    {
+        _buf.resize(_capacity);
+        _p_next = _buf.data();
+        _p_end = _p_next + _buf.size();
+    }
+    if (static_cast<size_t>(_p_end - _p_next) < n)
+    {
+        flush();
+    }
+}
+
+void output_sink::write(const char* p, size_t n)
+{
+    if (n == 0)
+    {
+        return;
+    }
+    if (static_cast<size_t>(_p_end - _p_next) < n)
+    {
+        spill(n);
+        if (n > _capacity)
+        {
+            // larger than the buffer, it goes as it is
+            drain(p, n);
+            return;
+        }
+    }
+    std::memcpy(_p_next, p, n);
+    _p_next += n;
+}
+
+void output_sink::put_uint(uint64_t v)
+{
+    if (static_cast<size_t>(_p_end - _p_next) < FORMAT_INT_SIZE)
+    {
+        spill(FORMAT_INT_SIZE);
+    }
+    _p_next += format_uint(v, _p_next);
+}
+
+void output_sink::put_int(int64_t v)
+{
+    if (static_cast<size_t>(_p_end - _p_next) < FORMAT_INT_SIZE)
+    {
+        spill(FORMAT_INT_SIZE);
+    }
+    _p_next += format_int(v, _p_next);
+}
+
+void output_sink::flush()
+{
+    if (_buf.empty() || _p_next == _buf.data())
+    {
+        return;
+    }
+    size_t n = static_cast<size_t>(_p_next - _buf.data());
+    _p_next = _buf.data();
+    drain(_p_next, n);
+}
+
+void fd_sink::drain(const char* p, size_t n)
+{
+#if LU_SINK_FD
+    while (n > 0)
+    {
+        ssize_t written = ::write(_fd, p, n);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            _failed = true;
+            return;
+        }
+        p += written;
+        n -= static_cast<size_t>(written);
+    }
+#else
+    std::FILE* p_file = _fd == 2 ? stderr : stdout;
+    if (std::fwrite(p, 1, n, p_file) != n || std::fflush(p_file) != 0)
+    {
+        _failed = true;
+    }
+#endif // LU_SINK_FD
+}
+
+void ostream_sink::drain(const char* p, size_t n)
+{
+    _p_os->write(p, static_cast<std::streamsize>(n));
+    _p_os->flush();
+}
+
+}
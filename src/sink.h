@@ -0,0 +1,114 @@
+#ifndef LU_SINK_H
+#define LU_SINK_H
+
+#include "string.h"
+#include "adt/vector.h"
+#include "internal/constexpr.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace lu
+{
+
+// where the print intrinsics write (see intermediate_interpreter_state::out()). values are formatted straight into a
+// buffer, handed on in one piece when it is full and on flush(). the buffer is allocated by the first write
+struct output_sink
+{
+    LU_CONSTEXPR static size_t DEFAULT_CAPACITY = 64 * 1024;
+
+    explicit output_sink(size_t capacity = DEFAULT_CAPACITY);
+    virtual ~output_sink() {}
+
+    output_sink(const output_sink&) = delete;
+    output_sink& operator=(const output_sink&) = delete;
+
+    void put(char c)
+    {
+        if (_p_next == _p_end)
+        {
+            spill(1);
+        }
+        *_p_next++ = c;
+    }
+
+    void write(const char* p, size_t n);
+    void write(string_view s) { write(s.buffer(), s.size()); }
+    void put_int(int64_t);
+    void put_uint(uint64_t);
+    void put_bool(bool b) { b ? write("true", 4) : write("false", 5); }
+
+    void flush();
+
+protected:
+    // takes the n bytes buffered so far
+    virtual void drain(const char* p, size_t n) = 0;
+
+private:
+    // makes room for n bytes, flushing or allocating the buffer
+    void spill(size_t n);
+
+    size_t _capacity;
+    vector<char> _buf;
+    char* _p_next;
+    char* _p_end;
+};
+
+// to a file descriptor, every flush is one write(2) (a few if it is interrupted or partial)
+struct fd_sink : output_sink
+{
+    explicit fd_sink(int fd = 1, size_t capacity = DEFAULT_CAPACITY) : output_sink(capacity), _fd(fd), _failed(false) {}
+    ~fd_sink() override { flush(); }
+
+    bool failed() const { return _failed; } // a write failed, what it held is lost
+
+protected:
+    void drain(const char* p, size_t n) override;
+
+private:
+    int _fd;
+    bool _failed;
+};
+
+// to a stream, for output redirected through std::cout (see stdio_redirect) or captured in a std::ostringstream
+struct ostream_sink : output_sink
+{
+    explicit ostream_sink(std::ostream& os, size_t capacity = DEFAULT_CAPACITY) : output_sink(capacity), _p_os(&os) {}
+    ~ostream_sink() override { flush(); }
+
+protected:
+    void drain(const char* p, size_t n) override;
+
+private:
+    std::ostream* _p_os;
+};
+
+// kept in memory, for tests and for output kept apart per run
+struct memory_sink : output_sink
+{
+    explicit memory_sink(size_t capacity = DEFAULT_CAPACITY) : output_sink(capacity) {}
+
+    // everything written so far
+    const string& str()
+    {
+        flush();
+        return _text;
+    }
+
+    void clear()
+    {
+        flush();
+        _text.clear();
+    }
+
+protected:
+    void drain(const char* p, size_t n) override { _text.append(p, n); }
+
+private:
+    string _text;
+};
+
+}
+
+#endif // LU_SINK_H
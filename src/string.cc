@@ -1,4 +1,5 @@
 #include "string.h"
+#include "format.h"
 
 #include "internal/int_util.h"
 #include "internal/constexpr.h"
@@ -30,6 +31,7 @@ string::~string()
 void string::clear()
 {
     if (_buf != nullptr) delete[] _buf;
+    _buf = nullptr;
     _size = 0;
     _cap = 0;
 }
@@ -78,6 +80,18 @@ string::string(const string_view& sv) : string(sv.buffer(), sv.size())
 
 string& string::operator=(const string& other)
 {
+    if (this == &other)
+    {
+        return *this;
+    }
+    if (other._size > 0 && other._size < _cap)
+    {
+        // fits, reuse the buffer
+        memcpy(_buf, other._buf, other._size);
+        _size = other._size;
+        _buf[_size] = '\0';
+        return *this;
+    }
     clear();
     _size = (other._size);
     _cap = (internal::choose_cap(_size + 1));
@@ -279,7 +293,9 @@ string to_string_snprintf(const char* fmt, T val)
     {
         char* buf = new char[static_cast<size_t>(n) + 1];
         snprintf(buf, static_cast<size_t>(n) + 1, fmt, val);
-        return string(buf, static_cast<size_t>(n));
+        string res(buf, static_cast<size_t>(n));
+        delete[] buf;
+        return res;
     }
     else
     {
@@ -291,14 +307,17 @@ string to_string_snprintf(const char* fmt, T val)
 
 string to_string(float val)
 {
-    return to_string_snprintf("%f", val);
+    char buf[FORMAT_FLOAT_SIZE];
+    return string(buf, format_float(val, buf));
 }
 
 string to_string(double val)
 {
-    return to_string_snprintf("%f", val);
+    char buf[FORMAT_FLOAT_SIZE];
+    return string(buf, format_double(val, buf));
 }
 
+// no shortest formatter for long double
 string to_string(long double val)
 {
     return to_string_snprintf("%Lf", val);
@@ -306,32 +325,34 @@ string to_string(long double val)
 
 string to_string(int val)
 {
-    return to_string_snprintf("%d", val);
+    return to_string(static_cast<long long>(val));
 }
 
 string to_string(long val)
 {
-    return to_string_snprintf("%ld", val);
+    return to_string(static_cast<long long>(val));
 }
 
 string to_string(long long val)
 {
-    return to_string_snprintf("%lld", val);
+    char buf[FORMAT_INT_SIZE];
+    return string(buf, format_int(val, buf));
 }
 
 string to_string(unsigned val)
 {
-    return to_string_snprintf("%u", val);
+    return to_string(static_cast<unsigned long long>(val));
 }
 
 string to_string(unsigned long val)
 {
-    return to_string_snprintf("%lu", val);
+    return to_string(static_cast<unsigned long long>(val));
 }
 
 string to_string(unsigned long long val)
 {
-    return to_string_snprintf("%llu", val);
+    char buf[FORMAT_INT_SIZE];
+    return string(buf, format_uint(val, buf));
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include "tagged_value.h"
+
+#include "except.h"
+#include "utility.h"
+#include "internal/debug.h"
+
+namespace lu
+{
+
+namespace internal
+{
+    scalar_value get_scalar(const intermediate_value& val)
+    {
+        scalar_value sv;
+        sv.bits = 0;
+        switch (val.tid().tclass)
+        {
+        case type_class::UNDEFINED:
+        case type_class::VOID:
+            break;
+        case type_class::BUILTIN:
+            sv = to_scalar(val.bin);
+            break;
+        case type_class::FUNCTION:
+            sv.u64 = val.func.faddr;
+            break;
+        case type_class::INTRINSIC:
+            sv.u64 = val.intr.iid;
+            break;
+        default:
+            throw internal_except_unhandled_switch(to_string(val.tid().tclass));
+        }
+        return sv;
+    }
+
+    void put_scalar(intermediate_value* p_val, scalar_value sv)
+    {
+        switch (p_val->tid().tclass)
+        {
+        case type_class::UNDEFINED:
+        case type_class::VOID:
+            break;
+        case type_class::BUILTIN:
+            set_scalar(&p_val->bin, sv);
+            break;
+        case type_class::FUNCTION:
+            p_val->func.faddr = static_cast<intermediate_addr>(sv.u64);
+            break;
+        case type_class::INTRINSIC:
+            p_val->intr.iid = static_cast<intrinsic_id>(sv.u64);
+            break;
+        default:
+            throw internal_except_unhandled_switch(to_string(p_val->tid().tclass));
+        }
+    }
+}
+
+tagged_value::tagged_value(const intermediate_value& val) : _tag(pack(type_id::UNDEFINED))
+{
+    bin.bits = 0;
+    assign(val);
+}
+
+intermediate_value* tagged_value::copy_box(const tagged_value& other)
+{
+    return new intermediate_value(*other.p_box);
+}
+
+tagged_value::tagged_value(tagged_value&& other) : _tag(other._tag)
+{
+    bin = other.bin; // takes the box, if any
+    other._tag = pack(type_id::UNDEFINED);
+    other.bin.bits = 0;
+}
+
+tagged_value& tagged_value::assign_boxed(const tagged_value& other)
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+    if (!other.boxed())
+    {
+        release();
+        _tag = other._tag;
+        bin = other.bin;
+        return *this;
+    }
+    if (boxed() && _tag == other._tag)
+    {
+        *p_box = *other.p_box; // reuses the box storage
+        return *this;
+    }
+    release();
+    p_box = copy_box(other);
+    _tag = other._tag;
+    return *this;
+}
+
+tagged_value& tagged_value::operator=(tagged_value&& other)
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+    release();
+    _tag = other._tag;
+    bin = other.bin;
+    other._tag = pack(type_id::UNDEFINED);
+    other.bin.bits = 0;
+    return *this;
+}
+
+tagged_value& tagged_value::assign(const intermediate_value& val)
+{
+    if (intermediate_value::trivial(val.tid().tclass))
+    {
+        release();
+        _tag = pack(val.tid());
+        bin = internal::get_scalar(val);
+        return *this;
+    }
+    box(val.tid()) = val;
+    return *this;
+}
+
+void tagged_value::copy_to(intermediate_value* p_val) const
+{
+    if (boxed())
+    {
+        *p_val = *p_box;
+        return;
+    }
+    if (p_val->tid() != tid())
+    {
+        *p_val = intermediate_value(tid());
+    }
+    internal::put_scalar(p_val, bin);
+}
+
+intermediate_value tagged_value::to_intermediate() const
+{
+    intermediate_value val;
+    copy_to(&val);
+    return val;
+}
+
+intermediate_value& tagged_value::box(type_id tid)
+{
+    assert(!intermediate_value::trivial(tid.tclass));
+
+    if (boxed() && this->tid() == tid)
+    {
+        return *p_box;
+    }
+    release();
+    p_box = new intermediate_value(tid);
+    _tag = pack(tid);
+    return *p_box;
+}
+
+void tagged_value::release_box()
+{
+    delete p_box;
+    _tag = pack(type_id::UNDEFINED);
+    bin.bits = 0;
+}
+
+}
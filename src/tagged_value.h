@@ -0,0 +1,110 @@
+#ifndef LU_TAGGED_VALUE_H
+#define LU_TAGGED_VALUE_H
+
+#include "value.h"
+#include "type.h"
+#include "internal/constexpr.h"
+
+#include <cstdint>
+
+namespace lu
+{
+
+// compact runtime value used by the interpreter, 16 bytes: a tag word (the type_id, class in the top byte)
+// and an 8 byte payload. builtins, functions and intrinsics are stored inline, everything else
+// (literals, tuples, unions) is boxed out of line as an owned intermediate_value.
+// the compiler side keeps using intermediate_value, values are converted at the boundary (constants in, inspection out).
+// TYPEID builtins only exist as static values and are not representable inline.
+struct tagged_value
+{
+    tagged_value() : _tag(pack(type_id::UNDEFINED)) { bin.bits = 0; }
+    explicit tagged_value(const intermediate_value&);
+
+    tagged_value(const tagged_value& other) : _tag(other._tag)
+    {
+        if (other.boxed())
+        {
+            p_box = copy_box(other);
+            return;
+        }
+        bin = other.bin;
+    }
+
+    tagged_value(tagged_value&&);
+    ~tagged_value() { release(); }
+
+    // copying between two inline values is two word stores
+    tagged_value& operator=(const tagged_value& other)
+    {
+        if (!boxed() && !other.boxed())
+        {
+            _tag = other._tag;
+            bin = other.bin;
+            return *this;
+        }
+        return assign_boxed(other);
+    }
+
+    tagged_value& operator=(tagged_value&&);
+
+    // boundary with intermediate_value
+    tagged_value& assign(const intermediate_value&);
+    tagged_value& assign_scalar(type_id tid, scalar_value sv) // tid must not be boxed
+    {
+        release();
+        _tag = pack(tid);
+        bin = sv;
+        return *this;
+    }
+    void copy_to(intermediate_value*) const;
+    intermediate_value to_intermediate() const;
+
+    // the boxed value of type tid, reusing the current box if it has the same type.
+    // for evaluating aggregates in place
+    intermediate_value& box(type_id tid);
+
+    type_id tid() const { return unpack(_tag); }
+    bool boxed() const { return !intermediate_value::trivial(tclass()); }
+
+    union
+    {
+        scalar_value bin; // builtin value, function address or intrinsic id
+        intermediate_value* p_box; // if boxed()
+    };
+
+private:
+    LU_CONSTEXPR static uint64_t CLASS_SHIFT = 56;
+    LU_CONSTEXPR static uint64_t IDX_MASK = (uint64_t(1) << CLASS_SHIFT) - 1;
+
+    static uint64_t pack(type_id tid)
+    {
+        return (static_cast<uint64_t>(tid.tclass) << CLASS_SHIFT) | (static_cast<uint64_t>(tid.idx) & IDX_MASK);
+    }
+
+    static type_id unpack(uint64_t tag)
+    {
+        return type_id(static_cast<type_class>(tag >> CLASS_SHIFT), static_cast<type_idx>(tag & IDX_MASK));
+    }
+
+    type_class tclass() const { return static_cast<type_class>(_tag >> CLASS_SHIFT); }
+
+    void release()
+    {
+        if (boxed())
+        {
+            release_box();
+        }
+    }
+
+    static intermediate_value* copy_box(const tagged_value&);
+    tagged_value& assign_boxed(const tagged_value&);
+    void release_box();
+
+    uint64_t _tag;
+};
+
+static_assert(sizeof(tagged_value) == 16, "tagged_value must be 16 bytes");
+
+}
+
+#endif // LU_TAGGED_VALUE_H
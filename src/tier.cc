@@ -0,0 +1,345 @@
+#include "tier.h"
+
+#include "optimize.h"
+#include "lower.h"
+#include "timer.h"
+#include "except.h"
+#include "internal/debug.h"
+
+#include <algorithm>
+
+namespace lu
+{
+
+namespace internal
+{
+    struct tier_runner
+    {
+        tier_runner(tiered_program* p_tp, intermediate_interpreter_state* is, diag_logger* p_log, tier_stats* p_stats)
+            : tp(*p_tp), is(is), p_log(p_log), p_stats(p_stats) {}
+
+        tiered_program& tp;
+        intermediate_interpreter_state* is;
+        diag_logger* p_log;
+        tier_stats* p_stats;
+        stopwatch sw;
+
+        intermediate_frame_id frame_of(intermediate_addr iaddr) const
+        {
+            for (intermediate_frame_id fid = 0; fid < tp._ip.frame_count(); ++fid)
+            {
+                if (tp._ip.frame(fid).entry <= iaddr && iaddr < tp._ends[fid])
+                {
+                    return fid;
+                }
+            }
+            return intermediate_frame::TOP;
+        }
+
+        // false if the program cannot be optimized
+        bool build_optimized()
+        {
+            if (tp._optimized)
+            {
+                return !tp._remap.empty();
+            }
+            tp._optimized = true;
+
+            // a copy of the code, frames and constants. the symbol table cannot be copied, the optimizer borrows it
+            vector<intermediate> code(tp._ip.data(), tp._ip.data() + tp._ip.size());
+            tp._opt.rewrite(move(code));
+            for (intermediate_frame_id fid = 0; fid < tp._ip.frame_count(); ++fid)
+            {
+                tp._opt.push_frame(intermediate_frame(tp._ip.frame(fid)));
+            }
+            tp._opt.constants() = tp._ip.constants();
+            tp._opt.context() = move(tp._ip.context());
+            // without inlining and block layout, which move code between frames and reorder it
+            optimize_settings settings(optimize_level::O2);
+            settings.inline_calls = false;
+            settings.layout = false;
+            optimize_result res = optimize(&tp._opt, settings, nullptr, &tp._remap);
+            tp._ip.context() = move(tp._opt.context());
+            if (!ok(res))
+            {
+                tp._opt = intermediate_program();
+                tp._remap.clear();
+                return false;
+            }
+            lower_intrinsics(&tp._opt);
+            // constants folded by the optimizer are interned after the ones both programs share
+            tp._ip.constants() = tp._opt.constants();
+            return true;
+        }
+
+        // replaces the code of the frame with its optimized code, then moves return addresses and *p_iaddr in it
+        // to where the optimized code continues. false if that code does not fit or leaves the frame
+        bool splice(intermediate_frame_id fid, intermediate_addr* p_iaddr)
+        {
+            intermediate_addr first = tp._ip.frame(fid).entry;
+            intermediate_addr end = tp._ends[fid];
+            intermediate_addr opt_first = tp._remap[first];
+            intermediate_addr opt_end = tp._remap[end];
+            if (first >= end || opt_end - opt_first > end - first)
+            {
+                return false;
+            }
+
+            vector<intermediate> code;
+            code.reserve(end - first);
+            for (intermediate_addr iaddr = opt_first; iaddr < opt_end; ++iaddr)
+            {
+                intermediate i = tp._opt[iaddr];
+                if (i.op() == intermediate::BRANCH)
+                {
+                    // a target past the end of the program stays as far past it
+                    intermediate_addr target = i.br.target();
+                    if (target > tp._opt.size())
+                    {
+                        target = tp._ip.size() + (target - tp._opt.size());
+                    }
+                    else if (opt_first <= target && target <= opt_end)
+                    {
+                        target = first + (target - opt_first);
+                    }
+                    else
+                    {
+                        return false;
+                    }
+                    i.br.base = first + code.size();
+                    i.br.offset = target >= i.br.base
+                        ? intermediate_branch::branch_offset(intermediate_branch::branch_offset::POSITIVE, target - i.br.base)
+                        : intermediate_branch::branch_offset(intermediate_branch::branch_offset::NEGATIVE, i.br.base - target);
+                }
+                code.push_back(move(i));
+            }
+            while (code.size() < end - first)
+            {
+                code.push_back(intermediate::create_block());
+            }
+            for (intermediate_addr k = 0; k < code.size(); ++k)
+            {
+                tp._ip[first + k] = move(code[k]);
+            }
+
+            // registers are the same in both, only the addresses move
+            for (size_t d = 0; d < is->depth(); ++d)
+            {
+                intermediate_addr ra = is->return_address(d);
+                if (first <= ra && ra < end)
+                {
+                    is->set_return_address(d, first + (tp._remap[ra] - opt_first));
+                }
+            }
+            if (first <= *p_iaddr && *p_iaddr < end)
+            {
+                *p_iaddr = first + (tp._remap[*p_iaddr] - opt_first);
+            }
+            return true;
+        }
+
+        // the native frames, the code of the others is left as it was if that fails
+        bool recompile()
+        {
+            jit_code code;
+            if (!ok(jit_compile(&tp._ip, &code, nullptr, &tp._counters.native)))
+            {
+                return false;
+            }
+            tp._code = move(code);
+            return true;
+        }
+
+        bool compile_native(intermediate_frame_id fid)
+        {
+            intermediate_addr first = tp._ip.frame(fid).entry;
+            intermediate_addr end = tp._ends[fid];
+            if (!tp._settings.native || !has_jit() || first >= end)
+            {
+                return false;
+            }
+            for (intermediate_addr iaddr = first; iaddr < end; ++iaddr)
+            {
+                tp._counters.native[iaddr] = true;
+            }
+            if (!recompile())
+            {
+                for (intermediate_addr iaddr = first; iaddr < end; ++iaddr)
+                {
+                    tp._counters.native[iaddr] = false;
+                }
+                return false;
+            }
+            return true;
+        }
+
+        // moves the frame up a tier, at *p_iaddr. a frame that cannot move up keeps counting past the thresholds,
+        // so it is not tried again
+        void promote(intermediate_frame_id fid, bool osr, intermediate_addr hot, uint64_t count, intermediate_addr* p_iaddr)
+        {
+            tier_event ev;
+            ev.seconds = sw.time().count();
+            ev.fid = fid;
+            ev.from = tp._tiers[fid];
+            ev.osr = osr;
+            ev.iaddr = hot;
+            ev.count = count;
+
+            stopwatch compile;
+            compile.start();
+            if (ev.from == execution_tier::INTERPRETED && build_optimized() && splice(fid, p_iaddr))
+            {
+                ev.to = execution_tier::OPTIMIZED;
+            }
+            else if (ev.from != execution_tier::NATIVE && compile_native(fid))
+            {
+                ev.to = execution_tier::NATIVE;
+            }
+            else
+            {
+                return;
+            }
+            ev.compile_seconds = compile.time().count();
+
+            tp._tiers[fid] = ev.to;
+            tp._counters.calls[fid] = 0;
+            for (intermediate_addr iaddr = tp._ip.frame(fid).entry; iaddr < tp._ends[fid]; ++iaddr)
+            {
+                tp._counters.backedges[iaddr] = 0;
+            }
+            p_stats->events.push_back(ev);
+        }
+
+        interpret_result run()
+        {
+            size_t n = tp._ip.size();
+            tier_counters& counters = tp._counters;
+            if (is->depth() == 0)
+            {
+                is->push_frame(tp._ip.frame(intermediate_frame::TOP), n);
+            }
+            interpret_settings settings;
+            settings.p_tiers = &counters;
+
+            sw.start();
+            interpret_result res = interpret_result::INTERPRET_OK;
+            intermediate_addr iaddr = 0;
+            while (iaddr < n)
+            {
+                if (counters.native[iaddr])
+                {
+                    ++p_stats->nnative;
+                    iaddr = jit_enter(&tp._code, is, iaddr, p_log, &res);
+                    if (iaddr >= n)
+                    {
+                        break;
+                    }
+                    // native code leaves its frames only to call an interpreted one, or for an intermediate it
+                    // did not translate. the call was not counted by the interpreter
+                    intermediate_frame_id fid = frame_of(iaddr);
+                    if (!counters.native[iaddr] && tp._ip.frame(fid).entry == iaddr && ++counters.calls[fid] == counters.call_threshold)
+                    {
+                        promote(fid, false, iaddr, counters.calls[fid], &iaddr);
+                        continue;
+                    }
+                }
+
+                ++p_stats->ninterpreted;
+                interpret_result r = interpret(&tp._ip, is, iaddr, p_log, settings);
+                if (!ok(r))
+                {
+                    res = r;
+                }
+                iaddr = counters.stop_addr;
+                switch (counters.stop)
+                {
+                case tier_counters::NONE:
+                    return res;
+                case tier_counters::HOT_CALL:
+                    promote(static_cast<intermediate_frame_id>(counters.hot), false, iaddr, counters.calls[counters.hot], &iaddr);
+                    break;
+                case tier_counters::HOT_LOOP:
+                    promote(frame_of(counters.hot), true, counters.hot, counters.backedges[counters.hot], &iaddr);
+                    break;
+                case tier_counters::NATIVE:
+                    break;
+                default:
+                    throw internal_except_unhandled_switch(to_string(static_cast<int>(counters.stop)));
+                }
+            }
+            return res;
+        }
+    };
+}
+
+const char* execution_tier_cstr(execution_tier tier)
+{
+    switch (tier)
+    {
+    case execution_tier::INTERPRETED:
+        return "interpreted";
+    case execution_tier::OPTIMIZED:
+        return "optimized";
+    case execution_tier::NATIVE:
+        return "native";
+    default:
+        throw internal_except_unhandled_switch(to_string(static_cast<int>(tier)));
+    }
+}
+
+string to_string(const tier_event& ev)
+{
+    return string::join(
+        to_string(ev.seconds * 1000), " ms: frame ", to_string(ev.fid), " ",
+        execution_tier_cstr(ev.from), " -> ", execution_tier_cstr(ev.to),
+        ev.osr ? " at loop " : " on call ", to_string(ev.iaddr), " after ", to_string(ev.count),
+        ev.osr ? " back edges (osr), " : " calls, ", to_string(ev.compile_seconds * 1000), " ms compiling");
+}
+
+string to_string(const tier_stats& stats)
+{
+    string s;
+    for (const tier_event& ev : stats.events)
+    {
+        s = string::join(s, to_string(ev), "\n");
+    }
+    return string::join(s, to_string(stats.ninterpreted), " interpreter runs, ", to_string(stats.nnative), " native entries");
+}
+
+tiered_program::tiered_program(intermediate_program&& ip, const tier_settings& settings)
+    : _ip(move(ip)), _settings(settings), _tiers(_ip.frame_count(), execution_tier::INTERPRETED), _ends(_ip.frame_count()), _optimized(false)
+{
+    lower_tail_calls(&_ip);
+    lower_intrinsics(&_ip);
+    // a frame's code runs up to the next frame entry. frames sharing their code cannot be replaced on their own
+    for (intermediate_frame_id fid = 0; fid < _ip.frame_count(); ++fid)
+    {
+        intermediate_addr entry = _ip.frame(fid).entry;
+        intermediate_addr end = _ip.size();
+        for (intermediate_frame_id other = 0; other < _ip.frame_count(); ++other)
+        {
+            intermediate_addr e = _ip.frame(other).entry;
+            if (other != fid && e >= entry && e < end)
+            {
+                end = e;
+            }
+        }
+        _ends[fid] = std::min(end, _ip.size());
+    }
+    _counters.resize(_ip.frame_count(), _ip.size());
+    _counters.call_threshold = settings.call_threshold;
+    _counters.backedge_threshold = settings.backedge_threshold;
+}
+
+interpret_result tiered_run(tiered_program* p_tp, intermediate_interpreter_state* is, diag_logger* p_log, tier_stats* p_stats)
+{
+    tier_stats stats;
+    if (!p_stats)
+    {
+        p_stats = &stats;
+    }
+    *p_stats = tier_stats();
+    return internal::tier_runner(p_tp, is, p_log, p_stats).run();
+}
+
+}
@@ -0,0 +1,106 @@
+#ifndef LU_TIER_H
+#define LU_TIER_H
+
+#include "intermediate.h"
+#include "interpreter.h"
+#include "jit.h"
+#include "diag.h"
+#include "string.h"
+#include "adt/vector.h"
+
+#include <cstdint>
+
+namespace lu
+{
+
+enum class execution_tier
+{
+    INTERPRETED, // the program as given, counted
+    OPTIMIZED, // the frame's code of the optimized program, interpreted
+    NATIVE, // that code compiled (see jit.h)
+};
+
+const char* execution_tier_cstr(execution_tier);
+
+struct tier_settings
+{
+    tier_settings() : call_threshold(1000), backedge_threshold(10000), native(true) {}
+
+    uint64_t call_threshold; // calls of a frame in one tier before it moves up
+    uint64_t backedge_threshold; // backward jumps of one branch in one tier before its frame moves up, while it runs
+    bool native; // the top tier is native code where the jit is supported
+};
+
+struct tier_event
+{
+    tier_event() : seconds(0), fid(0), from(execution_tier::INTERPRETED), to(execution_tier::INTERPRETED), osr(false), iaddr(0), count(0),
+        compile_seconds(0) {}
+
+    double seconds; // since the run started
+    intermediate_frame_id fid;
+    execution_tier from;
+    execution_tier to;
+    bool osr; // replaced on the stack at a loop header, rather than on a call
+    intermediate_addr iaddr; // of the hot branch, or the frame entry
+    uint64_t count; // calls or backward jumps that made the frame hot
+    double compile_seconds; // spent optimizing or compiling
+};
+
+string to_string(const tier_event&);
+
+struct tier_stats
+{
+    tier_stats() : ninterpreted(0), nnative(0) {}
+
+    vector<tier_event> events; // in order
+    size_t ninterpreted; // interpreter runs, one per stop or exit from native code
+    size_t nnative; // entries into native code
+};
+
+// one event per line
+string to_string(const tier_stats&);
+
+namespace internal
+{
+    struct tier_runner;
+}
+
+// a program run in tiers, each frame promoted on its own. the code of a promoted frame is replaced in place by its
+// code in the optimized program (see optimize), padded with empty blocks to the same address range, so calls,
+// returns and every other frame are unaffected. the optimized program is built the first time a frame gets hot.
+// takes the output of intermediate_transform, before optimize and fuse
+struct tiered_program
+{
+    explicit tiered_program(intermediate_program&&, const tier_settings& = tier_settings());
+
+    const intermediate_program& program() const { return _ip; } // as it runs now
+    execution_tier tier(intermediate_frame_id fid) const { return _tiers[fid]; }
+
+private:
+    friend struct internal::tier_runner;
+
+    intermediate_program _ip;
+    tier_settings _settings;
+    vector<execution_tier> _tiers; // per frame
+    vector<intermediate_addr> _ends; // per frame, end of its code
+    tier_counters _counters;
+
+    bool _optimized; // tried to build _opt
+    intermediate_program _opt; // empty if the optimizer skipped the program
+    vector<intermediate_addr> _remap; // address in _ip to address in _opt
+    jit_code _code; // of _ip, only the native frames translated
+};
+
+// runs the program like interpret, from its start. frames move up a tier once hot:
+//   - a frame called call_threshold times is promoted on that call, before its code runs
+//   - a branch that jumped back backedge_threshold times promotes its frame at the loop header (on stack
+//     replacement): the running frame continues in the new code at the address the old one maps to, registers
+//     as they are. frames of the same function further down the stack return into the new code too
+// a frame goes from interpreted to optimized, then native; straight to native if the program cannot be
+// optimized. counters start over on every promotion. native code is entered whenever control flow reaches a
+// native frame, and exits into the interpreter for anything else.
+interpret_result tiered_run(tiered_program*, intermediate_interpreter_state*, diag_logger*, tier_stats* = nullptr);
+
+}
+
+#endif // LU_TIER_H
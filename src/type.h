@@ -333,6 +333,7 @@ public:
 
     bool exists(type_id) const;
     bool exists(const type&) const;
+    size_t count(type_class tclass) const { return _id2t_map[tclass].size(); } // registered types of the class, idx below it
     // literal_type& find_literal_info(type_idx);
     // builtin_type& find_builtin_info(type_idx);
     // function_type& find_function_info(type_idx);
@@ -1,6 +1,9 @@
 #include "value.h"
 #include "except.h"
 #include "utility.h"
+#include "internal/debug.h"
+
+#include <cstring>
 
 namespace lu
 {
@@ -16,6 +19,18 @@ tuple_value::tuple_value(tuple_value&& other) : vals(move(other.vals))
 tuple_value::tuple_value(const tuple_value& other) : vals(other.vals)
 {}
 
+scalar_value to_scalar(const builtin_value& bin)
+{
+    scalar_value sv;
+    std::memcpy(&sv, static_cast<const void*>(&bin), sizeof(scalar_value));
+    return sv;
+}
+
+void set_scalar(builtin_value* p_bin, scalar_value sv)
+{
+    std::memcpy(static_cast<void*>(p_bin), &sv, sizeof(scalar_value));
+}
+
 intermediate_value::intermediate_value(type_id tid) : _tid(tid)
 {
     create();
@@ -64,6 +79,9 @@ void intermediate_value::destroy()
     case type_class::FUNCTION:
         func.~function_value();
         break;
+    case type_class::INTRINSIC:
+        intr.~intrinsic_value();
+        break;
     case type_class::TUPLE:
         tup.~tuple_value();
         break;
@@ -189,14 +207,71 @@ intermediate_value& intermediate_value::create(const intermediate_value& other)
 
 intermediate_value& intermediate_value::assign(intermediate_value&& other)
 {
-   this->destroy();
-   return this->create(move(other));
+    if (this == &other)
+    {
+        return *this;
+    }
+    if (trivial(_tid.tclass) && trivial(other._tid.tclass))
+    {
+        return assign_trivial(other);
+    }
+    this->destroy();
+    return this->create(move(other));
 }
 
 intermediate_value& intermediate_value::assign(const intermediate_value& other)
 {
-   this->destroy();
-   return this->create((other));
+    if (this == &other)
+    {
+        return *this;
+    }
+    if (trivial(_tid.tclass) && trivial(other._tid.tclass))
+    {
+        return assign_trivial(other);
+    }
+    if (_tid == other._tid && assign_inplace(other))
+    {
+        return *this;
+    }
+    this->destroy();
+    return this->create((other));
+}
+
+intermediate_value& intermediate_value::assign_trivial(const intermediate_value& other)
+{
+    // every trivial member fits in builtin_value, so copy its storage
+    _tid = other._tid;
+    std::memcpy(static_cast<void*>(&this->bin), static_cast<const void*>(&other.bin), sizeof(builtin_value));
+    return *this;
+}
+
+// reuse existing storage of a value of the same type, so the steady state of a store does not allocate.
+// false if the storage cannot be reused
+bool intermediate_value::assign_inplace(const intermediate_value& other)
+{
+    assert(_tid == other._tid);
+
+    switch (_tid.tclass)
+    {
+    case type_class::LITERAL:
+        lit.text = other.lit.text;
+        return true;
+    case type_class::TUPLE:
+    {
+        size_t n = tup.vals.size();
+        if (n != other.tup.vals.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < n; ++i)
+        {
+            tup.vals[i] = other.tup.vals[i];
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
 }
 
 void intermediate_value_table::probe(symbol_id sid)
@@ -29,7 +29,7 @@ struct literal_value
 
 struct builtin_value
 {
-    builtin_value() {}
+    builtin_value() : u64(0) {} // zero the whole scalar payload, so narrower builtins compare and copy as 8 bytes
 
     ~builtin_value() {} // do nothing
 
@@ -51,6 +51,29 @@ struct builtin_value
     };
 };
 
+// the 8 byte builtins (everything but TYPEID), without the type id member of builtin_value
+union scalar_value
+{
+    bool b;
+    char ascii;
+    int8_t i8;
+    int16_t i16;
+    int32_t i32;
+    int64_t i64;
+    uint8_t u8;
+    uint16_t u16;
+    uint32_t u32;
+    uint64_t u64;
+    float f32;
+    double f64;
+    uint64_t bits; // raw payload
+};
+
+static_assert(sizeof(scalar_value) == 8, "scalar_value must be 8 bytes");
+
+scalar_value to_scalar(const builtin_value&);
+void set_scalar(builtin_value*, scalar_value);
+
 struct function_value
 {
     intermediate_addr faddr;
@@ -109,12 +132,20 @@ struct intermediate_value
         builtin_value bin;
     };
 
+    // no heap data, copied by value without going through create/destroy
+    LU_CONSTEXPR static bool trivial(type_class tclass)
+    {
+        return tclass == type_class::UNDEFINED || tclass == type_class::VOID || tclass == type_class::BUILTIN || tclass == type_class::FUNCTION || tclass == type_class::INTRINSIC;
+    }
+
 private:
     intermediate_value& create();
     intermediate_value& create(intermediate_value&& other);
     intermediate_value& create(const intermediate_value& other);
     intermediate_value& assign(intermediate_value&& other);
     intermediate_value& assign(const intermediate_value& other);
+    intermediate_value& assign_trivial(const intermediate_value& other);
+    bool assign_inplace(const intermediate_value& other);
     void destroy();
 
     type_id _tid;
@@ -1 +1,1075 @@
-// EDIT ME!
\ No newline at end of file
+#include "source.h"
+#include "parse.h"
+#include "analyze.h"
+#include "intermediate.h"
+#include "interpreter.h"
+#include "optimize.h"
+#include "inline.h"
+#include "layout.h"
+#include "fuse.h"
+#include "lower.h"
+#include "jit.h"
+#include "tier.h"
+#include "bytecode.h"
+#include "cache.h"
+#include "compiler.h"
+#include "server.h"
+#include "batch.h"
+#include "arena.h"
+#include "parallel.h"
+#include "sink.h"
+#include "print.h"
+#include "format.h"
+#include "diag.h"
+#include "string.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#   include <sys/stat.h>
+#   include <unistd.h>
+#   define LU_TEST_POSIX
+#endif
+
+// tests: every way of running a program (interpreter dispatch, optimization levels, jit, tiers, .luc images, the
+// compile cache, native executables, the driver, batches and parallel instances) must print what the -O0 switch
+// interpreter prints, over scripts and hand built programs with loops and calls (the front end has neither yet).
+// formatted numbers must read back as the same value. exits 1 if any check fails
+
+namespace
+{
+
+size_t nchecks = 0;
+size_t nfailed = 0;
+
+bool check(bool cond, const char* expr, const char* file, int line)
+{
+    ++nchecks;
+    if (!cond)
+    {
+        ++nfailed;
+        std::cerr << file << ":" << line << ": check failed: " << expr << "\n";
+    }
+    return cond;
+}
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+bool check_output(lu::string_view name, const char* mode, lu::string_view actual, lu::string_view expected)
+{
+    ++nchecks;
+    if (actual != expected)
+    {
+        ++nfailed;
+        std::cerr << name << " " << mode << ": output differs:\n" << actual << "\n-O0 interpreter:\n" << expected << "\n";
+        return false;
+    }
+    return true;
+}
+
+// scratch files, removed by the test that made them
+#ifdef LU_TEST_POSIX
+lu::string temp_dir;
+#endif // LU_TEST_POSIX
+
+// ---- programs
+
+struct corpus_script
+{
+    const char* name;
+    const char* text;
+};
+
+const corpus_script CORPUS[] =
+{
+    {
+        // every intrinsic, with register and immediate operands
+        "intrinsics",
+        "a: int32 = 7; b: int32 = 3\nc: int64 = 9000000000; d: int64 = 2\ne: uint32 = 4000000000; f: uint32 = 1\n"
+        "g: uint64 = 18000000000000000000; h: uint64 = 5\np: bool = true; q: bool = false\nnl: ascii = \"\\n\"\n"
+        "$i32add(a, b); $i32add(a, 1); $i32print(a); $i32print(12); $asciiprint(nl)\n"
+        "$i64add(c, d); $i64add(c, 10); $i64add(c, 9000000000); $i64print(c); $i64print(34); $asciiprint(nl)\n"
+        "$u32add(e, f); $u32add(e, 300000000); $u32print(e); $u32print(56); $asciiprint(nl)\n"
+        "$u64add(g, h); $u64add(g, 7); $u64print(g); $u64print(78); $asciiprint(nl)\n"
+        "$lneg(p); $bprint(p); $lor(p, q); $bprint(p); $lor(q, true); $bprint(q); $land(p, q); $bprint(p); $land(q, false); $bprint(q); $asciiprint(nl)\n",
+    },
+    {
+        // wrapping at every width
+        "wrap",
+        "a: int32 = 2147483647\nb: uint32 = 4294967295\nc: int64 = 9223372036854775807\nd: uint64 = 18446744073709551615\nnl: ascii = \"\\n\"\n"
+        "$i32add(a, 1); $i32print(a); $asciiprint(nl)\n$u32add(b, 1); $u32print(b); $asciiprint(nl)\n"
+        "$i64add(c, 1); $i64print(c); $asciiprint(nl)\n$u64add(d, 2); $u64print(d); $asciiprint(nl)\n",
+    },
+    {
+        // tuples are aggregates, scopes and pooled constants
+        "mixed",
+        "eol: ascii = \"\\n\"\nc: int64 = 4\nd: int64 = 96\nb: bool = false\nt = (c, d)\nu = t\n"
+        "{\n    a: int32 = 3\n    $i32print(a), 123.99, \"abc\"\n}\nt = (c, d); u = t\n$i64add(c, d); $i64print(c); $lneg(b); $bprint(b); $asciiprint(eol)\n"
+        "{\n    a: int32 = 5\n    $i32print(a), 1.5, \"def\"\n}\n$i64add(c, d); $i64print(c); $lneg(b); $bprint(b); $asciiprint(eol)\n",
+    },
+    {
+        // constants to fold and copies to propagate
+        "arith",
+        "a: int64 = 1\nb: int64 = 2\nc: int64 = 0\nf: bool = false\nnl: ascii = \"\\n\"\n"
+        "a = 1; b = 2\n$i64add(a, b); $i64add(b, a); $i64add(a, b)\nc = a; $lneg(f)\n$i64print(c); $bprint(f); $asciiprint(nl)\n"
+        "a = c; $i64add(a, a); $i64add(a, 5); $i64print(a); $lneg(f); $bprint(f); $asciiprint(nl)\n",
+    },
+};
+
+// registers of the hand built programs
+const char* SYMBOLS_SCRIPT = "n: int64 = 0\na: int64 = 0\nstep: int64 = 0\nf: bool = false\nr: int64 = 0\nm: int64 = 0\nx: int64 = 0\ny: int64 = 0\n";
+
+// front end only. the source must outlive the program
+void compile(const lu::source* p_src, lu::intermediate_program* p_ip)
+{
+    lu::diag_logger log(lu::diag::ERROR_LEVEL);
+    lu::parse_expr_tree pet;
+    lu::analyze_expr_tree aet;
+    if (!CHECK(ok(lu::parse(p_src, &pet, &log)) && ok(lu::analyze(&pet, &aet, &log)) && ok(lu::intermediate_transform(&aet, p_ip, &log))))
+    {
+        log.flush();
+    }
+}
+
+lu::symbol_id find(lu::intermediate_program& ip, lu::string_view name)
+{
+    lu::symbol_table& syms = ip.context().symbols();
+    return syms.find_local(syms.top(), name);
+}
+
+lu::intermediate load(const lu::intermediate_program& ip, lu::symbol_id sid, lu::intermediate_register reg)
+{
+    return lu::intermediate::emplace_load_symbol(sid, ip.context().symbols()[sid].tid, lu::intermediate_slot::SCALAR, reg);
+}
+
+lu::intermediate store(lu::symbol_id sid, lu::intermediate_register reg, lu::intermediate&& eval)
+{
+    return lu::intermediate::emplace_store_symbol(sid, lu::intermediate_slot::SCALAR, reg, lu::make_unique(new lu::intermediate(lu::move(eval))));
+}
+
+lu::intermediate constant(lu::intermediate_program& ip, lu::symbol_id sid, int64_t k)
+{
+    lu::intermediate_value val(ip.context().symbols()[sid].tid);
+    lu::scalar_value sv;
+    sv.i64 = k;
+    lu::set_scalar(&val.bin, sv);
+    return ip.make_load_constant(lu::move(val));
+}
+
+lu::intermediate branch(lu::intermediate_addr from, lu::intermediate_addr to, lu::unique<lu::intermediate>&& cond)
+{
+    return lu::intermediate::emplace_branch(from, lu::move(cond), to >= from
+        ? lu::intermediate_branch::branch_offset(lu::intermediate_branch::branch_offset::POSITIVE, to - from)
+        : lu::intermediate_branch::branch_offset(lu::intermediate_branch::branch_offset::NEGATIVE, from - to));
+}
+
+lu::intermediate ret(lu::intermediate&& eval)
+{
+    return lu::intermediate::emplace_return(lu::make_unique(new lu::intermediate(lu::move(eval))));
+}
+
+lu::intermediate intrinsic(lu::intermediate_program& ip, lu::intrinsic_code icode, const char* name, lu::symbol_id dest, lu::symbol_id op, lu::intermediate_register dest_reg, lu::intermediate_register op_reg)
+{
+    return lu::intermediate::emplace_intrinsic(icode, ip.context().symbols().find_intrinsic_id(name), dest, op, dest_reg, op_reg);
+}
+
+lu::intermediate add_imm(lu::intermediate_program& ip, lu::symbol_id sid, lu::intermediate_register reg, int64_t k)
+{
+    lu::scalar_value imm;
+    imm.i64 = k;
+    return lu::intermediate::emplace_intrinsic(lu::I64ADD, ip.context().symbols().find_intrinsic_id("i64add"), sid, reg, imm);
+}
+
+// n = count; a = 0; step = 3; f = false
+// while n: a += step; lneg f; n += -1
+// print a; print f
+void make_loop(const lu::source* p_src, int64_t count, lu::intermediate_program* p_ip)
+{
+    lu::intermediate_program& ip = *p_ip;
+    compile(p_src, &ip);
+    lu::symbol_id sn = find(ip, "n");
+    lu::symbol_id sa = find(ip, "a");
+    lu::symbol_id sstep = find(ip, "step");
+    lu::symbol_id sf = find(ip, "f");
+
+    // n s0, a s1, step s2, f s3
+    lu::vector<lu::intermediate> code;
+    code.push_back(store(sn, 0, constant(ip, sn, count)));
+    code.push_back(store(sa, 1, constant(ip, sa, 0)));
+    code.push_back(store(sstep, 2, constant(ip, sstep, 3)));
+    code.push_back(store(sf, 3, constant(ip, sf, 0)));
+    code.push_back(branch(4, 6, lu::make_unique(new lu::intermediate(load(ip, sn, 0)))));
+    code.push_back(branch(5, 10, nullptr));
+    code.push_back(intrinsic(ip, lu::I64ADD, "i64add", sa, sstep, 1, 2));
+    code.push_back(intrinsic(ip, lu::LNEG, "lneg", sf, lu::symbol::INVALID_ID, 3, 0));
+    code.push_back(add_imm(ip, sn, 0, -1));
+    code.push_back(branch(9, 4, nullptr));
+    code.push_back(intrinsic(ip, lu::I64PRINT, "i64print", lu::symbol::INVALID_ID, sa, 0, 1));
+    code.push_back(intrinsic(ip, lu::BPRINT, "bprint", lu::symbol::INVALID_ID, sf, 0, 3));
+    code.push_back(lu::intermediate::create_halt());
+
+    ip.rewrite(lu::move(code));
+    ip.frame(lu::intermediate_frame::TOP) = lu::intermediate_frame(0, 4, 0);
+}
+
+// fib(n) = n == 0 ? 0 : n - 1 == 0 ? 1 : fib(n - 1) + fib(n - 2), print fib(n)
+void make_fib(const lu::source* p_src, int64_t n, lu::intermediate_program* p_ip)
+{
+    lu::intermediate_program& ip = *p_ip;
+    compile(p_src, &ip);
+    lu::symbol_id sn = find(ip, "n");
+    lu::symbol_id sr = find(ip, "r");
+    lu::symbol_id sm = find(ip, "m");
+    lu::symbol_id sx = find(ip, "x");
+    lu::symbol_id sy = find(ip, "y");
+
+    lu::intermediate_frame_id fib = 1;
+    auto call = [&](lu::symbol_id arg, lu::intermediate_register arg_reg, lu::symbol_id result, lu::intermediate_register result_reg)
+    {
+        lu::array<lu::intermediate> args(1);
+        args[0] = store(sn, 0, load(ip, arg, arg_reg));
+        return lu::intermediate::emplace_call(fib, lu::move(args), result, lu::intermediate_slot::SCALAR, result_reg);
+    };
+
+    lu::vector<lu::intermediate> code;
+    // top frame: n s0, r s1
+    code.push_back(store(sn, 0, constant(ip, sn, n)));
+    code.push_back(call(sn, 0, sr, 1));
+    code.push_back(intrinsic(ip, lu::I64PRINT, "i64print", lu::symbol::INVALID_ID, sr, 0, 1));
+    code.push_back(lu::intermediate::create_halt());
+    // fib frame: n s0, m s1, x s2, y s3
+    lu::intermediate_addr entry = code.size();
+    code.push_back(branch(entry, entry + 2, lu::make_unique(new lu::intermediate(load(ip, sn, 0)))));
+    code.push_back(ret(constant(ip, sn, 0)));
+    code.push_back(store(sm, 1, load(ip, sn, 0)));
+    code.push_back(add_imm(ip, sm, 1, -1));
+    code.push_back(branch(entry + 4, entry + 6, lu::make_unique(new lu::intermediate(load(ip, sm, 1)))));
+    code.push_back(ret(constant(ip, sn, 1)));
+    code.push_back(call(sm, 1, sx, 2));
+    code.push_back(add_imm(ip, sm, 1, -1));
+    code.push_back(call(sm, 1, sy, 3));
+    code.push_back(intrinsic(ip, lu::I64ADD, "i64add", sx, sy, 2, 3));
+    code.push_back(ret(load(ip, sx, 2)));
+
+    ip.rewrite(lu::move(code));
+    ip.frame(lu::intermediate_frame::TOP) = lu::intermediate_frame(0, 2, 0);
+    ip.push_frame(lu::intermediate_frame(entry, 4, 0));
+}
+
+// count(n, a) = n == 0 ? a : count(n - 1, a + 1), print count(n, 0). the recursive call is in tail position,
+// left a CALL for whatever runs the program to lower
+void make_count(const lu::source* p_src, int64_t n, lu::intermediate_program* p_ip)
+{
+    lu::intermediate_program& ip = *p_ip;
+    compile(p_src, &ip);
+    lu::symbol_id sn = find(ip, "n");
+    lu::symbol_id sa = find(ip, "a");
+    lu::symbol_id sr = find(ip, "r");
+    lu::symbol_id sx = find(ip, "x");
+
+    lu::intermediate_frame_id count = 1;
+    auto call = [&](lu::symbol_id result, lu::intermediate_register result_reg)
+    {
+        lu::array<lu::intermediate> args(2);
+        args[0] = store(sn, 0, load(ip, sn, 0));
+        args[1] = store(sa, 1, load(ip, sa, 1));
+        return lu::intermediate::emplace_call(count, lu::move(args), result, lu::intermediate_slot::SCALAR, result_reg);
+    };
+
+    lu::vector<lu::intermediate> code;
+    // top frame: n s0, a s1, r s2
+    code.push_back(store(sn, 0, constant(ip, sn, n)));
+    code.push_back(store(sa, 1, constant(ip, sa, 0)));
+    code.push_back(call(sr, 2));
+    code.push_back(intrinsic(ip, lu::I64PRINT, "i64print", lu::symbol::INVALID_ID, sr, 0, 2));
+    code.push_back(lu::intermediate::create_halt());
+    // count frame: n s0, a s1, x s2
+    lu::intermediate_addr entry = code.size();
+    code.push_back(branch(entry, entry + 2, lu::make_unique(new lu::intermediate(load(ip, sn, 0)))));
+    code.push_back(ret(load(ip, sa, 1)));
+    code.push_back(add_imm(ip, sn, 0, -1));
+    code.push_back(add_imm(ip, sa, 1, 1));
+    code.push_back(call(sx, 2));
+    code.push_back(ret(load(ip, sx, 2)));
+
+    ip.rewrite(lu::move(code));
+    ip.frame(lu::intermediate_frame::TOP) = lu::intermediate_frame(0, 3, 0);
+    ip.push_frame(lu::intermediate_frame(entry, 3, 0));
+}
+
+typedef std::function<void(lu::intermediate_program*)> builder;
+
+// ---- running
+
+// the driver's passes at a level (see main.cc)
+void lower(lu::intermediate_program* p_ip, lu::optimize_level level)
+{
+    lu::lower_tail_calls(p_ip);
+    lu::optimize_settings settings(level);
+    if (settings.inline_calls)
+    {
+        lu::inline_calls(p_ip);
+    }
+    lu::optimize(p_ip, settings);
+    if (settings.layout)
+    {
+        lu::layout_blocks(p_ip);
+    }
+    lu::fuse(p_ip);
+    lu::lower_intrinsics(p_ip);
+}
+
+lu::string run(const lu::intermediate_program* p_ip, lu::interpret_dispatch dispatch = lu::interpret_dispatch::SWITCH)
+{
+    lu::diag_logger log(lu::diag::ERROR_LEVEL);
+    lu::memory_sink out;
+    lu::intermediate_interpreter_state iis;
+    iis.set_out(&out);
+    lu::interpret_settings settings;
+    settings.dispatch = dispatch;
+    if (!CHECK(ok(lu::interpret(p_ip, &iis, 0, &log, settings))))
+    {
+        log.flush();
+    }
+    return out.str();
+}
+
+lu::string run_jit(const lu::intermediate_program* p_ip)
+{
+    lu::diag_logger log(lu::diag::ERROR_LEVEL);
+    lu::jit_code code;
+    // JIT_UNSUPPORTED still runs, through the interpreter
+    lu::jit_compile(p_ip, &code);
+    lu::memory_sink out;
+    lu::intermediate_interpreter_state iis;
+    iis.set_out(&out);
+    if (!CHECK(ok(lu::jit_run(&code, &iis, 0, &log))))
+    {
+        log.flush();
+    }
+    return out.str();
+}
+
+lu::string run_tiered(const builder& build, bool native)
+{
+    lu::intermediate_program ip;
+    build(&ip);
+    // every frame and loop moves up on its first few calls or iterations
+    lu::tier_settings settings;
+    settings.call_threshold = 2;
+    settings.backedge_threshold = 16;
+    settings.native = native;
+    lu::tiered_program tp(lu::move(ip), settings);
+    lu::diag_logger log(lu::diag::ERROR_LEVEL);
+    lu::memory_sink out;
+    lu::intermediate_interpreter_state iis;
+    iis.set_out(&out);
+    if (!CHECK(ok(lu::tiered_run(&tp, &iis, &log))))
+    {
+        log.flush();
+    }
+    return out.str();
+}
+
+lu::string run_luc(const lu::intermediate_program* p_ip)
+{
+    lu::diag_logger log(lu::diag::ERROR_LEVEL);
+    lu::vector<uint8_t> image;
+    lu::intermediate_program loaded;
+    if (!CHECK(ok(lu::bytecode_write(p_ip, &image, &log)) && ok(lu::bytecode_load(image.data(), image.size(), &loaded, &log))))
+    {
+        log.flush();
+        return lu::string();
+    }
+    return run(&loaded);
+}
+
+#ifdef LU_TEST_POSIX
+
+lu::string run_cached(lu::string_view name, const lu::intermediate_program* p_ip)
+{
+    lu::cache_settings settings;
+    settings.dir = lu::string::join(temp_dir, "/cache");
+    lu::compile_cache cache(settings);
+    lu::diag_logger log(lu::diag::ERROR_LEVEL);
+    uint64_t key = lu::cache_key(name, "-O2");
+    lu::intermediate_program loaded;
+    CHECK(!cache.lookup(key, &loaded, &log));
+    CHECK(cache.store(key, p_ip, &log));
+    bool hit = CHECK(cache.lookup(key, &loaded, &log));
+    log.flush();
+    std::remove(cache.path(key).buffer());
+    rmdir(settings.dir.buffer());
+    return hit ? run(&loaded) : lu::string();
+}
+
+bool has_cc()
+{
+    static int rc = std::system("cc --version > /dev/null 2>&1");
+    return rc == 0;
+}
+
+// the output of the program built ahead of time, unsupported programs are skipped
+bool run_native(const lu::intermediate_program* p_ip, lu::string* p_out)
+{
+    lu::string exe = lu::string::join(temp_dir, "/native");
+    lu::diag_logger log(lu::diag::ERROR_LEVEL);
+    lu::compiler_result res = lu::compile_native(p_ip, exe, &log);
+    if (!CHECK(res != lu::compiler_result::COMPILER_FAIL))
+    {
+        log.flush();
+    }
+    if (!ok(res))
+    {
+        return false;
+    }
+    FILE* p = popen(exe.buffer(), "r");
+    if (!CHECK(p != nullptr))
+    {
+        return false;
+    }
+    char buf[4096];
+    size_t nread;
+    while ((nread = std::fread(buf, 1, sizeof(buf), p)) != 0)
+    {
+        p_out->append(buf, nread);
+    }
+    CHECK(pclose(p) == 0);
+    std::remove(exe.buffer());
+    return true;
+}
+
+#endif // LU_TEST_POSIX
+
+// every mode against the -O0 switch interpreter
+void test_modes(lu::string_view name, const builder& build)
+{
+    lu::intermediate_program reference;
+    build(&reference);
+    lower(&reference, lu::optimize_level::O0);
+    lu::string expected = run(&reference);
+    CHECK(!expected.empty());
+    check_output(name, "-O0 threaded", run(&reference, lu::interpret_dispatch::THREADED), expected);
+    check_output(name, "-O0 jit", run_jit(&reference), expected);
+    check_output(name, "-O0 .luc", run_luc(&reference), expected);
+
+    for (lu::optimize_level level : { lu::optimize_level::O1, lu::optimize_level::O2 })
+    {
+        lu::intermediate_program ip;
+        build(&ip);
+        lower(&ip, level);
+        bool o2 = level == lu::optimize_level::O2;
+        check_output(name, o2 ? "-O2" : "-O1", run(&ip), expected);
+        check_output(name, o2 ? "-O2 threaded" : "-O1 threaded", run(&ip, lu::interpret_dispatch::THREADED), expected);
+        check_output(name, o2 ? "-O2 jit" : "-O1 jit", run_jit(&ip), expected);
+        check_output(name, o2 ? "-O2 .luc" : "-O1 .luc", run_luc(&ip), expected);
+        if (!o2)
+        {
+            continue;
+        }
+#ifdef LU_TEST_POSIX
+        check_output(name, "-O2 cached", run_cached(name, &ip), expected);
+        lu::string native;
+        if (has_cc() && run_native(&ip, &native))
+        {
+            check_output(name, "-O2 native", native, expected);
+        }
+#endif // LU_TEST_POSIX
+
+        lu::vector<lu::parallel_run> runs;
+        lu::parallel_settings settings;
+        settings.nthreads = 4;
+        lu::run_parallel(&ip, 8, settings, &runs);
+        CHECK(runs.size() == 8);
+        for (const lu::parallel_run& pr : runs)
+        {
+            CHECK(ok(pr.res));
+            check_output(name, "-O2 parallel", pr.output, expected);
+        }
+    }
+
+    check_output(name, "tiered", run_tiered(build, false), expected);
+    check_output(name, "tiered, native", run_tiered(build, true), expected);
+}
+
+// deep tail recursion runs in two frames wherever a program with calls comes in: the driver's passes at every
+// level, the jit, a .luc image of the program as built, and the tiers
+void test_tail_calls(const lu::source* p_src)
+{
+    const int64_t n = 1000000;
+    auto depth = [&](const lu::intermediate_program* p_ip, bool jit, lu::string_view expected)
+    {
+        lu::diag_logger log(lu::diag::ERROR_LEVEL);
+        lu::memory_sink out;
+        lu::intermediate_interpreter_state iis;
+        iis.set_out(&out);
+        lu::jit_code code;
+        if (jit)
+        {
+            lu::jit_compile(p_ip, &code);
+        }
+        CHECK(ok(jit ? lu::jit_run(&code, &iis, 0, &log) : lu::interpret(p_ip, &iis, 0, &log)));
+        CHECK(out.str() == expected);
+        return iis.max_depth();
+    };
+
+    for (lu::optimize_level level : { lu::optimize_level::O0, lu::optimize_level::O1, lu::optimize_level::O2 })
+    {
+        lu::intermediate_program ip;
+        make_count(p_src, n, &ip);
+        lower(&ip, level);
+        CHECK(depth(&ip, false, "1000000") <= 2);
+        CHECK(depth(&ip, true, "1000000") <= 2);
+    }
+
+    lu::intermediate_program built;
+    make_count(p_src, n, &built);
+    lu::diag_logger log(lu::diag::ERROR_LEVEL);
+    lu::vector<uint8_t> image;
+    lu::intermediate_program loaded;
+    if (CHECK(ok(lu::bytecode_write(&built, &image, &log)) && ok(lu::bytecode_load(image.data(), image.size(), &loaded, &log))))
+    {
+        CHECK(depth(&loaded, false, "1000000") <= 2);
+    }
+
+    for (bool native : { false, true })
+    {
+        lu::intermediate_program ip;
+        make_count(p_src, n, &ip);
+        lu::tier_settings settings;
+        settings.native = native;
+        lu::tiered_program tp(lu::move(ip), settings);
+        lu::memory_sink out;
+        lu::intermediate_interpreter_state iis;
+        iis.set_out(&out);
+        CHECK(ok(lu::tiered_run(&tp, &iis, &log)));
+        CHECK(out.str() == lu::string_view("1000000"));
+        CHECK(iis.max_depth() <= 2);
+    }
+
+    // not lowered, every call is a frame
+    lu::intermediate_program calls;
+    make_count(p_src, 1000, &calls);
+    lu::lower_intrinsics(&calls);
+    CHECK(depth(&calls, false, "1000") == 1002);
+}
+
+// a sink that cannot take anything, like one out of memory
+struct failing_sink : lu::output_sink
+{
+    failing_sink() : lu::output_sink(1) {}
+
+protected:
+    void drain(const char*, size_t) override { throw std::bad_alloc(); }
+};
+
+// jit helpers that fail trap and end the run, nothing is thrown through the machine code
+void test_jit_traps(const lu::source* p_src)
+{
+    if (!lu::has_jit())
+    {
+        return;
+    }
+    auto run_trapped = [&](const lu::intermediate_program* p_ip, lu::output_sink* p_out)
+    {
+        std::ostringstream diags;
+        lu::diag_logger log(lu::diag::ERROR_LEVEL, lu::diag::MAX_LEVEL, false, &diags);
+        lu::jit_code code;
+        CHECK(ok(lu::jit_compile(p_ip, &code)));
+        lu::intermediate_interpreter_state iis;
+        iis.set_out(p_out);
+        CHECK(!ok(lu::jit_run(&code, &iis, 0, &log)));
+        log.flush();
+        return diags.str();
+    };
+
+    lu::source prints = lu::source::from_string("prints.lu", CORPUS[0].text);
+    lu::intermediate_program ip;
+    compile(&prints, &ip);
+    lower(&ip, lu::optimize_level::O0);
+    failing_sink out;
+    CHECK(run_trapped(&ip, &out).find("out of memory in the runtime helper") != std::string::npos);
+
+    // the callee's registers cannot be allocated
+    lu::intermediate_program calls;
+    make_count(p_src, 10, &calls);
+    lower(&calls, lu::optimize_level::O0);
+    calls.frame(1) = lu::intermediate_frame(calls.frame(1).entry, std::numeric_limits<size_t>::max() / 2, 0);
+    lu::memory_sink sink;
+    CHECK(run_trapped(&calls, &sink).find("in the runtime helper of CALL") != std::string::npos);
+    CHECK(sink.str().empty());
+}
+
+#ifdef LU_TEST_POSIX
+
+// threads storing the same entry at once each write a file of their own. the cache directory must be the user's
+// alone, the default one in /tmp included
+void test_cache()
+{
+    lu::source src = lu::source::from_string("cache.lu", CORPUS[0].text);
+    lu::intermediate_program ip;
+    compile(&src, &ip);
+    lower(&ip, lu::optimize_level::O2);
+    lu::string expected = run(&ip);
+
+    lu::cache_settings settings;
+    settings.dir = lu::string::join(temp_dir, "/threads");
+    uint64_t key = lu::cache_key("threads", "-O2");
+    const size_t NTHREADS = 8;
+    size_t nstored[NTHREADS] = {};
+    lu::vector<std::thread> threads;
+    for (size_t t = 0; t < NTHREADS; ++t)
+    {
+        threads.emplace_back([&, t]()
+        {
+            lu::compile_cache cache(settings);
+            lu::diag_logger log(lu::diag::ERROR_LEVEL);
+            for (int i = 0; i < 20; ++i)
+            {
+                nstored[t] += cache.store(key, &ip, &log);
+            }
+        });
+    }
+    for (std::thread& t : threads)
+    {
+        t.join();
+    }
+    for (size_t t = 0; t < NTHREADS; ++t)
+    {
+        CHECK(nstored[t] == 20);
+    }
+    lu::compile_cache cache(settings);
+    lu::diag_logger log(lu::diag::ERROR_LEVEL);
+    lu::intermediate_program loaded;
+    if (CHECK(cache.lookup(key, &loaded, &log)))
+    {
+        check_output("threads", "cached", run(&loaded), expected);
+    }
+    struct stat st;
+    CHECK(stat(settings.dir.buffer(), &st) == 0 && (st.st_mode & 0777) == 0700);
+    std::remove(cache.path(key).buffer());
+
+    // others can write in it, or it is a link
+    std::ostringstream diags;
+    lu::diag_logger warn(lu::diag::WARN_LEVEL, lu::diag::MAX_LEVEL, false, &diags);
+    chmod(settings.dir.buffer(), 0777);
+    CHECK(!cache.store(key, &ip, &warn));
+    CHECK(!cache.lookup(key, &loaded, &warn));
+    chmod(settings.dir.buffer(), 0700);
+    lu::cache_settings linked;
+    linked.dir = lu::string::join(temp_dir, "/linked");
+    CHECK(symlink(settings.dir.buffer(), linked.dir.buffer()) == 0);
+    lu::compile_cache through_link(linked);
+    CHECK(!through_link.store(key, &ip, &warn));
+    warn.flush();
+    CHECK(diags.str().find("can be written by other users") != std::string::npos);
+    CHECK(diags.str().find("is not a directory") != std::string::npos);
+    std::remove(linked.dir.buffer());
+    rmdir(settings.dir.buffer());
+
+    // with no cache dir in the environment
+    const char* vars[] = { "LU_CACHE_DIR", "XDG_CACHE_HOME", "HOME" };
+    lu::vector<lu::string> saved;
+    for (const char* var : vars)
+    {
+        const char* value = std::getenv(var);
+        saved.push_back(value ? value : "");
+        unsetenv(var);
+    }
+    CHECK(lu::cache_settings().dir == lu::string::join("/tmp/lu-cache-", lu::to_string(static_cast<unsigned long>(getuid()))));
+    for (size_t i = 0; i < saved.size(); ++i)
+    {
+        if (!saved[i].empty())
+        {
+            setenv(vars[i], saved[i].buffer(), 1);
+        }
+    }
+}
+
+// only this user may connect, and a PATH is read only if the file opened is a regular one below the root
+void test_server()
+{
+    lu::server_settings settings;
+    settings.socket_path = lu::string::join(temp_dir, "/server.sock");
+    settings.root = temp_dir;
+    settings.timeout_ms = 1000;
+    std::ostringstream server_diags;
+    lu::diag_logger server_log(lu::diag::WARN_LEVEL, lu::diag::MAX_LEVEL, false, &server_diags);
+    std::thread server([&]() { lu::serve(settings, &server_log); });
+
+    auto request = [&](lu::server_frame kind, lu::string_view payload, std::string* p_out) -> int
+    {
+        std::ostringstream out;
+        std::ostringstream err;
+        std::ostringstream diags;
+        lu::diag_logger log(lu::diag::ERROR_LEVEL, lu::diag::MAX_LEVEL, false, &diags);
+        int code = -1;
+        if (!ok(lu::server_request(settings.socket_path, kind, payload, out, err, &code, &log)))
+        {
+            return -1;
+        }
+        *p_out = out.str();
+        return code;
+    };
+    std::string out;
+    int code = -1;
+    for (int tries = 0; tries < 500 && code < 0; ++tries)
+    {
+        code = request(lu::server_frame::SOURCE, "$i32print(7)", &out);
+        if (code < 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    if (CHECK(code == 0))
+    {
+        CHECK(out == "7");
+        struct stat st;
+        CHECK(stat(settings.socket_path.buffer(), &st) == 0 && (st.st_mode & 0777) == 0600);
+
+        lu::string script = lu::string::join(temp_dir, "/inside.lu");
+        lu::string fifo = lu::string::join(temp_dir, "/fifo.lu");
+        lu::string link = lu::string::join(temp_dir, "/outside.lu");
+        std::ofstream(script.buffer()) << "$i32print(8)";
+        CHECK(mkfifo(fifo.buffer(), 0600) == 0);
+        CHECK(symlink("/etc/passwd", link.buffer()) == 0);
+        CHECK(request(lu::server_frame::PATH, "inside.lu", &out) == 0 && out == "8");
+        CHECK(request(lu::server_frame::PATH, "fifo.lu", &out) == 1);
+        CHECK(request(lu::server_frame::PATH, "outside.lu", &out) == 1);
+        CHECK(request(lu::server_frame::PATH, "../inside.lu", &out) == 1);
+        std::remove(script.buffer());
+        std::remove(fifo.buffer());
+        std::remove(link.buffer());
+    }
+    request(lu::server_frame::SHUTDOWN, "", &out);
+    server.join();
+}
+
+#endif // LU_TEST_POSIX
+
+// what the driver prints, through run_script() and a batch, for each level
+void test_driver()
+{
+    lu::vector<lu::string> expected;
+    for (const corpus_script& cs : CORPUS)
+    {
+        lu::source src = lu::source::from_string(lu::string::join(cs.name, ".lu"), cs.text);
+        lu::intermediate_program ip;
+        compile(&src, &ip);
+        lower(&ip, lu::optimize_level::O0);
+        expected.push_back(run(&ip));
+
+        for (lu::optimize_level level : { lu::optimize_level::O0, lu::optimize_level::O1, lu::optimize_level::O2 })
+        {
+            std::ostringstream out;
+            std::ostringstream err;
+            int code;
+            {
+                lu::stdio_redirect redirect(out.rdbuf(), err.rdbuf());
+                lu::diag_logger log(lu::diag::WARN_LEVEL);
+                code = lu::run_script(&src, lu::builtin_context(), level, &log);
+                log.flush();
+            }
+            CHECK(code == 0);
+            check_output(cs.name, lu::optimize_level_cstr(level), out.str().c_str(), expected.back());
+        }
+    }
+
+#ifdef LU_TEST_POSIX
+    lu::vector<lu::string> paths;
+    for (const corpus_script& cs : CORPUS)
+    {
+        paths.push_back(lu::string::join(temp_dir, "/", cs.name, ".lu"));
+        std::ofstream(paths.back().buffer()) << cs.text;
+    }
+    paths.push_back(lu::string::join(temp_dir, "/missing.lu"));
+    lu::vector<lu::batch_script> scripts;
+    lu::batch_stats stats;
+    lu::run_batch(paths, lu::batch_settings(), &scripts, &stats);
+    if (CHECK(scripts.size() == paths.size()))
+    {
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            CHECK(scripts[i].code == 0);
+            check_output(CORPUS[i].name, "batch", scripts[i].output, expected[i]);
+        }
+        CHECK(scripts.back().code == 1);
+        CHECK(std::string(scripts.back().diags.buffer()).find("cannot read") != std::string::npos);
+    }
+    // the text and output of every script came from the arena, reset after each
+    CHECK(stats.arena.allocs >= 2 * expected.size() && stats.arena.resets == paths.size());
+    for (const lu::string& path : paths)
+    {
+        std::remove(path.buffer());
+    }
+#endif // LU_TEST_POSIX
+}
+
+// containers given an arena allocate from it and leave their memory for its reset, which keeps the blocks
+void test_arena()
+{
+    lu::arena scratch(4096);
+    lu::arena_allocator<uint64_t> alloc(&scratch);
+    size_t blocks = 0;
+    for (int round = 0; round < 3; ++round)
+    {
+        std::vector<uint64_t, lu::arena_allocator<uint64_t>> values(alloc);
+        for (uint64_t i = 0; i < 10000; ++i)
+        {
+            values.push_back(i * i);
+        }
+        uint64_t sum = 0;
+        for (uint64_t v : values)
+        {
+            sum += v;
+        }
+        CHECK(sum == 333283335000ull);
+        CHECK(reinterpret_cast<uintptr_t>(values.data()) % lu::arena::ALIGN == 0);
+        scratch.reset();
+        // the later rounds fit in the kept blocks
+        if (round == 0)
+        {
+            blocks = scratch.stats().blocks;
+        }
+    }
+    const lu::arena_stats& stats = scratch.stats();
+    CHECK(stats.resets == 3);
+    CHECK(stats.peak >= 10000 * sizeof(uint64_t));
+    CHECK(stats.blocks == blocks);
+    CHECK(lu::arena_allocator<char>(alloc) == alloc);
+    lu::arena other;
+    CHECK(lu::arena_allocator<uint64_t>(&other) != alloc);
+}
+
+// ---- analysis
+
+// literals only reach an intrinsic when they convert to its builtin param, everything else is a diagnostic
+void test_intrinsic_literals()
+{
+    const char* rejected[] =
+    {
+        "$i32print(\"abc\")\n",
+        "$bprint(3)\n",
+        "$i32print(true)\n",
+        "a: int32 = 1\n$i32add(a, 3.5)\n",
+        "$i32print(3000000000)\n",
+        "a: uint32 = 1\n$u32add(a, 4294967296)\n",
+        "$u64print(99999999999999999999)\n",
+    };
+    for (const char* text : rejected)
+    {
+        lu::source src = lu::source::from_string("rejected.lu", text);
+        std::ostringstream diags;
+        lu::diag_logger log(lu::diag::ERROR_LEVEL, lu::diag::MAX_LEVEL, false, &diags);
+        lu::parse_expr_tree pet;
+        lu::analyze_expr_tree aet;
+        CHECK(ok(lu::parse(&src, &pet, &log)));
+        if (!CHECK(!ok(lu::analyze(&pet, &aet, &log))))
+        {
+            std::cerr << "accepted: " << text;
+        }
+        log.flush();
+        CHECK(diags.str().find("cannot convert") != std::string::npos);
+    }
+
+    const char* accepted[] =
+    {
+        "$i32print(2147483647)\n", "$u32print(4294967295)\n", "$u64print(18446744073709551615)\n", "$bprint(false)\n",
+    };
+    for (const char* text : accepted)
+    {
+        lu::source src = lu::source::from_string("accepted.lu", text);
+        lu::intermediate_program ip;
+        compile(&src, &ip);
+    }
+}
+
+// ---- formatting
+
+// <cstring> would find src/string.h
+template <typename To, typename From>
+To bit_cast(const From& from)
+{
+    static_assert(sizeof(To) == sizeof(From), "bit_cast of different sizes");
+    To to;
+    std::copy_n(reinterpret_cast<const char*>(&from), sizeof(To), reinterpret_cast<char*>(&to));
+    return to;
+}
+
+uint64_t next(uint64_t* p_state)
+{
+    // xorshift64*
+    uint64_t x = *p_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *p_state = x;
+    return x * 0x2545f4914f6cdd1dull;
+}
+
+template <typename T> struct bits_of;
+template <> struct bits_of<double> { typedef uint64_t type; };
+template <> struct bits_of<float> { typedef uint32_t type; };
+
+double read_double(const char* p) { return std::strtod(p, nullptr); }
+float read_float(const char* p) { return std::strtof(p, nullptr); }
+
+template <typename T>
+bool reads_back(T v, size_t (*format)(T, char*), T (*read)(const char*))
+{
+    char buf[lu::FORMAT_FLOAT_SIZE + 1];
+    size_t n = format(v, buf);
+    buf[n] = '\0';
+    if (bit_cast<typename bits_of<T>::type>(read(buf)) != bit_cast<typename bits_of<T>::type>(v))
+    {
+        std::cerr << buf << " does not read back as " << static_cast<double>(v) << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool formats_int(int64_t v)
+{
+    char buf[lu::FORMAT_INT_SIZE];
+    char expected[32];
+    size_t n = lu::format_int(v, buf);
+    int m = snprintf(expected, sizeof(expected), "%lld", static_cast<long long>(v));
+    return lu::string_view(buf, n) == lu::string_view(expected, static_cast<size_t>(m));
+}
+
+bool formats_uint(uint64_t v)
+{
+    char buf[lu::FORMAT_INT_SIZE];
+    char expected[32];
+    size_t n = lu::format_uint(v, buf);
+    int m = snprintf(expected, sizeof(expected), "%llu", static_cast<unsigned long long>(v));
+    return lu::string_view(buf, n) == lu::string_view(expected, static_cast<size_t>(m));
+}
+
+void test_format()
+{
+    const int64_t edges[] =
+    {
+        0, 1, -1, 9, 10, 99, 100, 999, 1000, -1000, 4294967295ll, 4294967296ll,
+        std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min(),
+        std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::min(),
+    };
+    for (int64_t v : edges)
+    {
+        CHECK(formats_int(v));
+        CHECK(formats_uint(static_cast<uint64_t>(v)));
+    }
+    uint64_t p = 1;
+    for (int i = 0; i < 20; ++i, p *= 10)
+    {
+        CHECK(formats_uint(p - 1) && formats_uint(p) && formats_int(static_cast<int64_t>(p)) && formats_int(-static_cast<int64_t>(p - 1)));
+    }
+
+    // text, then the value. decimal notation stops at 1e21 going up and below 1e-6 going down, the exponent has its
+    // sign and no padding
+    const char* expected[][2] =
+    {
+        { "0.0", "0" }, { "-0.0", "-0" }, { "3.0", "3" }, { "0.001", "0.001" }, { "0.1", "0.1" }, { "123.456", "123.456" },
+        { "999999999999999900000.0", "999999999999999900000" }, { "1e+21", "1e21" }, { "1.5e+21", "1.5e21" },
+        { "-1e+21", "-1e21" }, { "1e+100", "1e100" }, { "0.000001", "1e-6" }, { "9.99e-7", "9.99e-7" }, { "1e-7", "1e-7" },
+        { "-1e-7", "-1e-7" }, { "5e-324", "5e-324" }, { "inf", "inf" }, { "-inf", "-inf" }, { "nan", "nan" },
+    };
+    for (const auto& e : expected)
+    {
+        double v = std::strtod(e[1], nullptr);
+        char buf[lu::FORMAT_FLOAT_SIZE];
+        size_t n = lu::format_double(v, buf);
+        CHECK(lu::string_view(buf, n) == lu::string_view(e[0]));
+        CHECK(lu::to_string(v) == lu::string_view(e[0]));
+    }
+    const char* expected_float[][2] =
+    {
+        { "3.0", "3" }, { "0.1", "0.1" }, { "1e+21", "1e21" }, { "1e+38", "1e38" }, { "1e-7", "1e-7" }, { "1e-45", "1e-45" },
+    };
+    for (const auto& e : expected_float)
+    {
+        char buf[lu::FORMAT_FLOAT_SIZE];
+        size_t n = lu::format_float(std::strtof(e[1], nullptr), buf);
+        CHECK(lu::string_view(buf, n) == lu::string_view(e[0]));
+    }
+
+    const double limits[] =
+    {
+        std::numeric_limits<double>::max(), std::numeric_limits<double>::min(), std::numeric_limits<double>::lowest(),
+        std::numeric_limits<double>::denorm_min(), std::numeric_limits<double>::epsilon(), 0.3, 2.2250738585072014e-308,
+    };
+    for (double v : limits)
+    {
+        CHECK(reads_back(v, lu::format_double, read_double));
+        CHECK(reads_back(static_cast<float>(v), lu::format_float, read_float));
+    }
+    uint64_t state = 1181783497276652981ull;
+    for (size_t i = 0; i < 100000; ++i)
+    {
+        uint64_t bits = next(&state);
+        double d = bit_cast<double>(bits);
+        float f = bit_cast<float>(static_cast<uint32_t>(bits >> 32));
+        double decimal = static_cast<double>(bits % 1000000) / 1000.0;
+        if ((std::isfinite(d) && !CHECK(reads_back(d, lu::format_double, read_double)))
+            || (std::isfinite(f) && !CHECK(reads_back(f, lu::format_float, read_float)))
+            || !CHECK(reads_back(decimal, lu::format_double, read_double))
+            || !CHECK(formats_int(static_cast<int64_t>(bits >> (i % 64))))
+            || !CHECK(formats_uint(bits >> (i % 64))))
+        {
+            break;
+        }
+    }
+}
+
+}
+
+int main(int, char**)
+{
+#ifdef LU_TEST_POSIX
+    char dir[] = "/tmp/lu_test.XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        std::cerr << "test: cannot make a scratch directory\n";
+        return 1;
+    }
+    temp_dir = dir;
+#endif // LU_TEST_POSIX
+
+    test_format();
+    test_intrinsic_literals();
+    for (const corpus_script& cs : CORPUS)
+    {
+        lu::source src = lu::source::from_string(lu::string::join(cs.name, ".lu"), cs.text);
+        test_modes(cs.name, [&](lu::intermediate_program* p_ip) { compile(&src, p_ip); });
+    }
+    lu::source src = lu::source::from_string("calls.lu", SYMBOLS_SCRIPT);
+    test_modes("loop", [&](lu::intermediate_program* p_ip) { make_loop(&src, 1000, p_ip); });
+    test_modes("fib", [&](lu::intermediate_program* p_ip) { make_fib(&src, 15, p_ip); });
+    test_modes("tail calls", [&](lu::intermediate_program* p_ip) { make_count(&src, 100000, p_ip); });
+    test_tail_calls(&src);
+    test_jit_traps(&src);
+#ifdef LU_TEST_POSIX
+    test_cache();
+    test_server();
+#endif // LU_TEST_POSIX
+    test_arena();
+    test_driver();
+
+#ifdef LU_TEST_POSIX
+    rmdir(dir);
+#endif // LU_TEST_POSIX
+    std::cout << nchecks - nfailed << " of " << nchecks << " checks passed\n";
+    return nfailed == 0 ? 0 : 1;
+}